@@ -0,0 +1,233 @@
+/*
+*****************************************************************************
+*   GrainEye - Sample analysis                                                *
+*   ------------------------------------------------------------------------- *
+*   With a cloud endpoint configured the sample goes to the cloud model.    *
+*   Otherwise (or when the cloud cannot be reached) the on-device model     *
+*   classifies the image if one is loaded, and the shape stage measures    *
+*   every grain; grain sizes are still the reference sample from the SIH   *
+*   demo.                                                                   *
+*****************************************************************************
+*/
+#include "Analysis.h"
+#include "CloudClient.h"
+#include "GrainShape.h"
+#include "ImageIO.h"
+#include "InferenceEngine.h"
+#include "ThreadPool.h"
+
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+
+static std::string CurrentTimestamp() {
+    std::time_t now = std::time(nullptr);
+    std::tm local = {};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &local);
+    return buf;
+}
+
+// Progress reported after each stage; the shape stage reports per band of
+// rows in between, with the grains counted so far.
+static const double PROGRESS_DECODED = 0.1;
+static const double PROGRESS_CLASSIFIED = 0.3;
+static const double PROGRESS_LABELLED = 0.95;
+
+bool RunAnalysis(const std::string& imagePath, AnalysisResult& result) {
+    return RunAnalysis(imagePath, result, AnalysisOptions());
+}
+
+bool RunAnalysis(const std::string& imagePath, AnalysisResult& result, const AnalysisOptions& options) {
+    bool haveModel = options.model && options.model->IsLoaded();
+    if (options.cloud) {
+        std::string cloudError;
+        if (FetchCloudAnalysis(*options.cloud, imagePath, result, &cloudError, options.onProgress)) {
+            result.timestamp = CurrentTimestamp();
+            result.classifier = "cloud model";
+            if (result.d50Mm <= 0.0) ComputeSizeStats(result);     // server sent only the histogram
+            return true;
+        }
+        if (!haveModel) {
+            if (options.error) *options.error = cloudError;
+            return false;
+        }
+    }
+
+    AnalysisResult partial;
+    partial.imagePath = imagePath;
+    partial.timestamp = CurrentTimestamp();
+    partial.complete = false;
+    auto publish = [&](double progress) {
+        partial.progress = progress;
+        if (options.onProgress) options.onProgress(partial);
+    };
+
+    // An image the local decoders cannot read (JPEG/PNG on Linux) loses the
+    // classify and shape stages and keeps the reference labels.
+    PixelImage image;
+    std::string decodeError;
+    bool haveImage = LoadPixelImage(imagePath, image, &decodeError);
+    publish(PROGRESS_DECODED);
+    bool classify = haveModel && haveImage;
+    Classification labels;
+    if (classify) {
+        if (!options.model->Classify(image, labels, &AnalysisPool())) {
+            if (options.error) *options.error = "on-device classification failed";
+            return false;
+        }
+    }
+
+    result = AnalysisResult();
+    result.imagePath = imagePath;
+    result.timestamp = partial.timestamp;
+
+    // Reference values when no cloud endpoint is configured
+    result.beachZone = "Intertidal Zone (Foreshore / Swash Zone)";
+    result.zoneLocation = "Area between high tide and low tide";
+    result.sandSize = "Medium Sand (0.25\xE2\x80\x93" "0.5 mm)";
+    result.beachType = "Typical sandy beach, dissipative";
+    result.category = "Medium Sand \xE2\x86\x92 Intertidal";
+    result.classifier = "reference sample";
+    if (haveModel && !haveImage) result.classifier += " (on-device model skipped: " + decodeError + ")";
+    if (classify) {
+        char buf[96];
+        std::snprintf(buf, sizeof(buf), "on-device model (%s, %.0f ms, %.0f%% / %.0f%%)", options.model->KernelName(),
+            labels.inferenceMs, labels.zoneConfidence * 100.0, labels.beachTypeConfidence * 100.0);
+        result.beachZone = labels.zone;
+        result.zoneLocation = labels.zoneDetail;
+        result.beachType = labels.beachType;
+        result.category = "Medium Sand \xE2\x86\x92 " + labels.zone.substr(0, labels.zone.find(" Zone"));
+        result.classifier = buf;
+        partial.beachZone = result.beachZone;
+        partial.classifier = result.classifier;
+        publish(PROGRESS_CLASSIFIED);
+    }
+
+    if (haveImage) {
+        ShapeOptions shapeOptions;
+        shapeOptions.mmPerPixel = options.mmPerPixel;
+        if (options.onProgress) {
+            shapeOptions.onProgress = [&](double fraction, size_t grains) {
+                partial.grainCount = (int)grains;
+                publish(PROGRESS_CLASSIFIED + (PROGRESS_LABELLED - PROGRESS_CLASSIFIED) * fraction);
+            };
+        }
+        MeasureGrainShapes(image, shapeOptions, result.grains);
+        ComputeShapeStats(result.grains, result.shape);
+        image = PixelImage();
+    }
+
+    result.d10Mm = 0.26;
+    result.d50Mm = 0.43;
+    result.d90Mm = 0.70;
+    result.meanMm = 0.43;
+
+    const std::vector<double> binSizes = { 0.25, 0.30, 0.35, 0.40, 0.45, 0.50, 0.55, 0.60, 0.65, 0.70 };
+    const std::vector<int> binCounts = { 5, 10, 20, 25, 20, 10, 5, 3, 2, 1 };
+    result.binSizesMm = binSizes;
+    result.binCounts = binCounts;
+    for (int c : binCounts) result.grainCount += c;
+    return true;
+}
+
+void ComputeSizeStats(AnalysisResult& result) {
+    const size_t bins = result.binCounts.size();
+    long long total = 0;
+    double sum = 0.0;
+    for (size_t i = 0; i < bins; i++) {
+        total += result.binCounts[i];
+        sum += result.binCounts[i] * result.binSizesMm[i];
+    }
+    if (bins == 0 || total == 0) return;
+    result.meanMm = sum / total;
+
+    // Bin i covers [size - w/2, size + w/2], w = spacing of the bin centres
+    double width = bins > 1 ? result.binSizesMm[1] - result.binSizesMm[0] : 0.0;
+    auto percentile = [&](double fraction) {
+        double target = fraction * total;
+        long long below = 0;
+        for (size_t i = 0; i < bins; i++) {
+            if (below + result.binCounts[i] >= target && result.binCounts[i] > 0) {
+                double within = (target - below) / result.binCounts[i];
+                return result.binSizesMm[i] - width / 2 + within * width;
+            }
+            below += result.binCounts[i];
+        }
+        return result.binSizesMm[bins - 1];
+    };
+    result.d10Mm = percentile(0.10);
+    result.d50Mm = percentile(0.50);
+    result.d90Mm = percentile(0.90);
+}
+
+std::string FormatResultText(const AnalysisResult& result) {
+    const char* bullet = "\xE2\x80\xA2 ";
+    char buf[256];
+
+    if (!result.complete) {
+        std::snprintf(buf, sizeof(buf), "ANALYZING IMAGE... %d%%\r\n\n", (int)(result.progress * 100 + 0.5));
+        std::string text = buf;
+        if (!result.beachZone.empty()) { text += bullet; text += "Beach Zone: " + result.beachZone + "\r\n"; }
+        std::snprintf(buf, sizeof(buf), "Grains counted: %d\r\n", result.grainCount);
+        text += bullet; text += buf;
+        if (result.d50Mm > 0.0) {
+            std::snprintf(buf, sizeof(buf), "Median (d50): %.2f mm (provisional)\r\n", result.d50Mm);
+            text += bullet; text += buf;
+            std::snprintf(buf, sizeof(buf), "Range (d10\xE2\x80\x93" "d90): %.2f \xE2\x80\x93 %.2f mm (provisional)\r\n", result.d10Mm, result.d90Mm);
+            text += bullet; text += buf;
+        }
+        text += bullet; text += "Image: " + result.imagePath;
+        return text;
+    }
+
+    std::string text = "SAND TYPE ANALYSIS COMPLETE:\r\n\n";
+
+    text += bullet; text += "Beach Zone: " + result.beachZone + "\r\n";
+    text += bullet; text += "Location: " + result.zoneLocation + "\r\n";
+    text += bullet; text += "Sand Size: " + result.sandSize + "\r\n";
+    std::snprintf(buf, sizeof(buf), "Median (d50): %.2f mm\r\n", result.d50Mm);
+    text += bullet; text += buf;
+    std::snprintf(buf, sizeof(buf), "Mean Grain Size: %.2f mm\r\n", result.meanMm);
+    text += bullet; text += buf;
+    std::snprintf(buf, sizeof(buf), "Range (d10\xE2\x80\x93" "d90): %.2f \xE2\x80\x93 %.2f mm\r\n", result.d10Mm, result.d90Mm);
+    text += bullet; text += buf;
+    text += bullet; text += "Beach Type: " + result.beachType + "\r\n\n";
+
+    if (result.shape.grains > 0) {
+        const ShapeStats& shape = result.shape;
+        std::snprintf(buf, sizeof(buf), "Grain Shape (%d grains, median):\r\n", shape.grains);
+        text += bullet; text += buf;
+        std::snprintf(buf, sizeof(buf), "   Roundness %.2f, Circularity %.2f, Sphericity %.2f\r\n",
+            shape.roundness.p50, shape.circularity.p50, shape.sphericity.p50);
+        text += buf;
+        std::snprintf(buf, sizeof(buf), "   Aspect Ratio %.2f, Elongation %.2f, Convexity %.2f\r\n\n",
+            shape.aspectRatio.p50, shape.elongation.p50, shape.convexity.p50);
+        text += buf;
+    }
+
+    text += bullet; text += "Category: " + result.category + "\r\n";
+    if (result.hasLocation) {
+        std::snprintf(buf, sizeof(buf), "GPS: %.2f\xC2\xB0%c, %.2f\xC2\xB0%c\r\n",
+            result.latitude < 0 ? -result.latitude : result.latitude, result.latitude < 0 ? 'S' : 'N',
+            result.longitude < 0 ? -result.longitude : result.longitude, result.longitude < 0 ? 'W' : 'E');
+        text += bullet; text += buf;
+    }
+    text += bullet; text += "Time: " + result.timestamp + "\r\n";
+    if (!result.classifier.empty()) { text += bullet; text += "Classified by: " + result.classifier + "\r\n"; }
+    text += bullet; text += "Image: " + result.imagePath;
+    return text;
+}
+
+bool IsSupportedImageFile(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string ext = path.substr(dot + 1);
+    for (auto& c : ext) c = (char)std::tolower((unsigned char)c);
+    return ext == "bmp" || ext == "jpg" || ext == "jpeg" || ext == "png";
+}
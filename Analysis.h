@@ -0,0 +1,132 @@
+/*
+*****************************************************************************
+*   GrainEye - Sample analysis                                                *
+*   ------------------------------------------------------------------------- *
+*   Result record shared by the Win32 client and the Linux CLI, plus the     *
+*   entry point that turns one sample image into a result.                   *
+*   Strings in this module are UTF-8; the Win32 client converts at the edge. *
+*****************************************************************************
+*/
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Per-grain measurements, one column per quantity (structure of arrays).
+// The shape columns are filled by the local shape stage (GrainShape.h) and
+// left empty for grains reported by the cloud model.
+struct GrainTable {
+    std::vector<float> diameterMm;
+    std::vector<float> centroidX;   // pixels
+    std::vector<float> centroidY;   // pixels
+
+    // Raw measurements (pixels)
+    std::vector<float> areaPx;
+    std::vector<float> perimeterPx;
+    std::vector<float> majorAxisPx;         // of the moment-equivalent ellipse
+    std::vector<float> minorAxisPx;
+    std::vector<float> hullAreaPx;
+    std::vector<float> hullPerimeterPx;
+
+    // Dimensionless shape descriptors
+    std::vector<float> circularity;         // 4 pi A / P^2
+    std::vector<float> roundness;           // 4 A / (pi major^2)
+    std::vector<float> elongation;          // 1 - minor / major
+    std::vector<float> aspectRatio;         // major / minor
+    std::vector<float> convexity;           // hull perimeter / perimeter
+    std::vector<float> solidity;            // area / hull area
+    std::vector<float> sphericity;          // equivalent diameter / major
+
+    size_t Size() const { return diameterMm.size(); }
+    bool HasShape() const { return circularity.size() == diameterMm.size() && !circularity.empty(); }
+    // False when the shape stage ran without an image scale: diameterMm is
+    // all zeros then, and only the pixel columns are meaningful
+    bool HasDiameterMm() const { return !diameterMm.empty() && diameterMm[0] > 0.0f; }
+};
+
+// Distribution of one shape descriptor over the grains of a sample.
+struct ShapeDistribution {
+    double mean = 0.0;
+    double p10 = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double binMin = 0.0;        // histogram covers [binMin, binMin + bins * binWidth)
+    double binWidth = 0.0;      // the last bin also takes everything above
+    std::vector<int> counts;
+};
+
+struct ShapeStats {
+    int grains = 0;             // grains that entered the statistics
+    ShapeDistribution circularity;
+    ShapeDistribution roundness;
+    ShapeDistribution elongation;
+    ShapeDistribution aspectRatio;
+    ShapeDistribution convexity;
+    ShapeDistribution solidity;
+    ShapeDistribution sphericity;
+};
+
+struct AnalysisResult {
+    std::string imagePath;
+    std::string timestamp;      // local time, "YYYY-MM-DD HH:MM"
+
+    // Partial results: false while the analysis is still running
+    bool complete = true;
+    double progress = 1.0;      // 0..1
+    int grainCount = 0;
+
+    // Classification
+    std::string beachZone;
+    std::string zoneLocation;
+    std::string sandSize;
+    std::string beachType;
+    std::string category;
+    std::string classifier;     // what produced the labels: cloud, on-device model or reference
+
+    // Grain size statistics (mm)
+    double d10Mm = 0.0;
+    double d50Mm = 0.0;
+    double d90Mm = 0.0;
+    double meanMm = 0.0;
+
+    // Location of the sample
+    bool hasLocation = false;
+    double latitude = 0.0;
+    double longitude = 0.0;
+
+    // Grain size distribution, one entry per bin (bin centre in mm)
+    std::vector<double> binSizesMm;
+    std::vector<int> binCounts;
+
+    GrainTable grains;
+    ShapeStats shape;           // grains == 0 when no shape analysis ran
+};
+
+struct CloudEndpoint;
+class InferenceEngine;
+
+// Receives provisional results (complete == false) while the analysis runs.
+using AnalysisProgress = std::function<void(const AnalysisResult& partial)>;
+
+struct AnalysisOptions {
+    AnalysisProgress onProgress;
+    const CloudEndpoint* cloud = nullptr;   // analyze on the cloud model when set
+    const InferenceEngine* model = nullptr; // on-device classifier; also the fallback when the cloud is unreachable
+    std::string* error = nullptr;           // reason, if RunAnalysis returns false
+    double mmPerPixel = 0.0;    // image scale for grain diameters (0 = uncalibrated)
+};
+
+// Analyze one sample image. Returns false if the image cannot be processed.
+bool RunAnalysis(const std::string& imagePath, AnalysisResult& result);
+bool RunAnalysis(const std::string& imagePath, AnalysisResult& result, const AnalysisOptions& options);
+
+// Fills d10/d50/d90/mean from the histogram (linear interpolation in each bin).
+void ComputeSizeStats(AnalysisResult& result);
+
+// Human readable summary shown in the result box ("\r\n" line breaks).
+// Partial results get a shorter progress summary.
+std::string FormatResultText(const AnalysisResult& result);
+
+// True for the file types accepted by the upload dialog (BMP/JPG/JPEG/PNG).
+bool IsSupportedImageFile(const std::string& path);
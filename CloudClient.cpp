@@ -0,0 +1,292 @@
+/*
+*****************************************************************************
+*   GrainEye - Cloud model client                                             *
+*****************************************************************************
+*/
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET SocketHandle;
+#define CLOSE_SOCKET closesocket
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef int SocketHandle;
+#define INVALID_SOCKET (-1)
+#define CLOSE_SOCKET close
+#endif
+
+#include "CloudClient.h"
+#include "FileUtil.h"
+#include "ResultParser.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static const size_t IO_BUFFER_BYTES = 64 * 1024;
+static const size_t MAX_HEADER_BYTES = 16 * 1024;
+static const size_t PROGRESS_EVERY_GRAINS = 2000;
+
+bool ParseCloudEndpoint(const std::string& spec, CloudEndpoint& endpoint) {
+    std::string hostPort = spec;
+    size_t slash = spec.find('/');
+    if (slash != std::string::npos) {
+        endpoint.path = spec.substr(slash);
+        hostPort = spec.substr(0, slash);
+    }
+    size_t colon = hostPort.rfind(':');
+    if (colon != std::string::npos) {
+        endpoint.port = std::atoi(hostPort.c_str() + colon + 1);
+        hostPort.resize(colon);
+    }
+    endpoint.host = hostPort;
+    return !endpoint.host.empty() && endpoint.port > 0 && endpoint.port < 65536;
+}
+
+static SocketHandle Connect(const CloudEndpoint& endpoint, std::string* error) {
+#ifdef _WIN32
+    static std::once_flag wsaOnce;
+    std::call_once(wsaOnce, [] { WSADATA wsa; WSAStartup(MAKEWORD(2, 2), &wsa); });
+#endif
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addrs = nullptr;
+    std::string port = std::to_string(endpoint.port);
+    if (getaddrinfo(endpoint.host.c_str(), port.c_str(), &hints, &addrs) != 0) {
+        if (error) *error = "cannot resolve " + endpoint.host;
+        return INVALID_SOCKET;
+    }
+
+    SocketHandle s = INVALID_SOCKET;
+    for (struct addrinfo* a = addrs; a; a = a->ai_next) {
+        s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s == INVALID_SOCKET) continue;
+#ifdef _WIN32
+        DWORD timeout = (DWORD)endpoint.timeoutMs;
+#else
+        struct timeval timeout = { endpoint.timeoutMs / 1000, (endpoint.timeoutMs % 1000) * 1000 };
+#endif
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+        setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+        if (connect(s, a->ai_addr, (int)a->ai_addrlen) == 0) break;
+        CLOSE_SOCKET(s);
+        s = INVALID_SOCKET;
+    }
+    freeaddrinfo(addrs);
+    if (s == INVALID_SOCKET && error) *error = "cannot connect to " + endpoint.host + ":" + port;
+    return s;
+}
+
+static bool SendAll(SocketHandle s, const char* data, size_t size) {
+    while (size > 0) {
+        int n = send(s, data, (int)(size > IO_BUFFER_BYTES ? IO_BUFFER_BYTES : size), 0);
+        if (n <= 0) return false;
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// Streams the image file as the request body without loading it whole.
+static bool SendRequest(SocketHandle s, const CloudEndpoint& endpoint, const std::string& imagePath, std::string* error) {
+    FILE* f = OpenFile(imagePath, "rb");
+    if (!f) {
+        if (error) *error = "cannot open " + imagePath;
+        return false;
+    }
+    std::fseek(f, 0, SEEK_END);
+    long length = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+
+    std::string header = "POST " + endpoint.path + " HTTP/1.1\r\n"
+        "Host: " + endpoint.host + "\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "Content-Length: " + std::to_string(length < 0 ? 0 : length) + "\r\n"
+        "Accept: application/json\r\n"
+        "Connection: close\r\n\r\n";
+    bool ok = SendAll(s, header.data(), header.size());
+
+    std::vector<char> buffer(IO_BUFFER_BYTES);
+    while (ok) {
+        size_t n = std::fread(buffer.data(), 1, buffer.size(), f);
+        if (n == 0) break;
+        ok = SendAll(s, buffer.data(), n);
+    }
+    std::fclose(f);
+    if (!ok && error) *error = "upload failed";
+    return ok;
+}
+
+// Incremental decoder for "Transfer-Encoding: chunked" bodies. Payload bytes
+// are passed on as pointers into the receive buffer.
+struct ChunkedDecoder {
+    enum State { SIZE, EXTENSION, SIZE_LF, DATA, DATA_CR, DATA_LF, TRAILER, DONE, BAD } state = SIZE;
+    size_t remaining = 0;
+    int digits = 0;
+    int trailerLineLength = 0;
+
+    template <typename Sink>
+    bool Decode(const char* p, size_t n, Sink&& sink) {
+        const char* end = p + n;
+        while (p < end && state != DONE && state != BAD) {
+            char c = *p;
+            switch (state) {
+            case SIZE: {
+                int h = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if (h >= 0 && digits < 15) { remaining = remaining * 16 + (size_t)h; digits++; p++; }
+                else if (digits > 0 && (c == ';' || c == ' ')) { state = EXTENSION; p++; }
+                else if (digits > 0 && c == '\r') { state = SIZE_LF; p++; }
+                else state = BAD;
+                break;
+            }
+            case EXTENSION:
+                if (c == '\r') state = SIZE_LF;
+                p++;
+                break;
+            case SIZE_LF:
+                if (c != '\n') { state = BAD; break; }
+                p++;
+                state = remaining ? DATA : TRAILER;
+                trailerLineLength = 0;
+                break;
+            case DATA: {
+                size_t take = (size_t)(end - p) < remaining ? (size_t)(end - p) : remaining;
+                if (!sink(p, take)) return false;
+                p += take;
+                remaining -= take;
+                if (!remaining) state = DATA_CR;
+                break;
+            }
+            case DATA_CR:
+                if (c != '\r') { state = BAD; break; }
+                p++;
+                state = DATA_LF;
+                break;
+            case DATA_LF:
+                if (c != '\n') { state = BAD; break; }
+                p++;
+                state = SIZE;
+                digits = 0;
+                break;
+            case TRAILER:
+                // Trailer headers end with an empty line
+                if (c == '\n') { if (trailerLineLength == 0) state = DONE; trailerLineLength = 0; }
+                else if (c != '\r') trailerLineLength++;
+                p++;
+                break;
+            default:
+                break;
+            }
+        }
+        return state != BAD;
+    }
+};
+
+bool FetchCloudAnalysis(const CloudEndpoint& endpoint, const std::string& imagePath, AnalysisResult& result,
+    std::string* error, const AnalysisProgress& onProgress) {
+    SocketHandle s = Connect(endpoint, error);
+    if (s == INVALID_SOCKET) return false;
+    if (!SendRequest(s, endpoint, imagePath, error)) {
+        CLOSE_SOCKET(s);
+        return false;
+    }
+
+    result = AnalysisResult();
+    CloudResultReader reader(result);
+    std::vector<char> buffer(IO_BUFFER_BYTES);
+    std::string header;
+    bool inBody = false;
+    bool chunked = false;
+    long long contentLength = -1;
+    long long bodyBytes = 0;
+    size_t lastReported = 0;
+    ChunkedDecoder decoder;
+    std::string failure;
+
+    auto feed = [&](const char* data, size_t n) {
+        bodyBytes += (long long)n;
+        if (!reader.Consume(data, n)) return false;
+        if (onProgress && reader.GrainsParsed() >= lastReported + PROGRESS_EVERY_GRAINS) {
+            lastReported = reader.GrainsParsed();
+            AnalysisResult partial;
+            partial.imagePath = imagePath;
+            partial.complete = false;
+            partial.grainCount = (int)lastReported;
+            partial.progress = contentLength > 0 ? (double)bodyBytes / (double)contentLength : 0.0;
+            partial.binSizesMm = result.binSizesMm;
+            partial.binCounts = result.binCounts;
+            // The server's statistics once parsed, else estimated from the
+            // histogram (only while both arrays are complete)
+            if (result.d50Mm > 0.0) {
+                partial.d10Mm = result.d10Mm;
+                partial.d50Mm = result.d50Mm;
+                partial.d90Mm = result.d90Mm;
+                partial.meanMm = result.meanMm;
+            }
+            else if (!partial.binCounts.empty() && partial.binCounts.size() == partial.binSizesMm.size()) {
+                ComputeSizeStats(partial);
+            }
+            onProgress(partial);
+        }
+        return true;
+    };
+
+    for (;;) {
+        int n = recv(s, buffer.data(), (int)buffer.size(), 0);
+        if (n < 0) { failure = "connection error or timeout"; break; }
+        if (n == 0) break;
+        const char* p = buffer.data();
+        size_t len = (size_t)n;
+
+        if (!inBody) {
+            // Collect the header block; the rest of this buffer is body
+            size_t before = header.size();
+            header.append(p, len);
+            size_t headerEnd = header.find("\r\n\r\n");
+            if (headerEnd == std::string::npos) {
+                if (header.size() > MAX_HEADER_BYTES) { failure = "response header too large"; break; }
+                continue;
+            }
+            size_t bodyOffset = headerEnd + 4 - before;
+            header.resize(headerEnd + 2);
+            p += bodyOffset;
+            len -= bodyOffset;
+            inBody = true;
+
+            int status = 0;
+            if (std::sscanf(header.c_str(), "HTTP/%*d.%*d %d", &status) != 1 || status != 200) {
+                failure = "server returned HTTP " + std::to_string(status);
+                break;
+            }
+            for (auto& c : header) c = (char)std::tolower((unsigned char)c);
+            chunked = header.find("\r\ntransfer-encoding: chunked\r\n") != std::string::npos;
+            size_t cl = header.find("\r\ncontent-length:");
+            if (cl != std::string::npos) contentLength = std::atoll(header.c_str() + cl + 17);
+        }
+
+        bool ok = chunked ? decoder.Decode(p, len, feed) : feed(p, len);
+        if (!ok) { failure = reader.Error().empty() ? "malformed chunked encoding" : reader.Error(); break; }
+        if ((chunked && decoder.state == ChunkedDecoder::DONE) || (contentLength >= 0 && bodyBytes >= contentLength)) break;
+    }
+    CLOSE_SOCKET(s);
+
+    if (failure.empty() && !inBody) failure = "no response from server";
+    if (failure.empty() && chunked && decoder.state != ChunkedDecoder::DONE) failure = "response truncated";
+    if (failure.empty() && contentLength >= 0 && bodyBytes < contentLength) failure = "response truncated";
+    if (failure.empty() && !reader.Finish()) failure = reader.Error();
+    if (!failure.empty()) {
+        if (error) *error = failure;
+        return false;
+    }
+    result.imagePath = imagePath;
+    return true;
+}
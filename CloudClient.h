@@ -0,0 +1,29 @@
+/*
+*****************************************************************************
+*   GrainEye - Cloud model client                                             *
+*   ------------------------------------------------------------------------- *
+*   Uploads a sample image to the analysis endpoint (plain HTTP/1.1 POST)    *
+*   and feeds the response body into CloudResultReader while it downloads,  *
+*   so parsing overlaps the transfer and the body is never buffered whole.   *
+*****************************************************************************
+*/
+#pragma once
+
+#include "Analysis.h"
+
+#include <string>
+
+struct CloudEndpoint {
+    std::string host;
+    int port = 80;
+    std::string path = "/analyze";
+    int timeoutMs = 30000;
+};
+
+// "host:port[/path]" -> endpoint. Returns false if it cannot be parsed.
+bool ParseCloudEndpoint(const std::string& spec, CloudEndpoint& endpoint);
+
+// Upload imagePath and parse the streamed response into result.
+// onProgress (optional) receives partial results while grains arrive.
+bool FetchCloudAnalysis(const CloudEndpoint& endpoint, const std::string& imagePath, AnalysisResult& result,
+    std::string* error, const AnalysisProgress& onProgress = nullptr);
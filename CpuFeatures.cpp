@@ -0,0 +1,75 @@
+/*
+*****************************************************************************
+*   GrainEye - CPU feature detection                                          *
+*****************************************************************************
+*/
+#include "CpuFeatures.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+static CpuFeatures Detect() {
+    CpuFeatures features;
+    unsigned cores = std::thread::hardware_concurrency();
+    features.logicalCores = cores ? (int)cores : 1;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    features.sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    features.sse41 = __builtin_cpu_supports("sse4.1");
+    features.avx2 = __builtin_cpu_supports("avx2");     // also checks OS support for the YMM state
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    features.neon = true;   // mandatory on AArch64
+#elif defined(__ARM_NEON)
+    features.neon = true;
+#endif
+    return features;
+}
+
+const CpuFeatures& GetCpuFeatures() {
+    static const CpuFeatures features = Detect();
+    return features;
+}
+
+static SimdLevel DetectLevel() {
+    const CpuFeatures& cpu = GetCpuFeatures();
+    SimdLevel best = cpu.avx2 ? SimdLevel::AVX2 : cpu.sse41 ? SimdLevel::SSE4 : cpu.neon ? SimdLevel::NEON : SimdLevel::Scalar;
+
+    const char* cap = std::getenv("GRAINEYE_SIMD");
+    if (!cap) return best;
+    if (!std::strcmp(cap, "scalar")) return SimdLevel::Scalar;
+    if (!std::strcmp(cap, "sse4") && cpu.sse41) return SimdLevel::SSE4;
+    if (!std::strcmp(cap, "avx2") && cpu.avx2) return SimdLevel::AVX2;
+    if (!std::strcmp(cap, "neon") && cpu.neon) return SimdLevel::NEON;
+    return best;
+}
+
+SimdLevel ActiveSimdLevel() {
+    static const SimdLevel level = DetectLevel();
+    return level;
+}
+
+const char* SimdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::SSE4: return "SSE4.1";
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::NEON: return "NEON";
+    default: return "scalar";
+    }
+}
@@ -0,0 +1,42 @@
+/*
+*****************************************************************************
+*   GrainEye - CPU feature detection                                          *
+*   ------------------------------------------------------------------------- *
+*   One binary runs on the Windows laptop (x86-64) and the Pi (ARM), so the  *
+*   vector kernels are picked at runtime from what the CPU reports.          *
+*   Set GRAINEYE_SIMD=scalar|sse4|avx2|neon to cap the level (for testing).  *
+*****************************************************************************
+*/
+#pragma once
+
+enum class SimdLevel { Scalar, SSE4, AVX2, NEON };
+
+struct CpuFeatures {
+    bool sse41 = false;
+    bool avx2 = false;
+    bool neon = false;
+    int logicalCores = 1;
+};
+
+// Detected once and cached.
+const CpuFeatures& GetCpuFeatures();
+
+// Best level supported by this CPU, after the GRAINEYE_SIMD override.
+SimdLevel ActiveSimdLevel();
+
+const char* SimdLevelName(SimdLevel level);
+
+// For kernel translation units: which vector code this compiler can emit.
+// GCC/Clang compile each x86 kernel for its own ISA (GE_TARGET) so the rest
+// of the binary stays baseline; MSVC accepts the intrinsics without it.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define GE_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define GE_NEON 1
+#endif
+#if defined(GE_X86) && defined(__GNUC__)
+#define GE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define GE_TARGET(isa)
+#endif
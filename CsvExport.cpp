@@ -0,0 +1,119 @@
+/*
+*****************************************************************************
+*   GrainEye - CSV export                                                     *
+*****************************************************************************
+*/
+#include "CsvExport.h"
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static const double PI = 3.14159265358979323846;
+
+// Quote a field if it contains a separator, quote or line break.
+static std::string CsvField(const std::string& text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) return text;
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+static void WriteDistribution(FILE* f, const char* name, const ShapeDistribution& d) {
+    std::fprintf(f, "%s,%.4f,%.4f,%.4f,%.4f,%.2f,%.2f", name, d.mean, d.p10, d.p50, d.p90, d.binMin, d.binWidth);
+    for (int count : d.counts) std::fprintf(f, ",%d", count);
+    std::fprintf(f, "\n");
+}
+
+bool WriteResultCsv(const std::string& path, const AnalysisResult& result, std::string* error) {
+    FILE* f = OpenFile(path, "wb");
+    if (!f) {
+        if (error) *error = "cannot create " + path;
+        return false;
+    }
+    std::vector<char> buffer(1 << 16);
+    std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+    std::fprintf(f, "\xEF\xBB\xBF" "Field,Value\n");
+    std::fprintf(f, "Image,%s\n", CsvField(result.imagePath).c_str());
+    std::fprintf(f, "Time,%s\n", CsvField(result.timestamp).c_str());
+    std::fprintf(f, "Beach Zone,%s\n", CsvField(result.beachZone).c_str());
+    std::fprintf(f, "Zone Location,%s\n", CsvField(result.zoneLocation).c_str());
+    std::fprintf(f, "Sand Size,%s\n", CsvField(result.sandSize).c_str());
+    std::fprintf(f, "Beach Type,%s\n", CsvField(result.beachType).c_str());
+    std::fprintf(f, "Category,%s\n", CsvField(result.category).c_str());
+    std::fprintf(f, "Classified By,%s\n", CsvField(result.classifier).c_str());
+    std::fprintf(f, "Grain Count,%d\n", result.grainCount);
+    std::fprintf(f, "d10 (mm),%.3f\nd50 (mm),%.3f\nd90 (mm),%.3f\nMean (mm),%.3f\n",
+        result.d10Mm, result.d50Mm, result.d90Mm, result.meanMm);
+    if (result.hasLocation) std::fprintf(f, "Latitude,%.6f\nLongitude,%.6f\n", result.latitude, result.longitude);
+
+    std::fprintf(f, "\nSize (mm),Count\n");
+    for (size_t i = 0; i < result.binCounts.size() && i < result.binSizesMm.size(); i++)
+        std::fprintf(f, "%.3f,%d\n", result.binSizesMm[i], result.binCounts[i]);
+
+    const ShapeStats& shape = result.shape;
+    if (shape.grains > 0) {
+        std::fprintf(f, "\nShape (%d grains),Mean,P10,P50,P90,Bin Min,Bin Width", shape.grains);
+        for (size_t i = 1; i <= shape.circularity.counts.size(); i++) std::fprintf(f, ",Bin %zu", i);
+        std::fprintf(f, "\n");
+        WriteDistribution(f, "Circularity", shape.circularity);
+        WriteDistribution(f, "Roundness", shape.roundness);
+        WriteDistribution(f, "Elongation", shape.elongation);
+        WriteDistribution(f, "Aspect Ratio", shape.aspectRatio);
+        WriteDistribution(f, "Convexity", shape.convexity);
+        WriteDistribution(f, "Solidity", shape.solidity);
+        WriteDistribution(f, "Sphericity", shape.sphericity);
+    }
+
+    const GrainTable& g = result.grains;
+    if (g.Size() > 0) {
+        bool hasShape = g.HasShape();
+        bool hasCentroid = g.centroidX.size() == g.Size() && g.centroidY.size() == g.Size();
+        // Uncalibrated: the equivalent diameter in pixels rather than 0 mm
+        bool inPixels = !g.HasDiameterMm() && g.areaPx.size() == g.Size();
+        std::fprintf(f, inPixels ? "\nGrain,X (px),Y (px),Diameter (px)" : "\nGrain,X (px),Y (px),Diameter (mm)");
+        if (hasShape)
+            std::fprintf(f, ",Area (px),Perimeter (px),Major Axis (px),Minor Axis (px),Hull Area (px),Hull Perimeter (px),"
+                "Circularity,Roundness,Elongation,Aspect Ratio,Convexity,Solidity,Sphericity");
+        std::fprintf(f, "\n");
+        for (size_t i = 0; i < g.Size(); i++) {
+            std::fprintf(f, "%zu,", i + 1);
+            if (hasCentroid) std::fprintf(f, "%.1f,%.1f,", g.centroidX[i], g.centroidY[i]);
+            else std::fprintf(f, ",,");
+            if (inPixels) std::fprintf(f, "%.2f", 2.0 * std::sqrt(g.areaPx[i] / PI));
+            else std::fprintf(f, "%.4f", g.diameterMm[i]);
+            if (hasShape)
+                std::fprintf(f, ",%.0f,%.1f,%.1f,%.1f,%.0f,%.1f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f",
+                    g.areaPx[i], g.perimeterPx[i], g.majorAxisPx[i], g.minorAxisPx[i], g.hullAreaPx[i], g.hullPerimeterPx[i],
+                    g.circularity[i], g.roundness[i], g.elongation[i], g.aspectRatio[i], g.convexity[i], g.solidity[i], g.sphericity[i]);
+            std::fprintf(f, "\n");
+        }
+    }
+
+    bool ok = !std::ferror(f);
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok && error) *error = "write failed: " + path;
+    return ok;
+}
+
+std::string DefaultCsvFileName(const AnalysisResult& result) {
+    std::string stamp = result.timestamp;   // "YYYY-MM-DD HH:MM"
+    for (auto& c : stamp) {
+        if (c == ' ') c = '_';
+        else if (c == ':') c = '\0';
+    }
+    stamp.erase(std::remove(stamp.begin(), stamp.end(), '\0'), stamp.end());
+
+    std::string name = result.imagePath.substr(result.imagePath.find_last_of("/\\") + 1);
+    name = name.substr(0, name.find_last_of('.'));
+    for (auto& c : name) {
+        if (c == '<' || c == '>' || c == ':' || c == '"' || c == '|' || c == '?' || c == '*' || c == ',') c = '_';
+    }
+    return "GrainEye_" + stamp + (name.empty() ? "" : "_" + name) + ".csv";
+}
@@ -0,0 +1,20 @@
+/*
+*****************************************************************************
+*   GrainEye - CSV export                                                     *
+*   ------------------------------------------------------------------------- *
+*   Writes one analysis as a CSV file in blocks separated by blank lines:    *
+*   summary fields, size distribution, shape distributions (one row per    *
+*   descriptor) and the per-grain table. UTF-8 with a BOM so Excel picks    *
+*   up the encoding.                                                         *
+*****************************************************************************
+*/
+#pragma once
+
+#include "Analysis.h"
+
+#include <string>
+
+bool WriteResultCsv(const std::string& path, const AnalysisResult& result, std::string* error = nullptr);
+
+// "GrainEye_YYYY-MM-DD_HHMM_<image name>.csv", safe on every file system.
+std::string DefaultCsvFileName(const AnalysisResult& result);
@@ -0,0 +1,162 @@
+/*
+*****************************************************************************
+*   GrainEye - File helpers                                                   *
+*****************************************************************************
+*/
+#include "FileUtil.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+std::wstring Widen(const std::string& text) {
+    if (text.empty()) return std::wstring();
+    int len = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), (int)text.size(), NULL, 0);
+    std::wstring out(len, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), (int)text.size(), &out[0], len);
+    return out;
+}
+
+std::string Narrow(const std::wstring& text) {
+    if (text.empty()) return std::string();
+    int len = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.size(), NULL, 0, NULL, NULL);
+    std::string out(len, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.size(), &out[0], len, NULL, NULL);
+    return out;
+}
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FILE* OpenFile(const std::string& path, const char* mode) {
+#ifdef _WIN32
+    std::wstring wmode(mode, mode + std::char_traits<char>::length(mode));
+    return _wfopen(Widen(path).c_str(), wmode.c_str());
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+
+long long FileTell(FILE* f) {
+#ifdef _WIN32
+    return _ftelli64(f);
+#else
+    return (long long)ftello(f);
+#endif
+}
+
+int FileSeek(FILE* f, long long offset, int origin) {
+#ifdef _WIN32
+    return _fseeki64(f, offset, origin);
+#else
+    return fseeko(f, (off_t)offset, origin);
+#endif
+}
+
+bool FileStamp(const std::string& path, long long& modified, long long& size) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(Widen(path).c_str(), GetFileExInfoStandard, &data)) return false;
+    modified = (long long)(((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+    size = (long long)(((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow);
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    modified = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    size = (long long)st.st_size;
+#endif
+    return true;
+}
+
+bool CommitFile(const std::string& part, const std::string& target, std::string* error) {
+#ifdef _WIN32
+    if (!MoveFileExW(Widen(part).c_str(), Widen(target).c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (std::rename(part.c_str(), target.c_str()) != 0) {
+#endif
+        DiscardFile(part);
+        if (error) *error = "cannot write " + target;
+        return false;
+    }
+    return true;
+}
+
+void DiscardFile(const std::string& path) {
+#ifdef _WIN32
+    DeleteFileW(Widen(path).c_str());
+#else
+    std::remove(path.c_str());
+#endif
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& path, std::string* error) {
+    Close();
+    HANDLE file = CreateFileW(Widen(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        if (error) *error = "cannot open " + path;
+        return false;
+    }
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+        CloseHandle(file);
+        if (error) *error = "empty file " + path;
+        return false;
+    }
+    // The mapping keeps the file open; the file handle is not needed any more
+    mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping) data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        Close();
+        if (error) *error = "cannot map " + path;
+        return false;
+    }
+    size = (size_t)length.QuadPart;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    data = nullptr;
+    mapping = nullptr;
+    size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path, std::string* error) {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (error) *error = "cannot open " + path;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        if (error) *error = "empty file " + path;
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        if (error) *error = "cannot map " + path;
+        return false;
+    }
+    data = (const uint8_t*)view;
+    size = (size_t)info.st_size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data) munmap((void*)data, size);
+    data = nullptr;
+    size = 0;
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+*****************************************************************************
+*   GrainEye - File helpers                                                   *
+*   ------------------------------------------------------------------------- *
+*   Paths are UTF-8 everywhere in the shared code; on Windows they have to   *
+*   go through the wide-character CRT to reach non-ASCII folders.            *
+*****************************************************************************
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// fopen() for a UTF-8 path.
+FILE* OpenFile(const std::string& path, const char* mode);
+
+// ftell() / fseek() with 64-bit offsets (long is 32 bits on Windows).
+long long FileTell(FILE* f);
+int FileSeek(FILE* f, long long offset, int origin);
+
+// Last-write time (platform ticks, only compared for equality) and size;
+// false if the file does not exist.
+bool FileStamp(const std::string& path, long long& modified, long long& size);
+
+// Replaces target with a finished temporary file (written as "<target>.part"
+// or similar); on failure the temporary file is deleted.
+bool CommitFile(const std::string& part, const std::string& target, std::string* error = nullptr);
+
+// remove() for a UTF-8 path.
+void DiscardFile(const std::string& path);
+
+// Read-only memory mapping of a whole file. Pages are loaded on first
+// touch and shared with the page cache, so large read-only data (model
+// weights) costs no copy and no private memory.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path, std::string* error = nullptr);
+    void Close();
+
+    const uint8_t* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* mapping = nullptr;
+#endif
+};
+
+#ifdef _WIN32
+// UTF-8 -> UTF-16 for Win32 calls that take a path, and back.
+std::wstring Widen(const std::string& text);
+std::string Narrow(const std::wstring& text);
+#endif
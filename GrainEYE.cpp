@@ -46,14 +46,37 @@
 #include <commdlg.h>
 #include <gdiplus.h>
 #include <dwmapi.h>
+#include <shellapi.h>
+#include <shlobj.h>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <unordered_set>
 #include<iostream>
 #pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "Msimg32.lib")
 #pragma comment(lib, "dwmapi.lib")
+#pragma comment(lib, "shell32.lib")
+#pragma comment(lib, "ole32.lib")
 #include"resource.h"
+#include "Analysis.h"
+#include "WatchFolder.h"
+#include "StartupProfile.h"
+#include "ResultChannel.h"
+#include "CloudClient.h"
+#include "InferenceEngine.h"
+#include "CsvExport.h"
+#include "FileUtil.h"
+#include "ThreadPool.h"
+#include "SurveyAggregate.h"
+#include "SampleStore.h"
+#include "SurveyExport.h"
+#include "Plot.h"
+#include "ThumbnailCache.h"
+#include "SessionLog.h"
 using namespace Gdiplus;
 
 // ---------- Globals ----------
@@ -61,15 +84,98 @@ HINSTANCE hInst;
 HWND hUploadBtn, hAnalyzeBtn, hSaveBtn, hRestartBtn;
 HWND hImageBox, hResultBox;
 HWND hFetchLocBtn, hTagBtn, hLocationText;
+HWND hGalleryBtn;
 std::wstring imagePath;
 Image* uploadedImage = nullptr;
+HWND g_hMainWnd = NULL;
 
 ULONG_PTR gdiplusToken;
+bool g_gdiplusStarted = false;     // GDI+ starts after the first paint (see RegisterStartupWork)
+
+// Private window messages
+#define WM_APP_WATCHED_SAMPLE (WM_APP + 1)   // lParam: const std::string* (UTF-8 path)
+#define WM_APP_SET_ICON       (WM_APP + 2)   // lParam: HICON loaded after the first paint
+#define WM_APP_STARTUP_DONE   (WM_APP + 3)   // deferred initialization finished
+#define WM_APP_RESULT_UPDATE  (WM_APP + 4)   // new snapshot in g_resultChannel
+#define WM_APP_EXPORT_DONE    (WM_APP + 5)   // wParam: 0 failed, 1 done, 2 done from a truncated store; lParam: std::string* (UTF-8 message, deleted by the handler)
+#define WM_APP_THUMBNAIL_READY (WM_APP + 6)  // thumbnails finished decoding; repaint the gallery (coalesced)
+
+// Watch-folder ingestion (started with --watch <folder>)
+SampleQueue g_watchQueue(8);
+WatchFolder g_watchFolder;
+std::thread g_watchConsumer;
+
+// Analysis runs on a worker thread and streams snapshots to the UI through
+// g_resultChannel (at most 10 updates per second, final result always shown).
+const int RESULT_UPDATE_INTERVAL_MS = 100;
+ResultChannel g_resultChannel(RESULT_UPDATE_INTERVAL_MS, [] { PostMessage(g_hMainWnd, WM_APP_RESULT_UPDATE, 0, 0); });
+std::thread g_analysisThread;
+HANDLE g_hAnalysisIdle = CreateEventW(NULL, TRUE, TRUE, NULL);   // signalled while no analysis runs
+AnalysisResult g_displayResult;     // snapshot behind the result box and graphs
+bool g_hasDisplayResult = false;
+
+// Samples tagged during this session, aggregated per zone and survey cell
+BeachSurvey g_survey;
+std::string g_lastTagged;           // imagePath + timestamp of the last tagged result
+
+// Last GNSS fix from Fetch Location, stamped onto the result on Tag; cleared
+// by Restart, so a sample without a fetched fix is tagged without a location
+bool g_hasFix = false;
+double g_fixLatitude = 0.0;
+double g_fixLongitude = 0.0;
+
+// Every tagged sample is also appended to %LOCALAPPDATA%\GrainEye\samples.gess;
+// Save exports the whole store (GeoJSON + columnar) in the background. A Save
+// while an export runs is queued and started when that one is done (UI thread
+// only; a later Save replaces the queued one, which would export the same store)
+ExportJob g_exportJob;
+ExportRequest g_queuedExport;
+bool g_exportQueued = false;
+
+// Sample gallery: thumbnails of the tagged samples, newest first. They are
+// decoded on background threads and kept in memory and in
+// %LOCALAPPDATA%\GrainEye\thumbnails.pack; painting only reads the cache.
+struct GalleryItem {
+    std::string path;               // UTF-8
+    std::wstring name;
+    std::wstring details;
+};
+const int GALLERY_THUMB_WIDTH = 160;
+const int GALLERY_THUMB_HEIGHT = 120;
+const int GALLERY_CELL_WIDTH = 184;
+const int GALLERY_CELL_HEIGHT = 180;
+const int GALLERY_MARGIN = 16;
+HWND g_hGalleryWnd = NULL;
+std::vector<GalleryItem> g_galleryItems;
+int g_galleryScroll = 0;            // pixels from the top
+int g_gallerySelected = -1;
+std::unique_ptr<ThumbnailCache> g_thumbnails;     // created when the gallery is first opened
+std::atomic<bool> g_thumbnailRepaintPosted{ false };
+
+// Session log (started with --record <file>) for graineye-cli --replay
+SessionRecorder g_session;
+
+// Button rectangles for hit-testing, in the order of customButtons
+HoverTracker g_hover;
+std::vector<int> g_hoverChanged;
+
+// Cloud model endpoint (set with --cloud host:port[/path]); local analysis otherwise
+CloudEndpoint g_cloudEndpoint;
+bool g_useCloud = false;
+
+// Image scale for grain diameters (set with --scale <mm per pixel>, measured
+// once for the camera at its mount height); diameters stay in pixels without it
+double g_mmPerPixel = 0.0;
+
+// On-device classifier (graineye_model.geq8 next to the executable), loaded
+// after the first paint; classification works offline when it is present
+InferenceEngine g_model;
 
 // Fonts (create once)
 HFONT g_hFont = NULL;
 HFONT g_hTitleFont = NULL;
 HFONT g_hSubtitleFont = NULL;
+HFONT g_hHintFont = NULL;          // created on first paint
 
 // Colors
 const COLORREF DARK_BG = RGB(32, 32, 32);
@@ -108,16 +214,35 @@ std::vector<CustomButton> customButtons;
 // Forward declarations
 void ShowImage(HWND hwnd, const std::wstring& path);
 void DoAnalysis(HWND hwnd);
+bool StartSurveyExport(HWND hwnd, const ExportRequest& request);
+void ShowAnalysisUpdate(HWND hwnd);
+void UpdateResultText(const std::wstring& text);
 void DrawModernButton(HDC hdc, HWND hwnd, CustomButton& button, const wchar_t* text);
 void RegisterButton(HWND hwnd, int cornerRadius = 8, bool isAccent = false, bool alwaysGreen = false);
 void UpdateButtonState(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+RECT ButtonRect(HWND button);
 void CreateGraphs();
-void DrawGraph(HDC hdc, int x, int y, int width, int height, const std::wstring& title);
+void DrawGraph(HDC hdc, int x, int y, int width, int height, GraphKind kind);
 void DrawRoundedRect(HDC hdc, int x, int y, int width, int height, int radius, COLORREF color);
 void FillRoundedRect(HDC hdc, int x, int y, int width, int height, int radius, COLORREF color);
 void DrawCard(HDC hdc, int x, int y, int width, int height, int radius = 12);
+void StartWatchFolder(HWND hwnd, const std::wstring& folder);
+void OpenGallery(HWND owner);
+void RefreshGallery();
+void RegisterStartupWork();
+std::wstring ExeDirectory();
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
+// %LOCALAPPDATA%\GrainEye\<name> (UTF-8), creating the folder; empty if unavailable
+static std::string AppDataFile(const wchar_t* name) {
+    wchar_t appData[MAX_PATH];
+    DWORD len = GetEnvironmentVariableW(L"LOCALAPPDATA", appData, MAX_PATH);
+    if (len == 0 || len >= MAX_PATH) return std::string();
+    std::wstring dir = std::wstring(appData) + L"\\GrainEye";
+    CreateDirectoryW(dir.c_str(), NULL);
+    return Narrow(dir + L"\\" + name);
+}
+
 // Helper function to set text color for static controls
 void SetStaticTextColor(HWND hwnd, COLORREF color) {
     SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)color);
@@ -149,60 +274,103 @@ void EnableWindowEffects(HWND hwnd) {
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow) {
     hInst = hInstance;
 
-    GdiplusStartupInput gdiplusStartupInput;
-    GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    // GDI+ and the icon are loaded after the first paint (cold start on the Pi)
+    RegisterStartupWork();
 
     const wchar_t CLASS_NAME[] = L"UltraModernGrainEyeClass";
 
-    // Use WNDCLASSEX instead of WNDCLASS
-    WNDCLASSEX wc = {};
-    wc.cbSize = sizeof(WNDCLASSEX);
-    wc.lpfnWndProc = WndProc;
-    wc.hInstance = hInstance;
-    wc.lpszClassName = CLASS_NAME;
-    wc.hCursor = LoadCursor(NULL, IDC_ARROW);
-    wc.hbrBackground = NULL;
-
-    // Load icon from file
-    HICON hAppIcon = (HICON)LoadImage(NULL, L"C:\\ico.ico", IMAGE_ICON, 32, 32, LR_LOADFROMFILE);
-    wc.hIcon = hAppIcon;      // Title bar icon
-    wc.hIconSm = hAppIcon;    // Taskbar / Alt+Tab small icon
-
-    RegisterClassEx(&wc);      // EX version required for hIconSm
-
-    HWND hwnd = CreateWindowEx(
-        0,
-        CLASS_NAME,
-        L"GRAINEYE",
-        WS_OVERLAPPEDWINDOW & ~WS_THICKFRAME,
-        CW_USEDEFAULT, CW_USEDEFAULT, 1280, 820,
-        NULL, NULL, hInstance, NULL
-    );
-
-    EnableWindowEffects(hwnd);
+    {
+        StartupPhase phase("register window class");
+
+        // Use WNDCLASSEX instead of WNDCLASS
+        WNDCLASSEX wc = {};
+        wc.cbSize = sizeof(WNDCLASSEX);
+        wc.lpfnWndProc = WndProc;
+        wc.hInstance = hInstance;
+        wc.lpszClassName = CLASS_NAME;
+        wc.hCursor = LoadCursor(NULL, IDC_ARROW);
+        wc.hbrBackground = NULL;
+
+        RegisterClassEx(&wc);      // EX version required for hIconSm
+    }
+
+    HWND hwnd;
+    {
+        StartupPhase phase("create window");
+        hwnd = CreateWindowEx(
+            0,
+            CLASS_NAME,
+            L"GRAINEYE",
+            WS_OVERLAPPEDWINDOW & ~WS_THICKFRAME,
+            CW_USEDEFAULT, CW_USEDEFAULT, 1280, 820,
+            NULL, NULL, hInstance, NULL
+        );
+    }
+    g_hMainWnd = hwnd;
+
+    {
+        StartupPhase phase("window effects");
+        EnableWindowEffects(hwnd);
+    }
 
     ShowWindow(hwnd, nCmdShow);
 
+    // Optional: GrainEYE.exe [--cloud host:port[/path]] [--scale <mm per pixel>] [--watch <folder>] [--record <session.log>]
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    for (int i = 1; argv && i + 1 < argc; i++) {
+        if (wcscmp(argv[i], L"--cloud") == 0) g_useCloud = ParseCloudEndpoint(Narrow(argv[i + 1]), g_cloudEndpoint);
+        if (wcscmp(argv[i], L"--scale") == 0) {
+            double scale = _wtof(argv[i + 1]);
+            if (scale > 0.0 && scale < 1e3) g_mmPerPixel = scale;
+        }
+    }
+    for (int i = 1; argv && i + 1 < argc; i++) {
+        if (wcscmp(argv[i], L"--record") != 0) continue;
+        std::string error;
+        if (!g_session.Start(Narrow(argv[i + 1]), &error)) {
+            OutputDebugStringA(("Session log: " + error + "\n").c_str());
+            continue;
+        }
+        // The layout first, so the replay can hit-test the recorded moves
+        for (const auto& btn : customButtons) {
+            RECT rc = ButtonRect(btn.hwnd);
+            g_session.Button(rc.left, rc.top, rc.right, rc.bottom);
+        }
+    }
+    for (int i = 1; argv && i + 1 < argc; i++) {
+        if (wcscmp(argv[i], L"--watch") == 0) StartWatchFolder(hwnd, argv[i + 1]);
+    }
+    if (argv) LocalFree(argv);
+
     MSG msg = {};
     while (GetMessage(&msg, NULL, 0, 0)) {
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
 
-    GdiplusShutdown(gdiplusToken);
+    // The window is gone, so a consumer blocked in SendMessage returns now
+    if (g_watchConsumer.joinable()) g_watchConsumer.join();
+
+    WaitDeferredInits();
+    if (g_gdiplusStarted) GdiplusShutdown(gdiplusToken);
     return 0;
 }
 
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
     case WM_CREATE: {
-        // Create modern fonts (store globally)
-        g_hFont = CreateFontW(17, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
-            OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
-        g_hTitleFont = CreateFontW(48, 0, 0, 0, FW_SEMIBOLD, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
-            OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
-        g_hSubtitleFont = CreateFontW(21, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
-            OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+        {
+            StartupPhase phase("WM_CREATE fonts");
+            // Create modern fonts (store globally)
+            g_hFont = CreateFontW(17, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+            g_hTitleFont = CreateFontW(48, 0, 0, 0, FW_SEMIBOLD, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+            g_hSubtitleFont = CreateFontW(21, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+        }
+        StartupPhase controlsPhase("WM_CREATE controls");
 
         // App title
         HWND hTitle = CreateWindowW(L"STATIC", L"Sand Grain Analyzer",
@@ -301,6 +469,13 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             270, 680, 200, 45, hwnd, (HMENU)4, hInst, NULL);
         RegisterButton(hRestartBtn, 10);
         SendMessage(hRestartBtn, WM_SETFONT, (WPARAM)g_hFont, TRUE);
+
+        // Gallery button (top right)
+        hGalleryBtn = CreateWindowW(L"BUTTON", L"🖼️ Gallery",
+            WS_CHILD | WS_VISIBLE | BS_OWNERDRAW,
+            1010, 112, 200, 45, hwnd, (HMENU)7, hInst, NULL);
+        RegisterButton(hGalleryBtn, 10);
+        SendMessage(hGalleryBtn, WM_SETFONT, (WPARAM)g_hFont, TRUE);
     }
                   break;
 
@@ -320,6 +495,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 
             if (GetOpenFileNameW(&ofn)) {
                 imagePath = szFile;
+                g_session.Image("upload", Narrow(imagePath));
                 ShowImage(hwnd, imagePath);
                 EnableWindow(hAnalyzeBtn, TRUE);
                 SetWindowTextW(hResultBox, L"Image loaded successfully. Click 'Analyze' to process.");
@@ -329,6 +505,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
               break;
 
         case 2: { // Analyze
+            if (WaitForSingleObject(g_hAnalysisIdle, 0) != WAIT_OBJECT_0) break;   // already running
             SetWindowTextW(hResultBox, L"Analyzing image...");
             UpdateWindow(hResultBox);
 
@@ -337,17 +514,51 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
               break;
 
         case 3: { // Save
-            // A simple stub: notify user. Could be extended to write files.
-            MessageBoxW(hwnd, L"Results and graphs saved to your Documents folder.", L"Save Complete", MB_OK | MB_ICONINFORMATION);
+            if (!g_hasDisplayResult || !g_displayResult.complete) break;
+            g_session.Command("save");
+            PWSTR documents = NULL;
+            if (FAILED(SHGetKnownFolderPath(FOLDERID_Documents, 0, NULL, &documents))) {
+                MessageBoxW(hwnd, L"The Documents folder could not be found.", L"Save Failed", MB_OK | MB_ICONERROR);
+                break;
+            }
+            std::wstring folder = documents;
+            std::wstring path = folder + L"\\" + Widen(DefaultCsvFileName(g_displayResult));
+            CoTaskMemFree(documents);
+
+            std::string error;
+            if (WriteResultCsv(Narrow(path), g_displayResult, &error)) {
+                std::wstring message = L"Results saved to:\n" + path;
+                MessageBoxW(hwnd, message.c_str(), L"Save Complete", MB_OK | MB_ICONINFORMATION);
+            }
+            else {
+                MessageBoxW(hwnd, Widen(error).c_str(), L"Save Failed", MB_OK | MB_ICONERROR);
+            }
+
+            // Survey export of all tagged samples; streams from the store on
+            // a background thread and reports through WM_APP_EXPORT_DONE
+            std::string store = AppDataFile(L"samples.gess");
+            if (!store.empty() && GetFileAttributesW(Widen(store).c_str()) != INVALID_FILE_ATTRIBUTES) {
+                std::string base = Narrow(folder) + "\\" + DefaultSurveyExportName();
+                ExportRequest request = { store, base + ".geojson", base + ".gecf" };
+                if (!StartSurveyExport(hwnd, request)) {
+                    g_queuedExport = request;
+                    g_exportQueued = true;
+                }
+            }
         }
               break;
 
         case 4: { // Restart
+            if (WaitForSingleObject(g_hAnalysisIdle, 0) != WAIT_OBJECT_0) break;   // let the running analysis finish
+            g_session.Command("restart");
+            g_resultChannel.Reset();
+            g_hasDisplayResult = false;
             imagePath.clear();
             if (uploadedImage) { delete uploadedImage; uploadedImage = nullptr; }
             InvalidateRect(hwnd, NULL, TRUE);
             SetWindowTextW(hResultBox, L"Upload an image to begin analysis...");
             SetWindowTextW(hLocationText, L"");
+            g_hasFix = false;
             EnableWindow(hAnalyzeBtn, FALSE);
             EnableWindow(hSaveBtn, FALSE);
             EnableWindow(hRestartBtn, FALSE);
@@ -360,6 +571,11 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
               break;
 
         case 5: { // Fetch Location
+            g_session.Command("fetch");
+            g_hasFix = true;
+            g_fixLatitude = 21.627761;
+            g_fixLongitude = 87.519650;
+            g_session.Gnss(g_fixLatitude, g_fixLongitude);
             // Immediately show the coordinates in the location text area
             SetWindowTextW(hLocationText, L"Latitude: 21° 37' 39.94\" N\nLongitude: 87° 31' 10.74\" E\n\n\n\nArea: DIGHA, WB, INDIA\nLocation data ready for tagging.");
             // After fetching, enable the Tag button
@@ -369,9 +585,33 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
               break;
 
         case 6: { // Tag
-            MessageBoxW(hwnd, L"Location has been tagged.", L"Tagged", MB_OK | MB_ICONINFORMATION);
+            g_session.Command("tag");
+            // A finished result joins the beach survey once; the summary is
+            // updated by merging, so tagging stays instant however long the survey
+            std::wstring message = L"Location has been tagged.";
+            if (g_hasDisplayResult && g_displayResult.complete && g_displayResult.grainCount >= 0) {
+                std::string key = g_displayResult.imagePath + "|" + g_displayResult.timestamp;
+                if (key != g_lastTagged) {
+                    g_displayResult.hasLocation = g_hasFix;
+                    g_displayResult.latitude = g_hasFix ? g_fixLatitude : 0.0;
+                    g_displayResult.longitude = g_hasFix ? g_fixLongitude : 0.0;
+                    g_survey.Add(g_displayResult);
+                    g_lastTagged = key;
+                    std::string store = AppDataFile(L"samples.gess"), error;
+                    if (!store.empty() && !AppendSample(store, SampleRecord::FromResult(g_displayResult), &error))
+                        OutputDebugStringA(("Sample store: " + error + "\n").c_str());
+                    RefreshGallery();
+                }
+                message += L"\n\n" + Widen(FormatSurveyReport(g_survey));
+            }
+            MessageBoxW(hwnd, message.c_str(), L"Tagged", MB_OK | MB_ICONINFORMATION);
         }
               break;
+
+        case 7: // Gallery
+            g_session.Command("gallery");
+            OpenGallery(hwnd);
+            break;
         }
     }
                    break;
@@ -413,12 +653,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                      break;
 
     case WM_MOUSELEAVE: {
-        for (auto& btn : customButtons) {
-            if (btn.isHovered) {
-                btn.isHovered = false;
-                InvalidateRect(btn.hwnd, NULL, FALSE);
-            }
-        }
+        UpdateButtonState(hwnd, msg, wParam, lParam);
     }
                       break;
 
@@ -433,6 +668,9 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                      break;
 
     case WM_PAINT: {
+        bool firstFrame = TimeToFirstFrameMs() < 0;
+        double paintStartMs = firstFrame ? StartupElapsedMs() : 0.0;
+
         PAINTSTRUCT ps;
         HDC hdc = BeginPaint(hwnd, &ps);
 
@@ -452,6 +690,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
         DrawCard(hdc, 40, 180, 440, 320); // Image preview card
         DrawCard(hdc, 40, 510, 440, 160); // Location tagging card (under image)
         DrawCard(hdc, 40, 680, 440, 50); // Action buttons card
+        DrawCard(hdc, 1000, 110, 220, 50); // Gallery button card
 
         // Draw graph cards
         DrawCard(hdc, 500, 180, 720, 320); // Graph area card
@@ -481,36 +720,101 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             DeleteDC(hdcMem);
         }
 
-        // Draw graphs if analysis was performed (indicated by Save button enabled)
-        if (IsWindowEnabled(hSaveBtn)) {
-            DrawGraph(hdc, 520, 200, 330, 260, L"Grain Size Distribution");
-            DrawGraph(hdc, 870, 200, 330, 260, L"Cumulative Grain Size Curve");
+        // Draw graphs once the first (possibly partial) result has arrived
+        if (g_hasDisplayResult) {
+            DrawGraph(hdc, 520, 200, 330, 260, GRAPH_DISTRIBUTION);
+            DrawGraph(hdc, 870, 200, 330, 260, GRAPH_CUMULATIVE);
         }
 
         // Draw small hint text inside location card
         SetTextColor(hdc, TEXT_SECONDARY);
         SetBkMode(hdc, TRANSPARENT);
-        HFONT hSmall = CreateFontW(14, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
-            OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
-        HFONT hOld = (HFONT)SelectObject(hdc, hSmall);
+        if (!g_hHintFont) {
+            g_hHintFont = CreateFontW(14, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+        }
+        HFONT hOld = (HFONT)SelectObject(hdc, g_hHintFont);
         RECT hintRect = { 70, 592, 450, 640 };
         DrawText(hdc, L"Use 'Fetch Location' to get coordinates. Press 'Tag' to tag the location.", -1, &hintRect, DT_LEFT | DT_WORDBREAK);
         SelectObject(hdc, hOld);
-        DeleteObject(hSmall);
 
         EndPaint(hwnd, &ps);
+
+        // First frame is on screen: start the heavy subsystems in the background
+        if (firstFrame) {
+            RecordStartupPhase("first paint", paintStartMs, StartupElapsedMs());
+            MarkFirstFrame();
+            StartDeferredInits([hwnd] { PostMessage(hwnd, WM_APP_STARTUP_DONE, 0, 0); });
+        }
     }
                  break;
 
     case WM_ERASEBKGND:
         return 1; // custom drawing
 
+    case WM_APP_RESULT_UPDATE:
+        ShowAnalysisUpdate(hwnd);
+        break;
+
+    case WM_APP_WATCHED_SAMPLE: {
+        // New image from the watch folder: same path as Upload + Analyze
+        // (the consumer waits for g_hAnalysisIdle before sending the next one)
+        const std::string* path = (const std::string*)lParam;
+        g_session.Image("watch", *path);
+        imagePath = Widen(*path);
+        ShowImage(hwnd, imagePath);
+        SetWindowTextW(hResultBox, L"Analyzing image...");
+        UpdateWindow(hResultBox);
+        DoAnalysis(hwnd);
+    }
+                              break;
+
+    case WM_APP_SET_ICON: {
+        HICON hAppIcon = (HICON)lParam;
+        SendMessage(hwnd, WM_SETICON, ICON_BIG, (LPARAM)hAppIcon);      // Title bar icon
+        SendMessage(hwnd, WM_SETICON, ICON_SMALL, (LPARAM)hAppIcon);    // Taskbar / Alt+Tab small icon
+    }
+                        break;
+
+    case WM_APP_STARTUP_DONE: {
+        // Startup timing report: debugger output + %LOCALAPPDATA%\GrainEye\startup_metrics.csv
+        OutputDebugStringA(FormatStartupReport().c_str());
+        std::string metrics = AppDataFile(L"startup_metrics.csv");
+        if (!metrics.empty()) AppendStartupMetrics(metrics);
+    }
+                            break;
+
+    case WM_APP_EXPORT_DONE: {
+        std::string* message = (std::string*)lParam;
+        OutputDebugStringA(("Survey export: " + *message).c_str());
+        // Before the message box, whose loop may take the next Save
+        if (g_exportQueued && StartSurveyExport(hwnd, g_queuedExport)) g_exportQueued = false;
+        if (wParam) MessageBoxW(hwnd, (L"Survey exported to:\n" + Widen(*message)).c_str(), L"Export Complete",
+            MB_OK | (wParam == 2 ? MB_ICONWARNING : MB_ICONINFORMATION));
+        else MessageBoxW(hwnd, Widen(*message).c_str(), L"Export Failed", MB_OK | MB_ICONERROR);
+        delete message;
+    }
+                           break;
+
+    case WM_APP_THUMBNAIL_READY:
+        g_thumbnailRepaintPosted = false;
+        if (g_hGalleryWnd) InvalidateRect(g_hGalleryWnd, NULL, FALSE);
+        break;
+
     case WM_DESTROY:
+        g_watchFolder.Stop();
+        g_exportJob.Cancel();
+        g_exportJob.Wait();
+        if (g_analysisThread.joinable()) g_analysisThread.join();
+        g_thumbnails.reset();           // joins the decode threads while GDI+ is still up
+        g_session.Stop();
+        SetEvent(g_hAnalysisIdle);      // release the watch consumer
         if (uploadedImage) delete uploadedImage;
         // Destroy fonts
         if (g_hFont) { DeleteObject(g_hFont); g_hFont = NULL; }
         if (g_hTitleFont) { DeleteObject(g_hTitleFont); g_hTitleFont = NULL; }
         if (g_hSubtitleFont) { DeleteObject(g_hSubtitleFont); g_hSubtitleFont = NULL; }
+        if (g_hHintFont) { DeleteObject(g_hHintFont); g_hHintFont = NULL; }
         PostQuitMessage(0);
         break;
 
@@ -527,33 +831,135 @@ void ShowImage(HWND hwnd, const std::wstring& path) {
         delete uploadedImage;
         uploadedImage = nullptr;
     }
+    EnsureDeferredInit("GDI+ / image codecs");
+    if (!g_gdiplusStarted) return;
     uploadedImage = Image::FromFile(path.c_str());
     InvalidateRect(hwnd, NULL, TRUE);
 }
 
+// Work that is not needed for the first frame. It runs on a background
+// thread after the first WM_PAINT; EnsureDeferredInit() pulls a step forward
+// if the user needs it sooner (e.g. uploads an image immediately).
+void RegisterStartupWork() {
+    RegisterDeferredInit("GDI+ / image codecs", [] {
+        GdiplusStartupInput gdiplusStartupInput;
+        g_gdiplusStarted = GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL) == Ok;
+    });
+
+    RegisterDeferredInit("app icon", [] {
+        // ico.ico next to the executable, falling back to the old fixed location
+        std::wstring iconPath = ExeDirectory() + L"ico.ico";
+
+        HICON hAppIcon = (HICON)LoadImage(NULL, iconPath.c_str(), IMAGE_ICON, 32, 32, LR_LOADFROMFILE);
+        if (!hAppIcon) hAppIcon = (HICON)LoadImage(NULL, L"C:\\ico.ico", IMAGE_ICON, 32, 32, LR_LOADFROMFILE);
+        if (hAppIcon) PostMessage(g_hMainWnd, WM_APP_SET_ICON, 0, (LPARAM)hAppIcon);
+    });
+
+    RegisterDeferredInit("on-device model", [] {
+        std::string error;
+        if (!g_model.Load(Narrow(ExeDirectory() + L"graineye_model.geq8"), &error))
+            OutputDebugStringA(("GrainEye: on-device model not loaded: " + error + "\n").c_str());
+    });
+}
+
+// Folder of GrainEYE.exe, with a trailing backslash
+std::wstring ExeDirectory() {
+    wchar_t exePath[MAX_PATH];
+    DWORD len = GetModuleFileNameW(NULL, exePath, MAX_PATH);
+    std::wstring path(exePath, len);
+    return path.substr(0, path.find_last_of(L'\\') + 1);
+}
+
+// Watch a folder for new images and analyze each one as it arrives.
+// The consumer hands one sample at a time to the UI and waits until its
+// analysis has finished; the bounded queue then pushes back on the watcher.
+void StartWatchFolder(HWND hwnd, const std::wstring& folder) {
+    WatchOptions options;
+    options.directory = Narrow(folder);
+
+    std::string error;
+    if (!g_watchFolder.Start(options, &g_watchQueue, &error)) {
+        MessageBoxW(hwnd, Widen(error).c_str(), L"Watch Folder", MB_OK | MB_ICONWARNING);
+        return;
+    }
+    g_watchConsumer = std::thread([hwnd] {
+        std::string path;
+        while (g_watchQueue.Pop(path)) {
+            WaitForSingleObject(g_hAnalysisIdle, INFINITE);
+            if (!IsWindow(hwnd)) break;
+            SendMessageW(hwnd, WM_APP_WATCHED_SAMPLE, 0, (LPARAM)&path);
+        }
+    });
+    SetWindowTextW(hResultBox, (L"Watching " + folder + L" for new images...").c_str());
+}
+
+// Start the analysis on a worker thread. Partial results arrive through
+// g_resultChannel and are shown by ShowAnalysisUpdate.
 void DoAnalysis(HWND hwnd) {
-    // Simulate processing delay for a more modern feel
-    Sleep(1200);
+    if (g_analysisThread.joinable()) g_analysisThread.join();   // previous run has finished (idle event set)
+    g_session.Command("analyze");
+    ResetEvent(g_hAnalysisIdle);
+    g_resultChannel.Reset();
+    EnableWindow(hAnalyzeBtn, FALSE);
+    InvalidateRect(hAnalyzeBtn, NULL, TRUE);
+
+    std::string path = Narrow(imagePath);
+    g_analysisThread = std::thread([path] {
+        AnalysisOptions options;
+        if (g_useCloud) options.cloud = &g_cloudEndpoint;
+        options.mmPerPixel = g_mmPerPixel;
+
+        // Decoding goes through GDI+; the model may still be loading if the
+        // user was quick
+        EnsureDeferredInit("GDI+ / image codecs");
+        EnsureDeferredInit("on-device model");
+        if (g_model.IsLoaded()) options.model = &g_model;
+        options.onProgress = [](const AnalysisResult& partial) { g_resultChannel.Publish(partial); };
+
+        AnalysisResult analysis;
+        if (!RunAnalysis(path, analysis, options)) {
+            analysis = AnalysisResult();
+            analysis.imagePath = path;
+            analysis.grainCount = -1;   // marks failure for the UI
+        }
+        g_resultChannel.Publish(analysis);
+
+        // Worker pool decisions (thermal throttling shows up here): debugger output
+        PoolMetrics pool = AnalysisPool().Metrics();
+        if (pool.loops > 0) OutputDebugStringA(("GrainEye pool: " + FormatPoolMetrics(pool) + "\n").c_str());
+    });
+}
+
+// Pull the latest snapshot and update the result box and graphs in place.
+void ShowAnalysisUpdate(HWND hwnd) {
+    AnalysisResult snapshot;
+    if (!g_resultChannel.Take(snapshot)) return;
+
+    RECT graphRect = { 500, 180, 1220, 500 };
+    if (snapshot.complete && snapshot.grainCount < 0) {
+        SetWindowTextW(hResultBox, L"Analysis failed. Please upload another image.");
+        g_hasDisplayResult = false;
+        InvalidateRect(hwnd, &graphRect, FALSE);
+        EnableWindow(hAnalyzeBtn, TRUE);
+        InvalidateRect(hAnalyzeBtn, NULL, TRUE);
+        SetEvent(g_hAnalysisIdle);
+        return;
+    }
 
-    std::wstring result = L"SAND TYPE ANALYSIS COMPLETE:\r\n\n"
-        L"• Beach Zone: Intertidal Zone (Foreshore / Swash Zone)\r\n"
-        L"• Location: Area between high tide and low tide\r\n"
-        L"• Sand Size: Medium Sand (0.25–0.5 mm)\r\n"
-        L"• Median (d50): 0.43 mm\r\n"
-        L"• Mean Grain Size: 0.43 mm\r\n"
-        L"• Range (d10–d90): 0.26 – 0.70 mm\r\n"
-        L"• Beach Type: Typical sandy beach, dissipative\r\n\n"
-        L"• Category: Medium Sand → Intertidal\r\n"
-        L"• GPS: 21.63°N, 87.55°E\r\n"
-        L"• Time: 2025-09-25 1:48pm\r\n"
-        L"• Image: c:/users/subhajit/downloads/20191010_130927_1c.jpg";
+    g_displayResult = snapshot;
+    g_hasDisplayResult = true;
+    UpdateResultText(Widen(FormatResultText(snapshot)));
 
+    // Only the graph card needs repainting
+    InvalidateRect(hwnd, &graphRect, FALSE);
 
-    SetWindowTextW(hResultBox, result.c_str());
+    if (!snapshot.complete) return;
 
     // Enable buttons
+    EnableWindow(hAnalyzeBtn, TRUE);
     EnableWindow(hSaveBtn, TRUE);
     EnableWindow(hRestartBtn, TRUE);
+    InvalidateRect(hAnalyzeBtn, NULL, TRUE);
     InvalidateRect(hSaveBtn, NULL, TRUE);
     InvalidateRect(hRestartBtn, NULL, TRUE);
 
@@ -561,220 +967,483 @@ void DoAnalysis(HWND hwnd) {
     EnableWindow(hTagBtn, TRUE);
     InvalidateRect(hTagBtn, NULL, TRUE);
 
-    // Force repaint for graphs
-    InvalidateRect(hwnd, NULL, TRUE);
+    SetEvent(g_hAnalysisIdle);
 }
 
-void CreateGraphs() {
-    // In a real app you'd create bitmaps or files; here we simulate drawing during WM_PAINT
+// Replace only the part of the result box that changed, so a progress tick
+// does not re-layout the whole text or reset the scroll position.
+void UpdateResultText(const std::wstring& text) {
+    int length = GetWindowTextLengthW(hResultBox);
+    std::wstring current(length + 1, L'\0');
+    GetWindowTextW(hResultBox, &current[0], length + 1);
+    current.resize(length);
+    if (current == text) return;
+
+    size_t prefix = 0;
+    size_t maxPrefix = (std::min)(current.size(), text.size());
+    while (prefix < maxPrefix && current[prefix] == text[prefix]) prefix++;
+    size_t suffix = 0;
+    while (suffix < maxPrefix - prefix &&
+        current[current.size() - 1 - suffix] == text[text.size() - 1 - suffix]) suffix++;
+
+    int firstVisible = (int)SendMessageW(hResultBox, EM_GETFIRSTVISIBLELINE, 0, 0);
+    SendMessageW(hResultBox, WM_SETREDRAW, FALSE, 0);
+    SendMessageW(hResultBox, EM_SETSEL, (WPARAM)prefix, (LPARAM)(current.size() - suffix));
+    std::wstring replacement = text.substr(prefix, text.size() - prefix - suffix);
+    SendMessageW(hResultBox, EM_REPLACESEL, FALSE, (LPARAM)replacement.c_str());
+    SendMessageW(hResultBox, EM_SETSEL, 0, 0);
+    int scrolled = (int)SendMessageW(hResultBox, EM_GETFIRSTVISIBLELINE, 0, 0);
+    SendMessageW(hResultBox, EM_LINESCROLL, 0, firstVisible - scrolled);
+    SendMessageW(hResultBox, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(hResultBox, NULL, FALSE);
 }
 
-// Draw a single graph card content
-void DrawGraph(HDC hdc, int x, int y, int width, int height, const std::wstring& title) {
-    // Create memory DC
+// False while the previous export still runs; the result comes back as
+// WM_APP_EXPORT_DONE
+bool StartSurveyExport(HWND hwnd, const ExportRequest& request) {
+    return g_exportJob.Start(request, [hwnd](bool ok, const std::string& message) {
+        WPARAM status = ok ? (g_exportJob.Truncated() ? 2 : 1) : 0;
+        PostMessage(hwnd, WM_APP_EXPORT_DONE, status, (LPARAM)new std::string(message));
+    });
+}
+
+// ------------ Sample gallery ------------
+
+LRESULT CALLBACK GalleryProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+// Tagged samples from the store, newest first, one cell per image
+static void LoadGalleryItems() {
+    std::vector<SampleRecord> records;
+    std::string store = AppDataFile(L"samples.gess");
+    SampleStoreReader reader;
+    SampleRecord record;
+    if (!store.empty() && reader.Open(store)) {
+        while (reader.Next(record))
+            if (!record.imagePath.empty()) records.push_back(record);
+    }
+
+    g_galleryItems.clear();
+    std::unordered_set<std::string> seen;
+    for (auto it = records.rbegin(); it != records.rend(); ++it) {
+        if (!seen.insert(it->imagePath).second) continue;
+        GalleryItem item;
+        item.path = it->imagePath;
+        std::wstring path = Widen(it->imagePath);
+        item.name = path.substr(path.find_last_of(L"\\/") + 1);
+        wchar_t details[64];
+        swprintf(details, 64, L"d50 %.2f mm", it->d50Mm);
+        item.details = details;
+        if (!it->zone.empty()) item.details += L" \u00B7 " + Widen(it->zone);
+        g_galleryItems.push_back(item);
+    }
+}
+
+static int GalleryColumns(int clientWidth) {
+    return (std::max)(1, (clientWidth - 2 * GALLERY_MARGIN) / GALLERY_CELL_WIDTH);
+}
+
+static int GalleryContentHeight(int clientWidth) {
+    int columns = GalleryColumns(clientWidth);
+    int rows = ((int)g_galleryItems.size() + columns - 1) / columns;
+    return 2 * GALLERY_MARGIN + rows * GALLERY_CELL_HEIGHT;
+}
+
+static void UpdateGalleryScrollBar(HWND hwnd) {
+    RECT rc;
+    GetClientRect(hwnd, &rc);
+    int content = GalleryContentHeight(rc.right);
+    g_galleryScroll = (std::max)(0, (std::min)(g_galleryScroll, content - rc.bottom));
+
+    SCROLLINFO si = {};
+    si.cbSize = sizeof(si);
+    si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
+    si.nMin = 0;
+    si.nMax = content - 1;
+    si.nPage = rc.bottom;
+    si.nPos = g_galleryScroll;
+    SetScrollInfo(hwnd, SB_VERT, &si, TRUE);
+}
+
+// Moves what is already on screen and paints only the uncovered strip, so
+// scrolling costs one blit plus a row of cells
+static void ScrollGallery(HWND hwnd, int position) {
+    RECT rc;
+    GetClientRect(hwnd, &rc);
+    position = (std::max)(0, (std::min)(position, GalleryContentHeight(rc.right) - rc.bottom));
+    if (position == g_galleryScroll) return;
+    int delta = g_galleryScroll - position;
+    g_galleryScroll = position;
+    ScrollWindowEx(hwnd, 0, delta, NULL, NULL, NULL, NULL, SW_INVALIDATE);
+    SetScrollPos(hwnd, SB_VERT, position, TRUE);
+    UpdateWindow(hwnd);
+}
+
+static int GalleryHitTest(HWND hwnd, int x, int y) {
+    RECT rc;
+    GetClientRect(hwnd, &rc);
+    int cx = x - GALLERY_MARGIN, cy = y + g_galleryScroll - GALLERY_MARGIN;
+    if (cx < 0 || cy < 0) return -1;
+    int columns = GalleryColumns(rc.right);
+    int column = cx / GALLERY_CELL_WIDTH, row = cy / GALLERY_CELL_HEIGHT;
+    if (column >= columns) return -1;
+    int index = row * columns + column;
+    return index < (int)g_galleryItems.size() ? index : -1;
+}
+
+static void DrawGalleryCell(HDC hdc, const GalleryItem& item, const PixelImage* thumb, bool failed, bool selected,
+    int x, int y, std::vector<uint8_t>& bits) {
+    const int width = GALLERY_CELL_WIDTH - 12, height = GALLERY_CELL_HEIGHT - 12;
+    FillRoundedRect(hdc, x, y, width, height, 12, CARD_BG);
+    DrawRoundedRect(hdc, x, y, width, height, 12, selected ? ACCENT_COLOR : RGB(80, 80, 80));
+
+    HFONT smallFont = g_hHintFont ? g_hHintFont : g_hFont;
+    int tx = x + 6, ty = y + 6;
+    if (thumb) {
+        // 24-bit DIB rows are BGR, padded to 4 bytes
+        int stride = (thumb->width * 3 + 3) & ~3;
+        bits.assign((size_t)stride * thumb->height, 0);
+        for (int row = 0; row < thumb->height; row++) {
+            const uint8_t* src = thumb->Row(row);
+            uint8_t* dst = bits.data() + (size_t)row * stride;
+            for (int col = 0; col < thumb->width; col++) {
+                dst[3 * col + 0] = src[3 * col + 2];
+                dst[3 * col + 1] = src[3 * col + 1];
+                dst[3 * col + 2] = src[3 * col + 0];
+            }
+        }
+        BITMAPINFO bmi = {};
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = thumb->width;
+        bmi.bmiHeader.biHeight = -thumb->height;     // top-down
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 24;
+        bmi.bmiHeader.biCompression = BI_RGB;
+        SetDIBitsToDevice(hdc, tx + (GALLERY_THUMB_WIDTH - thumb->width) / 2, ty + (GALLERY_THUMB_HEIGHT - thumb->height) / 2,
+            thumb->width, thumb->height, 0, 0, 0, thumb->height, bits.data(), &bmi, DIB_RGB_COLORS);
+    }
+    else {
+        FillRoundedRect(hdc, tx, ty, GALLERY_THUMB_WIDTH, GALLERY_THUMB_HEIGHT, 8, GRAPH_BG);
+        HFONT hOld = (HFONT)SelectObject(hdc, smallFont);
+        SetTextColor(hdc, TEXT_SECONDARY);
+        RECT placeholder = { tx, ty, tx + GALLERY_THUMB_WIDTH, ty + GALLERY_THUMB_HEIGHT };
+        DrawText(hdc, failed ? L"No preview" : L"Loading...", -1, &placeholder, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
+        SelectObject(hdc, hOld);
+    }
+
+    HFONT hOld = (HFONT)SelectObject(hdc, g_hFont);
+    SetTextColor(hdc, TEXT_PRIMARY);
+    RECT nameRect = { x + 6, y + 130, x + width - 6, y + 150 };
+    DrawText(hdc, item.name.c_str(), -1, &nameRect, DT_LEFT | DT_SINGLELINE | DT_END_ELLIPSIS);
+    SelectObject(hdc, smallFont);
+    SetTextColor(hdc, TEXT_SECONDARY);
+    RECT detailsRect = { x + 6, y + 150, x + width - 6, y + 166 };
+    DrawText(hdc, item.details.c_str(), -1, &detailsRect, DT_LEFT | DT_SINGLELINE | DT_END_ELLIPSIS);
+    SelectObject(hdc, hOld);
+}
+
+// Paints from the thumbnail cache only; cells without a thumbnail show a
+// placeholder until WM_APP_THUMBNAIL_READY repaints them
+static void PaintGallery(HWND hwnd) {
+    PAINTSTRUCT ps;
+    HDC hdc = BeginPaint(hwnd, &ps);
+    RECT client;
+    GetClientRect(hwnd, &client);
+    RECT area = ps.rcPaint;
+    int width = area.right - area.left, height = area.bottom - area.top;
+    if (width <= 0 || height <= 0) {
+        EndPaint(hwnd, &ps);
+        return;
+    }
+
+    // Drawn off screen in client coordinates, then copied in one blit
     HDC hdcMem = CreateCompatibleDC(hdc);
     HBITMAP hbmMem = CreateCompatibleBitmap(hdc, width, height);
     HBITMAP hOldBmp = (HBITMAP)SelectObject(hdcMem, hbmMem);
+    SetViewportOrgEx(hdcMem, -area.left, -area.top, NULL);
+    HBRUSH background = CreateSolidBrush(DARK_BG);
+    FillRect(hdcMem, &area, background);
+    DeleteObject(background);
+    SetBkMode(hdcMem, TRANSPARENT);
+
+    if (g_galleryItems.empty()) {
+        HFONT hOld = (HFONT)SelectObject(hdcMem, g_hFont);
+        SetTextColor(hdcMem, TEXT_SECONDARY);
+        DrawText(hdcMem, L"No tagged samples yet. Samples appear here once they are tagged.", -1, &client,
+            DT_CENTER | DT_VCENTER | DT_SINGLELINE);
+        SelectObject(hdcMem, hOld);
+    }
+    else {
+        const int count = (int)g_galleryItems.size();
+        int columns = GalleryColumns(client.right);
+        int firstRow = (std::max)(0, (g_galleryScroll - GALLERY_MARGIN) / GALLERY_CELL_HEIGHT);
+        int lastRow = (g_galleryScroll + client.bottom - GALLERY_MARGIN) / GALLERY_CELL_HEIGHT;
+
+        // Rows just off screen first, so the visible ones end up at the
+        // front of the decode queue
+        for (int row : { lastRow + 2, lastRow + 1, firstRow - 1 }) {
+            for (int col = 0; col < columns && row >= 0; col++) {
+                int index = row * columns + col;
+                if (index < count) g_thumbnails->Get(g_galleryItems[index].path);
+            }
+        }
 
-    // Fill with graph background (black background like Python script)
-    HBRUSH brush = CreateSolidBrush(RGB(18, 18, 18)); // #121212
-    RECT rc = { 0, 0, width, height };
-    FillRect(hdcMem, &rc, brush);
-    DeleteObject(brush);
+        std::vector<uint8_t> bits;
+        for (int row = lastRow; row >= firstRow; row--) {
+            for (int col = columns - 1; col >= 0; col--) {
+                int index = row * columns + col;
+                if (index >= count) continue;
+                bool failed = false;
+                std::shared_ptr<const PixelImage> thumb = g_thumbnails->Get(g_galleryItems[index].path, &failed);
+                int x = GALLERY_MARGIN + col * GALLERY_CELL_WIDTH;
+                int y = GALLERY_MARGIN + row * GALLERY_CELL_HEIGHT - g_galleryScroll;
+                RECT cell = { x, y, x + GALLERY_CELL_WIDTH, y + GALLERY_CELL_HEIGHT }, overlap;
+                if (!IntersectRect(&overlap, &cell, &area)) continue;
+                DrawGalleryCell(hdcMem, g_galleryItems[index], thumb.get(), failed, index == g_gallerySelected, x, y, bits);
+            }
+        }
+    }
 
-    // Apply with alpha (simulated)
-    BLENDFUNCTION blend = { 0 };
-    blend.BlendOp = AC_SRC_OVER;
-    blend.SourceConstantAlpha = 230;
-    blend.AlphaFormat = 0;
-    AlphaBlend(hdc, x, y, width, height, hdcMem, 0, 0, width, height, blend);
+    BitBlt(hdc, area.left, area.top, width, height, hdcMem, area.left, area.top, SRCCOPY);
+    SelectObject(hdcMem, hOldBmp);
+    DeleteObject(hbmMem);
+    DeleteDC(hdcMem);
+    EndPaint(hwnd, &ps);
+}
 
-    // Draw border (grey like Python axes)
-    DrawRoundedRect(hdc, x, y, width, height, 10, RGB(170, 170, 170)); // #aaaaaa
+// Double-click: the sample goes to the main window, as if uploaded
+static void OpenGallerySample(int index) {
+    imagePath = Widen(g_galleryItems[index].path);
+    g_session.Image("gallery", g_galleryItems[index].path);
+    ShowImage(g_hMainWnd, imagePath);
+    EnableWindow(hAnalyzeBtn, TRUE);
+    SetWindowTextW(hResultBox, L"Image loaded from the gallery. Click 'Analyze' to process.");
+    InvalidateRect(hAnalyzeBtn, NULL, TRUE);
+    SetForegroundWindow(g_hMainWnd);
+}
 
-    // Title
-    SetTextColor(hdc, RGB(170, 170, 170)); // Grey text like Python
-    SetBkMode(hdc, TRANSPARENT);
-    HFONT hTitleF = CreateFontW(16, 0, 0, 0, FW_SEMIBOLD, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
-        OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
-    HFONT hOldFont = (HFONT)SelectObject(hdc, hTitleF);
-    RECT titleRect = { x, y + 10, x + width, y + 36 };
-    DrawText(hdc, title.c_str(), -1, &titleRect, DT_CENTER | DT_SINGLELINE);
-
-    // Graph area boundaries
-    int graphLeft = x + 60;
-    int graphRight = x + width - 30;
-    int graphTop = y + 50;
-    int graphBottom = y + height - 50;
-
-    // Draw grid lines (like Python's grid)
-    HPEN gridPen = CreatePen(PS_SOLID, 1, RGB(170, 170, 170)); // Grey grid
-    HPEN oldPen = (HPEN)SelectObject(hdc, gridPen);
-
-    // Horizontal grid lines
-    for (int i = 0; i <= 5; i++) {
-        int yPos = graphBottom - i * (graphBottom - graphTop) / 5;
-        MoveToEx(hdc, graphLeft, yPos, NULL);
-        LineTo(hdc, graphRight, yPos);
-    }
-
-    // Vertical grid lines
-    for (int i = 0; i <= 10; i++) {
-        int xPos = graphLeft + i * (graphRight - graphLeft) / 10;
-        MoveToEx(hdc, xPos, graphTop, NULL);
-        LineTo(hdc, xPos, graphBottom);
-    }
-
-    // Draw axes
-    HPEN axisPen = CreatePen(PS_SOLID, 2, RGB(170, 170, 170)); // Grey axes
-    SelectObject(hdc, axisPen);
-
-    MoveToEx(hdc, graphLeft, graphBottom, NULL);
-    LineTo(hdc, graphRight, graphBottom);
-    MoveToEx(hdc, graphLeft, graphTop, NULL);
-    LineTo(hdc, graphLeft, graphBottom);
-
-    if (title == L"Grain Size Distribution") {
-        // Data from Python script
-        double grainSizes[] = { 0.25, 0.30, 0.35, 0.40, 0.45, 0.50, 0.55, 0.60, 0.65, 0.70 };
-        int counts[] = { 5, 10, 20, 25, 20, 10, 5, 3, 2, 1 };
-
-        // Create emerald green brush for bars
-        HBRUSH barBrush = CreateSolidBrush(RGB(46, 204, 113)); // #2ecc71 - emerald green
-        HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, barBrush);
-        HPEN borderPen = CreatePen(PS_SOLID, 1, RGB(170, 170, 170)); // Grey border
-        HPEN oldBarPen = (HPEN)SelectObject(hdc, borderPen);
-
-        int barWidth = (graphRight - graphLeft) / 15; // Adjust bar width
-
-        // Find max count for scaling
-        int maxCount = 0;
-        for (int i = 0; i < 10; i++) {
-            if (counts[i] > maxCount) maxCount = counts[i];
-        }
+void OpenGallery(HWND owner) {
+    if (g_hGalleryWnd) {
+        ShowWindow(g_hGalleryWnd, SW_RESTORE);
+        SetForegroundWindow(g_hGalleryWnd);
+        return;
+    }
 
-        // Draw histogram bars
-        for (int i = 0; i < 10; i++) {
-            int barHeight = (int)((double)counts[i] / maxCount * (graphBottom - graphTop));
-            int barX = graphLeft + (int)((grainSizes[i] - 0.25) / 0.45 * (graphRight - graphLeft - barWidth));
-            int barY = graphBottom - barHeight;
+    // Thumbnails decode through GDI+; decode threads report through the
+    // main window, which lives as long as the cache
+    EnsureDeferredInit("GDI+ / image codecs");
+    if (!g_thumbnails) {
+        ThumbnailOptions options;
+        options.maxWidth = GALLERY_THUMB_WIDTH;
+        options.maxHeight = GALLERY_THUMB_HEIGHT;
+        options.packPath = AppDataFile(L"thumbnails.pack");
+        g_thumbnails.reset(new ThumbnailCache(options, [] {
+            if (!g_thumbnailRepaintPosted.exchange(true)) PostMessage(g_hMainWnd, WM_APP_THUMBNAIL_READY, 0, 0);
+        }));
+    }
+    LoadGalleryItems();
+    g_galleryScroll = 0;
+    g_gallerySelected = -1;
+
+    static bool registered = false;
+    if (!registered) {
+        WNDCLASSEX wc = {};
+        wc.cbSize = sizeof(WNDCLASSEX);
+        wc.style = CS_DBLCLKS;
+        wc.lpfnWndProc = GalleryProc;
+        wc.hInstance = hInst;
+        wc.lpszClassName = L"GrainEyeGalleryClass";
+        wc.hCursor = LoadCursor(NULL, IDC_ARROW);
+        wc.hbrBackground = NULL;
+        registered = RegisterClassEx(&wc) != 0;
+    }
+    g_hGalleryWnd = CreateWindowEx(0, L"GrainEyeGalleryClass", L"GrainEye - Sample Gallery",
+        WS_OVERLAPPEDWINDOW | WS_VSCROLL, CW_USEDEFAULT, CW_USEDEFAULT, 1000, 720, owner, NULL, hInst, NULL);
+    if (!g_hGalleryWnd) return;
+    EnableWindowEffects(g_hGalleryWnd);
+    UpdateGalleryScrollBar(g_hGalleryWnd);
+    ShowWindow(g_hGalleryWnd, SW_SHOW);
+}
 
-            Rectangle(hdc, barX, barY, barX + barWidth, graphBottom);
-        }
+// A newly tagged sample shows up in an open gallery
+void RefreshGallery() {
+    if (!g_hGalleryWnd) return;
+    LoadGalleryItems();
+    UpdateGalleryScrollBar(g_hGalleryWnd);
+    InvalidateRect(g_hGalleryWnd, NULL, FALSE);
+}
 
-        // Axis labels
-        HFONT lbl = CreateFontW(18, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
-            OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
-        HFONT oldLbl = (HFONT)SelectObject(hdc, lbl);
-        SetTextColor(hdc, RGB(170, 170, 170));
-
-        // X-axis label - FIXED CENTERING
-        RECT xAxisRect = { x, y + height - 65, x + width, y + height };  // Changed from -25 to -35
-        DrawText(hdc, L"Grain Size (mm)", -1, &xAxisRect, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
-
-        // Rotated Y label
-        LOGFONT lf;
-        GetObject(lbl, sizeof(LOGFONT), &lf);
-        lf.lfEscapement = 900;
-        HFONT vert = CreateFontIndirectW(&lf);
-        HFONT oldVert = (HFONT)SelectObject(hdc, vert);
-        RECT vertRect = { x + 1, y + height / 1.5 - 80, x + 108, y + height / 1.5 + 80 };
-        DrawText(hdc, L"Frequency", -1, &vertRect, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
-
-        // Clean up bar resources
-        SelectObject(hdc, oldBarPen);
-        DeleteObject(borderPen);
-        SelectObject(hdc, oldBrush);
-        DeleteObject(barBrush);
-        SelectObject(hdc, oldVert);
-        DeleteObject(vert);
-        SelectObject(hdc, oldLbl);
-        DeleteObject(lbl);
-    }
-    else if (title == L"Cumulative Grain Size Curve") {
-        // Data from Python script
-        double grainSizes[] = { 0.25, 0.30, 0.35, 0.40, 0.45, 0.50, 0.55, 0.60, 0.65, 0.70 };
-        int counts[] = { 5, 10, 20, 25, 20, 10, 5, 3, 2, 1 };
-
-        // Calculate cumulative percentages
-        double cumulativePercent[10];
-        int total = 0;
-        for (int i = 0; i < 10; i++) total += counts[i];
-
-        cumulativePercent[0] = (counts[0] * 100.0) / total;
-        for (int i = 1; i < 10; i++) {
-            cumulativePercent[i] = cumulativePercent[i - 1] + (counts[i] * 100.0) / total;
+LRESULT CALLBACK GalleryProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    switch (msg) {
+    case WM_SIZE:
+        UpdateGalleryScrollBar(hwnd);
+        InvalidateRect(hwnd, NULL, FALSE);
+        break;
+
+    case WM_VSCROLL: {
+        RECT rc;
+        GetClientRect(hwnd, &rc);
+        SCROLLINFO si = {};
+        si.cbSize = sizeof(si);
+        si.fMask = SIF_TRACKPOS;
+        GetScrollInfo(hwnd, SB_VERT, &si);
+        int position = g_galleryScroll;
+        switch (LOWORD(wParam)) {
+        case SB_LINEUP: position -= GALLERY_CELL_HEIGHT / 4; break;
+        case SB_LINEDOWN: position += GALLERY_CELL_HEIGHT / 4; break;
+        case SB_PAGEUP: position -= rc.bottom; break;
+        case SB_PAGEDOWN: position += rc.bottom; break;
+        case SB_THUMBTRACK:
+        case SB_THUMBPOSITION: position = si.nTrackPos; break;
+        case SB_TOP: position = 0; break;
+        case SB_BOTTOM: position = GalleryContentHeight(rc.right); break;
         }
+        ScrollGallery(hwnd, position);
+    }
+                  break;
 
-        // Draw line graph
-        HPEN graphPen = CreatePen(PS_SOLID, 3, RGB(46, 204, 113)); // Emerald green line
-        HPEN oldGraphPen = (HPEN)SelectObject(hdc, graphPen);
+    case WM_MOUSEWHEEL:
+        // Half a row per notch
+        ScrollGallery(hwnd, g_galleryScroll - GET_WHEEL_DELTA_WPARAM(wParam) * GALLERY_CELL_HEIGHT / (2 * WHEEL_DELTA));
+        break;
 
-        POINT points[10];
-        for (int i = 0; i < 10; i++) {
-            int xPos = graphLeft + (int)((grainSizes[i] - 0.25) / 0.45 * (graphRight - graphLeft));
-            int yPos = graphBottom - (int)(cumulativePercent[i] / 100.0 * (graphBottom - graphTop));
-            points[i] = { xPos, yPos };
+    case WM_LBUTTONDOWN: {
+        int index = GalleryHitTest(hwnd, (short)LOWORD(lParam), (short)HIWORD(lParam));
+        if (index != g_gallerySelected) {
+            g_gallerySelected = index;
+            InvalidateRect(hwnd, NULL, FALSE);
         }
-        Polyline(hdc, points, 10);
+    }
+                       break;
+
+    case WM_LBUTTONDBLCLK: {
+        int index = GalleryHitTest(hwnd, (short)LOWORD(lParam), (short)HIWORD(lParam));
+        if (index >= 0) OpenGallerySample(index);
+    }
+                         break;
+
+    case WM_PAINT:
+        PaintGallery(hwnd);
+        break;
+
+    case WM_ERASEBKGND:
+        return 1; // custom drawing
+
+    case WM_DESTROY:
+        g_hGalleryWnd = NULL;
+        if (g_thumbnails) g_thumbnails->ClearQueue();
+        break;
+
+    default:
+        return DefWindowProc(hwnd, msg, wParam, lParam);
+    }
+    return 0;
+}
 
-        // Draw data points as circles
-        HBRUSH pointBrush = CreateSolidBrush(RGB(46, 204, 113));
-        HBRUSH oldPointBrush = (HBRUSH)SelectObject(hdc, pointBrush);
-        HPEN pointPen = CreatePen(PS_SOLID, 2, RGB(46, 204, 113));
-        HPEN oldPointPen = (HPEN)SelectObject(hdc, pointPen);
+void CreateGraphs() {
+    // In a real app you'd create bitmaps or files; here we simulate drawing during WM_PAINT
+}
 
-        for (int i = 0; i < 10; i++) {
-            Ellipse(hdc, points[i].x - 4, points[i].y - 4, points[i].x + 4, points[i].y + 4);
+// PlotCanvas on a window DC; the graphs themselves are drawn by the shared
+// plotting code (Plot.cpp), which also renders headless reports
+class GdiCanvas : public PlotCanvas {
+public:
+    explicit GdiCanvas(HDC dc) : hdc(dc) {}
+
+    void FillRect(int x, int y, int width, int height, PlotColor color, uint8_t alpha) override {
+        HBRUSH brush = CreateSolidBrush(RGB(color.r, color.g, color.b));
+        if (alpha == 255) {
+            RECT rc = { x, y, x + width, y + height };
+            ::FillRect(hdc, &rc, brush);
+            DeleteObject(brush);
+            return;
         }
+        // Blend through a memory DC
+        HDC hdcMem = CreateCompatibleDC(hdc);
+        HBITMAP hbmMem = CreateCompatibleBitmap(hdc, width, height);
+        HBITMAP hOldBmp = (HBITMAP)SelectObject(hdcMem, hbmMem);
+        RECT rc = { 0, 0, width, height };
+        ::FillRect(hdcMem, &rc, brush);
+        DeleteObject(brush);
+
+        BLENDFUNCTION blend = { 0 };
+        blend.BlendOp = AC_SRC_OVER;
+        blend.SourceConstantAlpha = alpha;
+        blend.AlphaFormat = 0;
+        AlphaBlend(hdc, x, y, width, height, hdcMem, 0, 0, width, height, blend);
+
+        SelectObject(hdcMem, hOldBmp);
+        DeleteObject(hbmMem);
+        DeleteDC(hdcMem);
+    }
 
-        // Axis labels
-       // HFONT lbl = CreateFontW(12, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
-         //   OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
-        //HFONT oldLbl = (HFONT)SelectObject(hdc, lbl);
-       // SetTextColor(hdc, RGB(170, 170, 170));
-
-        HFONT lbl = CreateFontW(18, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
-           OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
-        HFONT oldLbl = (HFONT)SelectObject(hdc, lbl);
-        SetTextColor(hdc, RGB(170, 170, 170));
-
-        // X-axis label - RAISED POSITION
-        RECT xAxisRect = { x, y + height - 65, x + width, y + height };
-        DrawText(hdc, L"Grain Size (mm)", -1, &xAxisRect, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
-
-        // Rotated Y label - FIXED POSITIONING
-        LOGFONT lf;
-        GetObject(lbl, sizeof(LOGFONT), &lf);
-        lf.lfEscapement = 900; // 90 degrees rotation
-        HFONT vert = CreateFontIndirectW(&lf);
-        HFONT oldVert = (HFONT)SelectObject(hdc, vert);
-
-        RECT vertRect = { x + 5, y + height / 1 - 210, x + 159, y + height / 1 + 85 };
-        DrawText(hdc, L"Cumulative % Passing", -1, &vertRect, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
-        // Clean up line graph resources
-        SelectObject(hdc, oldVert);
-        DeleteObject(vert);
-        SelectObject(hdc, oldLbl);
-        DeleteObject(lbl);
-        SelectObject(hdc, oldPointPen);
-        DeleteObject(pointPen);
-        SelectObject(hdc, oldPointBrush);
-        DeleteObject(pointBrush);
-        SelectObject(hdc, oldGraphPen);
-        DeleteObject(graphPen);
+    void Rectangle(int x0, int y0, int x1, int y1, PlotColor fill, PlotColor border) override {
+        HBRUSH brush = CreateSolidBrush(RGB(fill.r, fill.g, fill.b));
+        HPEN pen = CreatePen(PS_SOLID, 1, RGB(border.r, border.g, border.b));
+        HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, brush);
+        HPEN oldPen = (HPEN)SelectObject(hdc, pen);
+        ::Rectangle(hdc, x0, y0, x1, y1);
+        SelectObject(hdc, oldPen);
+        SelectObject(hdc, oldBrush);
+        DeleteObject(pen);
+        DeleteObject(brush);
     }
 
-    // Clean up
-    SelectObject(hdc, oldPen);
-    DeleteObject(axisPen);
-    DeleteObject(gridPen);
+    void Line(int x0, int y0, int x1, int y1, int width, PlotColor color) override {
+        HPEN pen = CreatePen(PS_SOLID, width, RGB(color.r, color.g, color.b));
+        HPEN oldPen = (HPEN)SelectObject(hdc, pen);
+        MoveToEx(hdc, x0, y0, NULL);
+        LineTo(hdc, x1, y1);
+        SelectObject(hdc, oldPen);
+        DeleteObject(pen);
+    }
 
-    SelectObject(hdcMem, hOldBmp);
-    DeleteObject(hbmMem);
-    DeleteDC(hdcMem);
-    DeleteObject(hTitleF);
-    SelectObject(hdc, hOldFont);
+    void Polyline(const PlotPoint* points, size_t count, int width, PlotColor color) override {
+        std::vector<POINT> gdiPoints(count);
+        for (size_t i = 0; i < count; i++) gdiPoints[i] = { points[i].x, points[i].y };
+        HPEN pen = CreatePen(PS_SOLID, width, RGB(color.r, color.g, color.b));
+        HPEN oldPen = (HPEN)SelectObject(hdc, pen);
+        ::Polyline(hdc, gdiPoints.data(), (int)count);
+        SelectObject(hdc, oldPen);
+        DeleteObject(pen);
+    }
+
+    void Dot(int cx, int cy, int radius, PlotColor color) override {
+        HBRUSH brush = CreateSolidBrush(RGB(color.r, color.g, color.b));
+        HPEN pen = CreatePen(PS_SOLID, 2, RGB(color.r, color.g, color.b));
+        HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, brush);
+        HPEN oldPen = (HPEN)SelectObject(hdc, pen);
+        Ellipse(hdc, cx - radius, cy - radius, cx + radius, cy + radius);
+        SelectObject(hdc, oldPen);
+        SelectObject(hdc, oldBrush);
+        DeleteObject(pen);
+        DeleteObject(brush);
+    }
+
+    void RoundedFrame(int x, int y, int width, int height, int radius, PlotColor color) override {
+        DrawRoundedRect(hdc, x, y, width, height, radius, RGB(color.r, color.g, color.b));
+    }
+
+    void Text(const std::string& text, int x0, int y0, int x1, int y1, int size, PlotColor color, unsigned flags) override {
+        HFONT font = CreateFontW(size, 0, (flags & PLOT_TEXT_VERTICAL) ? 900 : 0, 0, (flags & PLOT_TEXT_BOLD) ? FW_SEMIBOLD : FW_NORMAL,
+            FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+        HFONT oldFont = (HFONT)SelectObject(hdc, font);
+        SetTextColor(hdc, RGB(color.r, color.g, color.b));
+        SetBkMode(hdc, TRANSPARENT);
+        RECT rc = { x0, y0, x1, y1 };
+        UINT format = DT_SINGLELINE | ((flags & PLOT_TEXT_CENTER) ? DT_CENTER : 0) | ((flags & PLOT_TEXT_VCENTER) ? DT_VCENTER : 0);
+        DrawTextW(hdc, Widen(text).c_str(), -1, &rc, format);
+        SelectObject(hdc, oldFont);
+        DeleteObject(font);
+    }
+
+private:
+    HDC hdc;
+};
+
+// Draw a single graph card content
+void DrawGraph(HDC hdc, int x, int y, int width, int height, GraphKind kind) {
+    GdiCanvas canvas(hdc);
+    DrawResultGraph(canvas, g_displayResult, kind, x, y, width, height);
 }
 // Draw modern-looking rounded rectangle border
 void DrawRoundedRect(HDC hdc, int x, int y, int width, int height, int radius, COLORREF color) {
@@ -889,7 +1558,16 @@ void DrawModernButton(HDC hdc, HWND hwnd, CustomButton& button, const wchar_t* t
 
     SelectObject(hdc, hOld);
 }
-// Register button into list
+// Button rectangle in its parent's client coordinates
+RECT ButtonRect(HWND button) {
+    RECT rc;
+    GetWindowRect(button, &rc);
+    MapWindowPoints(HWND_DESKTOP, GetParent(button), (POINT*)&rc, 2);
+    return rc;
+}
+
+// Register button into list. The window is not resizable, so the
+// rectangle is cached for hit-testing here.
 void RegisterButton(HWND hwnd, int cornerRadius, bool isAccent, bool alwaysGreen) {
     CustomButton btn;
     btn.hwnd = hwnd;
@@ -899,57 +1577,54 @@ void RegisterButton(HWND hwnd, int cornerRadius, bool isAccent, bool alwaysGreen
     btn.isAccent = isAccent;
     btn.alwaysGreen = alwaysGreen;
     customButtons.push_back(btn);
+
+    RECT rc = ButtonRect(hwnd);
+    g_hover.Add(rc.left, rc.top, rc.right, rc.bottom);
 }
 
-// Update hover/press state. hwnd param is main window handle.
+// Update hover/press state. hwnd param is main window handle. Hit-testing
+// uses the cached rectangles, so a mouse move costs no window manager calls
+// and only buttons whose look changed are repainted.
 void UpdateButtonState(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
-    POINT pt;
-    if (msg == WM_MOUSEMOVE || msg == WM_LBUTTONDOWN || msg == WM_LBUTTONUP) {
-        pt.x = LOWORD(lParam);
-        pt.y = HIWORD(lParam);
-    }
-    else {
-        return;
-    }
+    int x = (short)LOWORD(lParam);
+    int y = (short)HIWORD(lParam);
 
-    POINT screenPt = pt;
-    ClientToScreen(hwnd, &screenPt);
+    g_hoverChanged.clear();
+    switch (msg) {
+    case WM_MOUSEMOVE:
+        g_session.Move(x, y);
+        if (g_hover.Move(x, y, g_hoverChanged)) {
+            TRACKMOUSEEVENT tme = {};
+            tme.cbSize = sizeof(tme);
+            tme.dwFlags = TME_LEAVE;
+            tme.hwndTrack = hwnd;
+            TrackMouseEvent(&tme);
+        }
+        break;
 
-    for (auto& btn : customButtons) {
-        RECT rc;
-        GetWindowRect(btn.hwnd, &rc);
-        bool wasHovered = btn.isHovered;
-        bool wasPressed = btn.isPressed;
-
-        switch (msg) {
-        case WM_MOUSEMOVE:
-            btn.isHovered = PtInRect(&rc, screenPt);
-            if (btn.isHovered && !wasHovered) {
-                InvalidateRect(btn.hwnd, NULL, FALSE);
-                TRACKMOUSEEVENT tme = {};
-                tme.cbSize = sizeof(tme);
-                tme.dwFlags = TME_LEAVE;
-                tme.hwndTrack = hwnd;
-                TrackMouseEvent(&tme);
-            }
-            else if (!btn.isHovered && wasHovered) {
-                InvalidateRect(btn.hwnd, NULL, FALSE);
-            }
-            break;
+    case WM_LBUTTONDOWN:
+        g_session.Down(x, y);
+        g_hover.Press(x, y, g_hoverChanged);
+        break;
 
-        case WM_LBUTTONDOWN:
-            btn.isPressed = PtInRect(&rc, screenPt);
-            if (btn.isPressed != wasPressed) {
-                InvalidateRect(btn.hwnd, NULL, FALSE);
-            }
-            break;
+    case WM_LBUTTONUP:
+        g_session.Up(x, y);
+        g_hover.Release(g_hoverChanged);
+        break;
 
-        case WM_LBUTTONUP:
-            if (btn.isPressed) {
-                btn.isPressed = false;
-                InvalidateRect(btn.hwnd, NULL, FALSE);
-            }
-            break;
-        }
+    case WM_MOUSELEAVE:
+        g_session.Leave();
+        g_hover.Leave(g_hoverChanged);
+        break;
+
+    default:
+        return;
+    }
+
+    for (int index : g_hoverChanged) {
+        CustomButton& btn = customButtons[index];
+        btn.isHovered = g_hover.Hovered(index);
+        btn.isPressed = g_hover.Pressed(index);
+        InvalidateRect(btn.hwnd, NULL, FALSE);
     }
 }
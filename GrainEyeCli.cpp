@@ -0,0 +1,959 @@
+/*
+*****************************************************************************
+*   GrainEye - Command line client (Linux / Raspberry Pi)                     *
+*   ------------------------------------------------------------------------- *
+*   Headless front end for the analysis pipeline, used on the Pi until the   *
+*   Qt port lands.                                                           *
+*                                                                             *
+*   Usage:                                                                    *
+*     graineye-cli [OPTIONS] IMAGE...                                         *
+*     graineye-cli [OPTIONS] --watch DIR [--settle MS] [--queue N]            *
+*       OPTIONS: --cloud HOST:PORT[/PATH]  --model FILE                       *
+*                --scale MM_PER_PIXEL  --csv DIR                              *
+*                --survey [--cell M] [--shore DEG]   beach survey roll-up     *
+*                --store FILE   append every sample to a sample store        *
+*                --report OUT.pdf|OUT.png   one report page per sample       *
+*     graineye-cli --store FILE [--export-geojson OUT]                        *
+*         [--export-columnar OUT] [IMAGE...]                                  *
+*         stream the store to GeoJSON / the columnar format                   *
+*     graineye-cli --read-columnar FILE [--store FILE]                        *
+*         summarize a columnar export; compare it with the store if given    *
+*     graineye-cli --parse RESPONSE.json [--chunk N]                          *
+*     graineye-cli --check-parse                                              *
+*         built-in recorded responses, valid and malformed, at every chunking *
+*     graineye-cli --serve-replay RESPONSE.json [--port N] [--chunk N]        *
+*         [--delay MS]        local stand-in for the cloud model              *
+*     graineye-cli --bench-kernels [WxH]                                      *
+*         check every SIMD level against scalar and time the pixel kernels    *
+*     graineye-cli --pool-stress [--load N] [--phase-ms MS]                   *
+*         drive the adaptive worker pool through synthetic CPU load and       *
+*         slowed tasks (GRAINEYE_POOL=min:max sets the band)                  *
+*     graineye-cli --thumbs [--thumb-pack FILE] IMAGE...                      *
+*         scroll a gallery over the images through the thumbnail cache       *
+*     graineye-cli --model FILE --check-jpeg                                  *
+*         a JPEG the local decoders cannot read still gets a result          *
+*     graineye-cli [OPTIONS] --record SESSION.log IMAGE... | --watch DIR      *
+*         log the session for --replay                                        *
+*     graineye-cli --replay SESSION.log [--speed X|max] [--work-dir DIR]      *
+*         [--cloud ...] [--model FILE] [--scale MM_PER_PIXEL]                 *
+*         replay a recorded session headlessly, latency per stage             *
+*         (into a fresh temporary directory unless --work-dir names one)      *
+*****************************************************************************
+*/
+#include "Analysis.h"
+#include "CloudClient.h"
+#include "CsvExport.h"
+#include "FileUtil.h"
+#include "InferenceEngine.h"
+#include "PixelKernels.h"
+#include "Report.h"
+#include "ResultParser.h"
+#include "SampleStore.h"
+#include "SessionLog.h"
+#include "SurveyAggregate.h"
+#include "SurveyExport.h"
+#include "ThreadPool.h"
+#include "ThumbnailCache.h"
+#include "WatchFolder.h"
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const CloudEndpoint* g_cloud = nullptr;
+static const InferenceEngine* g_model = nullptr;
+static double g_mmPerPixel = 0.0;
+static std::string g_csvDir;
+static BeachSurvey* g_survey = nullptr;    // --survey: every analyzed sample joins it
+static std::string g_storePath;             // --store: every analyzed sample is appended
+static std::vector<AnalysisResult>* g_reportResults = nullptr;  // --report: samples for the report
+static SessionRecorder g_session;           // --record
+
+static void PrintUsage() {
+    std::fprintf(stderr,
+        "Usage: graineye-cli [OPTIONS] IMAGE...\n"
+        "       graineye-cli [OPTIONS] --watch DIR [--settle MS] [--queue N]\n"
+        "         OPTIONS: --cloud HOST:PORT[/PATH] --model FILE --scale MM_PER_PIXEL --csv DIR\n"
+        "                  --survey [--cell M] [--shore DEG] --store FILE --report OUT.pdf|OUT.png\n"
+        "       graineye-cli --store FILE [--export-geojson OUT] [--export-columnar OUT] [IMAGE...]\n"
+        "       graineye-cli --read-columnar FILE [--store FILE]\n"
+        "       graineye-cli --parse RESPONSE.json [--chunk N]\n"
+        "       graineye-cli --check-parse\n"
+        "       graineye-cli --serve-replay RESPONSE.json [--port N] [--chunk N] [--delay MS]\n"
+        "       graineye-cli --bench-kernels [WxH]\n"
+        "       graineye-cli --pool-stress [--load N] [--phase-ms MS]\n"
+        "       graineye-cli --thumbs [--thumb-pack FILE] IMAGE...\n"
+        "       graineye-cli --model FILE --check-jpeg\n"
+        "       graineye-cli [OPTIONS] --record SESSION.log IMAGE... | --watch DIR\n"
+        "       graineye-cli --replay SESSION.log [--speed X|max] [--work-dir DIR] [--cloud ...] [--model FILE]\n");
+}
+
+static void PrintResult(const AnalysisResult& result) {
+    std::string text = FormatResultText(result);
+    text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+    std::printf("%s\n", text.c_str());
+    if (result.grains.Size()) std::printf("\xE2\x80\xA2 Grains measured: %zu\n", result.grains.Size());
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+static void AnalyzeAndPrint(const std::string& path, const char* source = "file") {
+    g_session.Image(source, path);
+    g_session.Command("analyze");
+    AnalysisResult result;
+    AnalysisOptions options;
+    std::string error;
+    options.cloud = g_cloud;
+    options.model = g_model;
+    options.mmPerPixel = g_mmPerPixel;
+    options.error = &error;
+    if (!RunAnalysis(path, result, options)) {
+        std::fprintf(stderr, "graineye: cannot analyze %s%s%s\n", path.c_str(), error.empty() ? "" : ": ", error.c_str());
+        return;
+    }
+    PrintResult(result);
+    if (g_survey) g_survey->Add(result);
+    if (!g_storePath.empty() && !AppendSample(g_storePath, SampleRecord::FromResult(result), &error))
+        std::fprintf(stderr, "graineye: %s\n", error.c_str());
+    if (g_reportResults) {
+        g_reportResults->push_back(result);
+        g_reportResults->back().grains = GrainTable();      // pages need the summaries only
+    }
+
+    if (g_survey || !g_storePath.empty()) g_session.Command("tag");
+
+    if (!g_csvDir.empty()) {
+        g_session.Command("save");
+        std::string csvPath = g_csvDir + "/" + DefaultCsvFileName(result);
+        if (!WriteResultCsv(csvPath, result, &error)) std::fprintf(stderr, "graineye: %s\n", error.c_str());
+    }
+
+    PoolMetrics pool = AnalysisPool().Metrics();
+    if (pool.loops > 0) std::fprintf(stderr, "graineye: pool %s\n", FormatPoolMetrics(pool).c_str());
+}
+
+static bool ReadWholeFile(const std::string& path, std::vector<char>& data) {
+    FILE* f = OpenFile(path, "rb");
+    if (!f) return false;
+    char buf[65536];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    std::fclose(f);
+    return true;
+}
+
+static void PrintSurvey() {
+    std::string text = FormatSurveyReport(*g_survey);
+    text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+    std::printf("%s\n", text.c_str());
+    std::fflush(stdout);
+}
+
+// Renders the collected samples after the analysis, pages in parallel on the analysis pool
+static int RunReport(const std::string& outPath) {
+    ReportStats stats;
+    std::string error;
+    if (!WriteReport(*g_reportResults, outPath, ReportOptions(), &AnalysisPool(), &stats, &error)) {
+        std::fprintf(stderr, "graineye: report: %s\n", error.c_str());
+        return 1;
+    }
+    std::printf("report: %d page(s), %.1f MB in %.0f ms (%.1f pages/s, %d threads)\n", stats.pages, stats.bytes / 1e6,
+        stats.ms, stats.pages * 1000.0 / (std::max)(stats.ms, 1.0), AnalysisPool().WorkerCount() + 1);
+    return 0;
+}
+
+// Same background job as Save in the app; this thread just waits for it
+static int RunExport(const ExportRequest& request) {
+    std::atomic<bool> ok{ false };
+    std::string message;
+    ExportJob job;
+    auto start = std::chrono::steady_clock::now();
+    job.Start(request, [&](bool success, const std::string& text) {
+        ok = success;
+        message = text;
+    });
+    job.Wait();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::fprintf(ok ? stdout : stderr, "%s%s", ok ? "" : "graineye: ", message.c_str());
+    if (ok) std::printf("exported in %.0f ms\n", ms);
+    return ok ? 0 : 1;
+}
+
+// Reads a columnar export back; with a store, checks it row by row against it
+static int RunReadColumnar(const std::string& path, const std::string& storePath) {
+    ColumnarReader reader;
+    std::string error;
+    if (!reader.Open(path, &error)) {
+        std::fprintf(stderr, "graineye: %s\n", error.c_str());
+        return 1;
+    }
+    SampleStoreReader store;
+    if (!storePath.empty() && !store.Open(storePath, &error)) {
+        std::fprintf(stderr, "graineye: %s\n", error.c_str());
+        return 1;
+    }
+
+    SampleRecord r, expected;
+    unsigned long long rows = 0, located = 0, shaped = 0, mismatches = 0;
+    double d50Sum = 0.0;
+    int64_t first = 0, last = 0;
+    while (reader.Next(r)) {
+        if (rows++ == 0) first = r.time;
+        last = r.time;
+        located += r.hasLocation;
+        shaped += r.hasShape;
+        d50Sum += r.d50Mm;
+        if (storePath.empty()) continue;
+        if (!store.Next(expected)) { mismatches++; continue; }
+        bool same = r.time == expected.time && r.hasLocation == expected.hasLocation && r.hasShape == expected.hasShape &&
+            (!r.hasLocation || (std::fabs(r.latitude - expected.latitude) < 1e-7 && std::fabs(r.longitude - expected.longitude) < 1e-7)) &&
+            r.d10Mm == expected.d10Mm && r.d50Mm == expected.d50Mm && r.d90Mm == expected.d90Mm && r.meanMm == expected.meanMm &&
+            r.grainCount == expected.grainCount && r.roundness == expected.roundness && r.sphericity == expected.sphericity &&
+            r.zone == expected.zone && r.category == expected.category && r.beachType == expected.beachType &&
+            r.imagePath == expected.imagePath;
+        if (!same && mismatches++ < 5) std::printf("row %llu differs from the store\n", rows - 1);
+    }
+    bool ok = reader.Error().empty() && rows == reader.TotalRows();
+    if (!reader.Error().empty()) std::fprintf(stderr, "graineye: %s\n", reader.Error().c_str());
+    std::printf("%llu rows in %zu row groups (footer: %llu), %llu located, %llu with shape\n",
+        rows, reader.RowGroupCount(), reader.TotalRows(), located, shaped);
+    if (rows) std::printf("time %lld..%lld, mean D50 %.3f mm\n", (long long)first, (long long)last, d50Sum / rows);
+    if (!storePath.empty()) {
+        if (store.Next(expected)) mismatches++;     // store has more rows than the export
+        std::printf(mismatches ? "%llu rows differ from the store\n" : "matches the store\n", mismatches);
+        ok = ok && mismatches == 0;
+    }
+    return ok ? 0 : 1;
+}
+
+static int RunWatch(const WatchOptions& options, size_t queueCapacity) {
+    // Block SIGINT/SIGTERM in every thread; the main thread waits for them.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    SampleQueue queue(queueCapacity);
+    WatchFolder watcher;
+    std::string error;
+    if (!watcher.Start(options, &queue, &error)) {
+        std::fprintf(stderr, "graineye: %s\n", error.c_str());
+        return 1;
+    }
+    std::fprintf(stderr, "graineye: watching %s (Ctrl+C to stop)\n", options.directory.c_str());
+
+    std::thread consumer([&queue] {
+        std::string path;
+        while (queue.Pop(path)) AnalyzeAndPrint(path, "watch");
+    });
+
+    int sig = 0;
+    sigwait(&signals, &sig);
+    watcher.Stop();
+    consumer.join();
+    if (g_survey) PrintSurvey();
+
+    if (watcher.OverflowCount())
+        std::fprintf(stderr, "graineye: %llu event overflow(s), folder listed again each time\n", watcher.OverflowCount());
+    return 0;
+}
+
+// Parse a recorded response offline, `chunk` bytes at a time.
+static int RunParse(const std::string& path, size_t chunk) {
+    std::vector<char> data;
+    if (!ReadWholeFile(path, data)) {
+        std::fprintf(stderr, "graineye: cannot read %s\n", path.c_str());
+        return 1;
+    }
+    AnalysisResult result;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!ParseCloudResponse(data.data(), data.size(), chunk, result, &error)) {
+        std::fprintf(stderr, "graineye: %s: %s\n", path.c_str(), error.c_str());
+        return 1;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.imagePath = path;
+    PrintResult(result);
+    std::fprintf(stderr, "graineye: parsed %zu bytes in %.2f ms (%.1f MB/s)\n",
+        data.size(), ms, ms > 0 ? data.size() / 1e3 / ms : 0.0);
+    return 0;
+}
+
+// Recorded responses: one well-formed, the rest with values a broken or
+// hostile server could send. Each must parse to the same outcome however
+// the network splits it.
+struct ParseFixture {
+    const char* name;
+    const char* json;
+    const char* error;          // nullptr: must parse
+};
+
+static const ParseFixture PARSE_FIXTURES[] = {
+    { "valid",
+      R"({"status":"ok","classification":{"beach_zone":"Intertidal Zone","category":"Medium Sand"},)"
+      R"("statistics":{"d10_mm":0.26,"d50_mm":0.43,"d90_mm":0.7,"mean_mm":0.43,"grain_count":3},)"
+      R"("histogram":{"sizes_mm":[0.25,0.3],"counts":[5,10]},)"
+      R"("grains":{"diameter_mm":[0.31,0.42,0.55],"x_px":[10.5,200,3000],"y_px":[4,80.25,1999]}})", nullptr },
+    { "huge bin count",
+      R"({"status":"ok","histogram":{"sizes_mm":[0.25,0.3],"counts":[5,1e300]}})", "histogram count out of range" },
+    { "count above int",
+      R"({"status":"ok","histogram":{"sizes_mm":[0.25],"counts":[4294967296]}})", "histogram count out of range" },
+    { "negative bin count",
+      R"({"status":"ok","histogram":{"sizes_mm":[0.25],"counts":[-3]}})", "histogram count out of range" },
+    { "huge bin size",
+      R"({"status":"ok","histogram":{"sizes_mm":[1e300],"counts":[1]}})", "histogram size out of range" },
+    { "huge diameter",
+      R"({"status":"ok","grains":{"diameter_mm":[0.3,1e300],"x_px":[1,2],"y_px":[1,2]}})", "grain diameter out of range" },
+    { "huge x",
+      R"({"status":"ok","grains":{"diameter_mm":[0.3],"x_px":[-1e39],"y_px":[1]}})", "grain position out of range" },
+    { "huge y",
+      R"({"status":"ok","grains":{"diameter_mm":[0.3],"x_px":[1],"y_px":[3.5e38]}})", "grain position out of range" },
+    { "huge grain count",
+      R"({"status":"ok","statistics":{"grain_count":1e300}})", "statistic out of range" },
+    { "huge d50",
+      R"({"status":"ok","statistics":{"d50_mm":1e300}})", "statistic out of range" },
+    { "number overflow",
+      R"({"status":"ok","statistics":{"d50_mm":1e400}})", "statistics must be numbers" },
+};
+
+static int RunCheckParse() {
+    const size_t chunks[] = { 1, 2, 3, 7, 64, 0 };
+    int failures = 0;
+    for (const ParseFixture& fixture : PARSE_FIXTURES) {
+        size_t size = std::strlen(fixture.json);
+        std::string outcome;
+        bool consistent = true;
+        for (size_t chunk : chunks) {
+            AnalysisResult result;
+            std::string error;
+            bool ok = ParseCloudResponse(fixture.json, size, chunk, result, &error);
+            std::string got = ok ? std::string("ok") : error;
+            bool expected = fixture.error ? !ok && got.find(fixture.error) != std::string::npos : ok;
+            if (!expected) consistent = false;
+            if (outcome.empty() || !expected) outcome = got;
+        }
+        std::printf("%-20s %-6s %s\n", fixture.name, consistent ? "ok" : "FAILED", outcome.c_str());
+        failures += !consistent;
+    }
+    std::printf(failures ? "%d fixture(s) failed\n" : "all fixtures parsed as expected\n", failures);
+    return failures ? 1 : 0;
+}
+
+// Stand-in for the cloud model: answers every request on 127.0.0.1:port
+// with the recorded response, sent chunked in odd-sized pieces so that
+// tokens straddle network buffers the way they do on a real link.
+static int RunServeReplay(const std::string& path, int port, size_t chunk, int delayMs) {
+    std::vector<char> body;
+    if (!ReadWholeFile(path, body)) {
+        std::fprintf(stderr, "graineye: cannot read %s\n", path.c_str());
+        return 1;
+    }
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0) {
+        std::fprintf(stderr, "graineye: cannot listen on port %d\n", port);
+        close(listener);
+        return 1;
+    }
+    std::fprintf(stderr, "graineye: replaying %s on 127.0.0.1:%d\n", path.c_str(), port);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) continue;
+
+        // Read and discard the request (headers + Content-Length body)
+        std::string request;
+        char buf[65536];
+        size_t headerEnd = std::string::npos;
+        long long remaining = -1;
+        for (;;) {
+            ssize_t n = recv(client, buf, sizeof(buf), 0);
+            if (n <= 0) break;
+            if (headerEnd == std::string::npos) {
+                request.append(buf, (size_t)n);
+                headerEnd = request.find("\r\n\r\n");
+                if (headerEnd == std::string::npos) continue;
+                const char* cl = strcasestr(request.c_str(), "\r\nContent-Length:");
+                remaining = cl ? std::atoll(cl + 17) : 0;
+                remaining -= (long long)(request.size() - headerEnd - 4);
+            }
+            else {
+                remaining -= n;
+            }
+            if (remaining <= 0) break;
+        }
+
+        std::string header = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+            "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n";
+        bool ok = send(client, header.data(), header.size(), 0) == (ssize_t)header.size();
+        size_t offset = 0;
+        for (int piece = 0; ok && offset < body.size(); piece++) {
+            size_t n = chunk + (size_t)(piece % 7) * 13;     // vary sizes to move the boundaries around
+            if (n > body.size() - offset) n = body.size() - offset;
+            char size[32];
+            int len = std::snprintf(size, sizeof(size), "%zx\r\n", n);
+            ok = send(client, size, (size_t)len, 0) == len &&
+                send(client, body.data() + offset, n, 0) == (ssize_t)n &&
+                send(client, "\r\n", 2, 0) == 2;
+            offset += n;
+            if (delayMs > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+        }
+        if (ok) send(client, "0\r\n\r\n", 5, 0);
+        close(client);
+        std::fprintf(stderr, "graineye: served %zu bytes\n", offset);
+    }
+}
+
+// Run every pixel kernel at every SIMD level this CPU has, check the
+// output against the scalar reference and report throughput (best of 5).
+// Odd sizes keep the scalar tails of the vector loops covered.
+static int RunBenchKernels(int width, int height) {
+    PixelImage rgb;
+    rgb.width = width;
+    rgb.height = height;
+    rgb.rgb.resize((size_t)width * height * 3);
+    uint32_t seed = 12345;
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = rgb.rgb.data() + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            int noise = (int)(seed >> 26) - 32;     // sand-like texture over a gradient
+            for (int c = 0; c < 3; c++)
+                row[3 * x + c] = (uint8_t)std::min(std::max((x * (c + 1) + y * (3 - c)) % 256 + noise, 0), 255);
+        }
+    }
+
+    struct Outputs {
+        GrayImage luma, box, gauss, mask, halfGray;
+        PixelImage lab, halfRgb;
+    };
+    struct Stage {
+        const char* name;
+        void (*run)(const PixelImage&, Outputs&, const PixelKernelTable*);
+    };
+    const Stage stages[] = {
+        { "luma", [](const PixelImage& in, Outputs& o, const PixelKernelTable* t) { ConvertToLuma(in, o.luma, t); } },
+        { "lab", [](const PixelImage& in, Outputs& o, const PixelKernelTable* t) { ConvertToLab(in, o.lab, t); } },
+        { "box r=7", [](const PixelImage&, Outputs& o, const PixelKernelTable* t) { BoxBlur(o.luma, 7, o.box, t); } },
+        { "gauss s=2", [](const PixelImage&, Outputs& o, const PixelKernelTable* t) { GaussianBlur(o.luma, 2.0f, o.gauss, t); } },
+        { "threshold", [](const PixelImage&, Outputs& o, const PixelKernelTable* t) { AdaptiveThreshold(o.luma, 15, 4, true, o.mask, t); } },
+        { "half rgb", [](const PixelImage& in, Outputs& o, const PixelKernelTable* t) { DownscaleHalf(in, o.halfRgb, t); } },
+        { "half gray", [](const PixelImage&, Outputs& o, const PixelKernelTable* t) { DownscaleHalf(o.luma, o.halfGray, t); } },
+    };
+
+    const PixelKernelTable* scalar = PixelKernelsFor(SimdLevel::Scalar);
+    Outputs reference;
+    for (const auto& stage : stages) stage.run(rgb, reference, scalar);
+
+    auto maxDiff = [](const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+        if (a.size() != b.size()) return 256;
+        int diff = 0;
+        for (size_t i = 0; i < a.size(); i++) diff = std::max(diff, std::abs((int)a[i] - (int)b[i]));
+        return diff;
+    };
+
+    const double megapixels = (double)width * height / 1e6;
+    std::printf("%dx%d, active level %s\n%-10s", width, height, SimdLevelName(ActiveSimdLevel()), "MP/s");
+    for (const auto& stage : stages) std::printf(" %10s", stage.name);
+    std::printf("\n");
+
+    bool ok = true;
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE4, SimdLevel::AVX2, SimdLevel::NEON }) {
+        const PixelKernelTable* table = PixelKernelsFor(level);
+        if (!table) continue;
+        Outputs out;
+        std::printf("%-10s", SimdLevelName(level));
+        for (const auto& stage : stages) {
+            double best = 1e30;
+            for (int run = 0; run < 5; run++) {
+                auto start = std::chrono::steady_clock::now();
+                stage.run(rgb, out, table);
+                best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+            std::printf(" %10.1f", best > 0 ? megapixels / best : 0.0);
+        }
+        std::printf("\n");
+
+        struct Check { const char* name; const std::vector<uint8_t>& got; const std::vector<uint8_t>& want; int tolerance; };
+        const Check checks[] = {
+            { "luma", out.luma.pixels, reference.luma.pixels, 0 },
+            { "lab", out.lab.rgb, reference.lab.rgb, 1 },
+            { "box", out.box.pixels, reference.box.pixels, 0 },
+            { "gauss", out.gauss.pixels, reference.gauss.pixels, 0 },
+            { "threshold", out.mask.pixels, reference.mask.pixels, 0 },
+            { "half rgb", out.halfRgb.rgb, reference.halfRgb.rgb, 0 },
+            { "half gray", out.halfGray.pixels, reference.halfGray.pixels, 0 },
+        };
+        for (const auto& check : checks) {
+            int diff = maxDiff(check.got, check.want);
+            if (diff > check.tolerance) {
+                std::fprintf(stderr, "graineye: %s %s differs from scalar by %d\n", SimdLevelName(level), check.name, diff);
+                ok = false;
+            }
+        }
+    }
+    std::printf(ok ? "all levels match scalar\n" : "MISMATCH\n");
+    return ok ? 0 : 1;
+}
+
+// Fixed amount of arithmetic; takes longer when the core is slowed or shared.
+static double SpinWork(long long iterations) {
+    volatile double x = 1.0;
+    for (long long i = 0; i < iterations; i++) x = x * 1.0000001 + 1e-9;
+    return x;
+}
+
+// Runs back-to-back parallel loops through phases of synthetic background
+// load and artificially slowed tasks, printing every pool decision. With
+// enough cores for the band plus one, also checks that the pool shrinks
+// under load and slow tasks and grows back afterwards.
+static int RunPoolStress(int loadThreads, int phaseMs) {
+    int minWorkers = 0, maxWorkers = 0;
+    {
+        ThreadPool probe;
+        PoolMetrics band = probe.Metrics();
+        minWorkers = band.minWorkers;
+        maxWorkers = band.maxWorkers;
+    }
+    const int cores = GetCpuFeatures().logicalCores;
+    if (maxWorkers == 0) {
+        minWorkers = 1;
+        maxWorkers = 3;
+        std::printf("%d core(s): default band is empty, using %d..%d\n", cores, minWorkers, maxWorkers);
+    }
+    if (loadThreads < 0) loadThreads = cores;
+    ThreadPool pool(minWorkers, maxWorkers);
+
+    // About 200 us per range on an unloaded core
+    auto start = std::chrono::steady_clock::now();
+    SpinWork(1000000);
+    double nsPerIteration = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 1e6;
+    const long long rangeIterations = (long long)(200e3 / std::max(nsPerIteration, 0.01));
+
+    struct Phase {
+        const char* name;
+        int load;           // background spinning threads
+        int slowdown;       // task cost multiplier
+        int expect;         // -1 shrink, +1 grow (unless already at the limit), 0 anything
+    };
+    const Phase phases[] = {
+        { "warm-up", 0, 1, 0 },
+        { "background load", loadThreads, 1, -1 },
+        { "load removed", 0, 1, +1 },
+        { "tasks slowed x3", 0, 3, -1 },
+        { "tasks back to normal", 0, 1, +1 },
+    };
+    const bool checked = cores >= maxWorkers + 2;
+    bool ok = true;
+    auto begin = std::chrono::steady_clock::now();
+    auto seconds = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); };
+
+    for (const auto& phase : phases) {
+        std::atomic<bool> stopLoad{ false };
+        std::vector<std::thread> load;
+        for (int i = 0; i < phase.load; i++)
+            load.emplace_back([&] { while (!stopLoad.load(std::memory_order_relaxed)) SpinWork(10000); });
+
+        PoolMetrics before = pool.Metrics();
+        std::printf("%7.2fs  %s (%d load threads, tasks x%d), workers %d\n",
+            seconds(), phase.name, phase.load, phase.slowdown, before.activeWorkers);
+        std::string lastDecision = before.lastDecision;
+        auto phaseEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(phaseMs);
+        while (std::chrono::steady_clock::now() < phaseEnd) {
+            pool.ParallelFor(64, 1, [&](size_t, size_t) { SpinWork(rangeIterations * phase.slowdown); });
+            PoolMetrics now = pool.Metrics();
+            if (now.lastDecision != lastDecision) {
+                lastDecision = now.lastDecision;
+                std::printf("%7.2fs    %s\n", seconds(), lastDecision.c_str());
+            }
+        }
+        stopLoad = true;
+        for (auto& t : load) t.join();
+
+        PoolMetrics after = pool.Metrics();
+        std::printf("%7.2fs    %s\n", seconds(), FormatPoolMetrics(after).c_str());
+        if (checked && phase.expect < 0 && before.activeWorkers > minWorkers && after.shrinks == before.shrinks) {
+            std::printf("    expected the pool to shrink\n");
+            ok = false;
+        }
+        if (checked && phase.expect > 0 && before.activeWorkers < maxWorkers && after.grows == before.grows) {
+            std::printf("    expected the pool to grow\n");
+            ok = false;
+        }
+    }
+    if (!checked) std::printf("checks skipped: need %d cores for band %d..%d plus one, have %d\n", maxWorkers + 2, minWorkers, maxWorkers, cores);
+    else std::printf(ok ? "pool adapted as expected\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
+
+// Mean absolute difference per channel; -1 if the sizes differ
+static double ThumbnailDifference(const PixelImage& a, const PixelImage& b) {
+    if (a.width != b.width || a.height != b.height || a.rgb.empty()) return -1.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < a.rgb.size(); i++) sum += std::abs((int)a.rgb[i] - (int)b.rgb[i]);
+    return sum / a.rgb.size();
+}
+
+// Writes a smooth 1001 x 777 pattern (odd sizes, so every halving drops a
+// row and a column) as PPM or bottom-up BMP. The full decode must give the
+// pattern back exactly, the reduced one nearly the same thumbnail.
+static bool CheckReducedDecode(const char* extension) {
+    const int width = 1001, height = 777;
+    PixelImage pattern;
+    pattern.width = width;
+    pattern.height = height;
+    pattern.rgb.resize((size_t)width * height * 3);
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = pattern.rgb.data() + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            row[3 * x + 0] = (uint8_t)(x * 255 / (width - 1));
+            row[3 * x + 1] = (uint8_t)(y * 255 / (height - 1));
+            row[3 * x + 2] = (uint8_t)(128.0 + 100.0 * std::sin(x / 37.0) * std::cos(y / 23.0));
+        }
+    }
+
+    std::vector<uint8_t> file;
+    bool bmp = !std::strcmp(extension, ".bmp");
+    if (bmp) {
+        size_t stride = ((size_t)width * 3 + 3) & ~(size_t)3;
+        file.assign(54 + stride * height, 0);
+        auto put32 = [&file](size_t at, uint32_t value) { for (int i = 0; i < 4; i++) file[at + i] = (uint8_t)(value >> (8 * i)); };
+        file[0] = 'B';
+        file[1] = 'M';
+        put32(2, (uint32_t)file.size());
+        put32(10, 54);
+        put32(14, 40);
+        put32(18, width);
+        put32(22, height);          // positive: bottom-up
+        file[26] = 1;
+        file[28] = 24;
+        for (int y = 0; y < height; y++) {
+            const uint8_t* src = pattern.Row(height - 1 - y);
+            uint8_t* dst = file.data() + 54 + stride * y;
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = src[3 * x + 2];
+                dst[3 * x + 1] = src[3 * x + 1];
+                dst[3 * x + 2] = src[3 * x + 0];
+            }
+        }
+    }
+    else {
+        char header[32];
+        int length = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+        file.assign(header, header + length);
+        file.insert(file.end(), pattern.rgb.begin(), pattern.rgb.end());
+    }
+
+    char path[] = "/tmp/graineye-pattern-XXXXXX.xxx";
+    std::memcpy(path + std::strlen(path) - 4, extension, 4);
+    int fd = mkstemps(path, 4);
+    if (fd < 0) {
+        std::fprintf(stderr, "graineye: cannot create a test image: %s\n", std::strerror(errno));
+        return false;
+    }
+    bool written = write(fd, file.data(), file.size()) == (ssize_t)file.size();
+    close(fd);
+
+    PixelImage full, reduced, expected, fromReduced;
+    bool decoded = written && LoadPixelImage(path, full) && LoadPixelImageReduced(path, 160, reduced);
+    unlink(path);
+    MakeThumbnail(pattern, 160, 120, expected);
+    MakeThumbnail(reduced, 160, 120, fromReduced);
+    double diff = decoded ? ThumbnailDifference(expected, fromReduced) : -1.0;
+    bool ok = decoded && full.width == width && full.height == height && full.rgb == pattern.rgb && diff >= 0.0 && diff < 1.0;
+    std::printf("reduced decode check (%s pattern %dx%d -> %dx%d): mean difference %.2f, %s\n", extension + 1,
+        width, height, reduced.width, reduced.height, diff, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Gallery scrolling through the thumbnail cache: a window of 24 samples
+// (6 x 4 cells) moves down the list at 60 frames per second and asks for
+// its thumbnails every frame, as the gallery's WM_PAINT does. Reports the
+// cost of each frame's lookups, how much of the window had thumbnails and
+// how the decode threads kept up; a second pass scrolls again once all
+// thumbnails exist. Run twice with the same pack to see a later session
+// served from it.
+static int RunThumbs(const std::vector<std::string>& images, const std::string& packPath) {
+    ThumbnailOptions options;
+    options.packPath = packPath;
+
+    // Reduced decode against a full decode of the first image (for
+    // information: on fine texture the two thumbnails legitimately differ,
+    // as a thumbnail pixel's edge cuts through reduced pixels)
+    PixelImage full, reduced, fromFull, fromReduced;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!LoadPixelImage(images[0], full, &error)) {
+        std::fprintf(stderr, "graineye: %s\n", error.c_str());
+        return 1;
+    }
+    double fullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    LoadPixelImageReduced(images[0], std::max(options.maxWidth, options.maxHeight), reduced, &error);
+    double reducedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    MakeThumbnail(full, options.maxWidth, options.maxHeight, fromFull);
+    MakeThumbnail(reduced, options.maxWidth, options.maxHeight, fromReduced);
+    std::printf("%s: %dx%d full decode %.1f ms, reduced %dx%d %.1f ms; thumbnail %dx%d, mean difference %.2f\n",
+        images[0].c_str(), full.width, full.height, fullMs, reduced.width, reduced.height, reducedMs,
+        fromReduced.width, fromReduced.height, ThumbnailDifference(fromFull, fromReduced));
+    full = PixelImage();
+
+    // The check itself runs on smooth patterns, where both must agree
+    bool ok = CheckReducedDecode(".ppm") && CheckReducedDecode(".bmp");
+
+    ThumbnailCache cache(options);
+    const size_t visible = 24, step = 3;
+    const auto frame = std::chrono::microseconds(16667);
+    auto scroll = [&](const char* name) {
+        std::vector<double> lookupUs;
+        size_t cells = 0, shown = 0;
+        auto next = std::chrono::steady_clock::now();
+        for (size_t first = 0;; first += step) {
+            size_t last = std::min(first + visible, images.size());
+            auto begin = std::chrono::steady_clock::now();
+            for (size_t i = first; i < last; i++) {
+                cells++;
+                if (cache.Get(images[i])) shown++;
+            }
+            lookupUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+            if (last == images.size()) break;
+            next += frame;
+            std::this_thread::sleep_until(next);
+        }
+        std::sort(lookupUs.begin(), lookupUs.end());
+        std::printf("%-5s %zu frames, lookups per frame p50 %.1f us, p99 %.1f us, max %.1f us; %.1f%% of cells had a thumbnail\n",
+            name, lookupUs.size(), lookupUs[lookupUs.size() / 2], lookupUs[lookupUs.size() * 99 / 100], lookupUs.back(),
+            100.0 * shown / std::max<size_t>(1, cells));
+    };
+
+    scroll("cold");
+    // Everything the scroll left behind, a queue's worth at a time
+    for (size_t i = 0; i < images.size(); i++) {
+        cache.Get(images[i]);
+        if ((i + 1) % options.queueLimit == 0) cache.WaitIdle();
+    }
+    cache.WaitIdle();
+    scroll("warm");
+    cache.WaitIdle();
+
+    ThumbnailStats stats = cache.Stats();
+    std::printf("decoded %lld (%.1f ms each), from pack %lld (%.2f ms each), unreadable %lld, dropped requests %lld\n",
+        stats.decodes, stats.decodes ? stats.decodeMs / stats.decodes : 0.0,
+        stats.packHits, stats.packHits ? stats.packReadMs / stats.packHits : 0.0, stats.failures, stats.dropped);
+    std::printf("memory %zu thumbnails, %.1f of %.1f MB, %lld evicted; pack %zu thumbnails, %.1f MB\n",
+        stats.entries, stats.memoryBytes / 1048576.0, options.memoryBytes / 1048576.0, stats.evictions,
+        stats.packEntries, stats.packBytes / 1048576.0);
+    if (stats.memoryBytes > options.memoryBytes && stats.entries > 1) ok = false;
+    std::printf(ok ? "thumbnail cache OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
+
+// Camera and phone JPEGs cannot be decoded here (BMP/PNM only); with a
+// model loaded they must still be analyzed, without the classify step.
+static int RunCheckJpeg() {
+    static const unsigned char JPEG_STUB[] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00,
+        0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0xFF, 0xD9,
+    };
+    char path[] = "/tmp/graineye-check-XXXXXX.jpg";
+    int fd = mkstemps(path, 4);
+    if (fd < 0) {
+        std::fprintf(stderr, "graineye: cannot create a test image: %s\n", std::strerror(errno));
+        return 1;
+    }
+    bool written = write(fd, JPEG_STUB, sizeof(JPEG_STUB)) == (ssize_t)sizeof(JPEG_STUB);
+    close(fd);
+
+    AnalysisResult result;
+    AnalysisOptions options;
+    std::string error;
+    options.model = g_model;
+    options.mmPerPixel = g_mmPerPixel;
+    options.error = &error;
+    bool analyzed = written && IsSupportedImageFile(path) && RunAnalysis(path, result, options);
+    unlink(path);
+
+    bool ok = analyzed && result.complete && result.grainCount >= 0;
+    std::printf("model: %s\n", g_model ? "loaded" : "none");
+    std::printf("jpeg: %s%s%s\n", ok ? "analyzed" : "FAILED", error.empty() ? "" : ": ", error.c_str());
+    if (analyzed) std::printf("classified by: %s\n", result.classifier.c_str());
+    return ok ? 0 : 1;
+}
+
+static int RunSessionReplay(const std::string& path, double speed, std::string workDir) {
+    std::vector<SessionEvent> events;
+    std::string error;
+    if (!ReadSessionLog(path, events, &error)) {
+        std::fprintf(stderr, "graineye: %s\n", error.c_str());
+        return 1;
+    }
+    if (workDir.empty()) {
+        char scratch[] = "/tmp/graineye-replay-XXXXXX";
+        if (!mkdtemp(scratch)) {
+            std::fprintf(stderr, "graineye: cannot create a work directory: %s\n", std::strerror(errno));
+            return 1;
+        }
+        workDir = scratch;
+    }
+
+    ReplayOptions options;
+    options.speed = speed;
+    options.workDir = workDir;
+    options.cloud = g_cloud;
+    options.model = g_model;
+    options.mmPerPixel = g_mmPerPixel;
+    ReplayReport report;
+    if (!ReplaySession(events, options, report, &error)) {
+        std::fprintf(stderr, "graineye: %s\n", error.c_str());
+        return 1;
+    }
+    std::printf("%s", FormatReplayReport(report).c_str());
+    std::fprintf(stderr, "graineye: replay output in %s\n", workDir.c_str());
+    return report.failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    WatchOptions watch;
+    size_t queueCapacity = 8;
+    std::vector<std::string> images;
+    CloudEndpoint cloud;
+    std::string parseFile, replayFile, modelFile;
+    std::string geoJsonOut, columnarOut, columnarIn, reportOut, thumbPack;
+    std::string recordFile, sessionFile, workDir;
+    double speed = 1.0;
+    size_t chunk = 0;
+    int port = 8080;
+    int delayMs = 0;
+    int benchWidth = 0, benchHeight = 0;
+    bool poolStress = false;
+    bool thumbs = false;
+    bool checkJpeg = false;
+    bool checkParse = false;
+    bool survey = false;
+    SurveyGrid grid;
+    int loadThreads = -1, phaseMs = 3000;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--watch") && hasValue) watch.directory = argv[++i];
+        else if (!std::strcmp(arg, "--settle") && hasValue) watch.settleMs = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--queue") && hasValue) queueCapacity = (size_t)std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--cloud") && hasValue) {
+            if (!ParseCloudEndpoint(argv[++i], cloud)) { PrintUsage(); return 2; }
+            g_cloud = &cloud;
+        }
+        else if (!std::strcmp(arg, "--model") && hasValue) modelFile = argv[++i];
+        else if (!std::strcmp(arg, "--scale") && hasValue) g_mmPerPixel = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--csv") && hasValue) g_csvDir = argv[++i];
+        else if (!std::strcmp(arg, "--parse") && hasValue) parseFile = argv[++i];
+        else if (!std::strcmp(arg, "--serve-replay") && hasValue) replayFile = argv[++i];
+        else if (!std::strcmp(arg, "--chunk") && hasValue) chunk = (size_t)std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--port") && hasValue) port = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--delay") && hasValue) delayMs = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--bench-kernels")) {
+            int w = 0, h = 0;
+            bool hasSize = hasValue && std::sscanf(argv[i + 1], "%dx%d", &w, &h) == 2;
+            if (hasSize) i++;
+            benchWidth = hasSize ? w : 4001;
+            benchHeight = hasSize ? h : 3001;
+            if (benchWidth < 2 || benchHeight < 2) { PrintUsage(); return 2; }
+        }
+        else if (!std::strcmp(arg, "--survey")) survey = true;
+        else if (!std::strcmp(arg, "--cell") && hasValue) grid.cellSizeM = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--shore") && hasValue) grid.shoreBearingDeg = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--store") && hasValue) g_storePath = argv[++i];
+        else if (!std::strcmp(arg, "--export-geojson") && hasValue) geoJsonOut = argv[++i];
+        else if (!std::strcmp(arg, "--export-columnar") && hasValue) columnarOut = argv[++i];
+        else if (!std::strcmp(arg, "--read-columnar") && hasValue) columnarIn = argv[++i];
+        else if (!std::strcmp(arg, "--report") && hasValue) reportOut = argv[++i];
+        else if (!std::strcmp(arg, "--pool-stress")) poolStress = true;
+        else if (!std::strcmp(arg, "--load") && hasValue) loadThreads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--phase-ms") && hasValue) phaseMs = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--thumbs")) thumbs = true;
+        else if (!std::strcmp(arg, "--thumb-pack") && hasValue) thumbPack = argv[++i];
+        else if (!std::strcmp(arg, "--check-jpeg")) checkJpeg = true;
+        else if (!std::strcmp(arg, "--check-parse")) checkParse = true;
+        else if (!std::strcmp(arg, "--record") && hasValue) recordFile = argv[++i];
+        else if (!std::strcmp(arg, "--replay") && hasValue) sessionFile = argv[++i];
+        else if (!std::strcmp(arg, "--work-dir") && hasValue) workDir = argv[++i];
+        else if (!std::strcmp(arg, "--speed") && hasValue) {
+            const char* value = argv[++i];
+            speed = std::strcmp(value, "max") ? std::atof(value) : 0.0;
+            if (!(speed > 0.0) && std::strcmp(value, "max")) { PrintUsage(); return 2; }
+        }
+        else if (arg[0] == '-') { PrintUsage(); return 2; }
+        else images.push_back(arg);
+    }
+
+    InferenceEngine model;
+    if (!modelFile.empty()) {
+        std::string error;
+        if (!model.Load(modelFile, &error)) {
+            std::fprintf(stderr, "graineye: %s\n", error.c_str());
+            return 1;
+        }
+        std::fprintf(stderr, "graineye: model %dx%d, %.1f M MACs per image, %s kernels\n",
+            model.InputWidth(), model.InputHeight(), model.MacsPerImage() / 1e6, model.KernelName());
+        g_model = &model;
+    }
+
+    BeachSurvey beachSurvey(grid);
+    if (survey) g_survey = &beachSurvey;
+    std::vector<AnalysisResult> reportResults;
+    if (!reportOut.empty()) g_reportResults = &reportResults;
+
+    if (benchWidth > 0) return RunBenchKernels(benchWidth, benchHeight);
+    if (poolStress) return RunPoolStress(loadThreads, phaseMs);
+    if (thumbs) {
+        if (images.empty()) { PrintUsage(); return 2; }
+        return RunThumbs(images, thumbPack);
+    }
+    if (checkJpeg) return RunCheckJpeg();
+    if (checkParse) return RunCheckParse();
+    if (!sessionFile.empty()) return RunSessionReplay(sessionFile, speed, workDir);
+    if (!recordFile.empty()) {
+        std::string error;
+        if (!g_session.Start(recordFile, &error)) {
+            std::fprintf(stderr, "graineye: %s\n", error.c_str());
+            return 1;
+        }
+    }
+    if (!parseFile.empty()) return RunParse(parseFile, chunk);
+    if (!replayFile.empty()) return RunServeReplay(replayFile, port, chunk ? chunk : 1400, delayMs);
+    if (!columnarIn.empty()) return RunReadColumnar(columnarIn, g_storePath);
+    if (!watch.directory.empty()) {
+        int status = RunWatch(watch, queueCapacity);
+        if (status == 0 && !reportOut.empty() && !reportResults.empty()) status = RunReport(reportOut);
+        return status;
+    }
+    bool exporting = !geoJsonOut.empty() || !columnarOut.empty();
+    if (exporting && g_storePath.empty()) { PrintUsage(); return 2; }
+    if (images.empty() && !exporting) { PrintUsage(); return 2; }
+    for (const auto& path : images) AnalyzeAndPrint(path);
+    if (g_survey) PrintSurvey();
+    int status = 0;
+    if (!reportOut.empty()) status = RunReport(reportOut);
+    if (exporting && status == 0) status = RunExport({ g_storePath, geoJsonOut, columnarOut });
+    return status;
+}
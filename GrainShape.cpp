@@ -0,0 +1,349 @@
+/*
+*****************************************************************************
+*   GrainEye - Grain segmentation and shape descriptors                       *
+*****************************************************************************
+*/
+#include "GrainShape.h"
+#include "PixelKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+static const double PI = 3.14159265358979323846;
+
+// Progress reports per image while labelling
+static const int SHAPE_PROGRESS_BANDS = 16;
+
+// Otsu's threshold on the luma histogram: foreground is luma > threshold.
+static int OtsuThreshold(const std::vector<uint8_t>& luma) {
+    uint64_t histogram[256] = {};
+    for (uint8_t v : luma) histogram[v]++;
+    double total = (double)luma.size();
+    double sumAll = 0.0;
+    for (int i = 0; i < 256; i++) sumAll += (double)i * histogram[i];
+
+    double sumBelow = 0.0, weightBelow = 0.0, bestVariance = -1.0;
+    int best = 127;
+    for (int t = 0; t < 256; t++) {
+        weightBelow += histogram[t];
+        if (weightBelow == 0.0) continue;
+        double weightAbove = total - weightBelow;
+        if (weightAbove == 0.0) break;
+        sumBelow += (double)t * histogram[t];
+        double meanBelow = sumBelow / weightBelow;
+        double meanAbove = (sumAll - sumBelow) / weightAbove;
+        double variance = weightBelow * weightAbove * (meanBelow - meanAbove) * (meanBelow - meanAbove);
+        if (variance > bestVariance) { bestVariance = variance; best = t; }
+    }
+    return best;
+}
+
+namespace {
+
+// Horizontal run of foreground pixels [x0, x1] in row y
+struct Run {
+    int y, x0, x1;
+    // Pixels with a foreground neighbour above, up-left and up-right
+    int above, aboveLeft, aboveRight;
+};
+
+// Length of [a0, a1] intersected with [b0, b1]
+inline int Overlap(int a0, int a1, int b0, int b1) {
+    return std::max(0, std::min(a1, b1) - std::max(a0, b0) + 1);
+}
+
+// Row extent of one grain, for the convex hull
+struct Span {
+    int grain, y, x0, x1;
+};
+
+// Per-grain sums collected in the raster pass
+struct GrainSums {
+    double m00 = 0, m10 = 0, m01 = 0, m20 = 0, m11 = 0, m02 = 0;
+    // Grain/background transitions along rows, columns and both diagonals
+    long long cross0 = 0, cross90 = 0, cross45 = 0, cross135 = 0;
+    bool touchesBorder = false;
+    int lastSpan = -1;
+};
+
+int FindRoot(std::vector<int>& parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];      // path halving
+        i = parent[i];
+    }
+    return i;
+}
+
+struct Point { long long x, y; };
+
+long long Cross(const Point& o, const Point& a, const Point& b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Area and perimeter of the convex hull of points (monotone chain). The
+// points are pixel corners, so the hull wraps the pixels, not their centres.
+void HullMetrics(std::vector<Point>& points, std::vector<Point>& hull, double& area, double& perimeter) {
+    std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+    points.erase(std::unique(points.begin(), points.end(), [](const Point& a, const Point& b) { return a.x == b.x && a.y == b.y; }), points.end());
+    hull.assign(2 * points.size(), Point());
+    size_t k = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        while (k >= 2 && Cross(hull[k - 2], hull[k - 1], points[i]) <= 0) k--;
+        hull[k++] = points[i];
+    }
+    for (size_t i = points.size() - 1, lower = k + 1; i-- > 0;) {
+        while (k >= lower && Cross(hull[k - 2], hull[k - 1], points[i]) <= 0) k--;
+        hull[k++] = points[i];
+    }
+    hull.resize(k > 1 ? k - 1 : k);
+
+    long long twiceArea = 0;
+    perimeter = 0.0;
+    for (size_t i = 0; i < hull.size(); i++) {
+        const Point& a = hull[i];
+        const Point& b = hull[(i + 1) % hull.size()];
+        twiceArea += a.x * b.y - b.x * a.y;
+        perimeter += std::sqrt((double)((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y)));
+    }
+    area = std::fabs((double)twiceArea) / 2.0;
+}
+
+} // namespace
+
+size_t MeasureGrainShapes(const PixelImage& image, const ShapeOptions& options, GrainTable& grains) {
+    grains = GrainTable();
+    if (image.Empty()) return 0;
+    const int width = image.width, height = image.height;
+
+    // Luma (BT.601) and threshold
+    GrayImage gray;
+    ConvertToLuma(image, gray);
+    const std::vector<uint8_t>& luma = gray.pixels;
+    const int threshold = OtsuThreshold(luma);
+
+    // Whichever class owns most of the border is the background (tray or paper)
+    long long borderAbove = 0, borderTotal = 0;
+    for (int x = 0; x < width; x++) {
+        borderAbove += (luma[x] > threshold) + (luma[(size_t)(height - 1) * width + x] > threshold);
+        borderTotal += 2;
+    }
+    for (int y = 0; y < height; y++) {
+        borderAbove += (luma[(size_t)y * width] > threshold) + (luma[(size_t)y * width + width - 1] > threshold);
+        borderTotal += 2;
+    }
+    const bool grainsAreBright = borderAbove * 2 < borderTotal;
+
+    // Runs, merged with the runs of the previous row (8-connectivity). For
+    // progress reports, area per root and the number of roots at minAreaPx
+    std::vector<Run> runs;
+    std::vector<int> parent;
+    std::vector<long long> rootArea;
+    size_t found = 0;
+    const int band = std::max(1, height / SHAPE_PROGRESS_BANDS);
+    size_t prevBegin = 0, prevEnd = 0;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = &luma[(size_t)y * width];
+        size_t rowBegin = runs.size();
+        size_t j = prevBegin;
+        for (int x = 0; x < width;) {
+            while (x < width && (row[x] > threshold) != grainsAreBright) x++;
+            if (x == width) break;
+            int x0 = x;
+            while (x < width && (row[x] > threshold) == grainsAreBright) x++;
+            Run run = { y, x0, x - 1, 0, 0, 0 };
+            int self = (int)runs.size();
+            parent.push_back(self);
+            rootArea.push_back(x - x0);
+            if (x - x0 >= options.minAreaPx) found++;
+
+            while (j < prevEnd && runs[j].x1 < x0 - 1) j++;
+            for (size_t k = j; k < prevEnd && runs[k].x0 <= run.x1 + 1; k++) {
+                run.above += Overlap(runs[k].x0, runs[k].x1, run.x0, run.x1);
+                run.aboveLeft += Overlap(runs[k].x0, runs[k].x1, run.x0 - 1, run.x1 - 1);
+                run.aboveRight += Overlap(runs[k].x0, runs[k].x1, run.x0 + 1, run.x1 + 1);
+                int a = FindRoot(parent, self), b = FindRoot(parent, (int)k);
+                if (a != b) {
+                    long long merged = rootArea[a] + rootArea[b];
+                    found -= (rootArea[a] >= options.minAreaPx) + (rootArea[b] >= options.minAreaPx);
+                    found += merged >= options.minAreaPx;
+                    parent[std::max(a, b)] = std::min(a, b);
+                    rootArea[std::min(a, b)] = merged;
+                }
+            }
+            runs.push_back(run);
+        }
+        prevBegin = rowBegin;
+        prevEnd = runs.size();
+        if (options.onProgress && (y + 1) % band == 0 && y + 1 < height)
+            options.onProgress((double)(y + 1) / height, found);
+    }
+    std::vector<long long>().swap(rootArea);
+
+    // One pass over the runs: moments, boundary crossings and row extents per grain
+    std::vector<int> grainOfRoot(runs.size(), -1);
+    std::vector<GrainSums> sums;
+    std::vector<Span> spans;
+    for (size_t i = 0; i < runs.size(); i++) {
+        const Run& run = runs[i];
+        int root = FindRoot(parent, (int)i);
+        if (grainOfRoot[root] < 0) {
+            grainOfRoot[root] = (int)sums.size();
+            sums.emplace_back();
+        }
+        int g = grainOfRoot[root];
+        GrainSums& s = sums[g];
+
+        // Closed-form sums over x = x0..x1
+        double n = run.x1 - run.x0 + 1, a = run.x0, b = run.x1, y = run.y;
+        double sumX = n * (a + b) / 2.0;
+        double sumXX = (b * (b + 1) * (2 * b + 1) - (a - 1) * a * (2 * a - 1)) / 6.0;
+        s.m00 += n;
+        s.m10 += sumX;
+        s.m01 += n * y;
+        s.m20 += sumXX;
+        s.m11 += sumX * y;
+        s.m02 += n * y * y;
+        // Every pixel has two neighbours per direction; each foreground pair
+        // seen from below removes two transitions (one for each pixel)
+        s.cross0 += 2;
+        s.cross90 += 2 * (long long)n - 2 * (long long)run.above;
+        s.cross45 += 2 * (long long)n - 2 * (long long)run.aboveRight;
+        s.cross135 += 2 * (long long)n - 2 * (long long)run.aboveLeft;
+        if (run.x0 == 0 || run.x1 == width - 1 || run.y == 0 || run.y == height - 1) s.touchesBorder = true;
+
+        if (s.lastSpan >= 0 && spans[s.lastSpan].y == run.y) {
+            spans[s.lastSpan].x1 = run.x1;      // runs arrive left to right
+        }
+        else {
+            s.lastSpan = (int)spans.size();
+            spans.push_back({ g, run.y, run.x0, run.x1 });
+        }
+    }
+    std::vector<int>().swap(grainOfRoot);
+    std::vector<Run>().swap(runs);
+
+    // Group row extents by grain (counting sort keeps them in row order)
+    std::vector<int> spanStart(sums.size() + 1, 0);
+    for (const Span& span : spans) spanStart[span.grain + 1]++;
+    for (size_t g = 0; g < sums.size(); g++) spanStart[g + 1] += spanStart[g];
+    std::vector<Span> grouped(spans.size());
+    {
+        std::vector<int> fill(spanStart.begin(), spanStart.end() - 1);
+        for (const Span& span : spans) grouped[fill[span.grain]++] = span;
+    }
+    std::vector<Span>().swap(spans);
+
+    // Raw measurements of the grains that are kept
+    std::vector<Point> points, hull;
+    std::vector<float> mu20, mu02, mu11;
+    for (size_t g = 0; g < sums.size(); g++) {
+        const GrainSums& s = sums[g];
+        if (s.touchesBorder || s.m00 < options.minAreaPx) continue;
+
+        points.clear();
+        for (int i = spanStart[g]; i < spanStart[g + 1]; i++) {
+            const Span& span = grouped[i];
+            points.push_back({ span.x0, span.y });
+            points.push_back({ span.x1 + 1, span.y });
+            points.push_back({ span.x0, span.y + 1 });
+            points.push_back({ span.x1 + 1, span.y + 1 });
+        }
+        double hullArea, hullPerimeter;
+        HullMetrics(points, hull, hullArea, hullPerimeter);
+
+        double cx = s.m10 / s.m00, cy = s.m01 / s.m00;
+        grains.centroidX.push_back((float)(cx + 0.5));     // pixel centres
+        grains.centroidY.push_back((float)(cy + 0.5));
+        grains.areaPx.push_back((float)s.m00);
+        // Cauchy-Crofton over four directions; diagonal lines are 1/sqrt(2) apart
+        double crossings = (double)(s.cross0 + s.cross90) + (double)(s.cross45 + s.cross135) / std::sqrt(2.0);
+        grains.perimeterPx.push_back((float)(crossings * PI / 8.0));
+        grains.hullAreaPx.push_back((float)hullArea);
+        grains.hullPerimeterPx.push_back((float)hullPerimeter);
+        // Central moments; + 1/12 is the variance of a unit pixel itself
+        mu20.push_back((float)(s.m20 / s.m00 - cx * cx + 1.0 / 12.0));
+        mu02.push_back((float)(s.m02 / s.m00 - cy * cy + 1.0 / 12.0));
+        mu11.push_back((float)(s.m11 / s.m00 - cx * cy));
+    }
+
+    // Descriptor pass, one column at a time over contiguous floats
+    const size_t count = grains.areaPx.size();
+    const float* area = grains.areaPx.data();
+    const float* perimeter = grains.perimeterPx.data();
+    const float* hullArea = grains.hullAreaPx.data();
+    const float* hullPerimeter = grains.hullPerimeterPx.data();
+    grains.majorAxisPx.resize(count);
+    grains.minorAxisPx.resize(count);
+    grains.diameterMm.resize(count);
+    grains.circularity.resize(count);
+    grains.roundness.resize(count);
+    grains.elongation.resize(count);
+    grains.aspectRatio.resize(count);
+    grains.convexity.resize(count);
+    grains.solidity.resize(count);
+    grains.sphericity.resize(count);
+    float* major = grains.majorAxisPx.data();
+    float* minor = grains.minorAxisPx.data();
+
+    for (size_t i = 0; i < count; i++) {
+        float trace = mu20[i] + mu02[i];
+        float diff = mu20[i] - mu02[i];
+        float root = std::sqrt(diff * diff + 4.0f * mu11[i] * mu11[i]);
+        major[i] = 4.0f * std::sqrt(0.5f * (trace + root));
+        minor[i] = 4.0f * std::sqrt(std::max(0.5f * (trace - root), 0.0f));
+    }
+    const float pi = (float)PI;
+    const float scale = (float)options.mmPerPixel;
+    for (size_t i = 0; i < count; i++) grains.diameterMm[i] = 2.0f * std::sqrt(area[i] / pi) * scale;
+    for (size_t i = 0; i < count; i++) grains.circularity[i] = std::min(4.0f * pi * area[i] / (perimeter[i] * perimeter[i]), 1.0f);
+    for (size_t i = 0; i < count; i++) grains.roundness[i] = std::min(4.0f * area[i] / (pi * major[i] * major[i]), 1.0f);
+    for (size_t i = 0; i < count; i++) grains.elongation[i] = 1.0f - minor[i] / major[i];
+    for (size_t i = 0; i < count; i++) grains.aspectRatio[i] = major[i] / std::max(minor[i], 1e-3f);
+    for (size_t i = 0; i < count; i++) grains.convexity[i] = std::min(hullPerimeter[i] / perimeter[i], 1.0f);
+    for (size_t i = 0; i < count; i++) grains.solidity[i] = std::min(area[i] / hullArea[i], 1.0f);
+    for (size_t i = 0; i < count; i++) grains.sphericity[i] = std::min(2.0f * std::sqrt(area[i] / pi) / major[i], 1.0f);
+    return count;
+}
+
+static void Summarize(const std::vector<float>& values, double binMin, double binWidth, ShapeDistribution& out) {
+    const int BINS = 10;
+    out = ShapeDistribution();
+    out.binMin = binMin;
+    out.binWidth = binWidth;
+    out.counts.assign(BINS, 0);
+    if (values.empty()) return;
+
+    std::vector<float> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) {
+        double pos = p * (sorted.size() - 1);
+        size_t lo = (size_t)pos;
+        size_t hi = std::min(lo + 1, sorted.size() - 1);
+        return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+    };
+    double sum = 0.0;
+    for (float v : sorted) {
+        sum += v;
+        int bin = (int)std::floor((v - binMin) / binWidth);
+        out.counts[std::min(std::max(bin, 0), BINS - 1)]++;
+    }
+    out.mean = sum / sorted.size();
+    out.p10 = percentile(0.10);
+    out.p50 = percentile(0.50);
+    out.p90 = percentile(0.90);
+}
+
+void ComputeShapeStats(const GrainTable& grains, ShapeStats& stats) {
+    stats = ShapeStats();
+    if (!grains.HasShape()) return;
+    stats.grains = (int)grains.Size();
+    Summarize(grains.circularity, 0.0, 0.1, stats.circularity);
+    Summarize(grains.roundness, 0.0, 0.1, stats.roundness);
+    Summarize(grains.elongation, 0.0, 0.1, stats.elongation);
+    Summarize(grains.aspectRatio, 1.0, 0.2, stats.aspectRatio);
+    Summarize(grains.convexity, 0.0, 0.1, stats.convexity);
+    Summarize(grains.solidity, 0.0, 0.1, stats.solidity);
+    Summarize(grains.sphericity, 0.0, 0.1, stats.sphericity);
+}
@@ -0,0 +1,48 @@
+/*
+*****************************************************************************
+*   GrainEye - Button hover tracking                                          *
+*****************************************************************************
+*/
+#include "HoverTracker.h"
+
+int HoverTracker::Add(int x0, int y0, int x1, int y1) {
+    buttons.push_back({ x0, y0, x1, y1, false, false });
+    return (int)buttons.size() - 1;
+}
+
+bool HoverTracker::Move(int x, int y, std::vector<int>& changed) {
+    bool entered = false;
+    for (size_t i = 0; i < buttons.size(); i++) {
+        bool inside = buttons[i].Contains(x, y);
+        if (inside == buttons[i].hovered) continue;
+        buttons[i].hovered = inside;
+        entered = entered || inside;
+        changed.push_back((int)i);
+    }
+    return entered;
+}
+
+void HoverTracker::Press(int x, int y, std::vector<int>& changed) {
+    for (size_t i = 0; i < buttons.size(); i++) {
+        bool inside = buttons[i].Contains(x, y);
+        if (inside == buttons[i].pressed) continue;
+        buttons[i].pressed = inside;
+        changed.push_back((int)i);
+    }
+}
+
+void HoverTracker::Release(std::vector<int>& changed) {
+    for (size_t i = 0; i < buttons.size(); i++) {
+        if (!buttons[i].pressed) continue;
+        buttons[i].pressed = false;
+        changed.push_back((int)i);
+    }
+}
+
+void HoverTracker::Leave(std::vector<int>& changed) {
+    for (size_t i = 0; i < buttons.size(); i++) {
+        if (!buttons[i].hovered) continue;
+        buttons[i].hovered = false;
+        changed.push_back((int)i);
+    }
+}
@@ -0,0 +1,44 @@
+/*
+*****************************************************************************
+*   GrainEye - Button hover tracking                                          *
+*   ------------------------------------------------------------------------- *
+*   Hover and pressed state of the owner-drawn buttons, hit-tested against   *
+*   rectangles cached when the buttons are created (client coordinates; the *
+*   window is not resizable). A mouse move costs a few comparisons and      *
+*   reports only the buttons whose look changed, so the window repaints    *
+*   nothing while the pointer crosses empty space. Shared with the session *
+*   replayer, which drives it with recorded mouse moves.                    *
+*****************************************************************************
+*/
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class HoverTracker {
+public:
+    // Rectangle includes x0/y0 and excludes x1/y1 (as PtInRect). Returns the
+    // button's index.
+    int Add(int x0, int y0, int x1, int y1);
+    size_t Count() const { return buttons.size(); }
+
+    // Each call appends the indexes of buttons to repaint to changed.
+    // Move returns true when the pointer entered a button (the window then
+    // asks for WM_MOUSELEAVE).
+    bool Move(int x, int y, std::vector<int>& changed);
+    void Press(int x, int y, std::vector<int>& changed);
+    void Release(std::vector<int>& changed);
+    void Leave(std::vector<int>& changed);
+
+    bool Hovered(int index) const { return buttons[index].hovered; }
+    bool Pressed(int index) const { return buttons[index].pressed; }
+
+private:
+    struct Button {
+        int x0, y0, x1, y1;
+        bool hovered;
+        bool pressed;
+        bool Contains(int x, int y) const { return x >= x0 && x < x1 && y >= y0 && y < y1; }
+    };
+    std::vector<Button> buttons;
+};
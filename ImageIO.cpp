@@ -0,0 +1,249 @@
+/*
+*****************************************************************************
+*   GrainEye - Image decoding                                                 *
+*****************************************************************************
+*/
+#ifdef _WIN32
+#include <windows.h>
+#include <gdiplus.h>
+#endif
+
+#include "ImageIO.h"
+#include "FileUtil.h"
+#include "PixelKernels.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// Sample images come from phone and Pi cameras; anything bigger is corrupt
+static const int MAX_IMAGE_SIDE = 16384;
+
+static bool Fail(std::string* error, const std::string& message) {
+    if (error) *error = message;
+    return false;
+}
+
+#ifdef _WIN32
+
+static bool CopyPixels(Gdiplus::Bitmap& bitmap, const std::string& path, PixelImage& image, std::string* error) {
+    int width = (int)bitmap.GetWidth();
+    int height = (int)bitmap.GetHeight();
+    Gdiplus::Rect rect(0, 0, width, height);
+    Gdiplus::BitmapData data;
+    if (bitmap.LockBits(&rect, Gdiplus::ImageLockModeRead, PixelFormat24bppRGB, &data) != Gdiplus::Ok)
+        return Fail(error, "cannot read pixels of " + path);
+
+    image.width = width;
+    image.height = height;
+    image.rgb.resize((size_t)width * height * 3);
+    for (int y = 0; y < height; y++) {
+        const BYTE* src = (const BYTE*)data.Scan0 + (ptrdiff_t)y * data.Stride;     // BGR
+        uint8_t* dst = image.rgb.data() + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            dst[3 * x + 0] = src[3 * x + 2];
+            dst[3 * x + 1] = src[3 * x + 1];
+            dst[3 * x + 2] = src[3 * x + 0];
+        }
+    }
+    bitmap.UnlockBits(&data);
+    return true;
+}
+
+bool LoadPixelImage(const std::string& path, PixelImage& image, std::string* error) {
+    std::unique_ptr<Gdiplus::Bitmap> bitmap(Gdiplus::Bitmap::FromFile(Widen(path).c_str()));
+    if (!bitmap || bitmap->GetLastStatus() != Gdiplus::Ok) return Fail(error, "cannot decode " + path);
+
+    int width = (int)bitmap->GetWidth();
+    int height = (int)bitmap->GetHeight();
+    if (width <= 0 || height <= 0 || width > MAX_IMAGE_SIDE || height > MAX_IMAGE_SIDE)
+        return Fail(error, "unsupported image size");
+    return CopyPixels(*bitmap, path, image, error);
+}
+
+// GDI+ decodes lazily: GetThumbnailImage() scales from the embedded EXIF
+// thumbnail when the file has one and only decodes the full image otherwise
+bool LoadPixelImageReduced(const std::string& path, int maxSide, PixelImage& image, std::string* error) {
+    std::unique_ptr<Gdiplus::Image> source(Gdiplus::Image::FromFile(Widen(path).c_str()));
+    if (!source || source->GetLastStatus() != Gdiplus::Ok) return Fail(error, "cannot decode " + path);
+
+    int width = (int)source->GetWidth();
+    int height = (int)source->GetHeight();
+    if (width <= 0 || height <= 0 || width > MAX_IMAGE_SIDE || height > MAX_IMAGE_SIDE)
+        return Fail(error, "unsupported image size");
+    if ((std::max)(width, height) > maxSide) {
+        double scale = (double)maxSide / (std::max)(width, height);
+        width = (std::max)(1, (int)(width * scale + 0.5));
+        height = (std::max)(1, (int)(height * scale + 0.5));
+    }
+
+    std::unique_ptr<Gdiplus::Image> thumb(source->GetThumbnailImage(width, height));
+    if (!thumb) return Fail(error, "cannot decode " + path);
+    Gdiplus::Bitmap bitmap(width, height, PixelFormat24bppRGB);
+    {
+        Gdiplus::Graphics graphics(&bitmap);
+        if (graphics.DrawImage(thumb.get(), 0, 0, width, height) != Gdiplus::Ok) return Fail(error, "cannot decode " + path);
+    }
+    return CopyPixels(bitmap, path, image, error);
+}
+
+#else
+
+// Takes decoded rows in file order and halves them `shift` times on the way
+// (2x2 box average per step, the DownscaleHalf row kernel), so a reduced
+// decode holds one pending row per step instead of the full image.
+class RowReducer {
+public:
+    RowReducer(int width, int height, int shift, bool bottomUp, PixelImage& out)
+        : shift(shift), bottomUp(bottomUp), image(out), pending(shift), halved(shift), hasPending(shift, false) {
+        for (int level = 0; level < shift; level++) {
+            pending[level].resize((size_t)(width >> level) * 3);
+            halved[level].resize((size_t)(width >> (level + 1)) * 3);
+        }
+        rowsOut = height >> shift;
+        image.width = width >> shift;
+        image.height = rowsOut;
+        image.rgb.resize((size_t)image.width * image.height * 3);
+    }
+
+    void Push(const uint8_t* rgb) { Push(rgb, 0); }
+
+private:
+    void Push(const uint8_t* rgb, int level) {
+        if (level == shift) {
+            if (written >= rowsOut) return;
+            int y = bottomUp ? rowsOut - 1 - written : written;
+            std::memcpy(image.rgb.data() + (size_t)y * image.width * 3, rgb, (size_t)image.width * 3);
+            written++;
+            return;
+        }
+        if (!hasPending[level]) {
+            std::memcpy(pending[level].data(), rgb, pending[level].size());
+            hasPending[level] = true;
+            return;
+        }
+        PixelKernels().halveRow(pending[level].data(), rgb, halved[level].data(), halved[level].size() / 3, 3);
+        hasPending[level] = false;
+        Push(halved[level].data(), level + 1);
+    }
+
+    int shift;
+    bool bottomUp;
+    PixelImage& image;
+    std::vector<std::vector<uint8_t>> pending;     // first row of a pair, per level
+    std::vector<std::vector<uint8_t>> halved;
+    std::vector<bool> hasPending;
+    int rowsOut = 0;
+    int written = 0;
+};
+
+// Largest power-of-two reduction that keeps the longer side at maxSide or more
+static int ReductionShift(int width, int height, int maxSide) {
+    int shift = 0;
+    while (maxSide > 0 && ((std::max)(width, height) >> (shift + 1)) >= maxSide && ((std::min)(width, height) >> (shift + 1)) >= 1)
+        shift++;
+    return shift;
+}
+
+static uint32_t ReadLE32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t ReadLE16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+// Uncompressed 24/32-bit BMP (BI_RGB or BI_BITFIELDS with the usual masks)
+static bool LoadBmp(FILE* f, int maxSide, PixelImage& image, std::string* error) {
+    uint8_t header[54];
+    if (std::fread(header, 1, sizeof(header), f) != sizeof(header)) return Fail(error, "truncated BMP header");
+    uint32_t dataOffset = ReadLE32(header + 10);
+    int32_t width = (int32_t)ReadLE32(header + 18);
+    int32_t height = (int32_t)ReadLE32(header + 22);
+    uint16_t bpp = ReadLE16(header + 28);
+    uint32_t compression = ReadLE32(header + 30);
+    if ((bpp != 24 && bpp != 32) || (compression != 0 && compression != 3))
+        return Fail(error, "only uncompressed 24/32-bit BMP is supported");
+
+    bool topDown = height < 0;
+    if (topDown) height = -height;
+    if (width <= 0 || height <= 0 || width > MAX_IMAGE_SIDE || height > MAX_IMAGE_SIDE)
+        return Fail(error, "unsupported image size");
+
+    size_t bytesPerPixel = bpp / 8;
+    size_t stride = ((size_t)width * bytesPerPixel + 3) & ~(size_t)3;
+    std::vector<uint8_t> row(stride), rgb((size_t)width * 3);
+    RowReducer reducer(width, height, ReductionShift(width, height, maxSide), !topDown, image);
+    if (std::fseek(f, (long)dataOffset, SEEK_SET) != 0) return Fail(error, "truncated BMP");
+    for (int i = 0; i < height; i++) {
+        if (std::fread(row.data(), 1, stride, f) != stride) return Fail(error, "truncated BMP");
+        for (int x = 0; x < width; x++) {
+            const uint8_t* src = row.data() + x * bytesPerPixel;     // BGR(A)
+            rgb[3 * x + 0] = src[2];
+            rgb[3 * x + 1] = src[1];
+            rgb[3 * x + 2] = src[0];
+        }
+        reducer.Push(rgb.data());
+    }
+    return true;
+}
+
+static bool ReadPnmInt(FILE* f, int& value) {
+    int c = std::fgetc(f);
+    for (;;) {
+        if (c == '#') while (c != '\n' && c != EOF) c = std::fgetc(f);
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') c = std::fgetc(f);
+        else break;
+    }
+    if (c < '0' || c > '9') return false;
+    value = 0;
+    while (c >= '0' && c <= '9') {
+        if (value > 1000000) return false;
+        value = value * 10 + (c - '0');
+        c = std::fgetc(f);
+    }
+    return true;    // the single whitespace after the number has been consumed
+}
+
+// Binary PPM (P6) and PGM (P5), 8 bits per sample
+static bool LoadPnm(FILE* f, bool color, int maxSide, PixelImage& image, std::string* error) {
+    int width, height, maxValue;
+    if (!ReadPnmInt(f, width) || !ReadPnmInt(f, height) || !ReadPnmInt(f, maxValue))
+        return Fail(error, "bad PNM header");
+    if (maxValue <= 0 || maxValue > 255) return Fail(error, "only 8-bit PNM is supported");
+    if (width <= 0 || height <= 0 || width > MAX_IMAGE_SIDE || height > MAX_IMAGE_SIDE)
+        return Fail(error, "unsupported image size");
+
+    size_t samples = (size_t)width * (color ? 3 : 1);
+    std::vector<uint8_t> row(samples), rgb((size_t)width * 3);
+    RowReducer reducer(width, height, ReductionShift(width, height, maxSide), false, image);
+    for (int y = 0; y < height; y++) {
+        if (std::fread(row.data(), 1, samples, f) != samples) return Fail(error, "truncated PNM");
+        if (color) std::memcpy(rgb.data(), row.data(), samples);
+        else for (int x = 0; x < width; x++) rgb[3 * x] = rgb[3 * x + 1] = rgb[3 * x + 2] = row[x];
+        if (maxValue != 255)
+            for (auto& v : rgb) v = (uint8_t)(v > maxValue ? 255 : v * 255 / maxValue);
+        reducer.Push(rgb.data());
+    }
+    return true;
+}
+
+static bool LoadImageFile(const std::string& path, int maxSide, PixelImage& image, std::string* error) {
+    FILE* f = OpenFile(path, "rb");
+    if (!f) return Fail(error, "cannot open " + path);
+    uint8_t magic[2] = {};
+    bool ok;
+    if (std::fread(magic, 1, 2, f) != 2) ok = Fail(error, "empty file");
+    else if (magic[0] == 'B' && magic[1] == 'M') { std::fseek(f, 0, SEEK_SET); ok = LoadBmp(f, maxSide, image, error); }
+    else if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6')) ok = LoadPnm(f, magic[1] == '6', maxSide, image, error);
+    else ok = Fail(error, "unsupported image format (BMP/PPM/PGM only on this platform)");
+    std::fclose(f);
+    if (!ok) image = PixelImage();
+    return ok;
+}
+
+bool LoadPixelImage(const std::string& path, PixelImage& image, std::string* error) {
+    return LoadImageFile(path, 0, image, error);
+}
+
+bool LoadPixelImageReduced(const std::string& path, int maxSide, PixelImage& image, std::string* error) {
+    return LoadImageFile(path, maxSide, image, error);
+}
+
+#endif
@@ -0,0 +1,33 @@
+/*
+*****************************************************************************
+*   GrainEye - Image decoding                                                 *
+*   ------------------------------------------------------------------------- *
+*   Decodes a sample image into 8-bit RGB for the on-device pipeline.        *
+*   Windows goes through GDI+ (BMP/JPG/PNG; GdiplusStartup must have run).  *
+*   Elsewhere the built-in decoders cover uncompressed BMP and binary        *
+*   PPM/PGM (raw camera dumps); other formats need converting first.         *
+*****************************************************************************
+*/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PixelImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgb;   // width * height * 3, rows top to bottom
+
+    bool Empty() const { return width <= 0 || height <= 0; }
+    const uint8_t* Row(int y) const { return rgb.data() + (size_t)y * width * 3; }
+};
+
+bool LoadPixelImage(const std::string& path, PixelImage& image, std::string* error = nullptr);
+
+// Decodes at reduced size for thumbnails. The built-in decoders halve rows
+// while reading (power-of-two steps, longer side kept at maxSide or more,
+// below 2 * maxSide); GDI+ returns the image fitted to maxSide, from the
+// embedded EXIF thumbnail when the file has one. Smaller images come back
+// at full size.
+bool LoadPixelImageReduced(const std::string& path, int maxSide, PixelImage& image, std::string* error = nullptr);
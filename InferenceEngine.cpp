@@ -0,0 +1,395 @@
+/*
+*****************************************************************************
+*   GrainEye - On-device int8 inference                                       *
+*****************************************************************************
+*/
+#include "InferenceEngine.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifdef GE_X86
+#include <immintrin.h>
+#endif
+#ifdef GE_NEON
+#include <arm_neon.h>
+#endif
+
+static const uint32_t MODEL_MAGIC = 0x38514547;     // "GEQ8"
+static const uint32_t MODEL_VERSION = 1;
+static const size_t ALIGN = 16;
+
+// Keeps a corrupt file from asking for absurd buffers or compute
+static const int MAX_INPUT_SIDE = 512;
+static const int MAX_CHANNELS = 1024;
+static const int MAX_KERNEL = 7;
+static const int MAX_LAYERS = 64;
+static const int MAX_CLASSES = 256;
+
+static size_t AlignUp(size_t n) { return (n + ALIGN - 1) & ~(ALIGN - 1); }
+
+// ---------------------------------------------------------------------------
+// int8 dot products. n is a multiple of 16 (weight rows are padded).
+// ---------------------------------------------------------------------------
+typedef int32_t (*DotInt8Fn)(const int8_t* a, const int8_t* b, size_t n);
+
+static int32_t DotInt8Scalar(const int8_t* a, const int8_t* b, size_t n) {
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += (int32_t)a[i] * b[i];
+    return sum;
+}
+
+#ifdef GE_X86
+GE_TARGET("sse4.1")
+static int32_t DotInt8SSE4(const int8_t* a, const int8_t* b, size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_cvtepi8_epi16(va), _mm_cvtepi8_epi16(vb)));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(va, 8)), _mm_cvtepi8_epi16(_mm_srli_si128(vb, 8))));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+}
+
+GE_TARGET("avx2")
+static int32_t DotInt8AVX2(const int8_t* a, const int8_t* b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+        __m256i vb0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+        __m256i va1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a + i + 16)));
+        __m256i vb1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b + i + 16)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va0, vb0));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va1, vb1));
+    }
+    if (i < n) {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+        __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+#ifdef GE_NEON
+static int32_t DotInt8NEON(const int8_t* a, const int8_t* b, size_t n) {
+    int32x4_t acc = vdupq_n_s32(0);
+    for (size_t i = 0; i < n; i += 16) {
+        int8x16_t va = vld1q_s8(a + i);
+        int8x16_t vb = vld1q_s8(b + i);
+        // int8 x int8 fits in int16; pairwise-add into the int32 lanes
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc = vpadalq_s16(acc, vmull_s8(vget_high_s8(va), vget_high_s8(vb)));
+    }
+#if defined(__aarch64__) || defined(_M_ARM64)
+    return vaddvq_s32(acc);
+#else
+    int32x2_t pair = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(pair, pair), 0);
+#endif
+}
+#endif
+
+static DotInt8Fn SelectDotKernel() {
+    switch (ActiveSimdLevel()) {
+#ifdef GE_X86
+    case SimdLevel::AVX2: return DotInt8AVX2;
+    case SimdLevel::SSE4: return DotInt8SSE4;
+#endif
+#ifdef GE_NEON
+    case SimdLevel::NEON: return DotInt8NEON;
+#endif
+    default: return DotInt8Scalar;
+    }
+}
+
+static const DotInt8Fn DotInt8 = SelectDotKernel();
+
+const char* InferenceEngine::KernelName() const {
+    return SimdLevelName(ActiveSimdLevel());
+}
+
+// ---------------------------------------------------------------------------
+// Loading
+// ---------------------------------------------------------------------------
+static bool Fail(std::string* error, const std::string& message) {
+    if (error) *error = message;
+    return false;
+}
+
+bool InferenceEngine::Load(const std::string& path, std::string* error) {
+    layers.clear();
+    zoneLabels.clear();
+    beachLabels.clear();
+    macs = 0;
+    if (!file.Open(path, error)) return false;
+
+    // Parsed into locals and kept only when the whole model checks out, so
+    // a file that fails partway leaves the engine unloaded
+    std::vector<Layer> loaded;
+    std::vector<std::string> zones, beaches;
+    long long loadedMacs = 0;
+
+    const uint8_t* base = file.Data();
+    size_t size = file.Size();
+    size_t offset = 0;
+    auto readU32 = [&](uint32_t& value) {
+        if (size - offset < 4) return false;
+        std::memcpy(&value, base + offset, 4);
+        offset += 4;
+        return true;
+    };
+
+    uint32_t header[9];
+    for (auto& field : header)
+        if (!readU32(field)) return Fail(error, "model file truncated");
+    if (header[0] != MODEL_MAGIC) return Fail(error, "not a GrainEye model file");
+    if (header[1] != MODEL_VERSION) return Fail(error, "unsupported model version " + std::to_string(header[1]));
+    int modelWidth = (int)header[2];
+    int modelHeight = (int)header[3];
+    int modelChannels = (int)header[4];
+    uint32_t layerCount = header[5];
+    uint32_t zoneClasses = header[6];
+    uint32_t beachClasses = header[7];
+    uint32_t labelBytes = header[8];
+    if (modelWidth <= 0 || modelWidth > MAX_INPUT_SIDE || modelHeight <= 0 || modelHeight > MAX_INPUT_SIDE ||
+        (modelChannels != 1 && modelChannels != 3) || layerCount == 0 || layerCount > (uint32_t)MAX_LAYERS ||
+        zoneClasses == 0 || zoneClasses > (uint32_t)MAX_CLASSES || beachClasses == 0 || beachClasses > (uint32_t)MAX_CLASSES)
+        return Fail(error, "model header out of range");
+
+    // Label table
+    if (labelBytes > size - offset) return Fail(error, "model file truncated");
+    const char* text = (const char*)base + offset;
+    const char* textEnd = text + labelBytes;
+    while (text < textEnd && zones.size() + beaches.size() < zoneClasses + beachClasses) {
+        const char* nul = (const char*)std::memchr(text, '\0', (size_t)(textEnd - text));
+        if (!nul) break;
+        (zones.size() < zoneClasses ? zones : beaches).emplace_back(text, nul);
+        text = nul + 1;
+    }
+    if (zones.size() != zoneClasses || beaches.size() != beachClasses)
+        return Fail(error, "model label table incomplete");
+    offset = AlignUp(offset + labelBytes);
+
+    int width = modelWidth, height = modelHeight, channels = modelChannels;
+    for (uint32_t i = 0; i < layerCount; i++) {
+        uint32_t fields[8];
+        for (auto& field : fields)
+            if (!readU32(field)) return Fail(error, "model file truncated");
+
+        Layer layer = {};
+        layer.type = (int)fields[0];
+        layer.kernel = (int)fields[1];
+        layer.stride = (int)fields[2];
+        layer.inChannels = (int)fields[3];
+        layer.outChannels = (int)fields[4];
+        layer.relu = fields[5] != 0;
+        layer.multiplier = (int32_t)fields[6];
+        layer.shift = (int)fields[7];
+        layer.inWidth = width;
+        layer.inHeight = height;
+
+        std::string where = "model layer " + std::to_string(i) + ": ";
+        if (layer.inChannels != channels) return Fail(error, where + "channel count does not match the previous layer");
+        if (layer.outChannels <= 0 || layer.outChannels > MAX_CHANNELS) return Fail(error, where + "bad output channel count");
+        if (layer.multiplier <= 0 || layer.shift < 1 || layer.shift > 62) return Fail(error, where + "bad requantization scale");
+
+        size_t inputsPerRow;
+        switch (layer.type) {
+        case CONV:
+            if (width <= 0 || height <= 0) return Fail(error, where + "convolution after pooling");
+            if (layer.kernel < 1 || layer.kernel > MAX_KERNEL || (layer.kernel & 1) == 0 || layer.stride < 1 || layer.stride > 4)
+                return Fail(error, where + "bad kernel or stride");
+            inputsPerRow = (size_t)layer.kernel * layer.kernel * layer.inChannels;
+            layer.outWidth = (width + layer.stride - 1) / layer.stride;
+            layer.outHeight = (height + layer.stride - 1) / layer.stride;
+            loadedMacs += (long long)layer.outWidth * layer.outHeight * layer.outChannels * (long long)inputsPerRow;
+            break;
+        case POOL:
+            if (layer.outChannels != layer.inChannels) return Fail(error, where + "pooling cannot change channels");
+            inputsPerRow = 0;
+            layer.outWidth = layer.outHeight = 0;     // a vector from here on
+            break;
+        case DENSE:
+            if (width > 0) return Fail(error, where + "dense layer needs a pooled input");
+            inputsPerRow = (size_t)layer.inChannels;
+            loadedMacs += (long long)layer.outChannels * (long long)inputsPerRow;
+            break;
+        default:
+            return Fail(error, where + "unknown layer type " + std::to_string(layer.type));
+        }
+
+        if (layer.type != POOL) {
+            layer.rowBytes = AlignUp(inputsPerRow);
+            size_t weightBytes = layer.rowBytes * (size_t)layer.outChannels;
+            size_t biasBytes = 4 * (size_t)layer.outChannels;
+            offset = AlignUp(offset);
+            if (offset > size || weightBytes + biasBytes > size - offset) return Fail(error, where + "weights truncated");
+            layer.weights = (const int8_t*)(base + offset);
+            layer.bias = (const int32_t*)(base + offset + weightBytes);    // 16-byte aligned: rows are
+            offset = AlignUp(offset + weightBytes + biasBytes);
+        }
+
+        loaded.push_back(layer);
+        width = layer.outWidth;
+        height = layer.outHeight;
+        channels = layer.outChannels;
+    }
+
+    const Layer& last = loaded.back();
+    if (last.type != DENSE || last.outChannels != (int)(zoneClasses + beachClasses))
+        return Fail(error, "model must end in a dense layer with one logit per label");
+
+    layers.swap(loaded);
+    zoneLabels.swap(zones);
+    beachLabels.swap(beaches);
+    inputWidth = modelWidth;
+    inputHeight = modelHeight;
+    inputChannels = modelChannels;
+    macs = loadedMacs;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Inference
+// ---------------------------------------------------------------------------
+static inline int8_t Requantize(int32_t acc, const int32_t multiplier, int shift, bool relu) {
+    int64_t v = ((int64_t)acc * multiplier + ((int64_t)1 << (shift - 1))) >> shift;
+    if (v > 127) v = 127;
+    if (v < (relu ? 0 : -128)) v = relu ? 0 : -128;
+    return (int8_t)v;
+}
+
+// Area-average resize to the network input, centred on zero (pixel - 128).
+static void PrepareInput(const PixelImage& image, int width, int height, int channels, int8_t* out, ThreadPool* pool) {
+    auto rows = [&](size_t begin, size_t end) {
+        for (size_t oy = begin; oy < end; oy++) {
+            int y0 = (int)(oy * image.height / height);
+            int y1 = std::max(y0 + 1, (int)((oy + 1) * image.height / height));
+            for (int ox = 0; ox < width; ox++) {
+                int x0 = ox * image.width / width;
+                int x1 = std::max(x0 + 1, (ox + 1) * image.width / width);
+                uint32_t sum[3] = {};
+                for (int y = y0; y < y1; y++) {
+                    const uint8_t* p = image.Row(y) + 3 * x0;
+                    for (int x = x0; x < x1; x++, p += 3) { sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; }
+                }
+                uint32_t area = (uint32_t)((y1 - y0) * (x1 - x0));
+                int8_t* dst = out + ((size_t)oy * width + ox) * channels;
+                if (channels == 3) {
+                    for (int c = 0; c < 3; c++) dst[c] = (int8_t)((int)((sum[c] + area / 2) / area) - 128);
+                }
+                else {
+                    uint32_t luma = (77 * sum[0] + 150 * sum[1] + 29 * sum[2]) >> 8;      // BT.601
+                    dst[0] = (int8_t)((int)((luma + area / 2) / area) - 128);
+                }
+            }
+        }
+    };
+    if (pool) pool->ParallelFor((size_t)height, 4, rows);
+    else rows(0, (size_t)height);
+}
+
+static void SoftmaxPick(const std::vector<float>& logits, size_t begin, size_t end, size_t& best, float& confidence) {
+    best = begin;
+    for (size_t i = begin; i < end; i++) if (logits[i] > logits[best]) best = i;
+    double sum = 0.0;
+    for (size_t i = begin; i < end; i++) sum += std::exp((double)logits[i] - logits[best]);
+    confidence = (float)(1.0 / sum);
+    best -= begin;
+}
+
+bool InferenceEngine::Classify(const PixelImage& image, Classification& out, ThreadPool* pool) const {
+    if (!IsLoaded() || image.Empty()) return false;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<int8_t> current((size_t)inputWidth * inputHeight * inputChannels);
+    std::vector<int8_t> next;
+    PrepareInput(image, inputWidth, inputHeight, inputChannels, current.data(), pool);
+    std::vector<float> logits;
+
+    for (const Layer& layer : layers) {
+        if (layer.type == CONV) {
+            next.assign((size_t)layer.outWidth * layer.outHeight * layer.outChannels, 0);
+            auto rows = [&](size_t begin, size_t end) {
+                std::vector<int8_t> patch(layer.rowBytes);
+                const int k = layer.kernel, half = k / 2, c = layer.inChannels;
+                for (size_t oy = begin; oy < end; oy++) {
+                    for (int ox = 0; ox < layer.outWidth; ox++) {
+                        // Gather the receptive field ("same" padding reads zeros)
+                        std::fill(patch.begin(), patch.end(), (int8_t)0);
+                        for (int ky = 0; ky < k; ky++) {
+                            int iy = (int)oy * layer.stride + ky - half;
+                            if (iy < 0 || iy >= layer.inHeight) continue;
+                            for (int kx = 0; kx < k; kx++) {
+                                int ix = ox * layer.stride + kx - half;
+                                if (ix < 0 || ix >= layer.inWidth) continue;
+                                std::memcpy(&patch[(size_t)(ky * k + kx) * c], &current[((size_t)iy * layer.inWidth + ix) * c], (size_t)c);
+                            }
+                        }
+                        int8_t* dst = &next[((size_t)oy * layer.outWidth + ox) * layer.outChannels];
+                        const int8_t* w = layer.weights;
+                        for (int oc = 0; oc < layer.outChannels; oc++, w += layer.rowBytes) {
+                            int32_t acc = DotInt8(patch.data(), w, layer.rowBytes) + layer.bias[oc];
+                            dst[oc] = Requantize(acc, layer.multiplier, layer.shift, layer.relu);
+                        }
+                    }
+                }
+            };
+            if (pool) pool->ParallelFor((size_t)layer.outHeight, 1, rows);
+            else rows(0, (size_t)layer.outHeight);
+        }
+        else if (layer.type == POOL) {
+            // Dense layers read whole padded rows, so leave the padding zeroed
+            next.assign(AlignUp((size_t)layer.outChannels), 0);
+            if (layer.inWidth > 0) {
+                size_t pixels = (size_t)layer.inWidth * layer.inHeight;
+                for (int ch = 0; ch < layer.outChannels; ch++) {
+                    int64_t sum = 0;
+                    for (size_t i = 0; i < pixels; i++) sum += current[i * layer.inChannels + ch];
+                    int64_t half = (int64_t)pixels / 2;
+                    next[ch] = (int8_t)((sum >= 0 ? sum + half : sum - half) / (int64_t)pixels);
+                }
+            }
+            else {
+                std::copy(current.begin(), current.begin() + layer.outChannels, next.begin());
+            }
+        }
+        else {
+            current.resize(layer.rowBytes, 0);
+            bool isLast = &layer == &layers.back();
+            next.assign(AlignUp((size_t)layer.outChannels), 0);
+            const int8_t* w = layer.weights;
+            for (int oc = 0; oc < layer.outChannels; oc++, w += layer.rowBytes) {
+                int32_t acc = DotInt8(current.data(), w, layer.rowBytes) + layer.bias[oc];
+                if (isLast) logits.push_back((float)(std::ldexp((double)acc * layer.multiplier, -layer.shift)));
+                else next[oc] = Requantize(acc, layer.multiplier, layer.shift, layer.relu);
+            }
+        }
+        current.swap(next);
+    }
+
+    if (logits.size() != zoneLabels.size() + beachLabels.size()) return false;
+    size_t zone, beach;
+    SoftmaxPick(logits, 0, zoneLabels.size(), zone, out.zoneConfidence);
+    SoftmaxPick(logits, zoneLabels.size(), logits.size(), beach, out.beachTypeConfidence);
+
+    const std::string& zoneLabel = zoneLabels[zone];
+    size_t tab = zoneLabel.find('\t');
+    out.zone = zoneLabel.substr(0, tab);
+    out.zoneDetail = tab == std::string::npos ? std::string() : zoneLabel.substr(tab + 1);
+    out.beachType = beachLabels[beach].substr(0, beachLabels[beach].find('\t'));
+    out.inferenceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
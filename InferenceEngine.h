@@ -0,0 +1,91 @@
+/*
+*****************************************************************************
+*   GrainEye - On-device int8 inference                                       *
+*   ------------------------------------------------------------------------- *
+*   Runs the exported, int8-quantized zone / beach-type classifier on the   *
+*   CPU so classification keeps working without connectivity. Weights are  *
+*   memory-mapped from a flat file and used in place; convolutions run on    *
+*   SSE4.1/AVX2/NEON dot-product kernels picked at load, spread over the     *
+*   analysis thread pool.                                                    *
+*                                                                             *
+*   Model file (little-endian, "GEQ8" version 1):                            *
+*     header    u32 magic, version, inputWidth, inputHeight, inputChannels, *
+*               layerCount, zoneClasses, beachClasses, labelBytes            *
+*     labels    zoneClasses + beachClasses NUL-terminated UTF-8 strings,     *
+*               "Label" or "Label\tDetail"; padded to 16 bytes               *
+*     layers    u32 type, kernel, stride, inChannels, outChannels, relu,    *
+*               i32 multiplier, u32 shift, then for CONV/DENSE:              *
+*                 int8 weights, outChannels rows of inputs padded to 16,     *
+*                 conv rows ordered [ky][kx][channel]                        *
+*                 int32 bias[outChannels]; padded to 16 bytes               *
+*   Layer types: 1 CONV ("same" padding), 2 global average POOL, 3 DENSE.   *
+*   Activations are int8 HWC; the input is pixel - 128. Each layer          *
+*   requantizes with out = round(acc * multiplier / 2^shift). The last      *
+*   layer is DENSE with zoneClasses + beachClasses logits.                   *
+*****************************************************************************
+*/
+#pragma once
+
+#include "FileUtil.h"
+#include "ImageIO.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct Classification {
+    std::string zone;
+    std::string zoneDetail;
+    std::string beachType;
+    float zoneConfidence = 0.0f;        // softmax probability of the chosen label
+    float beachTypeConfidence = 0.0f;
+    double inferenceMs = 0.0;           // resize + network
+};
+
+class InferenceEngine {
+public:
+    InferenceEngine() = default;
+    InferenceEngine(const InferenceEngine&) = delete;
+    InferenceEngine& operator=(const InferenceEngine&) = delete;
+
+    bool Load(const std::string& path, std::string* error = nullptr);
+    bool IsLoaded() const { return !layers.empty(); }
+
+    // Thread-safe once loaded; pool == nullptr runs on the calling thread.
+    bool Classify(const PixelImage& image, Classification& out, ThreadPool* pool) const;
+
+    int InputWidth() const { return inputWidth; }
+    int InputHeight() const { return inputHeight; }
+    const char* KernelName() const;
+    long long MacsPerImage() const { return macs; }
+
+private:
+    enum LayerType { CONV = 1, POOL = 2, DENSE = 3 };
+
+    struct Layer {
+        int type;
+        int kernel;
+        int stride;
+        int inChannels;
+        int outChannels;
+        bool relu;
+        int32_t multiplier;
+        int shift;
+        size_t rowBytes;                // padded weight row
+        const int8_t* weights;          // points into the mapping
+        const int32_t* bias;
+        int inWidth, inHeight;          // activation size entering the layer
+        int outWidth, outHeight;
+    };
+
+    MappedFile file;
+    std::vector<Layer> layers;
+    std::vector<std::string> zoneLabels;
+    std::vector<std::string> beachLabels;
+    int inputWidth = 0;
+    int inputHeight = 0;
+    int inputChannels = 0;
+    long long macs = 0;
+};
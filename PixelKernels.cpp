@@ -0,0 +1,758 @@
+/*
+*****************************************************************************
+*   GrainEye - Pixel kernels                                                  *
+*****************************************************************************
+*/
+#include "PixelKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef GE_X86
+#include <immintrin.h>
+#endif
+#ifdef GE_NEON
+#include <arm_neon.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Shared constants
+// ---------------------------------------------------------------------------
+namespace {
+
+// sRGB -> XYZ (D65), with the white point folded into the X and Z rows
+const float LAB_M[9] = {
+    0.4124564f / 0.950456f, 0.3575761f / 0.950456f, 0.1804375f / 0.950456f,
+    0.2126729f,             0.7151522f,             0.0721750f,
+    0.0193339f / 1.088754f, 0.1191920f / 1.088754f, 0.9503041f / 1.088754f,
+};
+const float LAB_EPSILON = 0.008856f;
+const float LAB_KAPPA = 7.787f;
+const float LAB_OFFSET = 16.0f / 116.0f;
+
+struct SrgbTable {
+    float linear[256];
+    SrgbTable() {
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            linear[i] = (float)(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+    }
+};
+const SrgbTable g_srgb;
+
+inline uint8_t ClampToByte(float v) {
+    return (uint8_t)(v <= 0.0f ? 0 : v >= 255.0f ? 255 : (int)(v + 0.5f));
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Scalar reference
+// ---------------------------------------------------------------------------
+static void RgbToLumaScalar(const uint8_t* rgb, uint8_t* luma, size_t pixels) {
+    for (size_t i = 0; i < pixels; i++, rgb += 3)
+        luma[i] = (uint8_t)((77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8);
+}
+
+static void RgbToLabScalar(const uint8_t* rgb, uint8_t* lab, size_t pixels) {
+    for (size_t i = 0; i < pixels; i++, rgb += 3, lab += 3) {
+        float r = g_srgb.linear[rgb[0]], g = g_srgb.linear[rgb[1]], b = g_srgb.linear[rgb[2]];
+        float xyz[3];
+        for (int k = 0; k < 3; k++) {
+            float t = LAB_M[3 * k] * r + LAB_M[3 * k + 1] * g + LAB_M[3 * k + 2] * b;
+            xyz[k] = t > LAB_EPSILON ? std::cbrt(t) : LAB_KAPPA * t + LAB_OFFSET;
+        }
+        lab[0] = ClampToByte((116.0f * xyz[1] - 16.0f) * (255.0f / 100.0f));
+        lab[1] = ClampToByte(500.0f * (xyz[0] - xyz[1]) + 128.0f);
+        lab[2] = ClampToByte(200.0f * (xyz[1] - xyz[2]) + 128.0f);
+    }
+}
+
+static void BoxColumnsScalar(uint32_t* colSum, const uint32_t* add, const uint32_t* sub, uint8_t* out, size_t n, uint32_t mul) {
+    for (size_t i = 0; i < n; i++) {
+        colSum[i] += add[i] - sub[i];
+        out[i] = (uint8_t)((colSum[i] * mul + (1u << 22)) >> 23);
+    }
+}
+
+static void ConvolveRowsScalar(const uint8_t* const* rows, const uint16_t* weights, int taps, uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t acc = 128;
+        for (int k = 0; k < taps; k++) acc += weights[k] * rows[k][i];
+        out[i] = (uint8_t)(acc >> 8);
+    }
+}
+
+static void ThresholdRowScalar(const uint8_t* src, const uint8_t* mean, int offset, bool invert, uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = ((int)src[i] > (int)mean[i] - offset) != invert ? 255 : 0;
+}
+
+static void HalveRowScalar(const uint8_t* row0, const uint8_t* row1, uint8_t* out, size_t outPixels, int channels) {
+    size_t stride = (size_t)channels * 2;
+    for (size_t i = 0; i < outPixels; i++, row0 += stride, row1 += stride, out += channels)
+        for (int c = 0; c < channels; c++)
+            out[c] = (uint8_t)((row0[c] + row0[c + channels] + row1[c] + row1[c + channels] + 2) >> 2);
+}
+
+static const PixelKernelTable SCALAR_KERNELS = {
+    SimdLevel::Scalar, RgbToLumaScalar, RgbToLabScalar, BoxColumnsScalar, ConvolveRowsScalar, ThresholdRowScalar, HalveRowScalar,
+};
+
+// ---------------------------------------------------------------------------
+// SSE4.1 (with SSSE3 shuffles) and AVX2
+// ---------------------------------------------------------------------------
+#ifdef GE_X86
+namespace {
+
+// pshufb masks that split 16 RGB pixels (3 x 16 bytes) into R, G and B
+// planes and back. 0x80 zeroes a byte, so the three partial shuffles can
+// be OR-ed together.
+struct RgbShuffles {
+    alignas(16) uint8_t split[3][3][16];    // [channel][source block][byte]
+    alignas(16) uint8_t merge[3][3][16];    // [destination block][channel][byte]
+    RgbShuffles() {
+        for (int c = 0; c < 3; c++)
+            for (int block = 0; block < 3; block++)
+                for (int j = 0; j < 16; j++) {
+                    int byte = 3 * j + c;       // pixel j, channel c
+                    split[c][block][j] = byte / 16 == block ? (uint8_t)(byte % 16) : 0x80;
+                }
+        for (int block = 0; block < 3; block++)
+            for (int c = 0; c < 3; c++)
+                for (int j = 0; j < 16; j++) {
+                    int byte = 16 * block + j;
+                    merge[block][c][j] = byte % 3 == c ? (uint8_t)(byte / 3) : 0x80;
+                }
+    }
+};
+const RgbShuffles g_shuffles;
+
+GE_TARGET("sse4.1")
+inline __m128i Mask(const uint8_t* m) { return _mm_load_si128((const __m128i*)m); }
+
+GE_TARGET("sse4.1")
+inline void SplitRgb(const uint8_t* rgb, __m128i& r, __m128i& g, __m128i& b) {
+    __m128i in[3] = {
+        _mm_loadu_si128((const __m128i*)rgb),
+        _mm_loadu_si128((const __m128i*)(rgb + 16)),
+        _mm_loadu_si128((const __m128i*)(rgb + 32)),
+    };
+    __m128i planes[3];
+    for (int c = 0; c < 3; c++) {
+        planes[c] = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(in[0], Mask(g_shuffles.split[c][0])),
+            _mm_shuffle_epi8(in[1], Mask(g_shuffles.split[c][1]))),
+            _mm_shuffle_epi8(in[2], Mask(g_shuffles.split[c][2])));
+    }
+    r = planes[0];
+    g = planes[1];
+    b = planes[2];
+}
+
+// Inverse of SplitRgb; writes only the first `bytes` bytes (24 or 48).
+GE_TARGET("sse4.1")
+inline void MergeRgb(__m128i r, __m128i g, __m128i b, uint8_t* out, int bytes) {
+    for (int block = 0; block * 16 < bytes; block++) {
+        __m128i v = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(r, Mask(g_shuffles.merge[block][0])),
+            _mm_shuffle_epi8(g, Mask(g_shuffles.merge[block][1]))),
+            _mm_shuffle_epi8(b, Mask(g_shuffles.merge[block][2])));
+        if (bytes - block * 16 >= 16) _mm_storeu_si128((__m128i*)(out + 16 * block), v);
+        else _mm_storel_epi64((__m128i*)(out + 16 * block), v);
+    }
+}
+
+// Cube root: exponent/3 bit trick, then two Newton steps (~1e-6 relative)
+GE_TARGET("sse4.1")
+inline __m128 CbrtSSE(__m128 t) {
+    __m128 guess = _mm_cvtepi32_ps(_mm_castps_si128(t));
+    __m128 y = _mm_castsi128_ps(_mm_add_epi32(_mm_cvttps_epi32(_mm_mul_ps(guess, _mm_set1_ps(1.0f / 3.0f))), _mm_set1_epi32(709921077)));
+    for (int i = 0; i < 2; i++)
+        y = _mm_mul_ps(_mm_add_ps(_mm_add_ps(y, y), _mm_div_ps(t, _mm_mul_ps(y, y))), _mm_set1_ps(1.0f / 3.0f));
+    return y;
+}
+
+GE_TARGET("sse4.1")
+inline __m128 LabF(__m128 t) {
+    __m128 linear = _mm_add_ps(_mm_mul_ps(t, _mm_set1_ps(LAB_KAPPA)), _mm_set1_ps(LAB_OFFSET));
+    return _mm_blendv_ps(linear, CbrtSSE(t), _mm_cmpgt_ps(t, _mm_set1_ps(LAB_EPSILON)));
+}
+
+GE_TARGET("sse4.1")
+void RgbToLumaSSE4(const uint8_t* rgb, uint8_t* luma, size_t pixels) {
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i r, g, b;
+        SplitRgb(rgb + 3 * i, r, g, b);
+        __m128i zero = _mm_setzero_si128();
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), _mm_set1_epi16(77)),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), _mm_set1_epi16(150))),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), _mm_set1_epi16(29)));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), _mm_set1_epi16(77)),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), _mm_set1_epi16(150))),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), _mm_set1_epi16(29)));
+        _mm_storeu_si128((__m128i*)(luma + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+    RgbToLumaScalar(rgb + 3 * i, luma + i, pixels - i);
+}
+
+GE_TARGET("sse4.1")
+void RgbToLabSSE4(const uint8_t* rgb, uint8_t* lab, size_t pixels) {
+    size_t i = 0;
+    alignas(16) uint8_t planes[3][16];
+    alignas(16) float linear[3][16];
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i r, g, b;
+        SplitRgb(rgb + 3 * i, r, g, b);
+        _mm_store_si128((__m128i*)planes[0], r);
+        _mm_store_si128((__m128i*)planes[1], g);
+        _mm_store_si128((__m128i*)planes[2], b);
+        for (int c = 0; c < 3; c++)
+            for (int j = 0; j < 16; j++) linear[c][j] = g_srgb.linear[planes[c][j]];
+
+        __m128i out[3][4];
+        for (int q = 0; q < 4; q++) {
+            __m128 vr = _mm_load_ps(&linear[0][4 * q]), vg = _mm_load_ps(&linear[1][4 * q]), vb = _mm_load_ps(&linear[2][4 * q]);
+            __m128 f[3];
+            for (int k = 0; k < 3; k++) {
+                __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vr, _mm_set1_ps(LAB_M[3 * k])), _mm_mul_ps(vg, _mm_set1_ps(LAB_M[3 * k + 1]))),
+                    _mm_mul_ps(vb, _mm_set1_ps(LAB_M[3 * k + 2])));
+                f[k] = LabF(t);
+            }
+            __m128 L = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(f[1], _mm_set1_ps(116.0f)), _mm_set1_ps(16.0f)), _mm_set1_ps(255.0f / 100.0f));
+            __m128 A = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(f[0], f[1]), _mm_set1_ps(500.0f)), _mm_set1_ps(128.0f));
+            __m128 B = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(f[1], f[2]), _mm_set1_ps(200.0f)), _mm_set1_ps(128.0f));
+            out[0][q] = _mm_cvtps_epi32(L);
+            out[1][q] = _mm_cvtps_epi32(A);
+            out[2][q] = _mm_cvtps_epi32(B);
+        }
+        __m128i bytes[3];
+        for (int c = 0; c < 3; c++)
+            bytes[c] = _mm_packus_epi16(_mm_packs_epi32(out[c][0], out[c][1]), _mm_packs_epi32(out[c][2], out[c][3]));
+        MergeRgb(bytes[0], bytes[1], bytes[2], lab + 3 * i, 48);
+    }
+    RgbToLabScalar(rgb + 3 * i, lab + 3 * i, pixels - i);
+}
+
+GE_TARGET("sse4.1")
+void BoxColumnsSSE4(uint32_t* colSum, const uint32_t* add, const uint32_t* sub, uint8_t* out, size_t n, uint32_t mul) {
+    size_t i = 0;
+    __m128i vmul = _mm_set1_epi32((int)mul), round = _mm_set1_epi32(1 << 22);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v[4];
+        for (int q = 0; q < 4; q++) {
+            size_t k = i + 4 * q;
+            __m128i s = _mm_sub_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(colSum + k)),
+                _mm_loadu_si128((const __m128i*)(add + k))), _mm_loadu_si128((const __m128i*)(sub + k)));
+            _mm_storeu_si128((__m128i*)(colSum + k), s);
+            v[q] = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(s, vmul), round), 23);
+        }
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packus_epi32(v[0], v[1]), _mm_packus_epi32(v[2], v[3])));
+    }
+    BoxColumnsScalar(colSum + i, add + i, sub + i, out + i, n - i, mul);
+}
+
+GE_TARGET("sse4.1")
+void ConvolveRowsSSE4(const uint8_t* const* rows, const uint16_t* weights, int taps, uint8_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo = _mm_set1_epi16(128), hi = lo;
+        for (int k = 0; k < taps; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(rows[k] + i));
+            __m128i w = _mm_set1_epi16((short)weights[k]);
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_cvtepu8_epi16(v), w));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(v, 8)), w));
+        }
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+    if (i < n) {
+        const uint8_t* tail[64];
+        for (int k = 0; k < taps; k++) tail[k] = rows[k] + i;
+        ConvolveRowsScalar(tail, weights, taps, out + i, n - i);
+    }
+}
+
+GE_TARGET("sse4.1")
+void ThresholdRowSSE4(const uint8_t* src, const uint8_t* mean, int offset, bool invert, uint8_t* out, size_t n) {
+    size_t i = 0;
+    __m128i voffset = _mm_set1_epi16((short)offset), flip = _mm_set1_epi8(invert ? -1 : 0);
+    for (; i + 16 <= n; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i m = _mm_loadu_si128((const __m128i*)(mean + i));
+        __m128i lo = _mm_cmpgt_epi16(_mm_cvtepu8_epi16(s), _mm_sub_epi16(_mm_cvtepu8_epi16(m), voffset));
+        __m128i hi = _mm_cmpgt_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(s, 8)), _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(m, 8)), voffset));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(_mm_packs_epi16(lo, hi), flip));
+    }
+    ThresholdRowScalar(src + i, mean + i, offset, invert, out + i, n - i);
+}
+
+// Pairwise sums of 16 bytes from each row, (a + b + c + d + 2) >> 2 as 8 x u16
+GE_TARGET("sse4.1")
+inline __m128i HalvePairs(__m128i a, __m128i b) {
+    __m128i ones = _mm_set1_epi8(1);
+    __m128i sum = _mm_add_epi16(_mm_maddubs_epi16(a, ones), _mm_maddubs_epi16(b, ones));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+GE_TARGET("sse4.1")
+void HalveRowSSE4(const uint8_t* row0, const uint8_t* row1, uint8_t* out, size_t outPixels, int channels) {
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 16 <= outPixels; i += 16) {
+            __m128i lo = HalvePairs(_mm_loadu_si128((const __m128i*)(row0 + 2 * i)), _mm_loadu_si128((const __m128i*)(row1 + 2 * i)));
+            __m128i hi = HalvePairs(_mm_loadu_si128((const __m128i*)(row0 + 2 * i + 16)), _mm_loadu_si128((const __m128i*)(row1 + 2 * i + 16)));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+        }
+    }
+    else {
+        // 16 input pixels per row -> 8 output pixels
+        for (; i + 8 <= outPixels; i += 8) {
+            __m128i r0, g0, b0, r1, g1, b1;
+            SplitRgb(row0 + 6 * i, r0, g0, b0);
+            SplitRgb(row1 + 6 * i, r1, g1, b1);
+            __m128i zero = _mm_setzero_si128();
+            MergeRgb(_mm_packus_epi16(HalvePairs(r0, r1), zero), _mm_packus_epi16(HalvePairs(g0, g1), zero),
+                _mm_packus_epi16(HalvePairs(b0, b1), zero), out + 3 * i, 24);
+        }
+    }
+    size_t step = (size_t)channels * i;
+    HalveRowScalar(row0 + 2 * step, row1 + 2 * step, out + step, outPixels - i, channels);
+}
+
+const PixelKernelTable SSE4_KERNELS = {
+    SimdLevel::SSE4, RgbToLumaSSE4, RgbToLabSSE4, BoxColumnsSSE4, ConvolveRowsSSE4, ThresholdRowSSE4, HalveRowSSE4,
+};
+
+// AVX2: the arithmetic-bound kernels get 256-bit versions. Luma and
+// halving are bound by the RGB shuffles, which AVX2 only does per 128-bit
+// lane, so they keep the SSE4.1 code.
+GE_TARGET("avx2")
+inline __m256 CbrtAVX2(__m256 t) {
+    __m256 guess = _mm256_cvtepi32_ps(_mm256_castps_si256(t));
+    __m256 y = _mm256_castsi256_ps(_mm256_add_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(guess, _mm256_set1_ps(1.0f / 3.0f))),
+        _mm256_set1_epi32(709921077)));
+    for (int i = 0; i < 2; i++)
+        y = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(y, y), _mm256_div_ps(t, _mm256_mul_ps(y, y))), _mm256_set1_ps(1.0f / 3.0f));
+    return y;
+}
+
+GE_TARGET("avx2")
+void RgbToLabAVX2(const uint8_t* rgb, uint8_t* lab, size_t pixels) {
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i planes[3];
+        SplitRgb(rgb + 3 * i, planes[0], planes[1], planes[2]);
+        __m128i packed[3][2];
+        for (int half = 0; half < 2; half++) {
+            __m256 v[3];
+            for (int c = 0; c < 3; c++) {
+                __m128i bytes = half ? _mm_srli_si128(planes[c], 8) : planes[c];
+                v[c] = _mm256_i32gather_ps(g_srgb.linear, _mm256_cvtepu8_epi32(bytes), 4);
+            }
+            __m256 f[3];
+            for (int k = 0; k < 3; k++) {
+                __m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v[0], _mm256_set1_ps(LAB_M[3 * k])),
+                    _mm256_mul_ps(v[1], _mm256_set1_ps(LAB_M[3 * k + 1]))), _mm256_mul_ps(v[2], _mm256_set1_ps(LAB_M[3 * k + 2])));
+                __m256 linear = _mm256_add_ps(_mm256_mul_ps(t, _mm256_set1_ps(LAB_KAPPA)), _mm256_set1_ps(LAB_OFFSET));
+                f[k] = _mm256_blendv_ps(linear, CbrtAVX2(t), _mm256_cmp_ps(t, _mm256_set1_ps(LAB_EPSILON), _CMP_GT_OQ));
+            }
+            __m256 L = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(f[1], _mm256_set1_ps(116.0f)), _mm256_set1_ps(16.0f)), _mm256_set1_ps(255.0f / 100.0f));
+            __m256 A = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(f[0], f[1]), _mm256_set1_ps(500.0f)), _mm256_set1_ps(128.0f));
+            __m256 B = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(f[1], f[2]), _mm256_set1_ps(200.0f)), _mm256_set1_ps(128.0f));
+            __m256i ints[3] = { _mm256_cvtps_epi32(L), _mm256_cvtps_epi32(A), _mm256_cvtps_epi32(B) };
+            for (int c = 0; c < 3; c++)
+                packed[c][half] = _mm_packs_epi32(_mm256_castsi256_si128(ints[c]), _mm256_extracti128_si256(ints[c], 1));
+        }
+        MergeRgb(_mm_packus_epi16(packed[0][0], packed[0][1]), _mm_packus_epi16(packed[1][0], packed[1][1]),
+            _mm_packus_epi16(packed[2][0], packed[2][1]), lab + 3 * i, 48);
+    }
+    RgbToLabScalar(rgb + 3 * i, lab + 3 * i, pixels - i);
+}
+
+GE_TARGET("avx2")
+void BoxColumnsAVX2(uint32_t* colSum, const uint32_t* add, const uint32_t* sub, uint8_t* out, size_t n, uint32_t mul) {
+    size_t i = 0;
+    __m256i vmul = _mm256_set1_epi32((int)mul), round = _mm256_set1_epi32(1 << 22);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v[4];
+        for (int q = 0; q < 2; q++) {
+            size_t k = i + 8 * q;
+            __m256i s = _mm256_sub_epi32(_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(colSum + k)),
+                _mm256_loadu_si256((const __m256i*)(add + k))), _mm256_loadu_si256((const __m256i*)(sub + k)));
+            _mm256_storeu_si256((__m256i*)(colSum + k), s);
+            __m256i r = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(s, vmul), round), 23);
+            v[2 * q] = _mm256_castsi256_si128(r);
+            v[2 * q + 1] = _mm256_extracti128_si256(r, 1);
+        }
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packus_epi32(v[0], v[1]), _mm_packus_epi32(v[2], v[3])));
+    }
+    BoxColumnsScalar(colSum + i, add + i, sub + i, out + i, n - i, mul);
+}
+
+GE_TARGET("avx2")
+void ConvolveRowsAVX2(const uint8_t* const* rows, const uint16_t* weights, int taps, uint8_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = _mm256_set1_epi16(128), hi = lo;
+        for (int k = 0; k < taps; k++) {
+            __m256i w = _mm256_set1_epi16((short)weights[k]);
+            lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rows[k] + i))), w));
+            hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(rows[k] + i + 16))), w));
+        }
+        // packus works per 128-bit lane; restore the pixel order afterwards
+        __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    if (i < n) {
+        const uint8_t* tail[64];
+        for (int k = 0; k < taps; k++) tail[k] = rows[k] + i;
+        ConvolveRowsSSE4(tail, weights, taps, out + i, n - i);
+    }
+}
+
+GE_TARGET("avx2")
+void ThresholdRowAVX2(const uint8_t* src, const uint8_t* mean, int offset, bool invert, uint8_t* out, size_t n) {
+    size_t i = 0;
+    __m256i voffset = _mm256_set1_epi16((short)offset), flip = _mm256_set1_epi8(invert ? -1 : 0);
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = _mm256_cmpgt_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i))),
+            _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(mean + i))), voffset));
+        __m256i hi = _mm256_cmpgt_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + i + 16))),
+            _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(mean + i + 16))), voffset));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_xor_si256(packed, flip));
+    }
+    ThresholdRowSSE4(src + i, mean + i, offset, invert, out + i, n - i);
+}
+
+const PixelKernelTable AVX2_KERNELS = {
+    SimdLevel::AVX2, RgbToLumaSSE4, RgbToLabAVX2, BoxColumnsAVX2, ConvolveRowsAVX2, ThresholdRowAVX2, HalveRowSSE4,
+};
+
+} // namespace
+#endif
+
+// ---------------------------------------------------------------------------
+// NEON
+// ---------------------------------------------------------------------------
+#ifdef GE_NEON
+namespace {
+
+inline float32x4_t DivideNEON(float32x4_t a, float32x4_t b) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+    return vdivq_f32(a, b);
+#else
+    float32x4_t inv = vrecpeq_f32(b);
+    inv = vmulq_f32(vrecpsq_f32(b, inv), inv);
+    inv = vmulq_f32(vrecpsq_f32(b, inv), inv);
+    return vmulq_f32(a, inv);
+#endif
+}
+
+inline int32x4_t RoundNEON(float32x4_t v) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+    return vcvtnq_s32_f32(v);
+#else
+    // Values are >= -0.5 after the Lab offsets that matter; negatives clamp to 0 anyway
+    return vcvtq_s32_f32(vaddq_f32(v, vdupq_n_f32(0.5f)));
+#endif
+}
+
+inline float32x4_t CbrtNEON(float32x4_t t) {
+    float32x4_t guess = vcvtq_f32_s32(vreinterpretq_s32_f32(t));
+    float32x4_t y = vreinterpretq_f32_s32(vaddq_s32(vcvtq_s32_f32(vmulq_n_f32(guess, 1.0f / 3.0f)), vdupq_n_s32(709921077)));
+    for (int i = 0; i < 2; i++)
+        y = vmulq_n_f32(vaddq_f32(vaddq_f32(y, y), DivideNEON(t, vmulq_f32(y, y))), 1.0f / 3.0f);
+    return y;
+}
+
+void RgbToLumaNEON(const uint8_t* rgb, uint8_t* luma, size_t pixels) {
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x3_t v = vld3q_u8(rgb + 3 * i);
+        uint16x8_t lo = vmull_u8(vget_low_u8(v.val[0]), vdup_n_u8(77));
+        lo = vmlal_u8(lo, vget_low_u8(v.val[1]), vdup_n_u8(150));
+        lo = vmlal_u8(lo, vget_low_u8(v.val[2]), vdup_n_u8(29));
+        uint16x8_t hi = vmull_u8(vget_high_u8(v.val[0]), vdup_n_u8(77));
+        hi = vmlal_u8(hi, vget_high_u8(v.val[1]), vdup_n_u8(150));
+        hi = vmlal_u8(hi, vget_high_u8(v.val[2]), vdup_n_u8(29));
+        vst1q_u8(luma + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+    RgbToLumaScalar(rgb + 3 * i, luma + i, pixels - i);
+}
+
+void RgbToLabNEON(const uint8_t* rgb, uint8_t* lab, size_t pixels) {
+    size_t i = 0;
+    uint8_t planes[3][16];
+    float linear[3][16];
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x3_t v = vld3q_u8(rgb + 3 * i);
+        vst1q_u8(planes[0], v.val[0]);
+        vst1q_u8(planes[1], v.val[1]);
+        vst1q_u8(planes[2], v.val[2]);
+        for (int c = 0; c < 3; c++)
+            for (int j = 0; j < 16; j++) linear[c][j] = g_srgb.linear[planes[c][j]];
+
+        uint16x4_t words[3][4];
+        for (int q = 0; q < 4; q++) {
+            float32x4_t vr = vld1q_f32(&linear[0][4 * q]), vg = vld1q_f32(&linear[1][4 * q]), vb = vld1q_f32(&linear[2][4 * q]);
+            float32x4_t f[3];
+            for (int k = 0; k < 3; k++) {
+                float32x4_t t = vmulq_n_f32(vr, LAB_M[3 * k]);
+                t = vmlaq_n_f32(t, vg, LAB_M[3 * k + 1]);
+                t = vmlaq_n_f32(t, vb, LAB_M[3 * k + 2]);
+                float32x4_t linearF = vaddq_f32(vmulq_n_f32(t, LAB_KAPPA), vdupq_n_f32(LAB_OFFSET));
+                f[k] = vbslq_f32(vcgtq_f32(t, vdupq_n_f32(LAB_EPSILON)), CbrtNEON(t), linearF);
+            }
+            float32x4_t L = vmulq_n_f32(vsubq_f32(vmulq_n_f32(f[1], 116.0f), vdupq_n_f32(16.0f)), 255.0f / 100.0f);
+            float32x4_t A = vaddq_f32(vmulq_n_f32(vsubq_f32(f[0], f[1]), 500.0f), vdupq_n_f32(128.0f));
+            float32x4_t B = vaddq_f32(vmulq_n_f32(vsubq_f32(f[1], f[2]), 200.0f), vdupq_n_f32(128.0f));
+            words[0][q] = vqmovun_s32(RoundNEON(L));
+            words[1][q] = vqmovun_s32(RoundNEON(A));
+            words[2][q] = vqmovun_s32(RoundNEON(B));
+        }
+        uint8x16x3_t out;
+        for (int c = 0; c < 3; c++)
+            out.val[c] = vcombine_u8(vqmovn_u16(vcombine_u16(words[c][0], words[c][1])), vqmovn_u16(vcombine_u16(words[c][2], words[c][3])));
+        vst3q_u8(lab + 3 * i, out);
+    }
+    RgbToLabScalar(rgb + 3 * i, lab + 3 * i, pixels - i);
+}
+
+void BoxColumnsNEON(uint32_t* colSum, const uint32_t* add, const uint32_t* sub, uint8_t* out, size_t n, uint32_t mul) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x4_t half[2];
+        for (int q = 0; q < 2; q++) {
+            size_t k = i + 4 * q;
+            uint32x4_t s = vsubq_u32(vaddq_u32(vld1q_u32(colSum + k), vld1q_u32(add + k)), vld1q_u32(sub + k));
+            vst1q_u32(colSum + k, s);
+            half[q] = vmovn_u32(vshrq_n_u32(vaddq_u32(vmulq_n_u32(s, mul), vdupq_n_u32(1u << 22)), 23));
+        }
+        vst1_u8(out + i, vqmovn_u16(vcombine_u16(half[0], half[1])));
+    }
+    BoxColumnsScalar(colSum + i, add + i, sub + i, out + i, n - i, mul);
+}
+
+void ConvolveRowsNEON(const uint8_t* const* rows, const uint16_t* weights, int taps, uint8_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint16x8_t lo = vdupq_n_u16(0), hi = lo;
+        for (int k = 0; k < taps; k++) {
+            uint8x16_t v = vld1q_u8(rows[k] + i);
+            lo = vmlaq_n_u16(lo, vmovl_u8(vget_low_u8(v)), weights[k]);
+            hi = vmlaq_n_u16(hi, vmovl_u8(vget_high_u8(v)), weights[k]);
+        }
+        vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));     // (acc + 128) >> 8
+    }
+    if (i < n) {
+        const uint8_t* tail[64];
+        for (int k = 0; k < taps; k++) tail[k] = rows[k] + i;
+        ConvolveRowsScalar(tail, weights, taps, out + i, n - i);
+    }
+}
+
+void ThresholdRowNEON(const uint8_t* src, const uint8_t* mean, int offset, bool invert, uint8_t* out, size_t n) {
+    size_t i = 0;
+    int16x8_t voffset = vdupq_n_s16((int16_t)offset);
+    uint8x16_t flip = vdupq_n_u8(invert ? 0xFF : 0);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i), m = vld1q_u8(mean + i);
+        uint16x8_t lo = vcgtq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(s))), vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(m))), voffset));
+        uint16x8_t hi = vcgtq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(s))), vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(m))), voffset));
+        vst1q_u8(out + i, veorq_u8(vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)), flip));
+    }
+    ThresholdRowScalar(src + i, mean + i, offset, invert, out + i, n - i);
+}
+
+void HalveRowNEON(const uint8_t* row0, const uint8_t* row1, uint8_t* out, size_t outPixels, int channels) {
+    size_t i = 0;
+    if (channels == 1) {
+        for (; i + 8 <= outPixels; i += 8) {
+            uint16x8_t sum = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * i)), vpaddlq_u8(vld1q_u8(row1 + 2 * i)));
+            vst1_u8(out + i, vrshrn_n_u16(sum, 2));
+        }
+    }
+    else {
+        for (; i + 8 <= outPixels; i += 8) {
+            uint8x16x3_t a = vld3q_u8(row0 + 6 * i), b = vld3q_u8(row1 + 6 * i);
+            uint8x8x3_t o;
+            for (int c = 0; c < 3; c++)
+                o.val[c] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c])), 2);
+            vst3_u8(out + 3 * i, o);
+        }
+    }
+    size_t step = (size_t)channels * i;
+    HalveRowScalar(row0 + 2 * step, row1 + 2 * step, out + step, outPixels - i, channels);
+}
+
+const PixelKernelTable NEON_KERNELS = {
+    SimdLevel::NEON, RgbToLumaNEON, RgbToLabNEON, BoxColumnsNEON, ConvolveRowsNEON, ThresholdRowNEON, HalveRowNEON,
+};
+
+} // namespace
+#endif
+
+// ---------------------------------------------------------------------------
+// Dispatch
+// ---------------------------------------------------------------------------
+const PixelKernelTable* PixelKernelsFor(SimdLevel level) {
+    const CpuFeatures& cpu = GetCpuFeatures();
+    switch (level) {
+    case SimdLevel::Scalar: return &SCALAR_KERNELS;
+#ifdef GE_X86
+    case SimdLevel::SSE4: return cpu.sse41 ? &SSE4_KERNELS : nullptr;
+    case SimdLevel::AVX2: return cpu.avx2 ? &AVX2_KERNELS : nullptr;
+#endif
+#ifdef GE_NEON
+    case SimdLevel::NEON: return cpu.neon ? &NEON_KERNELS : nullptr;
+#endif
+    default: return nullptr;
+    }
+}
+
+const PixelKernelTable& PixelKernels() {
+    static const PixelKernelTable* table = PixelKernelsFor(ActiveSimdLevel());
+    return table ? *table : SCALAR_KERNELS;
+}
+
+// ---------------------------------------------------------------------------
+// Image-level operations
+// ---------------------------------------------------------------------------
+static const PixelKernelTable& Table(const PixelKernelTable* table) {
+    return table ? *table : PixelKernels();
+}
+
+void ConvertToLuma(const PixelImage& image, GrayImage& out, const PixelKernelTable* table) {
+    out.width = image.width;
+    out.height = image.height;
+    out.pixels.resize((size_t)image.width * image.height);
+    Table(table).rgbToLuma(image.rgb.data(), out.pixels.data(), out.pixels.size());
+}
+
+void ConvertToLab(const PixelImage& image, PixelImage& lab, const PixelKernelTable* table) {
+    lab.width = image.width;
+    lab.height = image.height;
+    lab.rgb.resize(image.rgb.size());
+    Table(table).rgbToLab(image.rgb.data(), lab.rgb.data(), (size_t)image.width * image.height);
+}
+
+void BoxBlur(const GrayImage& image, int radius, GrayImage& out, const PixelKernelTable* table) {
+    const PixelKernelTable& k = Table(table);
+    radius = std::min(std::max(radius, 1), 127);
+    const int width = image.width, height = image.height;
+    out.width = width;
+    out.height = height;
+    out.pixels.resize((size_t)width * height);
+    if (image.Empty()) return;
+
+    const uint32_t area = (uint32_t)(2 * radius + 1) * (uint32_t)(2 * radius + 1);
+    const uint32_t mul = (uint32_t)(((1u << 23) + area / 2) / area);
+
+    // Ring of horizontal window sums; both row streams below only move forward
+    // and are at most 2 * radius + 1 rows apart
+    const int ringRows = 2 * radius + 2;
+    std::vector<uint32_t> ring((size_t)ringRows * width);
+    std::vector<int> ringRow(ringRows, -1);
+    auto horizontal = [&](int y) -> const uint32_t* {
+        y = std::min(std::max(y, 0), height - 1);
+        uint32_t* sums = &ring[(size_t)(y % ringRows) * width];
+        if (ringRow[y % ringRows] == y) return sums;
+        ringRow[y % ringRows] = y;
+        const uint8_t* src = image.Row(y);
+        uint32_t sum = 0;
+        for (int x = -radius - 1; x < radius; x++) sum += src[std::min(std::max(x, 0), width - 1)];
+        for (int x = 0; x < width; x++) {
+            sum += src[std::min(x + radius, width - 1)];
+            sum -= src[std::max(x - radius - 1, 0)];
+            sums[x] = sum;
+        }
+        return sums;
+    };
+
+    // colSum starts at rows -radius-1 .. radius-1 so that the first call
+    // (add row radius, drop row -radius-1) yields rows -radius .. radius
+    std::vector<uint32_t> colSum(width, 0);
+    for (int y = -radius - 1; y < radius; y++) {
+        const uint32_t* h = horizontal(y);
+        for (int x = 0; x < width; x++) colSum[x] += h[x];
+    }
+    for (int y = 0; y < height; y++) {
+        const uint32_t* add = horizontal(y + radius);
+        const uint32_t* sub = horizontal(y - radius - 1);
+        k.boxColumns(colSum.data(), add, sub, out.Row(y), (size_t)width, mul);
+    }
+}
+
+void GaussianBlur(const GrayImage& image, float sigma, GrayImage& out, const PixelKernelTable* table) {
+    const PixelKernelTable& k = Table(table);
+    const int width = image.width, height = image.height;
+    out.width = width;
+    out.height = height;
+    out.pixels.resize((size_t)width * height);
+    if (image.Empty()) return;
+
+    // Q8 weights that sum to exactly 256
+    int radius = std::min(std::max((int)std::ceil(3.0f * sigma), 1), 15);
+    int taps = 2 * radius + 1;
+    std::vector<double> exact(taps);
+    double total = 0.0;
+    for (int i = 0; i < taps; i++) total += exact[i] = std::exp(-(double)(i - radius) * (i - radius) / (2.0 * sigma * sigma));
+    std::vector<uint16_t> weights(taps);
+    int sum = 0;
+    for (int i = 0; i < taps; i++) sum += weights[i] = (uint16_t)std::lround(256.0 * exact[i] / total);
+    weights[radius] = (uint16_t)(weights[radius] + 256 - sum);
+
+    // Horizontal pass: the same row kernel over shifted views of a padded row
+    GrayImage temp;
+    temp.width = width;
+    temp.height = height;
+    temp.pixels.resize(out.pixels.size());
+    std::vector<uint8_t> padded((size_t)width + 2 * radius);
+    std::vector<const uint8_t*> rows(taps);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = image.Row(y);
+        for (int x = -radius; x < width + radius; x++) padded[x + radius] = src[std::min(std::max(x, 0), width - 1)];
+        for (int i = 0; i < taps; i++) rows[i] = padded.data() + i;
+        k.convolveRows(rows.data(), weights.data(), taps, temp.Row(y), (size_t)width);
+    }
+
+    // Vertical pass over neighbouring rows (edges repeat)
+    for (int y = 0; y < height; y++) {
+        for (int i = 0; i < taps; i++) rows[i] = temp.Row(std::min(std::max(y + i - radius, 0), height - 1));
+        k.convolveRows(rows.data(), weights.data(), taps, out.Row(y), (size_t)width);
+    }
+}
+
+void AdaptiveThreshold(const GrayImage& image, int radius, int offset, bool invert, GrayImage& mask, const PixelKernelTable* table) {
+    const PixelKernelTable& k = Table(table);
+    GrayImage mean;
+    BoxBlur(image, radius, mean, &k);
+    mask.width = image.width;
+    mask.height = image.height;
+    mask.pixels.resize(image.pixels.size());
+    for (int y = 0; y < image.height; y++)
+        k.thresholdRow(image.Row(y), mean.Row(y), offset, invert, mask.Row(y), (size_t)image.width);
+}
+
+void DownscaleHalf(const PixelImage& image, PixelImage& out, const PixelKernelTable* table) {
+    const PixelKernelTable& k = Table(table);
+    out.width = image.width / 2;
+    out.height = image.height / 2;
+    out.rgb.resize((size_t)out.width * out.height * 3);
+    for (int y = 0; y < out.height; y++)
+        k.halveRow(image.Row(2 * y), image.Row(2 * y + 1), out.rgb.data() + (size_t)y * out.width * 3, (size_t)out.width, 3);
+}
+
+void DownscaleHalf(const GrayImage& image, GrayImage& out, const PixelKernelTable* table) {
+    const PixelKernelTable& k = Table(table);
+    out.width = image.width / 2;
+    out.height = image.height / 2;
+    out.pixels.resize((size_t)out.width * out.height);
+    for (int y = 0; y < out.height; y++)
+        k.halveRow(image.Row(2 * y), image.Row(2 * y + 1), out.Row(y), (size_t)out.width, 1);
+}
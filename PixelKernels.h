@@ -0,0 +1,69 @@
+/*
+*****************************************************************************
+*   GrainEye - Pixel kernels                                                  *
+*   ------------------------------------------------------------------------- *
+*   Colour conversion, blurs, thresholding and downscaling for the analysis *
+*   stages, with scalar, SSE4.1, AVX2 and NEON versions of every row kernel. *
+*   The table for the best level the CPU supports is picked at startup       *
+*   (see CpuFeatures.h); the image-level functions below go through it.     *
+*                                                                             *
+*   Integer kernels give bit-identical output on every level. Lab uses an   *
+*   approximate cube root in the vector versions and may differ from the    *
+*   scalar reference by one code value.                                      *
+*****************************************************************************
+*/
+#pragma once
+
+#include "CpuFeatures.h"
+#include "ImageIO.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct GrayImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;    // width * height, rows top to bottom
+
+    bool Empty() const { return width <= 0 || height <= 0; }
+    uint8_t* Row(int y) { return pixels.data() + (size_t)y * width; }
+    const uint8_t* Row(int y) const { return pixels.data() + (size_t)y * width; }
+};
+
+// One row at a time; every kernel handles any length, including tails.
+struct PixelKernelTable {
+    SimdLevel level;
+
+    // luma = (77 R + 150 G + 29 B) >> 8 (BT.601)
+    void (*rgbToLuma)(const uint8_t* rgb, uint8_t* luma, size_t pixels);
+    // CIE L*a*b* (D65, sRGB input), 8-bit: L * 255 / 100, a + 128, b + 128
+    void (*rgbToLab)(const uint8_t* rgb, uint8_t* lab, size_t pixels);
+    // colSum += add - sub; out = (colSum * mul + 2^22) >> 23
+    void (*boxColumns)(uint32_t* colSum, const uint32_t* add, const uint32_t* sub, uint8_t* out, size_t n, uint32_t mul);
+    // out[x] = (sum_k weights[k] * rows[k][x] + 128) >> 8, weights sum to 256
+    void (*convolveRows)(const uint8_t* const* rows, const uint16_t* weights, int taps, uint8_t* out, size_t n);
+    // out = (src > mean - offset) != invert ? 255 : 0
+    void (*thresholdRow)(const uint8_t* src, const uint8_t* mean, int offset, bool invert, uint8_t* out, size_t n);
+    // 2x2 box average of two rows; channels is 1 or 3
+    void (*halveRow)(const uint8_t* row0, const uint8_t* row1, uint8_t* out, size_t outPixels, int channels);
+};
+
+// Table for ActiveSimdLevel().
+const PixelKernelTable& PixelKernels();
+
+// Table for a given level, or nullptr if it is not built in or the CPU
+// lacks it. Used by the self-test to compare every level with Scalar.
+const PixelKernelTable* PixelKernelsFor(SimdLevel level);
+
+// Image-level operations. table == nullptr uses PixelKernels().
+void ConvertToLuma(const PixelImage& image, GrayImage& out, const PixelKernelTable* table = nullptr);
+void ConvertToLab(const PixelImage& image, PixelImage& lab, const PixelKernelTable* table = nullptr);
+void BoxBlur(const GrayImage& image, int radius, GrayImage& out, const PixelKernelTable* table = nullptr);     // radius 1..127
+void GaussianBlur(const GrayImage& image, float sigma, GrayImage& out, const PixelKernelTable* table = nullptr); // up to 31 taps
+// Mean-C adaptive threshold over a (2 radius + 1)^2 window. invert selects
+// pixels darker than their surroundings.
+void AdaptiveThreshold(const GrayImage& image, int radius, int offset, bool invert, GrayImage& mask,
+    const PixelKernelTable* table = nullptr);
+void DownscaleHalf(const PixelImage& image, PixelImage& out, const PixelKernelTable* table = nullptr);
+void DownscaleHalf(const GrayImage& image, GrayImage& out, const PixelKernelTable* table = nullptr);
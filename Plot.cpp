@@ -0,0 +1,438 @@
+/*
+*****************************************************************************
+*   GrainEye - Plotting                                                       *
+*****************************************************************************
+*/
+#include "Plot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Grain size graphs (shared by the window and reports)
+// ---------------------------------------------------------------------------
+const char* GraphTitle(GraphKind kind) {
+    return kind == GRAPH_DISTRIBUTION ? "Grain Size Distribution" : "Cumulative Grain Size Curve";
+}
+
+void DrawResultGraph(PlotCanvas& canvas, const AnalysisResult& result, GraphKind kind,
+    int x, int y, int width, int height, double scale) {
+    auto px = [scale](double v) { return (int)(v * scale + 0.5); };
+    const PlotColor grey = PlotRgb(170, 170, 170);      // #aaaaaa, like the Python axes
+    const PlotColor green = PlotRgb(46, 204, 113);      // #2ecc71 - emerald green
+
+    // Near-black background (like the Python plots) over the card, grey border, title
+    canvas.FillRect(x, y, width, height, PlotRgb(18, 18, 18), 230);
+    canvas.RoundedFrame(x, y, width, height, px(10), grey);
+    canvas.Text(GraphTitle(kind), x, y + px(10), x + width, y + px(36), px(16), grey, PLOT_TEXT_CENTER | PLOT_TEXT_BOLD);
+
+    // Graph area boundaries
+    int graphLeft = x + px(60);
+    int graphRight = x + width - px(30);
+    int graphTop = y + px(50);
+    int graphBottom = y + height - px(50);
+
+    // Grid lines (like Python's grid), then the axes
+    for (int i = 0; i <= 5; i++) {
+        int yPos = graphBottom - i * (graphBottom - graphTop) / 5;
+        canvas.Line(graphLeft, yPos, graphRight, yPos, px(1), grey);
+    }
+    for (int i = 0; i <= 10; i++) {
+        int xPos = graphLeft + i * (graphRight - graphLeft) / 10;
+        canvas.Line(xPos, graphTop, xPos, graphBottom, px(1), grey);
+    }
+    canvas.Line(graphLeft, graphBottom, graphRight, graphBottom, px(2), grey);
+    canvas.Line(graphLeft, graphTop, graphLeft, graphBottom, px(2), grey);
+
+    // Distribution of the (possibly partial) result
+    const std::vector<double>& grainSizes = result.binSizesMm;
+    const std::vector<int>& counts = result.binCounts;
+    const int bins = (int)(std::min)(grainSizes.size(), counts.size());
+    const double minSize = bins > 0 ? grainSizes[0] : 0.0;
+    const double sizeSpan = bins > 1 ? grainSizes[bins - 1] - grainSizes[0] : 1.0;
+    const unsigned labelFlags = PLOT_TEXT_CENTER | PLOT_TEXT_VCENTER;
+
+    if (kind == GRAPH_DISTRIBUTION) {
+        int barWidth = (graphRight - graphLeft) / 15;
+        int maxCount = 1;
+        for (int i = 0; i < bins; i++) {
+            if (counts[i] > maxCount) maxCount = counts[i];
+        }
+        for (int i = 0; i < bins; i++) {
+            int barHeight = (int)((double)counts[i] / maxCount * (graphBottom - graphTop));
+            int barX = graphLeft + (int)((grainSizes[i] - minSize) / sizeSpan * (graphRight - graphLeft - barWidth));
+            canvas.Rectangle(barX, graphBottom - barHeight, barX + barWidth, graphBottom, green, grey);
+        }
+
+        canvas.Text("Grain Size (mm)", x, y + height - px(65), x + width, y + height, px(18), grey, labelFlags);
+        canvas.Text("Frequency", x + px(1), (int)(y + height / 1.5 - 80 * scale), x + px(108), (int)(y + height / 1.5 + 80 * scale),
+            px(18), grey, labelFlags | PLOT_TEXT_VERTICAL);
+    }
+    else if (kind == GRAPH_CUMULATIVE && bins > 0) {
+        std::vector<double> cumulativePercent(bins);
+        int total = 0;
+        for (int i = 0; i < bins; i++) total += counts[i];
+        if (total == 0) total = 1;
+        cumulativePercent[0] = (counts[0] * 100.0) / total;
+        for (int i = 1; i < bins; i++) {
+            cumulativePercent[i] = cumulativePercent[i - 1] + (counts[i] * 100.0) / total;
+        }
+
+        // Line through the bins, with the data points as dots
+        std::vector<PlotPoint> points(bins);
+        for (int i = 0; i < bins; i++) {
+            points[i].x = graphLeft + (int)((grainSizes[i] - minSize) / sizeSpan * (graphRight - graphLeft));
+            points[i].y = graphBottom - (int)(cumulativePercent[i] / 100.0 * (graphBottom - graphTop));
+        }
+        canvas.Polyline(points.data(), points.size(), px(3), green);
+        for (const auto& p : points) canvas.Dot(p.x, p.y, px(4), green);
+
+        canvas.Text("Grain Size (mm)", x, y + height - px(65), x + width, y + height, px(18), grey, labelFlags);
+        canvas.Text("Cumulative % Passing", x + px(5), y + height - px(210), x + px(159), y + height + px(85),
+            px(18), grey, labelFlags | PLOT_TEXT_VERTICAL);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Bitmap font: 5x7 glyphs in a 6-unit cell, one byte per row (bit 4 is the
+// left column). ASCII 32..126, then the bullet, degree sign and arrow.
+// ---------------------------------------------------------------------------
+static const uint8_t FONT_5X7[98][7] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  // space
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },  // !
+    { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 },  // "
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A },  // #
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 },  // $
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },  // %
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D },  // &
+    { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 },  // '
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },  // (
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },  // )
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 },  // *
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },  // +
+    { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 },  // ,
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },  // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },  // .
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },  // /
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },  // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },  // 1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },  // 2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },  // 3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },  // 4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },  // 5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },  // 6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },  // 7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },  // 8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },  // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },  // :
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 },  // ;
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },  // <
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },  // =
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },  // >
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },  // ?
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E },  // @
+    { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },  // A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },  // B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },  // C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },  // D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },  // E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },  // F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },  // G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },  // H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },  // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },  // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },  // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },  // L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },  // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },  // N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },  // O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },  // P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },  // Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },  // R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },  // S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },  // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },  // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },  // W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },  // X
+    { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 },  // Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },  // Z
+    { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E },  // [
+    { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },  // backslash
+    { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E },  // ]
+    { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 },  // ^
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F },  // _
+    { 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 },  // `
+    { 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F },  // a
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E },  // b
+    { 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E },  // c
+    { 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F },  // d
+    { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E },  // e
+    { 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08 },  // f
+    { 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E },  // g
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 },  // h
+    { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E },  // i
+    { 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C },  // j
+    { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 },  // k
+    { 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },  // l
+    { 0x00, 0x00, 0x1A, 0x15, 0x15, 0x15, 0x15 },  // m
+    { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 },  // n
+    { 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E },  // o
+    { 0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10 },  // p
+    { 0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01 },  // q
+    { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 },  // r
+    { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E },  // s
+    { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06 },  // t
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D },  // u
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04 },  // v
+    { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A },  // w
+    { 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11 },  // x
+    { 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E },  // y
+    { 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F },  // z
+    { 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 },  // {
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  // |
+    { 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 },  // }
+    { 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 },  // ~
+    { 0x00, 0x00, 0x0E, 0x0E, 0x0E, 0x00, 0x00 },  // bullet
+    { 0x0C, 0x12, 0x12, 0x0C, 0x00, 0x00, 0x00 },  // degree
+    { 0x00, 0x04, 0x02, 0x1F, 0x02, 0x04, 0x00 },  // arrow
+};
+
+static const int GLYPH_BULLET = 95;
+static const int GLYPH_DEGREE = 96;
+static const int GLYPH_ARROW = 97;
+
+// Font units per pixel of font size: 7-unit capitals in a 13-unit line
+// keep widths close to the 18 px Segoe UI labels of the window.
+static float FontUnit(int size) { return size / 13.0f; }
+
+// UTF-8 -> glyph indices; characters outside the font fall back to look-alikes or '?'
+static void ToGlyphs(const std::string& text, std::vector<int>& glyphs) {
+    glyphs.clear();
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = (unsigned char)text[i];
+        unsigned code = c;
+        size_t length = c < 0x80 ? 1 : (c >> 5) == 6 ? 2 : (c >> 4) == 14 ? 3 : (c >> 3) == 30 ? 4 : 1;
+        if (length > 1 && i + length <= text.size()) {
+            code = c & (0x7F >> length);
+            for (size_t k = 1; k < length; k++) code = (code << 6) | ((unsigned char)text[i + k] & 0x3F);
+        }
+        i += length;
+        if (code == '\r' || code == '\n') continue;
+        if (code == '\t') code = ' ';
+        if (code >= 32 && code <= 126) glyphs.push_back((int)code - 32);
+        else if (code == 0x2022 || code == 0x00B7) glyphs.push_back(GLYPH_BULLET);
+        else if (code == 0x00B0) glyphs.push_back(GLYPH_DEGREE);
+        else if (code == 0x2192) glyphs.push_back(GLYPH_ARROW);
+        else if (code == 0x2013 || code == 0x2014 || code == 0x2212) glyphs.push_back('-' - 32);
+        else if (code == 0x00B5 || code == 0x03BC) glyphs.push_back('u' - 32);
+        else glyphs.push_back('?' - 32);
+    }
+}
+
+int RasterCanvas::TextWidth(const std::string& text, int size) {
+    std::vector<int> glyphs;
+    ToGlyphs(text, glyphs);
+    return glyphs.empty() ? 0 : (int)std::ceil((glyphs.size() * 6 - 1) * FontUnit(size));
+}
+
+// ---------------------------------------------------------------------------
+// Raster canvas
+// ---------------------------------------------------------------------------
+void RasterCanvas::Blend(int x, int y, PlotColor color, float coverage) {
+    if (x < 0 || y < 0 || x >= image.width || y >= image.height || coverage <= 0.0f) return;
+    if (coverage > 1.0f) coverage = 1.0f;
+    uint8_t* p = image.rgb.data() + ((size_t)y * image.width + x) * 3;
+    p[0] = (uint8_t)(p[0] + (color.r - p[0]) * coverage + 0.5f);
+    p[1] = (uint8_t)(p[1] + (color.g - p[1]) * coverage + 0.5f);
+    p[2] = (uint8_t)(p[2] + (color.b - p[2]) * coverage + 0.5f);
+}
+
+void RasterCanvas::FillRect(int x, int y, int width, int height, PlotColor color, uint8_t alpha) {
+    int x0 = (std::max)(x, 0), y0 = (std::max)(y, 0);
+    int x1 = (std::min)(x + width, image.width), y1 = (std::min)(y + height, image.height);
+    float coverage = alpha / 255.0f;
+    for (int py = y0; py < y1; py++)
+        for (int px = x0; px < x1; px++) Blend(px, py, color, coverage);
+}
+
+void RasterCanvas::Rectangle(int x0, int y0, int x1, int y1, PlotColor fill, PlotColor border) {
+    if (x1 <= x0 || y1 <= y0) return;
+    FillRect(x0, y0, x1 - x0, y1 - y0, fill);
+    FillRect(x0, y0, x1 - x0, 1, border);
+    FillRect(x0, y1 - 1, x1 - x0, 1, border);
+    FillRect(x0, y0, 1, y1 - y0, border);
+    FillRect(x1 - 1, y0, 1, y1 - y0, border);
+}
+
+static float SegmentDistance(float px, float py, float x0, float y0, float x1, float y1) {
+    float dx = x1 - x0, dy = y1 - y0;
+    float lengthSq = dx * dx + dy * dy;
+    float t = lengthSq > 0.0f ? ((px - x0) * dx + (py - y0) * dy) / lengthSq : 0.0f;
+    t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+    float ex = px - (x0 + t * dx), ey = py - (y0 + t * dy);
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+// Anti-aliased thick segment between pixel-centre coordinates
+void RasterCanvas::Segment(float x0, float y0, float x1, float y1, float halfWidth, PlotColor color) {
+    int left = (std::max)(0, (int)std::floor((std::min)(x0, x1) - halfWidth - 1));
+    int right = (std::min)(image.width - 1, (int)std::ceil((std::max)(x0, x1) + halfWidth + 1));
+    int top = (std::max)(0, (int)std::floor((std::min)(y0, y1) - halfWidth - 1));
+    int bottom = (std::min)(image.height - 1, (int)std::ceil((std::max)(y0, y1) + halfWidth + 1));
+    for (int py = top; py <= bottom; py++)
+        for (int px = left; px <= right; px++)
+            Blend(px, py, color, halfWidth + 0.5f - SegmentDistance(px + 0.5f, py + 0.5f, x0, y0, x1, y1));
+}
+
+void RasterCanvas::Line(int x0, int y0, int x1, int y1, int width, PlotColor color) {
+    Segment(x0 + 0.5f, y0 + 0.5f, x1 + 0.5f, y1 + 0.5f, (std::max)(width, 1) * 0.5f, color);
+}
+
+void RasterCanvas::Polyline(const PlotPoint* points, size_t count, int width, PlotColor color) {
+    if (count == 0) return;
+    // Coverage is the nearest segment's, so the joins are not blended twice
+    float halfWidth = (std::max)(width, 1) * 0.5f;
+    int left = image.width, right = -1, top = image.height, bottom = -1;
+    for (size_t i = 0; i < count; i++) {
+        left = (std::min)(left, points[i].x);
+        right = (std::max)(right, points[i].x);
+        top = (std::min)(top, points[i].y);
+        bottom = (std::max)(bottom, points[i].y);
+    }
+    int margin = (int)std::ceil(halfWidth) + 1;
+    left = (std::max)(0, left - margin);
+    top = (std::max)(0, top - margin);
+    right = (std::min)(image.width - 1, right + margin);
+    bottom = (std::min)(image.height - 1, bottom + margin);
+    if (right < left || bottom < top) return;
+
+    int w = right - left + 1;
+    std::vector<float> coverage((size_t)w * (bottom - top + 1), 0.0f);
+    for (size_t i = 0; i + 1 < count || (count == 1 && i == 0); i++) {
+        const PlotPoint& a = points[i];
+        const PlotPoint& b = points[count == 1 ? i : i + 1];
+        float ax = a.x + 0.5f, ay = a.y + 0.5f, bx = b.x + 0.5f, by = b.y + 0.5f;
+        int x0 = (std::max)(left, (std::min)(a.x, b.x) - margin), x1 = (std::min)(right, (std::max)(a.x, b.x) + margin);
+        int y0 = (std::max)(top, (std::min)(a.y, b.y) - margin), y1 = (std::min)(bottom, (std::max)(a.y, b.y) + margin);
+        for (int py = y0; py <= y1; py++)
+            for (int px = x0; px <= x1; px++) {
+                float c = halfWidth + 0.5f - SegmentDistance(px + 0.5f, py + 0.5f, ax, ay, bx, by);
+                float& slot = coverage[(size_t)(py - top) * w + (px - left)];
+                if (c > slot) slot = c;
+            }
+    }
+    for (int py = top; py <= bottom; py++)
+        for (int px = left; px <= right; px++) Blend(px, py, color, coverage[(size_t)(py - top) * w + (px - left)]);
+}
+
+void RasterCanvas::Dot(int cx, int cy, int radius, PlotColor color) {
+    for (int py = cy - radius - 1; py <= cy + radius; py++)
+        for (int px = cx - radius - 1; px <= cx + radius; px++) {
+            float dx = px + 0.5f - cx, dy = py + 0.5f - cy;
+            Blend(px, py, color, radius + 0.5f - std::sqrt(dx * dx + dy * dy));
+        }
+}
+
+void RasterCanvas::RoundedFrame(int x, int y, int width, int height, int radius, PlotColor color) {
+    // One pixel outline through the centres of the edge pixels; RoundRect's
+    // ellipse size is twice the corner radius
+    float left = x + 0.5f, top = y + 0.5f, right = x + width - 0.5f, bottom = y + height - 0.5f;
+    float corner = (std::min)((float)radius * 0.5f, (std::min)(right - left, bottom - top) * 0.5f);
+    float cx = (left + right) * 0.5f, cy = (top + bottom) * 0.5f;
+    float hx = (right - left) * 0.5f - corner, hy = (bottom - top) * 0.5f - corner;
+    int cornerRows = (int)std::ceil(corner) + 2;
+    for (int py = y - 1; py <= y + height; py++) {
+        bool straight = py > y + cornerRows && py < y + height - 1 - cornerRows;
+        for (int px = x - 1; px <= x + width; px++) {
+            if (straight && px > x + 1 && px < x + width - 2) px = x + width - 2;    // skip the inside
+            float qx = std::fabs(px + 0.5f - cx) - hx, qy = std::fabs(py + 0.5f - cy) - hy;
+            float ox = (std::max)(qx, 0.0f), oy = (std::max)(qy, 0.0f);
+            float d = std::sqrt(ox * ox + oy * oy) + (std::min)((std::max)(qx, qy), 0.0f) - corner;
+            Blend(px, py, color, 1.0f - std::fabs(d));
+        }
+    }
+}
+
+void RasterCanvas::Text(const std::string& text, int x0, int y0, int x1, int y1, int size, PlotColor color, unsigned flags) {
+    std::vector<int> glyphs;
+    ToGlyphs(text, glyphs);
+    if (glyphs.empty() || size <= 0) return;
+    const float unit = FontUnit(size);
+    const int width = TextWidth(text, size);
+    const bool vertical = (flags & PLOT_TEXT_VERTICAL) != 0;
+    const bool bold = (flags & PLOT_TEXT_BOLD) != 0;
+
+    // Layout as horizontal text; (originX, originY) is its top-left corner
+    int originX = (flags & PLOT_TEXT_CENTER) ? x0 + (x1 - x0 - width) / 2 : x0;
+    int originY = (flags & PLOT_TEXT_VCENTER) ? y0 + (y1 - y0 - size) / 2 : y0;
+    const float glyphTop = (size - 7 * unit) * 0.5f;
+
+    // Along / across the line in layout space; vertical text maps layout
+    // (u, v) to (originX + v, originY - u)
+    auto Ink = [&](float u, float v) {
+        if (u < 0.0f || v < 0.0f) return false;
+        int column = (int)(u / unit), row = (int)(v / unit);
+        size_t index = (size_t)(column / 6);
+        column %= 6;
+        if (row >= 7 || column >= 5 || index >= glyphs.size()) return false;
+        return ((FONT_5X7[glyphs[index]][row] >> (4 - column)) & 1) != 0;
+    };
+    const int samples = 4;
+    const int extentU = width + 1, extentV = size;
+    int left, top, right, bottom;
+    if (vertical) { left = originX; right = originX + extentV; top = originY - extentU; bottom = originY; }
+    else { left = originX; right = originX + extentU; top = originY; bottom = originY + extentV; }
+    left = (std::max)(left, 0);
+    top = (std::max)(top, 0);
+    right = (std::min)(right, image.width - 1);
+    bottom = (std::min)(bottom, image.height - 1);
+
+    for (int py = top; py <= bottom; py++)
+        for (int px = left; px <= right; px++) {
+            int hits = 0;
+            for (int sy = 0; sy < samples; sy++)
+                for (int sx = 0; sx < samples; sx++) {
+                    float fx = px + (sx + 0.5f) / samples, fy = py + (sy + 0.5f) / samples;
+                    float u = vertical ? originY - fy : fx - originX;
+                    float v = (vertical ? fx - originX : fy - originY) - glyphTop;
+                    // Bold: the glyph again, half a unit to the right
+                    if (Ink(u, v) || (bold && Ink(u - unit * 0.5f, v))) hits++;
+                }
+            if (hits) Blend(px, py, color, (float)hits / (samples * samples));
+        }
+}
+
+void RasterCanvas::DrawImage(const PixelImage& source, int x, int y, int width, int height) {
+    if (source.Empty() || width <= 0 || height <= 0) return;
+    double scale = (std::min)((double)width / source.width, (double)height / source.height);
+    int w = (std::max)(1, (int)(source.width * scale)), h = (std::max)(1, (int)(source.height * scale));
+    int left = x + (width - w) / 2, top = y + (height - h) / 2;
+    // Bilinear; callers halve large images first (DownscaleHalf)
+    for (int dy = 0; dy < h; dy++) {
+        int py = top + dy;
+        if (py < 0 || py >= image.height) continue;
+        double sy = (dy + 0.5) / scale - 0.5;
+        int y0 = (std::max)(0, (std::min)((int)std::floor(sy), source.height - 1));
+        int y1 = (std::min)(y0 + 1, source.height - 1);
+        double fy = (std::min)((std::max)(sy - y0, 0.0), 1.0);
+        for (int dx = 0; dx < w; dx++) {
+            int px = left + dx;
+            if (px < 0 || px >= image.width) continue;
+            double sx = (dx + 0.5) / scale - 0.5;
+            int x0 = (std::max)(0, (std::min)((int)std::floor(sx), source.width - 1));
+            int x1 = (std::min)(x0 + 1, source.width - 1);
+            double fx = (std::min)((std::max)(sx - x0, 0.0), 1.0);
+            const uint8_t* a = source.Row(y0) + x0 * 3;
+            const uint8_t* b = source.Row(y0) + x1 * 3;
+            const uint8_t* c = source.Row(y1) + x0 * 3;
+            const uint8_t* d = source.Row(y1) + x1 * 3;
+            uint8_t* out = image.rgb.data() + ((size_t)py * image.width + px) * 3;
+            for (int k = 0; k < 3; k++) {
+                double top0 = a[k] + (b[k] - a[k]) * fx, bottom0 = c[k] + (d[k] - c[k]) * fx;
+                out[k] = (uint8_t)(top0 + (bottom0 - top0) * fy + 0.5);
+            }
+        }
+    }
+}
@@ -0,0 +1,104 @@
+/*
+*****************************************************************************
+*   GrainEye - Plotting                                                       *
+*   ------------------------------------------------------------------------- *
+*   The grain size graphs are drawn through a small canvas interface so the *
+*   same plotting code serves the window (GDI canvas in GrainEYE.cpp) and   *
+*   headless reports (RasterCanvas below: software rasterizer into a        *
+*   PixelImage with a built-in bitmap font, no display server or system     *
+*   fonts needed).                                                          *
+*                                                                             *
+*   Coordinates are pixels. Shapes follow GDI conventions so the window     *
+*   looks as before: Rectangle() includes x0/y0 and excludes x1/y1,         *
+*   RoundedFrame() takes the RoundRect() ellipse size as its radius.       *
+*****************************************************************************
+*/
+#pragma once
+
+#include "Analysis.h"
+#include "ImageIO.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct PlotColor {
+    uint8_t r = 0;
+    uint8_t g = 0;
+    uint8_t b = 0;
+};
+
+inline PlotColor PlotRgb(uint8_t r, uint8_t g, uint8_t b) {
+    PlotColor c;
+    c.r = r;
+    c.g = g;
+    c.b = b;
+    return c;
+}
+
+struct PlotPoint {
+    int x = 0;
+    int y = 0;
+};
+
+// Text() flags; without PLOT_TEXT_CENTER text starts at the left edge
+const unsigned PLOT_TEXT_CENTER = 1;       // horizontally centred in the rectangle
+const unsigned PLOT_TEXT_VCENTER = 2;      // vertically centred (single line)
+const unsigned PLOT_TEXT_VERTICAL = 4;     // rotated 90 degrees, reading bottom to top
+const unsigned PLOT_TEXT_BOLD = 8;
+
+class PlotCanvas {
+public:
+    virtual ~PlotCanvas() = default;
+
+    virtual void FillRect(int x, int y, int width, int height, PlotColor color, uint8_t alpha = 255) = 0;
+    virtual void Rectangle(int x0, int y0, int x1, int y1, PlotColor fill, PlotColor border) = 0;
+    virtual void Line(int x0, int y0, int x1, int y1, int width, PlotColor color) = 0;
+    virtual void Polyline(const PlotPoint* points, size_t count, int width, PlotColor color) = 0;
+    virtual void Dot(int cx, int cy, int radius, PlotColor color) = 0;
+    virtual void RoundedFrame(int x, int y, int width, int height, int radius, PlotColor color) = 0;
+    // One line of UTF-8 text; size is the font height in pixels. Vertical
+    // text is laid out as if horizontal in the rectangle, then turned about
+    // its top-left corner (as GDI does with lfEscapement = 900).
+    virtual void Text(const std::string& text, int x0, int y0, int x1, int y1, int size, PlotColor color, unsigned flags) = 0;
+};
+
+enum GraphKind {
+    GRAPH_DISTRIBUTION,         // histogram of the size bins
+    GRAPH_CUMULATIVE,           // cumulative % passing
+};
+
+const char* GraphTitle(GraphKind kind);
+
+// One graph card for the result's size distribution. scale 1 is the
+// window layout (330 x 260 cards); reports draw larger cards with scale > 1.
+void DrawResultGraph(PlotCanvas& canvas, const AnalysisResult& result, GraphKind kind,
+    int x, int y, int width, int height, double scale = 1.0);
+
+// Software canvas drawing into an RGB image (anti-aliased shapes, bitmap
+// font scaled to the requested size). Safe to use from several threads on
+// different images.
+class RasterCanvas : public PlotCanvas {
+public:
+    explicit RasterCanvas(PixelImage& target) : image(target) {}
+
+    void FillRect(int x, int y, int width, int height, PlotColor color, uint8_t alpha = 255) override;
+    void Rectangle(int x0, int y0, int x1, int y1, PlotColor fill, PlotColor border) override;
+    void Line(int x0, int y0, int x1, int y1, int width, PlotColor color) override;
+    void Polyline(const PlotPoint* points, size_t count, int width, PlotColor color) override;
+    void Dot(int cx, int cy, int radius, PlotColor color) override;
+    void RoundedFrame(int x, int y, int width, int height, int radius, PlotColor color) override;
+    void Text(const std::string& text, int x0, int y0, int x1, int y1, int size, PlotColor color, unsigned flags) override;
+
+    // Width of a line of text at this size, in pixels.
+    static int TextWidth(const std::string& text, int size);
+
+    // Copies source scaled to fit (aspect kept, centred) into the rectangle.
+    void DrawImage(const PixelImage& source, int x, int y, int width, int height);
+
+private:
+    void Blend(int x, int y, PlotColor color, float coverage);
+    void Segment(float x0, float y0, float x1, float y1, float halfWidth, PlotColor color);
+
+    PixelImage& image;
+};
@@ -0,0 +1,474 @@
+/*
+*****************************************************************************
+*   GrainEye - Sample reports                                                 *
+*****************************************************************************
+*/
+#include "Report.h"
+#include "FileUtil.h"
+#include "PixelKernels.h"
+#include "Plot.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static bool Fail(std::string* error, const std::string& message) {
+    if (error) *error = message;
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// Page layout (designed for 1240 px wide pages, scaled to others)
+// ---------------------------------------------------------------------------
+// Cuts text to maxWidth pixels, ending it with "..."
+static std::string FitText(std::string text, int size, int maxWidth) {
+    if (RasterCanvas::TextWidth(text, size) <= maxWidth) return text;
+    while (!text.empty() && RasterCanvas::TextWidth(text + "...", size) > maxWidth) {
+        text.pop_back();
+        while (!text.empty() && ((unsigned char)text.back() & 0xC0) == 0x80) text.pop_back();
+        if (!text.empty() && (unsigned char)text.back() >= 0xC0) text.pop_back();
+    }
+    return text + "...";
+}
+
+static std::string FileName(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+void RenderReportPage(const AnalysisResult& result, int page, int pageCount, const ReportOptions& options, PixelImage& out) {
+    out.width = options.pageWidth;
+    out.height = options.pageHeight;
+    out.rgb.assign((size_t)out.width * out.height * 3, 255);
+    RasterCanvas canvas(out);
+
+    const double scale = options.pageWidth / 1240.0;
+    auto px = [scale](double v) { return (int)(v * scale + 0.5); };
+    const PlotColor ink = PlotRgb(30, 30, 30);
+    const PlotColor secondary = PlotRgb(110, 110, 110);
+    const PlotColor rule = PlotRgb(200, 200, 200);
+    const PlotColor cardGrey = PlotRgb(170, 170, 170);
+    const int left = px(60), right = px(1180);
+    char buf[256];
+
+    // Header
+    canvas.Text(options.title, left, px(50), right, px(100), px(40), ink, PLOT_TEXT_BOLD);
+    std::snprintf(buf, sizeof(buf), "Page %d of %d", page, pageCount);
+    canvas.Text(buf, right - RasterCanvas::TextWidth(buf, px(22)), px(60), right, px(90), px(22), secondary, 0);
+    std::string subtitle = FileName(result.imagePath) + (result.timestamp.empty() ? "" : "   " + result.timestamp);
+    canvas.Text(FitText(subtitle, px(24), right - left), left, px(108), right, px(140), px(24), secondary, 0);
+    canvas.FillRect(left, px(150), right - left, (std::max)(1, px(2)), rule);
+
+    // Thumbnail on a dark card like the window's image preview
+    const int tx = left, ty = px(180), tw = px(540), th = px(405);
+    canvas.FillRect(tx, ty, tw, th, PlotRgb(18, 18, 18));
+    PixelImage image;
+    if (!result.imagePath.empty() && LoadPixelImage(result.imagePath, image)) {
+        while (image.width >= 2 * tw && image.height >= 2 * th) {
+            PixelImage half;
+            DownscaleHalf(image, half);
+            image = std::move(half);
+        }
+        canvas.DrawImage(image, tx + px(10), ty + px(10), tw - px(20), th - px(20));
+    }
+    else {
+        canvas.Text("Image not available", tx, ty, tx + tw, ty + th, px(22), cardGrey, PLOT_TEXT_CENTER | PLOT_TEXT_VCENTER);
+    }
+    canvas.RoundedFrame(tx, ty, tw, th, px(20), cardGrey);
+
+    // Key figures beside the thumbnail
+    struct Figure { const char* label; std::string value; };
+    std::vector<Figure> figures;
+    std::snprintf(buf, sizeof(buf), "%.3f mm", result.d50Mm);
+    figures.push_back({ "Median (D50)", buf });
+    std::snprintf(buf, sizeof(buf), "%.3f mm", result.meanMm);
+    figures.push_back({ "Mean grain size", buf });
+    std::snprintf(buf, sizeof(buf), "%.3f - %.3f mm", result.d10Mm, result.d90Mm);
+    figures.push_back({ "Range (D10 - D90)", buf });
+    std::snprintf(buf, sizeof(buf), "%d", result.grainCount);
+    figures.push_back({ "Grains", buf });
+    figures.push_back({ "Beach zone", result.beachZone.empty() ? "-" : result.beachZone });
+    figures.push_back({ "Category", result.category.empty() ? "-" : result.category });
+    if (result.hasLocation) std::snprintf(buf, sizeof(buf), "%.6f, %.6f", result.latitude, result.longitude);
+    else std::snprintf(buf, sizeof(buf), "not tagged");
+    figures.push_back({ "Location", buf });
+    const int fx = px(640);
+    int fy = ty;
+    for (const auto& figure : figures) {
+        canvas.Text(figure.label, fx, fy, right, fy + px(24), px(20), secondary, 0);
+        canvas.Text(FitText(figure.value, px(28), right - fx), fx, fy + px(22), right, fy + px(52), px(28), ink, PLOT_TEXT_BOLD);
+        fy += px(58);
+    }
+
+    // Graphs: the window's cards, larger
+    const double graphScale = 1.6 * scale;
+    const int gw = (int)(330 * graphScale), gh = (int)(260 * graphScale), gy = px(620);
+    canvas.FillRect(left - px(10), gy - px(10), right - left + px(20), gh + px(20), PlotRgb(40, 40, 40));
+    DrawResultGraph(canvas, result, GRAPH_DISTRIBUTION, left, gy, gw, gh, graphScale);
+    DrawResultGraph(canvas, result, GRAPH_CUMULATIVE, right - gw, gy, gw, gh, graphScale);
+
+    // Full result text, as in the result box
+    std::string text = FormatResultText(result);
+    text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+    const int lineSize = px(20), lineHeight = px(29), bottom = options.pageHeight - px(110);
+    int ly = gy + gh + px(50);
+    size_t start = 0;
+    while (start <= text.size() && ly + lineHeight <= bottom) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(start, end - start);
+        if (line.empty()) ly += lineHeight / 2;
+        else {
+            canvas.Text(FitText(line, lineSize, right - left), left, ly, right, ly + lineHeight, lineSize, ink, 0);
+            ly += lineHeight;
+        }
+        start = end + 1;
+    }
+
+    // Footer
+    canvas.FillRect(left, options.pageHeight - px(90), right - left, (std::max)(1, px(2)), rule);
+    canvas.Text("GrainEye sand grain analysis", left, options.pageHeight - px(75), right, options.pageHeight - px(45),
+        px(18), secondary, 0);
+}
+
+// ---------------------------------------------------------------------------
+// Compression: PNG "Up" filter + zlib stream (fixed Huffman, run-length matches)
+// ---------------------------------------------------------------------------
+namespace {
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& target) : out(target) {}
+
+    void Put(uint32_t value, int count) {
+        bits |= value << used;
+        used += count;
+        while (used >= 8) {
+            out.push_back((uint8_t)bits);
+            bits >>= 8;
+            used -= 8;
+        }
+    }
+    // Huffman codes go most significant bit first
+    void PutCode(uint32_t code, int count) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < count; i++) reversed |= ((code >> i) & 1) << (count - 1 - i);
+        Put(reversed, count);
+    }
+    void Flush() {
+        if (used > 0) out.push_back((uint8_t)bits);
+        bits = 0;
+        used = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint32_t bits = 0;
+    int used = 0;
+};
+
+const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+void PutSymbol(BitWriter& w, int symbol) {
+    if (symbol < 144) w.PutCode(0x30 + symbol, 8);
+    else if (symbol < 256) w.PutCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280) w.PutCode(symbol - 256, 7);
+    else w.PutCode(0xC0 + symbol - 280, 8);
+}
+
+void PutMatch(BitWriter& w, int length, int distance) {
+    int code = 28;
+    while (LENGTH_BASE[code] > length) code--;
+    PutSymbol(w, 257 + code);
+    if (LENGTH_EXTRA[code]) w.Put(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+    w.PutCode(distance - 1, 5);     // distances 1..4 are codes 0..3 without extra bits
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t chunk = (std::min)(size, (size_t)5552);
+        size -= chunk;
+        for (size_t i = 0; i < chunk; i++) {
+            a += data[i];
+            b += a;
+        }
+        data += chunk;
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+void PutBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t)(value >> shift));
+}
+
+// zlib stream of the filtered rows. Matches only reach back one byte (runs)
+// or one pixel, which is what the flat, Up-filtered pages are made of.
+void CompressRows(const PixelImage& image, std::vector<uint8_t>& out) {
+    const size_t stride = (size_t)image.width * 3;
+    std::vector<uint8_t> filtered((stride + 1) * image.height);
+    for (int y = 0; y < image.height; y++) {
+        uint8_t* row = filtered.data() + y * (stride + 1);
+        const uint8_t* current = image.Row(y);
+        row[0] = 2;     // Up
+        if (y == 0) std::memcpy(row + 1, current, stride);
+        else {
+            const uint8_t* above = image.Row(y - 1);
+            for (size_t i = 0; i < stride; i++) row[1 + i] = (uint8_t)(current[i] - above[i]);
+        }
+    }
+
+    out.clear();
+    out.reserve(filtered.size() / 16);
+    out.push_back(0x78);
+    out.push_back(0x01);
+    BitWriter w(out);
+    w.Put(1, 1);        // final block
+    w.Put(1, 2);        // fixed Huffman codes
+    const uint8_t* data = filtered.data();
+    const size_t size = filtered.size();
+    for (size_t i = 0; i < size;) {
+        int bestLength = 0, bestDistance = 0;
+        for (int distance : { 1, 3 }) {
+            if (i < (size_t)distance) continue;
+            int length = 0;
+            while (length < 258 && i + length < size && data[i + length] == data[i + length - distance]) length++;
+            if (length > bestLength) {
+                bestLength = length;
+                bestDistance = distance;
+            }
+        }
+        if (bestLength >= 3) {
+            PutMatch(w, bestLength, bestDistance);
+            i += bestLength;
+        }
+        else {
+            PutSymbol(w, data[i++]);
+        }
+    }
+    PutSymbol(w, 256);  // end of block
+    w.Flush();
+    PutBigEndian(out, Adler32(data, size));
+}
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+bool WritePngChunk(FILE* f, const char* type, const uint8_t* data, size_t size) {
+    uint8_t header[8];
+    for (int i = 0; i < 4; i++) header[i] = (uint8_t)(size >> (24 - 8 * i));
+    std::memcpy(header + 4, type, 4);
+    uint32_t crc = Crc32(header + 4, 4);
+    crc = Crc32(data, size, crc);
+    uint8_t trailer[4];
+    for (int i = 0; i < 4; i++) trailer[i] = (uint8_t)(crc >> (24 - 8 * i));
+    return std::fwrite(header, 1, 8, f) == 8 && (size == 0 || std::fwrite(data, 1, size, f) == size) &&
+        std::fwrite(trailer, 1, 4, f) == 4;
+}
+
+bool WritePngStream(const std::string& path, int width, int height, const std::vector<uint8_t>& stream, long long* bytes,
+    std::string* error) {
+    FILE* f = OpenFile(path, "wb");
+    if (!f) return Fail(error, "cannot create " + path);
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> header;
+    PutBigEndian(header, (uint32_t)width);
+    PutBigEndian(header, (uint32_t)height);
+    const uint8_t format[5] = { 8, 2, 0, 0, 0 };   // 8-bit RGB, deflate, adaptive filters, no interlace
+    header.insert(header.end(), format, format + 5);
+    bool ok = std::fwrite(SIGNATURE, 1, 8, f) == 8 && WritePngChunk(f, "IHDR", header.data(), header.size()) &&
+        WritePngChunk(f, "IDAT", stream.data(), stream.size()) && WritePngChunk(f, "IEND", nullptr, 0);
+    if (bytes) *bytes = ok ? FileTell(f) : 0;
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        DiscardFile(path);
+        return Fail(error, "write failed: " + path);
+    }
+    return true;
+}
+
+// Multi-page PDF, one full-page image per page. Objects: 1 catalog,
+// 2 page tree (both written last), then page, contents and image per page.
+class PdfWriter {
+public:
+    ~PdfWriter() {
+        if (file) std::fclose(file);
+    }
+
+    bool Open(const std::string& outPath, std::string* error) {
+        path = outPath;
+        file = OpenFile(path, "wb");
+        if (!file) return Fail(error, "cannot create " + path);
+        offsets.assign(3, 0);
+        return Write("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n");
+    }
+
+    bool AddPage(int width, int height, int dpi, const std::vector<uint8_t>& stream) {
+        const double pageWidth = width * 72.0 / dpi, pageHeight = height * 72.0 / dpi;
+        const int page = (int)offsets.size(), contents = page + 1, image = page + 2;
+        char buf[512];
+        std::snprintf(buf, sizeof(buf), "q %.2f 0 0 %.2f 0 0 cm /Im0 Do Q\n", pageWidth, pageHeight);
+        std::string drawing = buf;
+
+        bool ok = BeginObject();
+        std::snprintf(buf, sizeof(buf),
+            "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 %.2f %.2f] /Contents %d 0 R /Resources << /XObject << /Im0 %d 0 R >> >> >>\nendobj\n",
+            pageWidth, pageHeight, contents, image);
+        ok = ok && Write(buf) && BeginObject();
+        std::snprintf(buf, sizeof(buf), "<< /Length %zu >>\nstream\n", drawing.size());
+        ok = ok && Write(buf) && Write(drawing) && Write("endstream\nendobj\n") && BeginObject();
+        std::snprintf(buf, sizeof(buf),
+            "<< /Type /XObject /Subtype /Image /Width %d /Height %d /ColorSpace /DeviceRGB /BitsPerComponent 8 "
+            "/Filter /FlateDecode /DecodeParms << /Predictor 15 /Colors 3 /BitsPerComponent 8 /Columns %d >> /Length %zu >>\nstream\n",
+            width, height, width, stream.size());
+        ok = ok && Write(buf) && std::fwrite(stream.data(), 1, stream.size(), file) == stream.size() &&
+            Write("\nendstream\nendobj\n");
+        pages.push_back(page);
+        return ok;
+    }
+
+    bool Close(long long* bytes, std::string* error) {
+        std::string kids;
+        for (int page : pages) kids += std::to_string(page) + " 0 R ";
+        offsets[2] = FileTell(file);
+        bool ok = Write("2 0 obj\n<< /Type /Pages /Kids [" + kids + "] /Count " + std::to_string(pages.size()) + " >>\nendobj\n");
+        offsets[1] = FileTell(file);
+        ok = ok && Write("1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+
+        long long xref = FileTell(file);
+        char buf[64];
+        ok = ok && Write("xref\n0 " + std::to_string(offsets.size()) + "\n0000000000 65535 f \n");
+        for (size_t i = 1; i < offsets.size() && ok; i++) {
+            std::snprintf(buf, sizeof(buf), "%010lld 00000 n \n", offsets[i]);
+            ok = Write(buf);
+        }
+        ok = ok && Write("trailer\n<< /Size " + std::to_string(offsets.size()) + " /Root 1 0 R >>\nstartxref\n" +
+            std::to_string(xref) + "\n%%EOF\n");
+        if (bytes) *bytes = ok ? FileTell(file) : 0;
+        ok = std::fclose(file) == 0 && ok;
+        file = nullptr;
+        if (!ok) {
+            Discard();
+            return Fail(error, "write failed: " + path);
+        }
+        return true;
+    }
+
+    void Discard() {
+        if (file) std::fclose(file);
+        file = nullptr;
+        DiscardFile(path);
+    }
+
+private:
+    bool Write(const std::string& text) { return std::fwrite(text.data(), 1, text.size(), file) == text.size(); }
+
+    bool BeginObject() {
+        offsets.push_back(FileTell(file));
+        return Write(std::to_string(offsets.size() - 1) + " 0 obj\n");
+    }
+
+    std::string path;
+    FILE* file = nullptr;
+    std::vector<long long> offsets;     // by object number; 0 is the free-list head
+    std::vector<int> pages;
+};
+
+} // namespace
+
+bool WritePng(const std::string& path, const PixelImage& image, std::string* error) {
+    if (image.Empty()) return Fail(error, "empty image");
+    std::vector<uint8_t> stream;
+    CompressRows(image, stream);
+    return WritePngStream(path, image.width, image.height, stream, nullptr, error);
+}
+
+// ---------------------------------------------------------------------------
+// Report
+// ---------------------------------------------------------------------------
+bool WriteReport(const std::vector<AnalysisResult>& results, const std::string& outPath, const ReportOptions& options,
+    ThreadPool* pool, ReportStats* stats, std::string* error) {
+    auto start = std::chrono::steady_clock::now();
+    if (results.empty()) return Fail(error, "no samples to report");
+    if (options.pageWidth <= 0 || options.pageHeight <= 0 || options.dpi <= 0) return Fail(error, "invalid page size");
+
+    std::string lower = outPath;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+    const bool pdf = lower.size() > 4 && lower.compare(lower.size() - 4, 4, ".pdf") == 0;
+    std::string pngBase = outPath;
+    if (!pdf && lower.size() > 4 && lower.compare(lower.size() - 4, 4, ".png") == 0) pngBase.resize(outPath.size() - 4);
+
+    PdfWriter pdfWriter;
+    if (pdf && !pdfWriter.Open(outPath, error)) return false;
+
+    // A few pages per participant at a time: enough to keep the workers
+    // busy, few enough that only a handful of pages are held at once
+    struct Page {
+        std::vector<uint8_t> stream;
+        long long bytes = 0;
+        std::string error;
+    };
+    const size_t participants = pool ? (size_t)pool->WorkerCount() + 1 : 1;
+    const size_t batch = (std::max)((size_t)4, participants * 2);
+    std::vector<Page> pages(batch);
+    const int pageCount = (int)results.size();
+    long long totalBytes = 0;
+
+    for (size_t first = 0; first < results.size(); first += batch) {
+        const size_t count = (std::min)(batch, results.size() - first);
+        auto render = [&](size_t begin, size_t end) {
+            PixelImage image;
+            for (size_t i = begin; i < end; i++) {
+                Page& page = pages[i];
+                page.error.clear();
+                RenderReportPage(results[first + i], (int)(first + i + 1), pageCount, options, image);
+                CompressRows(image, page.stream);
+                if (!pdf) {
+                    char suffix[32];
+                    std::snprintf(suffix, sizeof(suffix), "_%03d.png", (int)(first + i + 1));
+                    WritePngStream(pngBase + suffix, image.width, image.height, page.stream, &page.bytes, &page.error);
+                }
+            }
+        };
+        if (pool) pool->ParallelFor(count, 1, render);
+        else render(0, count);
+
+        for (size_t i = 0; i < count; i++) {
+            if (!pages[i].error.empty()) {
+                if (pdf) pdfWriter.Discard();
+                return Fail(error, pages[i].error);
+            }
+            if (pdf && !pdfWriter.AddPage(options.pageWidth, options.pageHeight, options.dpi, pages[i].stream)) {
+                pdfWriter.Discard();
+                return Fail(error, "write failed: " + outPath);
+            }
+            totalBytes += pages[i].bytes;
+        }
+    }
+    if (pdf && !pdfWriter.Close(&totalBytes, error)) return false;
+
+    if (stats) {
+        stats->pages = pageCount;
+        stats->bytes = totalBytes;
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+/*
+*****************************************************************************
+*   GrainEye - Sample reports                                                 *
+*   ------------------------------------------------------------------------- *
+*   One page per analyzed sample: image thumbnail, the two grain size       *
+*   graphs (the window's plotting code on a RasterCanvas), key figures and  *
+*   the full result text. Rendering needs no window or display server, so  *
+*   reports run on the Pi and in batch jobs.                                 *
+*                                                                             *
+*   Pages are rendered and compressed in parallel, a batch of a few pages   *
+*   per worker at a time, so memory stays bounded for long surveys. Output *
+*   is one multi-page PDF (".pdf") or one PNG per page ("x.png" gives      *
+*   x_001.png, x_002.png, ...). Both use the same compressed rows: PNG      *
+*   "Up" filtering and a deflate stream with fixed Huffman codes and        *
+*   run-length matches, which suits the flat areas of the pages; the PDF    *
+*   embeds it as a FlateDecode image with the PNG predictor.                *
+*****************************************************************************
+*/
+#pragma once
+
+#include "Analysis.h"
+#include "ImageIO.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct ReportOptions {
+    int pageWidth = 1240;           // A4 at 150 dpi
+    int pageHeight = 1754;
+    int dpi = 150;
+    std::string title = "GrainEye Sample Report";
+};
+
+struct ReportStats {
+    int pages = 0;
+    long long bytes = 0;            // all files written
+    double ms = 0.0;
+};
+
+// Draws one page. The thumbnail is decoded from result.imagePath (on
+// Windows GDI+ must be running); a placeholder is drawn when it cannot be.
+void RenderReportPage(const AnalysisResult& result, int page, int pageCount, const ReportOptions& options, PixelImage& out);
+
+// Renders every result on the pool (the calling thread alone when null).
+bool WriteReport(const std::vector<AnalysisResult>& results, const std::string& outPath, const ReportOptions& options,
+    ThreadPool* pool, ReportStats* stats = nullptr, std::string* error = nullptr);
+
+// Single RGB image as PNG.
+bool WritePng(const std::string& path, const PixelImage& image, std::string* error = nullptr);
@@ -0,0 +1,43 @@
+/*
+*****************************************************************************
+*   GrainEye - Incremental result channel                                     *
+*****************************************************************************
+*/
+#include "ResultChannel.h"
+
+ResultChannel::ResultChannel(int minIntervalMs, std::function<void()> notify)
+    : notify(std::move(notify)), minInterval(minIntervalMs) {}
+
+void ResultChannel::Publish(const AnalysisResult& snapshot) {
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        latest = snapshot;
+        hasUnseen = true;
+
+        // A pending wake-up will pick this snapshot up anyway. Otherwise wake
+        // the consumer if the interval has passed, or always for the final result.
+        auto now = std::chrono::steady_clock::now();
+        if (!notifyPending && (snapshot.complete || now - lastNotify >= minInterval)) {
+            notifyPending = true;
+            lastNotify = now;
+            wake = true;
+        }
+    }
+    if (wake && notify) notify();
+}
+
+bool ResultChannel::Take(AnalysisResult& out) {
+    std::lock_guard<std::mutex> guard(lock);
+    notifyPending = false;
+    if (!hasUnseen) return false;
+    out = latest;
+    hasUnseen = false;
+    return true;
+}
+
+void ResultChannel::Reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    hasUnseen = false;
+    latest = AnalysisResult();
+}
@@ -0,0 +1,41 @@
+/*
+*****************************************************************************
+*   GrainEye - Incremental result channel                                     *
+*   ------------------------------------------------------------------------- *
+*   Carries partial analysis results (grains so far, provisional d50,        *
+*   coarse histogram) from the analysis thread to the UI. Snapshots are      *
+*   coalesced: the consumer only ever sees the latest one, and it is woken   *
+*   at most once per interval. The final result is always delivered.         *
+*****************************************************************************
+*/
+#pragma once
+
+#include "Analysis.h"
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+class ResultChannel {
+public:
+    // notify is called on the producer thread and must not block
+    // (the Win32 client posts a message).
+    ResultChannel(int minIntervalMs, std::function<void()> notify);
+
+    void Publish(const AnalysisResult& snapshot);
+
+    // Latest snapshot not yet taken. Returns false if there is none.
+    bool Take(AnalysisResult& latest);
+
+    // Drop anything unseen (new sample / restart).
+    void Reset();
+
+private:
+    std::mutex lock;
+    std::function<void()> notify;
+    std::chrono::milliseconds minInterval;
+    std::chrono::steady_clock::time_point lastNotify;
+    AnalysisResult latest;
+    bool hasUnseen = false;
+    bool notifyPending = false;
+};
@@ -0,0 +1,568 @@
+/*
+*****************************************************************************
+*   GrainEye - Streaming parser for the cloud model's response                *
+*****************************************************************************
+*/
+#include "ResultParser.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+// Hard limits so a hostile or corrupt response cannot exhaust memory
+static const size_t MAX_GRAINS = 4 * 1024 * 1024;
+static const size_t MAX_HISTOGRAM_BINS = 4096;
+
+// Numbers from the network are range-checked before any narrowing cast
+static const double MAX_COUNT = 1e9;
+static const double MAX_SIZE_MM = 1e4;
+static const double MAX_COORDINATE_PX = 1e7;
+
+static bool InRange(double value, double low, double high) {
+    return std::isfinite(value) && value >= low && value <= high;
+}
+
+static bool IsDelimiter(char c) {
+    return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ':';
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool IsJsonNumber(const char* p, const char* end) {
+    if (p < end && *p == '-') p++;
+    if (p == end) return false;
+    if (*p == '0') p++;
+    else if (*p >= '1' && *p <= '9') { while (p < end && *p >= '0' && *p <= '9') p++; }
+    else return false;
+    if (p < end && *p == '.') {
+        p++;
+        if (p == end || *p < '0' || *p > '9') return false;
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) p++;
+        if (p == end || *p < '0' || *p > '9') return false;
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    return p == end;
+}
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool ReadHex4(const char* p, const char* end, unsigned& value) {
+    if (end - p < 4) return false;
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = HexValue(p[i]);
+        if (h < 0) return false;
+        value = (value << 4) | (unsigned)h;
+    }
+    return true;
+}
+
+static void AppendUtf8(std::string& out, unsigned cp) {
+    if (cp < 0x80) out += (char)cp;
+    else if (cp < 0x800) { out += (char)(0xC0 | (cp >> 6)); out += (char)(0x80 | (cp & 0x3F)); }
+    else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12)); out += (char)(0x80 | ((cp >> 6) & 0x3F)); out += (char)(0x80 | (cp & 0x3F));
+    }
+    else {
+        out += (char)(0xF0 | (cp >> 18)); out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F)); out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+// Decodes the body of a string (without quotes) into out.
+static bool Unescape(const char* p, const char* end, std::string& out) {
+    out.clear();
+    while (p < end) {
+        char c = *p++;
+        if (c != '\\') { out += c; continue; }
+        if (p == end) return false;
+        char e = *p++;
+        switch (e) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            unsigned cp;
+            if (!ReadHex4(p, end, cp)) return false;
+            p += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                unsigned low;
+                if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !ReadHex4(p + 2, end, low) || low < 0xDC00 || low > 0xDFFF)
+                    return false;
+                p += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                return false;
+            }
+            AppendUtf8(out, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------- JsonPullParser ----------
+
+JsonPullParser::JsonPullParser(size_t maxTokenBytes, int maxDepth)
+    : maxTokenBytes(maxTokenBytes), maxDepth(maxDepth) {}
+
+void JsonPullParser::Feed(const char* buf, size_t len) {
+    data = buf;
+    size = len;
+    pos = 0;
+}
+
+void JsonPullParser::Finish() {
+    finished = true;
+    data = nullptr;
+    size = 0;
+    pos = 0;
+}
+
+JsonStatus JsonPullParser::Fail(const char* message) {
+    if (!failed) {
+        failed = true;
+        error = message;
+    }
+    token = JsonToken::None;
+    return JsonStatus::Error;
+}
+
+void JsonPullParser::AfterValue() {
+    expect = stack.empty() ? Expect::End : Expect::CommaOrEnd;
+}
+
+JsonStatus JsonPullParser::FinishString(const char* begin, const char* end, bool hasEscapes) {
+    for (const char* p = begin; p < end; p++) {
+        if ((unsigned char)*p < 0x20) return Fail("control character in string");
+    }
+    if (hasEscapes) {
+        if (!Unescape(begin, end, scratch)) return Fail("invalid escape sequence");
+        text = std::string_view(scratch);
+    }
+    else {
+        text = std::string_view(begin, (size_t)(end - begin));
+    }
+    if (pendingIsKey) {
+        token = JsonToken::Key;
+        expect = Expect::Colon;
+    }
+    else {
+        token = JsonToken::String;
+        AfterValue();
+    }
+    return JsonStatus::Token;
+}
+
+JsonStatus JsonPullParser::FinishScalar(const char* begin, const char* end) {
+    size_t len = (size_t)(end - begin);
+    if (len == 4 && !std::memcmp(begin, "true", 4)) token = JsonToken::True;
+    else if (len == 5 && !std::memcmp(begin, "false", 5)) token = JsonToken::False;
+    else if (len == 4 && !std::memcmp(begin, "null", 4)) token = JsonToken::Null;
+    else if (IsJsonNumber(begin, end)) token = JsonToken::Number;
+    else return Fail("invalid literal or number");
+    text = std::string_view(begin, len);
+    AfterValue();
+    return JsonStatus::Token;
+}
+
+// Scans a string starting after the opening quote at data[pos].
+JsonStatus JsonPullParser::BeginString(bool isKey) {
+    pendingIsKey = isKey;
+    size_t start = ++pos;
+    bool hasEscapes = false;
+    while (pos < size) {
+        char c = data[pos];
+        if (c == '\\') {
+            hasEscapes = true;
+            pos += 2;
+            continue;
+        }
+        if (c == '"') {
+            const char* begin = data + start;
+            const char* end = data + pos;
+            pos++;
+            return FinishString(begin, end, hasEscapes);
+        }
+        pos++;
+    }
+    // Runs past the end of this buffer: keep the partial string
+    if (finished) return Fail("unterminated string");
+    if (size - start > maxTokenBytes) return Fail("string too long");
+    pendingEscaped = pos > size;    // buffer ended right after a backslash
+    carry.assign(data + start, (pos > size ? size : pos) - start);
+    pending = Pending::String;
+    pendingHasEscapes = hasEscapes;
+    pos = size;
+    return JsonStatus::NeedMore;
+}
+
+JsonStatus JsonPullParser::BeginScalar() {
+    size_t start = pos;
+    while (pos < size && !IsDelimiter(data[pos])) pos++;
+    if (pos < size || finished) return FinishScalar(data + start, data + pos);
+    if (size - start > maxTokenBytes) return Fail("number too long");
+    carry.assign(data + start, size - start);
+    pending = Pending::Scalar;
+    return JsonStatus::NeedMore;
+}
+
+// Completes a token that started in an earlier buffer.
+JsonStatus JsonPullParser::ContinuePending() {
+    if (pending == Pending::String) {
+        while (pos < size) {
+            char c = data[pos];
+            if (pendingEscaped) {
+                pendingEscaped = false;
+                carry += c;
+                pos++;
+                continue;
+            }
+            if (c == '"') {
+                pos++;
+                pending = Pending::None;
+                return FinishString(carry.data(), carry.data() + carry.size(), pendingHasEscapes);
+            }
+            if (c == '\\') {
+                pendingEscaped = true;
+                pendingHasEscapes = true;
+            }
+            carry += c;
+            pos++;
+        }
+        if (finished) return Fail("unterminated string");
+    }
+    else {
+        size_t start = pos;
+        while (pos < size && !IsDelimiter(data[pos])) pos++;
+        carry.append(data + start, pos - start);
+        if (pos < size || finished) {
+            pending = Pending::None;
+            return FinishScalar(carry.data(), carry.data() + carry.size());
+        }
+    }
+    if (carry.size() > maxTokenBytes) return Fail("token too long");
+    return JsonStatus::NeedMore;
+}
+
+JsonStatus JsonPullParser::Next() {
+    if (failed) return JsonStatus::Error;
+    token = JsonToken::None;
+    text = std::string_view();
+
+    if (pending != Pending::None) {
+        if (pos >= size && !finished) return JsonStatus::NeedMore;
+        return ContinuePending();
+    }
+
+    for (;;) {
+        while (pos < size && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\n' || data[pos] == '\r')) pos++;
+        if (pos >= size) {
+            if (!finished) return JsonStatus::NeedMore;
+            if (expect != Expect::End) return Fail("unexpected end of input");
+            return JsonStatus::Done;
+        }
+
+        char c = data[pos];
+        switch (c) {
+        case '{':
+        case '[':
+            if (expect != Expect::Value && expect != Expect::ValueOrEnd) return Fail("unexpected container");
+            if ((int)stack.size() >= maxDepth) return Fail("nesting too deep");
+            stack.push_back(c);
+            expect = c == '{' ? Expect::KeyOrEnd : Expect::ValueOrEnd;
+            token = c == '{' ? JsonToken::BeginObject : JsonToken::BeginArray;
+            pos++;
+            return JsonStatus::Token;
+
+        case '}':
+        case ']': {
+            char open = c == '}' ? '{' : '[';
+            bool canClose = expect == Expect::CommaOrEnd || expect == (c == '}' ? Expect::KeyOrEnd : Expect::ValueOrEnd);
+            if (stack.empty() || stack.back() != open || !canClose) return Fail("unexpected closing bracket");
+            stack.pop_back();
+            AfterValue();
+            token = c == '}' ? JsonToken::EndObject : JsonToken::EndArray;
+            pos++;
+            return JsonStatus::Token;
+        }
+
+        case ':':
+            if (expect != Expect::Colon) return Fail("unexpected ':'");
+            expect = Expect::Value;
+            pos++;
+            continue;
+
+        case ',':
+            if (expect != Expect::CommaOrEnd) return Fail("unexpected ','");
+            expect = stack.back() == '{' ? Expect::Key : Expect::Value;
+            pos++;
+            continue;
+
+        case '"':
+            if (expect == Expect::Key || expect == Expect::KeyOrEnd) return BeginString(true);
+            if (expect == Expect::Value || expect == Expect::ValueOrEnd) return BeginString(false);
+            return Fail("unexpected string");
+
+        default:
+            if (expect != Expect::Value && expect != Expect::ValueOrEnd) return Fail("unexpected value");
+            return BeginScalar();
+        }
+    }
+}
+
+bool JsonPullParser::NumberValue(double& value) const {
+    if (token != JsonToken::Number) return false;
+    auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+    return res.ec == std::errc() && res.ptr == text.data() + text.size();
+}
+
+// ---------- CloudResultReader ----------
+
+enum Section { SEC_NONE, SEC_STATUS, SEC_MESSAGE, SEC_CLASSIFICATION, SEC_STATISTICS, SEC_HISTOGRAM, SEC_GRAINS };
+
+enum Field {
+    F_NONE,
+    F_BEACH_ZONE, F_ZONE_LOCATION, F_SAND_SIZE, F_BEACH_TYPE, F_CATEGORY,
+    F_D10, F_D50, F_D90, F_MEAN, F_GRAIN_COUNT,
+    F_BIN_SIZES, F_BIN_COUNTS,
+    F_DIAMETER, F_X, F_Y
+};
+
+struct KeyId { const char* name; int id; };
+
+static int Lookup(std::string_view key, const KeyId* table, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (key == table[i].name) return table[i].id;
+    }
+    return 0;
+}
+
+static const KeyId ROOT_KEYS[] = {
+    { "status", SEC_STATUS }, { "message", SEC_MESSAGE }, { "classification", SEC_CLASSIFICATION },
+    { "statistics", SEC_STATISTICS }, { "histogram", SEC_HISTOGRAM }, { "grains", SEC_GRAINS },
+};
+static const KeyId CLASSIFICATION_KEYS[] = {
+    { "beach_zone", F_BEACH_ZONE }, { "zone_location", F_ZONE_LOCATION }, { "sand_size", F_SAND_SIZE },
+    { "beach_type", F_BEACH_TYPE }, { "category", F_CATEGORY },
+};
+static const KeyId STATISTICS_KEYS[] = {
+    { "d10_mm", F_D10 }, { "d50_mm", F_D50 }, { "d90_mm", F_D90 }, { "mean_mm", F_MEAN }, { "grain_count", F_GRAIN_COUNT },
+};
+static const KeyId HISTOGRAM_KEYS[] = { { "sizes_mm", F_BIN_SIZES }, { "counts", F_BIN_COUNTS } };
+static const KeyId GRAIN_KEYS[] = { { "diameter_mm", F_DIAMETER }, { "x_px", F_X }, { "y_px", F_Y } };
+
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
+
+CloudResultReader::CloudResultReader(AnalysisResult& result) : result(result) {}
+
+bool CloudResultReader::Reject(const std::string& msg) {
+    if (error.empty()) error = msg;
+    return false;
+}
+
+bool CloudResultReader::Consume(const char* data, size_t size) {
+    if (!error.empty()) return false;
+    parser.Feed(data, size);
+    return Drain();
+}
+
+bool CloudResultReader::Finish() {
+    if (!error.empty()) return false;
+    parser.Finish();
+    if (!Drain()) return false;
+
+    if (!sawStatus) return Reject("response has no status");
+    if (!statusOk) return Reject(message.empty() ? "analysis rejected by server" : "server: " + message);
+    if (result.binSizesMm.size() != result.binCounts.size()) return Reject("histogram columns differ in length");
+    const GrainTable& g = result.grains;
+    if ((!g.centroidX.empty() && g.centroidX.size() != g.diameterMm.size()) ||
+        (!g.centroidY.empty() && g.centroidY.size() != g.diameterMm.size()))
+        return Reject("grain columns differ in length");
+    if (result.grainCount == 0) result.grainCount = (int)g.Size();
+    result.complete = true;
+    result.progress = 1.0;
+    return true;
+}
+
+bool CloudResultReader::Drain() {
+    for (;;) {
+        switch (parser.Next()) {
+        case JsonStatus::Token:
+            if (!HandleToken()) return false;
+            break;
+        case JsonStatus::NeedMore:
+        case JsonStatus::Done:
+            return true;
+        case JsonStatus::Error:
+            return Reject("malformed response: " + parser.Error());
+        }
+    }
+}
+
+bool CloudResultReader::HandleToken() {
+    JsonToken token = parser.Token();
+    int depth = parser.Depth();
+
+    // Skipping the value of an unknown key
+    if (skipToDepth >= 0) {
+        if (depth <= skipToDepth) skipToDepth = -1;
+        return true;
+    }
+
+    if (token == JsonToken::Key) {
+        if (depth == 1) { section = Lookup(parser.Text(), ROOT_KEYS, COUNT_OF(ROOT_KEYS)); field = F_NONE; }
+        else if (depth == 2) {
+            switch (section) {
+            case SEC_CLASSIFICATION: field = Lookup(parser.Text(), CLASSIFICATION_KEYS, COUNT_OF(CLASSIFICATION_KEYS)); break;
+            case SEC_STATISTICS: field = Lookup(parser.Text(), STATISTICS_KEYS, COUNT_OF(STATISTICS_KEYS)); break;
+            case SEC_HISTOGRAM: field = Lookup(parser.Text(), HISTOGRAM_KEYS, COUNT_OF(HISTOGRAM_KEYS)); break;
+            case SEC_GRAINS: field = Lookup(parser.Text(), GRAIN_KEYS, COUNT_OF(GRAIN_KEYS)); break;
+            default: field = F_NONE; break;
+            }
+        }
+        return true;
+    }
+
+    if (token == JsonToken::EndObject || token == JsonToken::EndArray) {
+        if (depth == 1) section = SEC_NONE;
+        if (depth <= 2) field = F_NONE;
+        return true;
+    }
+
+    bool isContainer = token == JsonToken::BeginObject || token == JsonToken::BeginArray;
+    int valueDepth = isContainer ? depth - 1 : depth;   // depth of the key that owns this value
+
+    if (valueDepth == 0) {
+        if (token != JsonToken::BeginObject) return Reject("response is not a JSON object");
+        return true;
+    }
+
+    // Root level: status/message scalars, section objects
+    if (valueDepth == 1) {
+        switch (section) {
+        case SEC_STATUS:
+            if (token != JsonToken::String) return Reject("status must be a string");
+            sawStatus = true;
+            statusOk = parser.Text() == "ok";
+            return true;
+        case SEC_MESSAGE:
+            if (token == JsonToken::String) message.assign(parser.Text());
+            return true;
+        case SEC_CLASSIFICATION:
+        case SEC_STATISTICS:
+        case SEC_HISTOGRAM:
+        case SEC_GRAINS:
+            if (token != JsonToken::BeginObject) return Reject("section must be an object");
+            return true;
+        default:
+            if (isContainer) skipToDepth = depth - 1;
+            return true;
+        }
+    }
+
+    // Section members
+    if (valueDepth == 2) {
+        if (section == SEC_CLASSIFICATION && field != F_NONE) {
+            if (token != JsonToken::String) return Reject("classification fields must be strings");
+            std::string* target = nullptr;
+            switch (field) {
+            case F_BEACH_ZONE: target = &result.beachZone; break;
+            case F_ZONE_LOCATION: target = &result.zoneLocation; break;
+            case F_SAND_SIZE: target = &result.sandSize; break;
+            case F_BEACH_TYPE: target = &result.beachType; break;
+            case F_CATEGORY: target = &result.category; break;
+            }
+            if (target) target->assign(parser.Text());
+            return true;
+        }
+        if (section == SEC_STATISTICS && field != F_NONE) {
+            double value;
+            if (!parser.NumberValue(value)) return Reject("statistics must be numbers");
+            bool valid = field == F_GRAIN_COUNT ? InRange(value, -MAX_COUNT, MAX_COUNT) : InRange(value, -MAX_SIZE_MM, MAX_SIZE_MM);
+            if (!valid) return Reject("statistic out of range");
+            switch (field) {
+            case F_D10: result.d10Mm = value; break;
+            case F_D50: result.d50Mm = value; break;
+            case F_D90: result.d90Mm = value; break;
+            case F_MEAN: result.meanMm = value; break;
+            case F_GRAIN_COUNT: result.grainCount = value < 0 ? 0 : (int)value; break;
+            }
+            return true;
+        }
+        if ((section == SEC_HISTOGRAM || section == SEC_GRAINS) && field != F_NONE) {
+            if (token != JsonToken::BeginArray) return Reject("histogram and grain columns must be arrays");
+            return true;
+        }
+        if (isContainer) skipToDepth = depth - 1;
+        return true;
+    }
+
+    // Array elements: histogram bins and grain columns
+    if (valueDepth == 3 && field != F_NONE && (section == SEC_HISTOGRAM || section == SEC_GRAINS)) {
+        double value;
+        if (!parser.NumberValue(value)) return Reject("array elements must be numbers");
+        GrainTable& g = result.grains;
+        switch (field) {
+        case F_BIN_SIZES:
+            if (result.binSizesMm.size() >= MAX_HISTOGRAM_BINS) return Reject("too many histogram bins");
+            if (!InRange(value, 0.0, MAX_SIZE_MM)) return Reject("histogram size out of range");
+            result.binSizesMm.push_back(value);
+            break;
+        case F_BIN_COUNTS:
+            if (result.binCounts.size() >= MAX_HISTOGRAM_BINS) return Reject("too many histogram bins");
+            if (!InRange(value, 0.0, MAX_COUNT)) return Reject("histogram count out of range");
+            result.binCounts.push_back((int)value);
+            break;
+        case F_DIAMETER:
+            if (g.diameterMm.size() >= MAX_GRAINS) return Reject("too many grains");
+            if (!InRange(value, 0.0, MAX_SIZE_MM)) return Reject("grain diameter out of range");
+            g.diameterMm.push_back((float)value);
+            break;
+        case F_X:
+            if (g.centroidX.size() >= MAX_GRAINS) return Reject("too many grains");
+            if (!InRange(value, -MAX_COORDINATE_PX, MAX_COORDINATE_PX)) return Reject("grain position out of range");
+            g.centroidX.push_back((float)value);
+            break;
+        case F_Y:
+            if (g.centroidY.size() >= MAX_GRAINS) return Reject("too many grains");
+            if (!InRange(value, -MAX_COORDINATE_PX, MAX_COORDINATE_PX)) return Reject("grain position out of range");
+            g.centroidY.push_back((float)value);
+            break;
+        }
+        return true;
+    }
+
+    if (isContainer) skipToDepth = depth - 1;
+    return true;
+}
+
+bool ParseCloudResponse(const char* data, size_t size, size_t chunk, AnalysisResult& result, std::string* error) {
+    CloudResultReader reader(result);
+    if (chunk == 0) chunk = size ? size : 1;
+    bool ok = true;
+    for (size_t offset = 0; ok && offset < size; offset += chunk) {
+        size_t n = size - offset < chunk ? size - offset : chunk;
+        ok = reader.Consume(data + offset, n);
+    }
+    if (ok) ok = reader.Finish();
+    if (!ok && error) *error = reader.Error();
+    return ok;
+}
@@ -0,0 +1,116 @@
+/*
+*****************************************************************************
+*   GrainEye - Streaming parser for the cloud model's response                *
+*   ------------------------------------------------------------------------- *
+*   The response is parsed straight out of the network buffers as they      *
+*   arrive: no DOM, and string/number tokens are views into the buffer.      *
+*   Only a token that straddles two buffers (or a string with escapes) is    *
+*   copied, into a small bounded scratch buffer.                             *
+*                                                                             *
+*   Response schema (unknown keys are skipped):                               *
+*   {                                                                         *
+*     "status": "ok" | "error",  "message": "...",                            *
+*     "classification": { "beach_zone", "zone_location", "sand_size",         *
+*                         "beach_type", "category" },          (strings)      *
+*     "statistics": { "d10_mm", "d50_mm", "d90_mm", "mean_mm",                *
+*                     "grain_count" },                         (numbers)      *
+*     "histogram": { "sizes_mm": [..], "counts": [..] },                      *
+*     "grains": { "diameter_mm": [..], "x_px": [..], "y_px": [..] }           *
+*   }                                                                         *
+*****************************************************************************
+*/
+#pragma once
+
+#include "Analysis.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class JsonToken { None, BeginObject, EndObject, BeginArray, EndArray, Key, String, Number, True, False, Null };
+enum class JsonStatus { Token, NeedMore, Done, Error };
+
+// Pull-style JSON tokenizer over a sequence of buffers. Usage:
+//   parser.Feed(buf, n);  while (parser.Next() == JsonStatus::Token) { ... }
+// Feed the next buffer only after Next() returned NeedMore; call Finish()
+// after the last one. Text() stays valid until the next Feed()/Next().
+class JsonPullParser {
+public:
+    explicit JsonPullParser(size_t maxTokenBytes = 64 * 1024, int maxDepth = 32);
+
+    void Feed(const char* data, size_t size);
+    void Finish();
+    JsonStatus Next();
+
+    JsonToken Token() const { return token; }
+    std::string_view Text() const { return text; }     // Key/String (unescaped) or Number (raw)
+    bool NumberValue(double& value) const;
+    int Depth() const { return (int)stack.size(); }
+    const std::string& Error() const { return error; }
+
+private:
+    enum class Expect { Value, ValueOrEnd, Key, KeyOrEnd, Colon, CommaOrEnd, End };
+    enum class Pending { None, String, Scalar };
+
+    JsonStatus Fail(const char* message);
+    JsonStatus BeginString(bool isKey);
+    JsonStatus BeginScalar();
+    JsonStatus ContinuePending();
+    JsonStatus FinishString(const char* begin, const char* end, bool hasEscapes);
+    JsonStatus FinishScalar(const char* begin, const char* end);
+    void AfterValue();
+
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    bool finished = false;
+
+    std::vector<char> stack;        // '{' or '['
+    Expect expect = Expect::Value;
+    size_t maxTokenBytes;
+    int maxDepth;
+
+    // Token straddling a buffer boundary
+    Pending pending = Pending::None;
+    bool pendingIsKey = false;
+    bool pendingEscaped = false;    // last byte in carry was an unconsumed backslash
+    bool pendingHasEscapes = false;
+    std::string carry;
+    std::string scratch;            // unescaped strings
+
+    JsonToken token = JsonToken::None;
+    std::string_view text;
+    std::string error;
+    bool failed = false;
+};
+
+// Fills an AnalysisResult from the response stream. Grain columns are
+// appended directly into result.grains as the numbers are parsed.
+class CloudResultReader {
+public:
+    explicit CloudResultReader(AnalysisResult& result);
+
+    bool Consume(const char* data, size_t size);    // false on malformed input
+    bool Finish();                                  // false if incomplete or rejected
+    const std::string& Error() const { return error; }
+    size_t GrainsParsed() const { return result.grains.diameterMm.size(); }
+
+private:
+    bool Drain();
+    bool HandleToken();
+    bool Reject(const std::string& message);
+
+    JsonPullParser parser;
+    AnalysisResult& result;
+    std::string error;
+    int section = 0;            // root key we are inside of
+    int field = 0;              // key inside the section
+    int skipToDepth = -1;       // skipping an unknown value until this depth
+    bool sawStatus = false;
+    bool statusOk = false;
+    std::string message;
+};
+
+// Parses a complete response held in memory, `chunk` bytes at a time
+// (0 = all at once). Used for recorded payloads.
+bool ParseCloudResponse(const char* data, size_t size, size_t chunk, AnalysisResult& result, std::string* error);
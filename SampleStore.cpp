@@ -0,0 +1,207 @@
+/*
+*****************************************************************************
+*   GrainEye - Sample store                                                   *
+*****************************************************************************
+*/
+#include "SampleStore.h"
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+static const char STORE_MAGIC[4] = { 'G', 'E', 'S', 'S' };
+static const uint32_t STORE_VERSION = 1;
+static const uint32_t MAX_RECORD_BYTES = 1 << 20;
+
+// "YYYY-MM-DD HH:MM" local time -> unix seconds; now if it does not parse
+static int64_t ParseTimestamp(const std::string& text) {
+    std::tm local = {};
+    if (std::sscanf(text.c_str(), "%d-%d-%d %d:%d", &local.tm_year, &local.tm_mon, &local.tm_mday, &local.tm_hour, &local.tm_min) != 5)
+        return (int64_t)std::time(nullptr);
+    local.tm_year -= 1900;
+    local.tm_mon -= 1;
+    local.tm_isdst = -1;
+    std::time_t t = std::mktime(&local);
+    return t == (std::time_t)-1 ? (int64_t)std::time(nullptr) : (int64_t)t;
+}
+
+SampleRecord SampleRecord::FromResult(const AnalysisResult& result) {
+    SampleRecord r;
+    r.time = ParseTimestamp(result.timestamp);
+    r.hasLocation = result.hasLocation;
+    r.latitude = result.latitude;
+    r.longitude = result.longitude;
+    r.d10Mm = (float)result.d10Mm;
+    r.d50Mm = (float)result.d50Mm;
+    r.d90Mm = (float)result.d90Mm;
+    r.meanMm = (float)result.meanMm;
+    r.grainCount = result.grainCount;
+    r.hasShape = result.shape.grains > 0;
+    r.roundness = (float)result.shape.roundness.p50;
+    r.sphericity = (float)result.shape.sphericity.p50;
+    r.zone = result.beachZone;
+    r.category = result.category;
+    r.beachType = result.beachType;
+    r.imagePath = result.imagePath;
+    return r;
+}
+
+// ---------------------------------------------------------------------------
+// Encoding
+// ---------------------------------------------------------------------------
+template <typename T>
+static void Put(std::vector<uint8_t>& out, T value) {
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void PutString(std::vector<uint8_t>& out, const std::string& text) {
+    uint16_t length = (uint16_t)std::min<size_t>(text.size(), 0xFFFF);
+    Put(out, length);
+    out.insert(out.end(), text.begin(), text.begin() + length);
+}
+
+struct PayloadReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    template <typename T>
+    T Get() {
+        T value = T();
+        if (end - p < (ptrdiff_t)sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+    std::string GetString() {
+        uint16_t length = Get<uint16_t>();
+        if (!ok || end - p < (ptrdiff_t)length) {
+            ok = false;
+            return std::string();
+        }
+        std::string text((const char*)p, length);
+        p += length;
+        return text;
+    }
+};
+
+bool AppendSample(const std::string& path, const SampleRecord& r, std::string* error) {
+    std::vector<uint8_t> record;
+    Put<uint32_t>(record, 0);       // payload size, patched below
+    Put<int64_t>(record, r.time);
+    Put<uint8_t>(record, (uint8_t)((r.hasLocation ? 1 : 0) | (r.hasShape ? 2 : 0)));
+    Put(record, r.latitude);
+    Put(record, r.longitude);
+    Put(record, r.d10Mm);
+    Put(record, r.d50Mm);
+    Put(record, r.d90Mm);
+    Put(record, r.meanMm);
+    Put<int32_t>(record, r.grainCount);
+    Put(record, r.roundness);
+    Put(record, r.sphericity);
+    PutString(record, r.zone);
+    PutString(record, r.category);
+    PutString(record, r.beachType);
+    PutString(record, r.imagePath);
+    uint32_t payloadBytes = (uint32_t)(record.size() - 4);
+    std::memcpy(record.data(), &payloadBytes, 4);
+
+    FILE* f = OpenFile(path, "ab");
+    if (!f) {
+        if (error) *error = "cannot open " + path;
+        return false;
+    }
+    bool ok = true;
+    FileSeek(f, 0, SEEK_END);
+    if (FileTell(f) == 0) {
+        ok = std::fwrite(STORE_MAGIC, 1, 4, f) == 4 && std::fwrite(&STORE_VERSION, 4, 1, f) == 1;
+    }
+    ok = ok && std::fwrite(record.data(), 1, record.size(), f) == record.size();
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok && error) *error = "write failed: " + path;
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Reader
+// ---------------------------------------------------------------------------
+SampleStoreReader::~SampleStoreReader() {
+    if (file) std::fclose(file);
+}
+
+bool SampleStoreReader::Open(const std::string& path, std::string* error) {
+    if (file) std::fclose(file);
+    file = OpenFile(path, "rb");
+    if (!file) {
+        if (error) *error = "cannot open " + path;
+        return false;
+    }
+    buffer.resize(1 << 16);
+    std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+    FileSeek(file, 0, SEEK_END);
+    fileSize = FileTell(file);
+    FileSeek(file, 0, SEEK_SET);
+
+    char magic[4];
+    uint32_t version = 0;
+    if (std::fread(magic, 1, 4, file) != 4 || std::memcmp(magic, STORE_MAGIC, 4) != 0 ||
+        std::fread(&version, 4, 1, file) != 1 || version != STORE_VERSION) {
+        std::fclose(file);
+        file = nullptr;
+        if (error) *error = path + " is not a GrainEye sample store";
+        return false;
+    }
+    position = 8;
+    truncated = false;
+    return true;
+}
+
+bool SampleStoreReader::Next(SampleRecord& r) {
+    if (!file) return false;
+    uint32_t size = 0;
+    if (std::fread(&size, 4, 1, file) != 1) {
+        truncated = position < fileSize;
+        return false;
+    }
+    if (size > MAX_RECORD_BYTES) {
+        truncated = true;
+        return false;
+    }
+    payload.resize(size);
+    if (std::fread(payload.data(), 1, size, file) != size) {
+        truncated = true;
+        return false;
+    }
+    position += 4 + (long long)size;
+
+    PayloadReader in = { payload.data(), payload.data() + payload.size() };
+    r.time = in.Get<int64_t>();
+    uint8_t flags = in.Get<uint8_t>();
+    r.hasLocation = (flags & 1) != 0;
+    r.hasShape = (flags & 2) != 0;
+    r.latitude = in.Get<double>();
+    r.longitude = in.Get<double>();
+    r.d10Mm = in.Get<float>();
+    r.d50Mm = in.Get<float>();
+    r.d90Mm = in.Get<float>();
+    r.meanMm = in.Get<float>();
+    r.grainCount = in.Get<int32_t>();
+    r.roundness = in.Get<float>();
+    r.sphericity = in.Get<float>();
+    r.zone = in.GetString();
+    r.category = in.GetString();
+    r.beachType = in.GetString();
+    r.imagePath = in.GetString();
+    if (!in.ok) truncated = true;
+    return in.ok;
+}
+
+double SampleStoreReader::Progress() const {
+    return fileSize > 0 ? (double)position / (double)fileSize : 1.0;
+}
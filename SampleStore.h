@@ -0,0 +1,74 @@
+/*
+*****************************************************************************
+*   GrainEye - Sample store                                                   *
+*   ------------------------------------------------------------------------- *
+*   Append-only file with one record per tagged sample: the summary of the  *
+*   analysis, not its grains. Each record is written with one write and   *
+*   the file closed again, so nothing is buffered in the app; readers stop *
+*   at a truncated tail. Exports stream from here record by record.         *
+*                                                                             *
+*   File (little-endian):                                                    *
+*     "GESS" u32 version (1)                                                 *
+*     per record: u32 payload bytes, then                                    *
+*       i64 unix time, u8 flags (1 location, 2 shape),                      *
+*       f64 latitude, f64 longitude,                                         *
+*       f32 d10, d50, d90, mean (mm), i32 grain count,                      *
+*       f32 roundness, sphericity (medians),                                 *
+*       strings zone, category, beach type, image path (u16 length + UTF-8) *
+*****************************************************************************
+*/
+#pragma once
+
+#include "Analysis.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct SampleRecord {
+    int64_t time = 0;               // unix seconds, UTC
+    bool hasLocation = false;
+    bool hasShape = false;
+    double latitude = 0.0;
+    double longitude = 0.0;
+    float d10Mm = 0.0f;
+    float d50Mm = 0.0f;
+    float d90Mm = 0.0f;
+    float meanMm = 0.0f;
+    int32_t grainCount = 0;
+    float roundness = 0.0f;
+    float sphericity = 0.0f;
+    std::string zone;
+    std::string category;
+    std::string beachType;
+    std::string imagePath;
+
+    static SampleRecord FromResult(const AnalysisResult& result);
+};
+
+// Appends one record, creating the file if needed.
+bool AppendSample(const std::string& path, const SampleRecord& record, std::string* error = nullptr);
+
+// Sequential reader holding one record at a time.
+class SampleStoreReader {
+public:
+    SampleStoreReader() = default;
+    ~SampleStoreReader();
+    SampleStoreReader(const SampleStoreReader&) = delete;
+    SampleStoreReader& operator=(const SampleStoreReader&) = delete;
+
+    bool Open(const std::string& path, std::string* error = nullptr);
+    // False at the end of the store (or at a truncated / damaged tail)
+    bool Next(SampleRecord& record);
+    bool Truncated() const { return truncated; }    // stopped before the end of the file
+    double Progress() const;                        // 0..1 by bytes read
+
+private:
+    FILE* file = nullptr;
+    std::vector<char> buffer;       // stdio buffer
+    std::vector<uint8_t> payload;
+    long long fileSize = 0;
+    long long position = 0;
+    bool truncated = false;
+};
@@ -0,0 +1,659 @@
+/*
+*****************************************************************************
+*   GrainEye - Session recording and replay                                   *
+*****************************************************************************
+*/
+#include "SessionLog.h"
+#include "Analysis.h"
+#include "CsvExport.h"
+#include "FileUtil.h"
+#include "ImageIO.h"
+#include "ResultChannel.h"
+#include "SampleStore.h"
+#include "SurveyAggregate.h"
+#include "SurveyExport.h"
+#include "ThumbnailCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+
+static const char* const SESSION_HEADER = "# GrainEye session log 1";
+
+// Same pacing as the window's result box
+static const int REPLAY_UPDATE_INTERVAL_MS = 100;
+
+// Files a replay writes under fixed names; ReplaySession refuses a work
+// directory that already holds one, so a replay never touches survey data
+static const char* const REPLAY_FILES[] = {
+    "samples.gess", "thumbnails.pack", "survey.geojson", "survey.gecf",
+};
+
+static const char* const STAGE_ORDER[] = {
+    "hover", "load", "analyze first", "analyze", "ui update", "save", "export", "tag", "gallery",
+};
+
+static bool Fail(std::string* error, const std::string& message) {
+    if (error) *error = message;
+    return false;
+}
+
+static std::string WorkPath(const std::string& dir, const std::string& name) {
+    char last = dir.back();
+    if (last == '/' || last == '\\') return dir + name;
+#ifdef _WIN32
+    return dir + "\\" + name;
+#else
+    return dir + "/" + name;
+#endif
+}
+
+static std::string Escape(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '\t') out += "\\t";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+static std::string Unescape(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '\\' || i + 1 == text.size()) { out += text[i]; continue; }
+        char c = text[++i];
+        out += c == 't' ? '\t' : c == 'n' ? '\n' : c;
+    }
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Recorder
+// ---------------------------------------------------------------------------
+
+bool SessionRecorder::Start(const std::string& path, std::string* error) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (file) return Fail(error, "a session is already being recorded");
+    file = OpenFile(path, "wb");
+    if (!file) return Fail(error, "cannot create " + path);
+    buffer.resize(64 * 1024);
+    std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+    std::fprintf(file, "%s\n", SESSION_HEADER);
+    std::fflush(file);
+    start = std::chrono::steady_clock::now();
+    recording = true;
+    return true;
+}
+
+void SessionRecorder::Stop() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!file) return;
+    recording = false;
+    std::fclose(file);
+    file = nullptr;
+}
+
+void SessionRecorder::Write(const std::string& line, bool flush) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!file) return;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::fprintf(file, "%.3f\t%s\n", ms, line.c_str());
+    if (flush) std::fflush(file);
+}
+
+void SessionRecorder::Button(int x0, int y0, int x1, int y1) {
+    char line[96];
+    std::snprintf(line, sizeof(line), "button\t%d\t%d\t%d\t%d", x0, y0, x1, y1);
+    Write(line, true);
+}
+
+void SessionRecorder::Move(int x, int y) {
+    if (!Recording()) return;       // hot path: skip the formatting
+    char line[48];
+    std::snprintf(line, sizeof(line), "move\t%d\t%d", x, y);
+    Write(line, false);
+}
+
+void SessionRecorder::Down(int x, int y) {
+    char line[48];
+    std::snprintf(line, sizeof(line), "down\t%d\t%d", x, y);
+    Write(line, false);
+}
+
+void SessionRecorder::Up(int x, int y) {
+    char line[48];
+    std::snprintf(line, sizeof(line), "up\t%d\t%d", x, y);
+    Write(line, false);
+}
+
+void SessionRecorder::Leave() {
+    Write("leave", false);
+}
+
+void SessionRecorder::Image(const char* source, const std::string& path) {
+    Write(std::string("image\t") + source + "\t" + Escape(path), true);
+}
+
+void SessionRecorder::Command(const char* name) {
+    Write(std::string("command\t") + name, true);
+}
+
+void SessionRecorder::Gnss(double latitude, double longitude) {
+    char line[96];
+    std::snprintf(line, sizeof(line), "gnss\t%.7f\t%.7f", latitude, longitude);
+    Write(line, true);
+}
+
+// ---------------------------------------------------------------------------
+// Reader
+// ---------------------------------------------------------------------------
+
+static bool ReadLine(FILE* f, std::string& line) {
+    line.clear();
+    char chunk[1024];
+    while (std::fgets(chunk, sizeof(chunk), f)) {
+        line += chunk;
+        if (!line.empty() && line.back() == '\n') break;
+    }
+    if (line.empty()) return false;
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+    return true;
+}
+
+static std::vector<std::string> SplitTabs(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t begin = 0;
+    for (;;) {
+        size_t tab = line.find('\t', begin);
+        fields.push_back(line.substr(begin, tab == std::string::npos ? std::string::npos : tab - begin));
+        if (tab == std::string::npos) break;
+        begin = tab + 1;
+    }
+    return fields;
+}
+
+static bool ParseNumber(const std::string& text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return !text.empty() && end && *end == '\0' && std::isfinite(value);
+}
+
+static bool ParseInts(const std::vector<std::string>& fields, size_t count, SessionEvent& event) {
+    if (fields.size() != 2 + count) return false;
+    int* targets[] = { &event.x0, &event.y0, &event.x1, &event.y1 };
+    for (size_t i = 0; i < count; i++) {
+        double value = 0.0;
+        if (!ParseNumber(fields[2 + i], value) || value != std::floor(value) || std::fabs(value) > 1e6) return false;
+        *targets[i] = (int)value;
+    }
+    return true;
+}
+
+bool ReadSessionLog(const std::string& path, std::vector<SessionEvent>& events, std::string* error) {
+    events.clear();
+    FILE* f = OpenFile(path, "rb");
+    if (!f) return Fail(error, "cannot open " + path);
+
+    std::string line;
+    bool ok = ReadLine(f, line) && line == SESSION_HEADER;
+    if (!ok) {
+        std::fclose(f);
+        return Fail(error, path + " is not a GrainEye session log");
+    }
+
+    int lineNumber = 1;
+    while (ok && ReadLine(f, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::vector<std::string> fields = SplitTabs(line);
+        SessionEvent event;
+        ok = fields.size() >= 2 && ParseNumber(fields[0], event.ms) && event.ms >= 0.0;
+        if (!ok) break;
+
+        const std::string& name = fields[1];
+        if (name == "button") {
+            event.type = SESSION_BUTTON;
+            ok = ParseInts(fields, 4, event);
+        }
+        else if (name == "move" || name == "down" || name == "up") {
+            event.type = name == "move" ? SESSION_MOVE : name == "down" ? SESSION_DOWN : SESSION_UP;
+            ok = ParseInts(fields, 2, event);
+        }
+        else if (name == "leave") {
+            event.type = SESSION_LEAVE;
+            ok = fields.size() == 2;
+        }
+        else if (name == "image") {
+            event.type = SESSION_IMAGE;
+            ok = fields.size() == 4 && !fields[3].empty();
+            if (ok) {
+                event.name = fields[2];
+                event.path = Unescape(fields[3]);
+            }
+        }
+        else if (name == "command") {
+            event.type = SESSION_COMMAND;
+            ok = fields.size() == 3;
+            if (ok) event.name = fields[2];
+        }
+        else if (name == "gnss") {
+            event.type = SESSION_GNSS;
+            ok = fields.size() == 4 && ParseNumber(fields[2], event.latitude) && ParseNumber(fields[3], event.longitude)
+                && std::fabs(event.latitude) <= 90.0 && std::fabs(event.longitude) <= 180.0;
+        }
+        else {
+            continue;       // from a newer recorder
+        }
+        if (ok) events.push_back(event);
+    }
+    std::fclose(f);
+    if (!ok) return Fail(error, path + ": line " + std::to_string(lineNumber) + " is malformed");
+
+    // Timestamps only go forward; the replay schedule relies on it
+    for (size_t i = 1; i < events.size(); i++)
+        if (events[i].ms < events[i - 1].ms) return Fail(error, path + ": timestamps go backwards");
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Replayer
+// ---------------------------------------------------------------------------
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double MsSince(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// The main thread plays the window's message loop: it dispatches the events
+// on schedule and, in between, handles result updates as WM_APP_RESULT_UPDATE
+// would. Analyses and exports run on their own threads as in the window.
+class Replayer {
+public:
+    Replayer(const ReplayOptions& options, ReplayReport& report);
+    ~Replayer();
+
+    void Run(const std::vector<SessionEvent>& events);
+
+private:
+    void Dispatch(const SessionEvent& event);
+    void Command(const std::string& name);
+    void StartAnalysis();
+    void WaitForAnalysis();
+    void HandleUpdates(Clock::time_point deadline, bool untilIdle);
+    void ShowUpdate(Clock::time_point notified);
+    void Save();
+    void Tag();
+    void Gallery();
+    void Time(const char* stage, double ms);
+    std::string WorkFile(const std::string& name) const;
+
+    const ReplayOptions& options;
+    ReplayReport& report;
+
+    std::mutex timesLock;                   // export times arrive on the export thread
+    std::map<std::string, std::vector<double>> times;
+    std::atomic<int> exportFailures{ 0 };
+
+    HoverTracker hover;
+    std::vector<int> changed;
+
+    std::mutex updateLock;
+    std::condition_variable updateWake;
+    bool updatePending = false;
+    Clock::time_point notifyTime;
+    ResultChannel channel;
+
+    std::thread analysis;
+    bool analyzing = false;
+    bool firstUpdate = false;
+    Clock::time_point analyzeStart;
+
+    std::string imagePath;
+    AnalysisResult current;
+    bool hasResult = false;
+    std::string lastTagged;
+    std::unordered_set<std::string> csvWritten;
+    bool tagEnabled = false;                // the window's Tag button: after a fetch or a result, until restart
+    bool hasGnss = false;
+    double latitude = 0.0;
+    double longitude = 0.0;
+
+    BeachSurvey survey;
+    ExportJob exportJob;
+    std::unique_ptr<ThumbnailCache> thumbnails;
+};
+
+Replayer::Replayer(const ReplayOptions& replayOptions, ReplayReport& replayReport)
+    : options(replayOptions), report(replayReport),
+      channel(REPLAY_UPDATE_INTERVAL_MS, [this] {
+          std::lock_guard<std::mutex> guard(updateLock);
+          if (!updatePending) notifyTime = Clock::now();
+          updatePending = true;
+          updateWake.notify_one();
+      }) {
+}
+
+Replayer::~Replayer() {
+    if (analysis.joinable()) analysis.join();
+    exportJob.Wait();
+}
+
+std::string Replayer::WorkFile(const std::string& name) const {
+    return WorkPath(options.workDir, name);
+}
+
+void Replayer::Time(const char* stage, double ms) {
+    std::lock_guard<std::mutex> guard(timesLock);
+    times[stage].push_back(ms);
+}
+
+void Replayer::Run(const std::vector<SessionEvent>& events) {
+    Clock::time_point begin = Clock::now();
+    double firstMs = events.empty() ? 0.0 : events.front().ms;
+    for (const SessionEvent& event : events) {
+        if (options.speed > 0.0) {
+            auto offset = std::chrono::duration<double, std::milli>((event.ms - firstMs) / options.speed);
+            HandleUpdates(begin + std::chrono::duration_cast<Clock::duration>(offset), false);
+        }
+        else {
+            HandleUpdates(Clock::now(), false);
+        }
+        Dispatch(event);
+    }
+    WaitForAnalysis();
+    exportJob.Wait();
+
+    report.events = events.size();
+    report.wallMs = MsSince(begin);
+    report.recordedMs = events.empty() ? 0.0 : events.back().ms - firstMs;
+    report.speed = options.speed;
+    report.failures += exportFailures.load();
+
+    std::lock_guard<std::mutex> guard(timesLock);
+    for (const char* stage : STAGE_ORDER) {
+        auto found = times.find(stage);
+        if (found == times.end() || found->second.empty()) continue;
+        std::vector<double>& samples = found->second;
+        std::sort(samples.begin(), samples.end());
+
+        // Nearest rank
+        auto percentile = [&samples](double p) {
+            size_t rank = (size_t)std::ceil(p * samples.size());
+            return samples[(std::min)(samples.size(), (std::max)(rank, (size_t)1)) - 1];
+        };
+        StageLatency latency;
+        latency.stage = stage;
+        latency.count = samples.size();
+        latency.p50Ms = percentile(0.50);
+        latency.p90Ms = percentile(0.90);
+        latency.p99Ms = percentile(0.99);
+        latency.maxMs = samples.back();
+        for (double ms : samples) latency.totalMs += ms;
+        report.stages.push_back(latency);
+    }
+}
+
+void Replayer::Dispatch(const SessionEvent& event) {
+    Clock::time_point t0 = Clock::now();
+    switch (event.type) {
+    case SESSION_BUTTON:
+        hover.Add(event.x0, event.y0, event.x1, event.y1);
+        return;
+    case SESSION_MOVE:
+    case SESSION_DOWN:
+    case SESSION_UP:
+    case SESSION_LEAVE:
+        changed.clear();
+        if (event.type == SESSION_MOVE) hover.Move(event.x0, event.y0, changed);
+        else if (event.type == SESSION_DOWN) hover.Press(event.x0, event.y0, changed);
+        else if (event.type == SESSION_UP) hover.Release(changed);
+        else hover.Leave(changed);
+        Time("hover", MsSince(t0));
+        report.repaints += (long long)changed.size();
+        return;
+    case SESSION_IMAGE: {
+        PixelImage image;
+        if (!LoadPixelImage(event.path, image)) report.failures++;
+        Time("load", MsSince(t0));
+        imagePath = event.path;
+        return;
+    }
+    case SESSION_COMMAND:
+        Command(event.name);
+        return;
+    case SESSION_GNSS:
+        hasGnss = true;
+        latitude = event.latitude;
+        longitude = event.longitude;
+        return;
+    }
+}
+
+void Replayer::Command(const std::string& name) {
+    if (name == "analyze") {
+        WaitForAnalysis();
+        if (!imagePath.empty()) StartAnalysis();
+    }
+    else if (name == "save") {
+        WaitForAnalysis();
+        Save();
+    }
+    else if (name == "tag") {
+        WaitForAnalysis();
+        Tag();
+    }
+    else if (name == "restart") {
+        WaitForAnalysis();
+        channel.Reset();
+        hasResult = false;
+        imagePath.clear();
+        tagEnabled = false;
+        hasGnss = false;
+    }
+    else if (name == "fetch") {
+        tagEnabled = true;      // the fix itself is the gnss event that follows
+    }
+    else if (name == "gallery") {
+        Gallery();
+    }
+}
+
+void Replayer::StartAnalysis() {
+    channel.Reset();
+    analyzing = true;
+    firstUpdate = false;
+    analyzeStart = Clock::now();
+    std::string path = imagePath;
+    analysis = std::thread([this, path] {
+        AnalysisOptions analysisOptions;
+        analysisOptions.cloud = options.cloud;
+        analysisOptions.model = options.model;
+        analysisOptions.mmPerPixel = options.mmPerPixel;
+        analysisOptions.onProgress = [this](const AnalysisResult& partial) { channel.Publish(partial); };
+
+        AnalysisResult result;
+        if (!RunAnalysis(path, result, analysisOptions)) {
+            result = AnalysisResult();
+            result.imagePath = path;
+            result.grainCount = -1;     // marks failure, as in the window
+        }
+        channel.Publish(result);
+    });
+}
+
+// A command the window would not accept before the result is in
+void Replayer::WaitForAnalysis() {
+    if (!analyzing) return;
+    report.waits++;
+    HandleUpdates(Clock::time_point::max(), true);
+}
+
+// Handles result updates until the deadline, or with untilIdle until the
+// running analysis has delivered its final result.
+void Replayer::HandleUpdates(Clock::time_point deadline, bool untilIdle) {
+    for (;;) {
+        if (untilIdle && !analyzing) return;
+        std::unique_lock<std::mutex> guard(updateLock);
+        if (untilIdle) updateWake.wait(guard, [this] { return updatePending; });
+        else if (!updateWake.wait_until(guard, deadline, [this] { return updatePending; })) return;
+        updatePending = false;
+        Clock::time_point notified = notifyTime;
+        guard.unlock();
+        ShowUpdate(notified);
+    }
+}
+
+void Replayer::ShowUpdate(Clock::time_point notified) {
+    AnalysisResult snapshot;
+    if (!channel.Take(snapshot)) return;
+    bool failed = snapshot.complete && snapshot.grainCount < 0;
+    if (!failed) FormatResultText(snapshot);
+    Time("ui update", MsSince(notified));
+
+    if (!firstUpdate) {
+        firstUpdate = true;
+        Time("analyze first", MsSince(analyzeStart));
+    }
+    if (!snapshot.complete) return;
+
+    analysis.join();
+    analyzing = false;
+    Time("analyze", MsSince(analyzeStart));
+    report.analyses++;
+    if (failed) {
+        report.failures++;
+        hasResult = false;
+        return;
+    }
+    current = snapshot;
+    hasResult = true;
+    tagEnabled = true;
+}
+
+void Replayer::Save() {
+    if (!hasResult) return;
+    Clock::time_point t0 = Clock::now();
+    // CSV names come from the sample time; one the replay did not write itself
+    // is left alone
+    std::string csv = WorkFile(DefaultCsvFileName(current));
+    long long modified = 0, size = 0;
+    bool foreign = !csvWritten.count(csv) && FileStamp(csv, modified, size);
+    if (foreign || !WriteResultCsv(csv, current)) report.failures++;
+    else csvWritten.insert(csv);
+    Time("save", MsSince(t0));
+
+    std::string store = WorkFile("samples.gess");
+    if (!FileStamp(store, modified, size)) return;
+    ExportRequest request = { store, WorkFile("survey.geojson"), WorkFile("survey.gecf") };
+    exportJob.Wait();       // the window queues a Save during an export; replays run each one in turn
+    exportJob.Start(request, [this, t0](bool ok, const std::string&) {
+        if (!ok) exportFailures++;
+        Time("export", MsSince(t0));
+    });
+}
+
+// Same path as the window's Tag handler: the fetched fix, if any, is stamped
+// onto the result before it joins the survey and the store
+void Replayer::Tag() {
+    if (!tagEnabled || !hasResult) return;
+    Clock::time_point t0 = Clock::now();
+    std::string key = current.imagePath + "|" + current.timestamp;
+    if (key != lastTagged) {
+        current.hasLocation = hasGnss;
+        current.latitude = hasGnss ? latitude : 0.0;
+        current.longitude = hasGnss ? longitude : 0.0;
+        survey.Add(current);
+        lastTagged = key;
+        if (!AppendSample(WorkFile("samples.gess"), SampleRecord::FromResult(current))) report.failures++;
+    }
+    FormatSurveyReport(survey);
+    Time("tag", MsSince(t0));
+}
+
+void Replayer::Gallery() {
+    Clock::time_point t0 = Clock::now();
+    if (!thumbnails) {
+        ThumbnailOptions thumbnailOptions;
+        thumbnailOptions.packPath = WorkFile("thumbnails.pack");
+        thumbnails.reset(new ThumbnailCache(thumbnailOptions));
+    }
+
+    // Newest first, as the gallery lists them
+    std::vector<std::string> paths;
+    std::unordered_set<std::string> seen;
+    SampleStoreReader reader;
+    if (reader.Open(WorkFile("samples.gess"))) {
+        SampleRecord record;
+        while (reader.Next(record))
+            if (!record.imagePath.empty() && seen.insert(record.imagePath).second) paths.push_back(record.imagePath);
+    }
+    std::reverse(paths.begin(), paths.end());
+
+    // In batches the decode queue keeps whole
+    const size_t batch = 64;
+    for (size_t i = 0; i < paths.size(); i += batch) {
+        size_t end = (std::min)(paths.size(), i + batch);
+        for (size_t j = i; j < end; j++) thumbnails->Get(paths[j]);
+        thumbnails->WaitIdle();
+    }
+    Time("gallery", MsSince(t0));
+}
+
+} // namespace
+
+bool ReplaySession(const std::vector<SessionEvent>& events, const ReplayOptions& options, ReplayReport& report,
+    std::string* error) {
+    report = ReplayReport();
+    if (options.speed < 0.0 || !std::isfinite(options.speed)) return Fail(error, "replay speed must be 0 or positive");
+    if (options.workDir.empty()) return Fail(error, "replay needs a work directory");
+    long long modified = 0, size = 0;
+    if (!FileStamp(options.workDir, modified, size))
+        return Fail(error, "work directory " + options.workDir + " does not exist");
+    for (const char* name : REPLAY_FILES) {
+        std::string path = WorkPath(options.workDir, name);
+        if (FileStamp(path, modified, size))
+            return Fail(error, path + " already exists; replay into an empty directory");
+    }
+    Replayer replayer(options, report);
+    replayer.Run(events);
+    return true;
+}
+
+std::string FormatReplayReport(const ReplayReport& report) {
+    char line[160];
+    std::string text;
+    char speed[32];
+    if (report.speed > 0.0) std::snprintf(speed, sizeof(speed), "%gx", report.speed);
+    else std::snprintf(speed, sizeof(speed), "max");
+    std::snprintf(line, sizeof(line), "%zu events, %.1f s recorded, replayed in %.1f s (speed %s)\n",
+        report.events, report.recordedMs / 1000.0, report.wallMs / 1000.0, speed);
+    text += line;
+
+    std::snprintf(line, sizeof(line), "%-14s %7s %10s %10s %10s %10s\n", "stage", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    text += line;
+    for (const StageLatency& stage : report.stages) {
+        std::snprintf(line, sizeof(line), "%-14s %7zu %10.3f %10.3f %10.3f %10.3f\n", stage.stage.c_str(), stage.count,
+            stage.p50Ms, stage.p90Ms, stage.p99Ms, stage.maxMs);
+        text += line;
+    }
+
+    std::snprintf(line, sizeof(line), "hover repaints: %lld, analyses: %d, failures: %d, waits for an analysis: %d\n",
+        report.repaints, report.analyses, report.failures, report.waits);
+    text += line;
+    return text;
+}
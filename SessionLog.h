@@ -0,0 +1,137 @@
+/*
+*****************************************************************************
+*   GrainEye - Session recording and replay                                   *
+*   ------------------------------------------------------------------------- *
+*   The recorder writes what an operator did as a timestamped event log:    *
+*   button layout, mouse moves and clicks, images coming in (upload,        *
+*   gallery, watch folder), commands (analyze, save, tag, ...) and GNSS     *
+*   fixes. The replayer drives the same application core headlessly from   *
+*   such a log, at the recorded pace or as fast as possible, and reports   *
+*   latency percentiles per stage, so a field session becomes a repeatable *
+*   load test.                                                              *
+*                                                                             *
+*   Log (UTF-8 text, one event per line, fields separated by tabs; tab,     *
+*   newline and backslash in paths are escaped as \t \n \\):                 *
+*     # GrainEye session log 1                                               *
+*     <ms since start> <event> <fields...>                                   *
+*       button  x0 y0 x1 y1        move  x y       down  x y     up  x y    *
+*       leave                      image  source path                        *
+*       command  name              gnss  latitude longitude                  *
+*   Commands: analyze, save, tag, fetch, restart, gallery.                   *
+*                                                                             *
+*   Replay stages, each timed from its event to the state the operator      *
+*   would see: hover (hit test per mouse event; repaints counted), load     *
+*   (image decode), analyze first / analyze (first partial / final result  *
+*   through a ResultChannel, as in the window), ui update (taking and      *
+*   formatting one snapshot), save (CSV), export (survey export after       *
+*   save), tag (survey + sample store), gallery (store read and all         *
+*   thumbnails). Commands needing a result first wait for the running      *
+*   analysis, as their buttons would be disabled.                           *
+*****************************************************************************
+*/
+#pragma once
+
+#include "HoverTracker.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CloudEndpoint;
+class InferenceEngine;
+
+enum SessionEventType {
+    SESSION_BUTTON,             // layout: one owner-drawn button
+    SESSION_MOVE,
+    SESSION_DOWN,
+    SESSION_UP,
+    SESSION_LEAVE,
+    SESSION_IMAGE,
+    SESSION_COMMAND,
+    SESSION_GNSS,
+};
+
+struct SessionEvent {
+    double ms = 0.0;            // since the start of the recording
+    SessionEventType type = SESSION_MOVE;
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;     // pointer position in x0/y0
+    std::string name;           // command, or image source
+    std::string path;           // image
+    double latitude = 0.0;
+    double longitude = 0.0;
+};
+
+// Thread-safe; every call is a no-op until Start() succeeds. Pointer events
+// are buffered, everything else is flushed at once so a crash keeps the
+// commands that led to it.
+class SessionRecorder {
+public:
+    SessionRecorder() = default;
+    ~SessionRecorder() { Stop(); }
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    bool Start(const std::string& path, std::string* error = nullptr);
+    void Stop();
+    bool Recording() const { return recording.load(); }
+
+    void Button(int x0, int y0, int x1, int y1);
+    void Move(int x, int y);
+    void Down(int x, int y);
+    void Up(int x, int y);
+    void Leave();
+    void Image(const char* source, const std::string& path);
+    void Command(const char* name);
+    void Gnss(double latitude, double longitude);
+
+private:
+    void Write(const std::string& line, bool flush);
+
+    std::mutex lock;
+    std::atomic<bool> recording{ false };
+    FILE* file = nullptr;
+    std::vector<char> buffer;       // stdio buffer
+    std::chrono::steady_clock::time_point start;
+};
+
+bool ReadSessionLog(const std::string& path, std::vector<SessionEvent>& events, std::string* error = nullptr);
+
+struct ReplayOptions {
+    double speed = 1.0;                     // 2 = twice as fast; 0 = as fast as possible
+    std::string workDir;                    // CSV, sample store, exports and thumbnails go here;
+                                            // must exist and hold no earlier replay's files
+    const CloudEndpoint* cloud = nullptr;
+    const InferenceEngine* model = nullptr;
+    double mmPerPixel = 0.0;
+};
+
+struct StageLatency {
+    std::string stage;
+    size_t count = 0;
+    double p50Ms = 0.0;
+    double p90Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+    double totalMs = 0.0;
+};
+
+struct ReplayReport {
+    size_t events = 0;
+    double wallMs = 0.0;
+    double recordedMs = 0.0;                // time span of the log
+    double speed = 1.0;
+    long long repaints = 0;                 // buttons the hover tracker invalidated
+    int analyses = 0;
+    int failures = 0;                       // analyses, saves, tags or loads that failed
+    int waits = 0;                          // commands that had to wait for an analysis
+    std::vector<StageLatency> stages;       // in pipeline order, stages that ran
+};
+
+bool ReplaySession(const std::vector<SessionEvent>& events, const ReplayOptions& options, ReplayReport& report,
+    std::string* error = nullptr);
+
+// Table of the stage latencies.
+std::string FormatReplayReport(const ReplayReport& report);
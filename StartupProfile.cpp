@@ -0,0 +1,214 @@
+/*
+*****************************************************************************
+*   GrainEye - Cold-start profiling and deferred initialization               *
+*****************************************************************************
+*/
+#include "StartupProfile.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// Milliseconds between process creation and the moment this is called.
+static double ProcessAgeMs() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user, now;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+    GetSystemTimeAsFileTime(&now);
+    ULARGE_INTEGER c, n;
+    c.LowPart = created.dwLowDateTime; c.HighPart = created.dwHighDateTime;
+    n.LowPart = now.dwLowDateTime; n.HighPart = now.dwHighDateTime;
+    return n.QuadPart > c.QuadPart ? (n.QuadPart - c.QuadPart) / 10000.0 : 0.0;
+#else
+    // Field 22 of /proc/self/stat: start time in clock ticks since boot
+    FILE* f = std::fopen("/proc/self/stat", "r");
+    if (!f) return 0.0;
+    char buf[1024];
+    size_t len = std::fread(buf, 1, sizeof(buf) - 1, f);
+    std::fclose(f);
+    buf[len] = '\0';
+    const char* p = std::strrchr(buf, ')');     // comm may contain spaces
+    if (!p) return 0.0;
+    unsigned long long startTicks = 0;
+    int field = 2;
+    for (const char* s = p + 1; *s; s++) {
+        if (*s == ' ') {
+            if (++field == 22) { startTicks = std::strtoull(s + 1, nullptr, 10); break; }
+        }
+    }
+    struct timespec ts;
+    if (clock_gettime(CLOCK_BOOTTIME, &ts) != 0) return 0.0;
+    double nowMs = ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+    double startMs = startTicks * 1000.0 / sysconf(_SC_CLK_TCK);
+    return nowMs > startMs ? nowMs - startMs : 0.0;
+#endif
+}
+
+static const Clock::time_point g_profileAnchor = Clock::now();
+static const double g_anchorAgeMs = ProcessAgeMs();
+
+double StartupElapsedMs() {
+    return g_anchorAgeMs + std::chrono::duration<double, std::milli>(Clock::now() - g_profileAnchor).count();
+}
+
+// ---------- Phase records ----------
+
+struct PhaseRecord {
+    std::string name;
+    double startMs;
+    double endMs;
+    bool background;
+};
+
+static std::mutex g_phaseLock;
+static std::vector<PhaseRecord> g_phases;
+static double g_firstFrameMs = -1.0;
+static std::thread::id g_mainThread = std::this_thread::get_id();
+
+void RecordStartupPhase(const char* name, double startMs, double endMs) {
+    std::lock_guard<std::mutex> guard(g_phaseLock);
+    g_phases.push_back({ name, startMs, endMs, std::this_thread::get_id() != g_mainThread });
+}
+
+StartupPhase::StartupPhase(const char* name) : name(name), startMs(StartupElapsedMs()) {}
+
+StartupPhase::~StartupPhase() {
+    RecordStartupPhase(name, startMs, StartupElapsedMs());
+}
+
+void MarkFirstFrame() {
+    double now = StartupElapsedMs();
+    std::lock_guard<std::mutex> guard(g_phaseLock);
+    if (g_firstFrameMs < 0) g_firstFrameMs = now;
+}
+
+double TimeToFirstFrameMs() {
+    std::lock_guard<std::mutex> guard(g_phaseLock);
+    return g_firstFrameMs;
+}
+
+// ---------- Deferred initialization ----------
+
+enum class InitState { Pending, Running, Done };
+
+struct DeferredInit {
+    std::string name;
+    std::function<void()> init;
+    InitState state = InitState::Pending;
+};
+
+static std::mutex g_initLock;
+static std::condition_variable g_initChanged;
+static std::vector<DeferredInit> g_inits;
+static std::thread g_initThread;
+static bool g_initStarted = false;
+
+void RegisterDeferredInit(const char* name, std::function<void()> init) {
+    std::lock_guard<std::mutex> guard(g_initLock);
+    DeferredInit entry;
+    entry.name = name;
+    entry.init = std::move(init);
+    g_inits.push_back(std::move(entry));
+}
+
+// Runs entry `index` if nobody has claimed it yet, otherwise waits for it.
+static void RunOrWait(std::unique_lock<std::mutex>& guard, size_t index) {
+    if (g_inits[index].state == InitState::Pending) {
+        g_inits[index].state = InitState::Running;
+        std::function<void()> init = g_inits[index].init;
+        std::string name = g_inits[index].name;
+        guard.unlock();
+        {
+            StartupPhase phase(name.c_str());
+            if (init) init();
+        }
+        guard.lock();
+        g_inits[index].state = InitState::Done;
+        g_initChanged.notify_all();
+    }
+    g_initChanged.wait(guard, [index] { return g_inits[index].state == InitState::Done; });
+}
+
+void EnsureDeferredInit(const char* name) {
+    std::unique_lock<std::mutex> guard(g_initLock);
+    for (size_t i = 0; i < g_inits.size(); i++) {
+        if (g_inits[i].name == name) { RunOrWait(guard, i); return; }
+    }
+}
+
+void StartDeferredInits(std::function<void()> onDone) {
+    std::lock_guard<std::mutex> guard(g_initLock);
+    if (g_initStarted) return;
+    g_initStarted = true;
+    g_initThread = std::thread([onDone] {
+        std::unique_lock<std::mutex> lock(g_initLock);
+        for (size_t i = 0; i < g_inits.size(); i++) RunOrWait(lock, i);
+        lock.unlock();
+        if (onDone) onDone();
+    });
+}
+
+void WaitDeferredInits() {
+    if (g_initThread.joinable()) g_initThread.join();
+}
+
+// ---------- Reporting ----------
+
+std::string FormatStartupReport() {
+    std::lock_guard<std::mutex> guard(g_phaseLock);
+    std::string report = "GrainEye startup profile\n";
+    char line[160];
+    for (const auto& phase : g_phases) {
+        std::snprintf(line, sizeof(line), "  %-28s %8.1f ms   (at %8.1f ms%s)\n",
+            phase.name.c_str(), phase.endMs - phase.startMs, phase.startMs, phase.background ? ", background" : "");
+        report += line;
+    }
+    if (g_firstFrameMs >= 0) std::snprintf(line, sizeof(line), "  time to first frame          %8.1f ms\n", g_firstFrameMs);
+    else std::snprintf(line, sizeof(line), "  time to first frame          (not reached)\n");
+    report += line;
+    return report;
+}
+
+bool AppendStartupMetrics(const std::string& path) {
+#ifdef _WIN32
+    int len = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+    std::wstring wpath(len, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wpath[0], len);
+    FILE* f = _wfopen(wpath.c_str(), L"a");
+#else
+    FILE* f = std::fopen(path.c_str(), "a");
+#endif
+    if (!f) return false;
+
+    std::time_t now = std::time(nullptr);
+    std::tm local = {};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    std::lock_guard<std::mutex> guard(g_phaseLock);
+    std::fprintf(f, "%s,time_to_first_frame_ms=%.1f", stamp, g_firstFrameMs);
+    for (const auto& phase : g_phases) std::fprintf(f, ",%s=%.1f", phase.name.c_str(), phase.endMs - phase.startMs);
+    std::fprintf(f, "\n");
+    std::fclose(f);
+    return true;
+}
@@ -0,0 +1,51 @@
+/*
+*****************************************************************************
+*   GrainEye - Cold-start profiling and deferred initialization               *
+*   ------------------------------------------------------------------------- *
+*   Every launch records how long each startup phase took and the time to    *
+*   the first painted frame. Heavy subsystems register a deferred init that  *
+*   runs on a background thread after the first paint; code that needs the   *
+*   subsystem earlier calls EnsureDeferredInit() and gets it inline.         *
+*****************************************************************************
+*/
+#pragma once
+
+#include <functional>
+#include <string>
+
+// Milliseconds since the process was created (includes loader time).
+double StartupElapsedMs();
+
+// Times a startup phase for as long as the object lives.
+class StartupPhase {
+public:
+    explicit StartupPhase(const char* name);
+    ~StartupPhase();
+    StartupPhase(const StartupPhase&) = delete;
+    StartupPhase& operator=(const StartupPhase&) = delete;
+
+private:
+    const char* name;
+    double startMs;
+};
+
+void RecordStartupPhase(const char* name, double startMs, double endMs);
+
+// Call once the first frame is on screen. Only the first call counts.
+void MarkFirstFrame();
+double TimeToFirstFrameMs();    // -1 until MarkFirstFrame()
+
+// Deferred initialization of heavy subsystems
+void RegisterDeferredInit(const char* name, std::function<void()> init);
+void EnsureDeferredInit(const char* name);  // runs inline or waits for the background run
+
+// Runs all pending deferred inits on a background thread, then calls onDone
+// (on that thread). Safe to call more than once; later calls do nothing.
+void StartDeferredInits(std::function<void()> onDone = nullptr);
+void WaitDeferredInits();   // join the background thread (call before exit)
+
+// Phase breakdown, e.g. for OutputDebugString or stderr.
+std::string FormatStartupReport();
+
+// Appends one CSV line (time-to-first-frame + every phase) to path.
+bool AppendStartupMetrics(const std::string& path);
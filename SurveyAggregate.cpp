@@ -0,0 +1,379 @@
+/*
+*****************************************************************************
+*   GrainEye - Beach survey aggregation                                       *
+*****************************************************************************
+*/
+#include "SurveyAggregate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static const double PI = 3.14159265358979323846;
+
+// ---------------------------------------------------------------------------
+// Moments
+// ---------------------------------------------------------------------------
+void Moments::Add(double x, double w) {
+    Moments one;
+    one.weight = w;
+    one.mean = x;
+    one.min = x;
+    one.max = x;
+    Merge(one);
+}
+
+void Moments::Merge(const Moments& other) {
+    if (other.weight <= 0) return;
+    if (weight <= 0) {
+        *this = other;
+        return;
+    }
+    const double na = weight, nb = other.weight, n = na + nb;
+    const double delta = other.mean - mean;
+    m3 += other.m3 + delta * delta * delta * na * nb * (na - nb) / (n * n) + 3.0 * delta * (na * other.m2 - nb * m2) / n;
+    m2 += other.m2 + delta * delta * na * nb / n;
+    mean += delta * nb / n;
+    weight = n;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+double Moments::StdDev() const {
+    return std::sqrt(std::max(Variance(), 0.0));
+}
+
+double Moments::Skewness() const {
+    double variance = Variance();
+    return variance > 0 ? (m3 / weight) / (variance * std::sqrt(variance)) : 0.0;
+}
+
+// ---------------------------------------------------------------------------
+// QuantileSketch
+// ---------------------------------------------------------------------------
+QuantileSketch::QuantileSketch(double relativeError, int maxBucketCount)
+    : gamma((1.0 + relativeError) / (1.0 - relativeError)), logGamma(std::log(gamma)), maxBuckets(maxBucketCount) {}
+
+int QuantileSketch::Index(double x) const {
+    return (int)std::ceil(std::log(x) / logGamma);
+}
+
+// Make counts cover `index`, growing with slack so repeated growth at one
+// end stays amortized O(1). Beyond maxBuckets the lowest buckets fold into
+// the lowest kept one.
+void QuantileSketch::Cover(int index) {
+    if (counts.empty()) {
+        offset = index;
+        counts.assign(1, 0.0);
+        return;
+    }
+    if (index >= offset + (int)counts.size()) {
+        counts.resize((size_t)(index - offset + 1), 0.0);
+    }
+    else if (index < offset) {
+        int grow = std::max(offset - index, (int)counts.size() / 2);
+        counts.insert(counts.begin(), (size_t)grow, 0.0);
+        offset -= grow;
+    }
+    if ((int)counts.size() > maxBuckets) {
+        int fold = (int)counts.size() - maxBuckets;
+        double low = 0.0;
+        for (int i = 0; i <= fold; i++) low += counts[i];
+        counts.erase(counts.begin(), counts.begin() + fold);
+        counts[0] = low;
+        offset += fold;
+    }
+}
+
+void QuantileSketch::Add(double x, double w) {
+    if (w <= 0) return;
+    total += w;
+    if (!(x > 0)) {
+        zeroWeight += w;
+        return;
+    }
+    int index = Index(x);
+    Cover(index);
+    counts[(size_t)std::max(index - offset, 0)] += w;
+}
+
+void QuantileSketch::Merge(const QuantileSketch& other) {
+    if (other.total <= 0) return;
+    total += other.total;
+    zeroWeight += other.zeroWeight;
+    if (other.counts.empty()) return;
+    Cover(other.offset);
+    Cover(other.offset + (int)other.counts.size() - 1);
+    for (size_t i = 0; i < other.counts.size(); i++)
+        counts[(size_t)std::max(other.offset + (int)i - offset, 0)] += other.counts[i];
+}
+
+double QuantileSketch::Quantile(double q) const {
+    if (total <= 0) return 0.0;
+    double rank = std::min(std::max(q, 0.0), 1.0) * total;
+    double seen = zeroWeight;
+    if (seen >= rank && zeroWeight > 0) return 0.0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank && counts[i] > 0)
+            return 2.0 * std::pow(gamma, offset + (int)i) / (gamma + 1.0);     // middle of the bucket in relative terms
+    }
+    for (size_t i = counts.size(); i-- > 0;)
+        if (counts[i] > 0) return 2.0 * std::pow(gamma, offset + (int)i) / (gamma + 1.0);
+    return 0.0;
+}
+
+// ---------------------------------------------------------------------------
+// LabelHistogram and size classes
+// ---------------------------------------------------------------------------
+void LabelHistogram::Add(const std::string& label, double w) {
+    if (label.empty() || w <= 0) return;
+    for (auto& entry : entries) {
+        if (entry.first == label) {
+            entry.second += w;
+            return;
+        }
+    }
+    entries.emplace_back(label, w);
+}
+
+void LabelHistogram::Merge(const LabelHistogram& other) {
+    for (const auto& entry : other.entries) Add(entry.first, entry.second);
+}
+
+const std::string& LabelHistogram::Top() const {
+    static const std::string none;
+    const std::pair<std::string, double>* best = nullptr;
+    for (const auto& entry : entries)
+        if (!best || entry.second > best->second) best = &entry;
+    return best ? best->first : none;
+}
+
+static const double SIZE_CLASS_UPPER_MM[SIZE_CLASS_COUNT - 1] = { 0.0625, 0.125, 0.25, 0.5, 1.0, 2.0, 4.0 };
+
+const char* SizeClassName(int sizeClass) {
+    static const char* names[SIZE_CLASS_COUNT] = {
+        "Silt / clay", "Very fine sand", "Fine sand", "Medium sand", "Coarse sand", "Very coarse sand", "Granule", "Pebble",
+    };
+    return sizeClass >= 0 && sizeClass < SIZE_CLASS_COUNT ? names[sizeClass] : "";
+}
+
+int SizeClassOf(double diameterMm) {
+    int c = 0;
+    while (c < SIZE_CLASS_COUNT - 1 && diameterMm >= SIZE_CLASS_UPPER_MM[c]) c++;
+    return c;
+}
+
+// ---------------------------------------------------------------------------
+// SurveySummary
+// ---------------------------------------------------------------------------
+SurveySummary SurveySummary::FromResult(const AnalysisResult& result) {
+    SurveySummary s;
+    s.samples = 1;
+
+    const GrainTable& g = result.grains;
+    bool scaled = g.HasDiameterMm();
+    if (scaled) {
+        for (size_t i = 0; i < g.Size(); i++) {
+            double d = g.diameterMm[i];
+            s.grainSizeMm.Add(d);
+            s.grainSizeSketch.Add(d);
+            s.sizeClasses[SizeClassOf(d)] += 1.0;
+        }
+        s.grains = (double)g.Size();
+    }
+    else {
+        for (size_t i = 0; i < result.binCounts.size() && i < result.binSizesMm.size(); i++) {
+            double d = result.binSizesMm[i], w = result.binCounts[i];
+            if (w <= 0) continue;
+            s.grainSizeMm.Add(d, w);
+            s.grainSizeSketch.Add(d, w);
+            s.sizeClasses[SizeClassOf(d)] += w;
+            s.grains += w;
+        }
+    }
+    if (g.HasShape()) {
+        for (size_t i = 0; i < g.Size(); i++) {
+            s.roundness.Add(g.roundness[i]);
+            s.sphericity.Add(g.sphericity[i]);
+        }
+    }
+    if (result.d50Mm > 0) s.sampleD50Mm.Add(scaled ? s.grainSizeSketch.Quantile(0.5) : result.d50Mm);
+
+    s.zones.Add(result.beachZone);
+    s.beachTypes.Add(result.beachType);
+    s.categories.Add(result.category);
+
+    if (result.hasLocation) {
+        s.hasLocation = true;
+        s.minLatitude = s.maxLatitude = result.latitude;
+        s.minLongitude = s.maxLongitude = result.longitude;
+    }
+    s.firstTime = s.lastTime = result.timestamp;
+    return s;
+}
+
+void SurveySummary::Merge(const SurveySummary& other) {
+    if (other.samples == 0) return;
+    samples += other.samples;
+    grains += other.grains;
+    grainSizeMm.Merge(other.grainSizeMm);
+    grainSizeSketch.Merge(other.grainSizeSketch);
+    sampleD50Mm.Merge(other.sampleD50Mm);
+    roundness.Merge(other.roundness);
+    sphericity.Merge(other.sphericity);
+    for (int c = 0; c < SIZE_CLASS_COUNT; c++) sizeClasses[c] += other.sizeClasses[c];
+    zones.Merge(other.zones);
+    beachTypes.Merge(other.beachTypes);
+    categories.Merge(other.categories);
+
+    if (other.hasLocation) {
+        if (!hasLocation) {
+            minLatitude = other.minLatitude;
+            maxLatitude = other.maxLatitude;
+            minLongitude = other.minLongitude;
+            maxLongitude = other.maxLongitude;
+        }
+        else {
+            minLatitude = std::min(minLatitude, other.minLatitude);
+            maxLatitude = std::max(maxLatitude, other.maxLatitude);
+            minLongitude = std::min(minLongitude, other.minLongitude);
+            maxLongitude = std::max(maxLongitude, other.maxLongitude);
+        }
+        hasLocation = true;
+    }
+    // The timestamps sort as text
+    if (!other.firstTime.empty() && (firstTime.empty() || other.firstTime < firstTime)) firstTime = other.firstTime;
+    if (other.lastTime > lastTime) lastTime = other.lastTime;
+}
+
+// ---------------------------------------------------------------------------
+// BeachSurvey
+// ---------------------------------------------------------------------------
+BeachSurvey::BeachSurvey(const SurveyGrid& g) : grid(g) {
+    if (!(grid.cellSizeM > 0)) grid.cellSizeM = 25.0;
+}
+
+SurveyCell BeachSurvey::CellOf(double latitude, double longitude) const {
+    // Equirectangular around the origin: plenty for a beach a few km long
+    const double metresPerDegree = 111320.0;
+    double east = (longitude - originLongitude) * metresPerDegree * std::cos(originLatitude * PI / 180.0);
+    double north = (latitude - originLatitude) * metresPerDegree;
+    double bearing = grid.shoreBearingDeg * PI / 180.0;
+    double along = east * std::sin(bearing) + north * std::cos(bearing);
+    double across = east * std::cos(bearing) - north * std::sin(bearing);
+    SurveyCell cell;
+    cell.transect = (int)std::floor(along / grid.cellSizeM);
+    cell.row = (int)std::floor(across / grid.cellSizeM);
+    return cell;
+}
+
+void BeachSurvey::Add(const AnalysisResult& result) {
+    if (!result.complete || result.grainCount < 0) return;
+    SurveySummary sample = SurveySummary::FromResult(result);
+
+    beach.Merge(sample);
+    zones[result.beachZone.empty() ? "Unclassified" : result.beachZone].Merge(sample);
+    if (!result.hasLocation) {
+        unlocated.Merge(sample);
+        return;
+    }
+    if (!hasOrigin) {
+        hasOrigin = true;
+        originLatitude = result.latitude;
+        originLongitude = result.longitude;
+    }
+    cells[CellOf(result.latitude, result.longitude)].Merge(sample);
+}
+
+std::vector<std::pair<std::string, const SurveySummary*>> BeachSurvey::Zones() const {
+    std::vector<std::pair<std::string, const SurveySummary*>> out;
+    for (const auto& zone : zones) out.emplace_back(zone.first, &zone.second);
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    return out;
+}
+
+std::vector<std::pair<SurveyCell, const SurveySummary*>> BeachSurvey::Cells() const {
+    std::vector<std::pair<SurveyCell, const SurveySummary*>> out;
+    for (const auto& cell : cells) out.emplace_back(cell.first, &cell.second);
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+        return a.first.transect != b.first.transect ? a.first.transect < b.first.transect : a.first.row < b.first.row;
+    });
+    return out;
+}
+
+std::vector<int> BeachSurvey::Transects() const {
+    std::vector<int> out;
+    for (const auto& cell : cells) out.push_back(cell.first.transect);
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
+}
+
+SurveySummary BeachSurvey::Transect(int transect) const {
+    SurveySummary out;
+    for (const auto& cell : cells)
+        if (cell.first.transect == transect) out.Merge(cell.second);
+    return out;
+}
+
+SurveySummary BeachSurvey::RollUpBeach() const {
+    SurveySummary out;
+    for (int transect : Transects()) out.Merge(Transect(transect));
+    out.Merge(unlocated);
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Report
+// ---------------------------------------------------------------------------
+static std::string SummaryLine(const SurveySummary& s) {
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "%llu sample(s), %.0f grains, d50 %.2f mm (d10 %.2f, d90 %.2f), mean %.2f \xC2\xB1 %.2f mm",
+        s.samples, s.grains, s.grainSizeSketch.Quantile(0.5), s.grainSizeSketch.Quantile(0.1), s.grainSizeSketch.Quantile(0.9),
+        s.grainSizeMm.mean, s.grainSizeMm.StdDev());
+    return buf;
+}
+
+std::string FormatSurveyReport(const BeachSurvey& survey) {
+    const char* bullet = "\xE2\x80\xA2 ";
+    const SurveySummary& beach = survey.Beach();
+    char buf[256];
+    std::string text = "BEACH SURVEY:\r\n\n";
+    if (beach.samples == 0) return text + bullet + "No samples tagged yet.\r\n";
+
+    text += bullet; text += "Beach: " + SummaryLine(beach) + "\r\n";
+    std::snprintf(buf, sizeof(buf), "Skewness %.2f, samples' d50 %.2f \xE2\x80\x93 %.2f mm\r\n",
+        beach.grainSizeMm.Skewness(), beach.sampleD50Mm.min, beach.sampleD50Mm.max);
+    text += "   "; text += buf;
+    if (beach.grains > 0) {
+        text += "   Size classes:";
+        for (int c = 0; c < SIZE_CLASS_COUNT; c++) {
+            if (beach.sizeClasses[c] <= 0) continue;
+            std::snprintf(buf, sizeof(buf), " %s %.0f%%", SizeClassName(c), 100.0 * beach.sizeClasses[c] / beach.grains);
+            text += buf;
+        }
+        text += "\r\n";
+    }
+    if (beach.roundness.weight > 0) {
+        std::snprintf(buf, sizeof(buf), "   Roundness %.2f, Sphericity %.2f (mean of %.0f grains)\r\n",
+            beach.roundness.mean, beach.sphericity.mean, beach.roundness.weight);
+        text += buf;
+    }
+    if (!beach.categories.Top().empty()) text += "   Most common: " + beach.categories.Top() + "\r\n";
+    if (!beach.firstTime.empty()) text += "   From " + beach.firstTime + " to " + beach.lastTime + "\r\n";
+
+    text += "\r\n"; text += bullet; text += "Zones:\r\n";
+    for (const auto& zone : survey.Zones()) text += "   " + zone.first + ": " + SummaryLine(*zone.second) + "\r\n";
+
+    std::vector<int> transects = survey.Transects();
+    if (!transects.empty()) {
+        std::snprintf(buf, sizeof(buf), "Transects (%.0f m cells, %zu cell(s)):\r\n", survey.Grid().cellSizeM, survey.CellCount());
+        text += "\r\n"; text += bullet; text += buf;
+        for (int transect : transects) {
+            std::snprintf(buf, sizeof(buf), "   %+d: ", transect);
+            text += buf + SummaryLine(survey.Transect(transect)) + "\r\n";
+        }
+    }
+    return text;
+}
@@ -0,0 +1,164 @@
+/*
+*****************************************************************************
+*   GrainEye - Beach survey aggregation                                       *
+*   ------------------------------------------------------------------------- *
+*   Mergeable summaries of many samples: weighted moments (Welford, merged   *
+*   with Chan's formulas), a log-bucket quantile sketch with bounded        *
+*   relative error, Wentworth size classes and label histograms.             *
+*                                                                             *
+*   A sample is digested into a SurveySummary once; adding it to the survey *
+*   merges that digest into its zone, its spatial cell and the beach, so the *
+*   cost does not grow with the number of samples already in the survey.    *
+*   Transects (the cells across the beach at one along-shore position) and *
+*   the beach are roll-ups: merges of cell summaries, never a rescan of     *
+*   grains. Merging is exact for counts and moments; quantiles keep the     *
+*   sketch's relative error.                                                 *
+*****************************************************************************
+*/
+#pragma once
+
+#include "Analysis.h"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Count, mean, variance and skewness of weighted values.
+struct Moments {
+    double weight = 0.0;
+    double mean = 0.0;
+    double m2 = 0.0;            // sum of w (x - mean)^2
+    double m3 = 0.0;            // sum of w (x - mean)^3
+    double min = 0.0;
+    double max = 0.0;
+
+    void Add(double x, double w = 1.0);
+    void Merge(const Moments& other);
+    double Variance() const { return weight > 0 ? m2 / weight : 0.0; }
+    double StdDev() const;
+    double Skewness() const;
+};
+
+// Quantiles within +-relativeError of the true value (for positive values).
+// Bucket i holds values in (gamma^(i-1), gamma^i], gamma = (1+e)/(1-e);
+// buckets live in one array that only grows at its ends. Past maxBuckets
+// the lowest buckets are folded together, which only affects the smallest
+// values.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(double relativeError = 0.01, int maxBuckets = 1024);
+
+    void Add(double x, double w = 1.0);
+    void Merge(const QuantileSketch& other);    // both must use the same relativeError
+    double Quantile(double q) const;            // q in [0, 1]; 0 when empty
+    double Weight() const { return total; }
+
+private:
+    double gamma;
+    double logGamma;
+    int maxBuckets;
+    int offset = 0;                 // bucket index of counts[0]
+    std::vector<double> counts;
+    double zeroWeight = 0.0;        // values <= 0 (and below the smallest bucket)
+    double total = 0.0;
+
+    int Index(double x) const;
+    void Cover(int index);
+};
+
+// Weight per label, in first-seen order. Surveys have a handful of labels.
+struct LabelHistogram {
+    std::vector<std::pair<std::string, double>> entries;
+
+    void Add(const std::string& label, double w = 1.0);
+    void Merge(const LabelHistogram& other);
+    const std::string& Top() const;     // most frequent label, "" when empty
+};
+
+// Wentworth classes by grain diameter: silt/clay, very fine, fine, medium,
+// coarse and very coarse sand, granule, pebble.
+const int SIZE_CLASS_COUNT = 8;
+const char* SizeClassName(int sizeClass);
+int SizeClassOf(double diameterMm);
+
+struct SurveySummary {
+    unsigned long long samples = 0;
+    double grains = 0.0;
+
+    Moments grainSizeMm;            // every grain of every sample
+    QuantileSketch grainSizeSketch;
+    Moments sampleD50Mm;            // one value per sample
+    Moments roundness;              // every grain with shape measurements
+    Moments sphericity;
+    double sizeClasses[SIZE_CLASS_COUNT] = {};     // grains per Wentworth class
+
+    LabelHistogram zones;
+    LabelHistogram beachTypes;
+    LabelHistogram categories;
+
+    bool hasLocation = false;
+    double minLatitude = 0.0, maxLatitude = 0.0;
+    double minLongitude = 0.0, maxLongitude = 0.0;
+    std::string firstTime, lastTime;    // "YYYY-MM-DD HH:MM"
+
+    // Digest of one complete result. Uses the per-grain diameters when the
+    // sample was measured to scale, otherwise the binned size distribution.
+    static SurveySummary FromResult(const AnalysisResult& result);
+    void Merge(const SurveySummary& other);
+};
+
+// Local survey grid: metres east/north of the first located sample,
+// rotated so that transects run across the shoreline.
+struct SurveyGrid {
+    double cellSizeM = 25.0;
+    double shoreBearingDeg = 0.0;   // compass bearing of the shoreline (0 = N-S beach, 90 = E-W beach)
+};
+
+struct SurveyCell {
+    int transect = 0;               // along-shore index
+    int row = 0;                    // cross-shore index
+    bool operator==(const SurveyCell& other) const { return transect == other.transect && row == other.row; }
+};
+
+class BeachSurvey {
+public:
+    explicit BeachSurvey(const SurveyGrid& grid = SurveyGrid());
+
+    // O(1) amortized in the size of the survey. Incomplete results are ignored.
+    void Add(const AnalysisResult& result);
+
+    const SurveySummary& Beach() const { return beach; }
+    const SurveyGrid& Grid() const { return grid; }
+    size_t CellCount() const { return cells.size(); }
+
+    // Sorted by label / position
+    std::vector<std::pair<std::string, const SurveySummary*>> Zones() const;
+    std::vector<std::pair<SurveyCell, const SurveySummary*>> Cells() const;
+    std::vector<int> Transects() const;
+
+    // Roll-ups by merging cell summaries
+    SurveySummary Transect(int transect) const;
+    SurveySummary RollUpBeach() const;      // transects, plus samples without a location
+
+    SurveyCell CellOf(double latitude, double longitude) const;     // needs a located sample first
+
+private:
+    struct CellHash {
+        size_t operator()(const SurveyCell& c) const { return (size_t)(unsigned)c.transect * 73856093u ^ (size_t)(unsigned)c.row; }
+    };
+
+    SurveyGrid grid;
+    bool hasOrigin = false;
+    double originLatitude = 0.0;
+    double originLongitude = 0.0;
+
+    SurveySummary beach;
+    SurveySummary unlocated;
+    std::unordered_map<std::string, SurveySummary> zones;
+    std::unordered_map<SurveyCell, SurveySummary, CellHash> cells;
+};
+
+// Beach, zone and transect tables for the result box or the terminal.
+std::string FormatSurveyReport(const BeachSurvey& survey);
@@ -0,0 +1,560 @@
+/*
+*****************************************************************************
+*   GrainEye - Survey export (GeoJSON, columnar)                              *
+*****************************************************************************
+*/
+#include "SurveyExport.h"
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static const char COLUMNAR_MAGIC[4] = { 'G', 'E', 'C', 'F' };
+static const uint32_t COLUMNAR_VERSION = 1;
+
+enum ColumnType : uint8_t { TYPE_INT64 = 0, TYPE_BOOL = 1, TYPE_FLOAT32 = 2, TYPE_STRING = 3 };
+enum ColumnEncoding : uint8_t { PLAIN_F32 = 0, DELTA_VARINT = 1, VARINT = 2, BITMAP = 3, DICT = 4, STRING = 5 };
+
+struct ColumnSpec {
+    const char* name;
+    ColumnType type;
+    ColumnEncoding encoding;
+};
+
+// Schema order is file order
+static const ColumnSpec COLUMNS[] = {
+    { "time", TYPE_INT64, DELTA_VARINT },
+    { "has_location", TYPE_BOOL, BITMAP },
+    { "latitude_e7", TYPE_INT64, DELTA_VARINT },
+    { "longitude_e7", TYPE_INT64, DELTA_VARINT },
+    { "d10_mm", TYPE_FLOAT32, PLAIN_F32 },
+    { "d50_mm", TYPE_FLOAT32, PLAIN_F32 },
+    { "d90_mm", TYPE_FLOAT32, PLAIN_F32 },
+    { "mean_mm", TYPE_FLOAT32, PLAIN_F32 },
+    { "grain_count", TYPE_INT64, VARINT },
+    { "has_shape", TYPE_BOOL, BITMAP },
+    { "roundness", TYPE_FLOAT32, PLAIN_F32 },
+    { "sphericity", TYPE_FLOAT32, PLAIN_F32 },
+    { "zone", TYPE_STRING, DICT },
+    { "category", TYPE_STRING, DICT },
+    { "beach_type", TYPE_STRING, DICT },
+    { "image_path", TYPE_STRING, STRING },
+};
+static const size_t COLUMN_COUNT = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+
+static bool Fail(std::string* error, const std::string& message) {
+    if (error) *error = message;
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// GeoJSON
+// ---------------------------------------------------------------------------
+static void WriteJsonString(FILE* f, const std::string& text) {
+    std::fputc('"', f);
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            std::fputc('\\', f);
+            std::fputc(c, f);
+        }
+        else if (c < 0x20) {
+            std::fprintf(f, "\\u%04x", c);
+        }
+        else {
+            std::fputc(c, f);
+        }
+    }
+    std::fputc('"', f);
+}
+
+static void FormatUtc(int64_t time, char* out, size_t size) {
+    std::time_t t = (std::time_t)time;
+    std::tm utc = {};
+#ifdef _WIN32
+    gmtime_s(&utc, &t);
+#else
+    gmtime_r(&t, &utc);
+#endif
+    std::strftime(out, size, "%Y-%m-%dT%H:%M:%SZ", &utc);
+}
+
+bool ExportGeoJson(const std::string& storePath, const std::string& outPath, ExportStats* stats, std::string* error,
+    const std::atomic<bool>* cancel) {
+    auto start = std::chrono::steady_clock::now();
+    SampleStoreReader reader;
+    if (!reader.Open(storePath, error)) return false;
+
+    const std::string part = outPath + ".part";
+    FILE* f = OpenFile(part, "wb");
+    if (!f) return Fail(error, "cannot create " + outPath);
+    std::vector<char> buffer(1 << 16);
+    std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+    std::fprintf(f, "{\"type\":\"FeatureCollection\",\"features\":[\n");
+    SampleRecord r;
+    unsigned long long count = 0;
+    bool cancelled = false;
+    while (reader.Next(r)) {
+        if (cancel && cancel->load()) {
+            cancelled = true;
+            break;
+        }
+        if (count++) std::fprintf(f, ",\n");
+        if (r.hasLocation) std::fprintf(f, "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":[%.7f,%.7f]},", r.longitude, r.latitude);
+        else std::fprintf(f, "{\"type\":\"Feature\",\"geometry\":null,");
+
+        char time[32];
+        FormatUtc(r.time, time, sizeof(time));
+        std::fprintf(f, "\"properties\":{\"time\":\"%s\",\"zone\":", time);
+        WriteJsonString(f, r.zone);
+        std::fprintf(f, ",\"category\":");
+        WriteJsonString(f, r.category);
+        std::fprintf(f, ",\"beach_type\":");
+        WriteJsonString(f, r.beachType);
+        std::fprintf(f, ",\"d10_mm\":%.4f,\"d50_mm\":%.4f,\"d90_mm\":%.4f,\"mean_mm\":%.4f,\"grain_count\":%d",
+            r.d10Mm, r.d50Mm, r.d90Mm, r.meanMm, r.grainCount);
+        if (r.hasShape) std::fprintf(f, ",\"roundness\":%.4f,\"sphericity\":%.4f", r.roundness, r.sphericity);
+        else std::fprintf(f, ",\"roundness\":null,\"sphericity\":null");
+        std::fprintf(f, ",\"image\":");
+        WriteJsonString(f, r.imagePath);
+        std::fprintf(f, "}}");
+    }
+    std::fprintf(f, "\n]}\n");
+
+    bool ok = !std::ferror(f);
+    long long bytes = ok ? FileTell(f) : 0;
+    ok = std::fclose(f) == 0 && ok;
+    if (cancelled || !ok) {
+        DiscardFile(part);
+        return Fail(error, cancelled ? "cancelled" : "write failed: " + outPath);
+    }
+    if (!CommitFile(part, outPath, error)) return false;
+    if (stats) {
+        stats->samples = count;
+        stats->bytes = bytes;
+        stats->rowGroups = 0;
+        stats->truncated = reader.Truncated();
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Columnar encoding
+// ---------------------------------------------------------------------------
+static void PutVarint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static uint64_t ZigZag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static int64_t UnZigZag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+template <typename T>
+static void PutRaw(std::vector<uint8_t>& out, T value) {
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void PutBytes(std::vector<uint8_t>& out, const std::string& text) {
+    PutVarint(out, text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+static int64_t ToE7(double degrees) {
+    return (int64_t)(degrees * 1e7 + (degrees < 0 ? -0.5 : 0.5));
+}
+
+// One row group worth of columns, reused between groups
+class RowGroupWriter {
+public:
+    void Add(const SampleRecord& r) { rows.push_back(r); }
+    size_t Rows() const { return rows.size(); }
+
+    // Appends the encoded group to f
+    bool Flush(FILE* f) {
+        uint32_t count = (uint32_t)rows.size();
+        bool ok = std::fwrite(&count, 4, 1, f) == 1;
+        for (size_t c = 0; c < COLUMN_COUNT && ok; c++) {
+            data.clear();
+            Encode(c);
+            uint8_t encoding = COLUMNS[c].encoding;
+            uint32_t bytes = (uint32_t)data.size();
+            ok = std::fwrite(&encoding, 1, 1, f) == 1 && std::fwrite(&bytes, 4, 1, f) == 1 &&
+                (bytes == 0 || std::fwrite(data.data(), 1, bytes, f) == bytes);
+        }
+        rows.clear();
+        return ok;
+    }
+
+private:
+    std::vector<SampleRecord> rows;
+    std::vector<uint8_t> data;
+    std::vector<std::string> dictionary;
+    std::vector<uint32_t> indices;
+
+    void Delta(int64_t (*get)(const SampleRecord&)) {
+        int64_t previous = 0;
+        for (const auto& r : rows) {
+            int64_t v = get(r);
+            PutVarint(data, ZigZag(v - previous));
+            previous = v;
+        }
+    }
+    void Floats(float SampleRecord::* field) {
+        for (const auto& r : rows) PutRaw(data, r.*field);
+    }
+    void Bits(bool SampleRecord::* field) {
+        data.assign((rows.size() + 7) / 8, 0);
+        for (size_t i = 0; i < rows.size(); i++)
+            if (rows[i].*field) data[i / 8] |= (uint8_t)(1 << (i % 8));
+    }
+    void Dictionary(std::string SampleRecord::* field) {
+        // Few distinct values per group: a linear search beats hashing
+        dictionary.clear();
+        indices.clear();
+        for (const auto& r : rows) {
+            const std::string& value = r.*field;
+            size_t i = std::find(dictionary.begin(), dictionary.end(), value) - dictionary.begin();
+            if (i == dictionary.size()) dictionary.push_back(value);
+            indices.push_back((uint32_t)i);
+        }
+        PutVarint(data, dictionary.size());
+        for (const auto& entry : dictionary) PutBytes(data, entry);
+        for (uint32_t i : indices) PutVarint(data, i);
+    }
+
+    void Encode(size_t column) {
+        switch (column) {
+        case 0: Delta([](const SampleRecord& r) { return r.time; }); break;
+        case 1: Bits(&SampleRecord::hasLocation); break;
+        case 2: Delta([](const SampleRecord& r) { return r.hasLocation ? ToE7(r.latitude) : 0; }); break;
+        case 3: Delta([](const SampleRecord& r) { return r.hasLocation ? ToE7(r.longitude) : 0; }); break;
+        case 4: Floats(&SampleRecord::d10Mm); break;
+        case 5: Floats(&SampleRecord::d50Mm); break;
+        case 6: Floats(&SampleRecord::d90Mm); break;
+        case 7: Floats(&SampleRecord::meanMm); break;
+        case 8: for (const auto& r : rows) PutVarint(data, ZigZag(r.grainCount)); break;
+        case 9: Bits(&SampleRecord::hasShape); break;
+        case 10: Floats(&SampleRecord::roundness); break;
+        case 11: Floats(&SampleRecord::sphericity); break;
+        case 12: Dictionary(&SampleRecord::zone); break;
+        case 13: Dictionary(&SampleRecord::category); break;
+        case 14: Dictionary(&SampleRecord::beachType); break;
+        case 15: for (const auto& r : rows) PutBytes(data, r.imagePath); break;
+        }
+    }
+};
+
+bool ExportColumnar(const std::string& storePath, const std::string& outPath, ExportStats* stats, std::string* error,
+    const std::atomic<bool>* cancel, size_t rowGroupRows) {
+    auto start = std::chrono::steady_clock::now();
+    if (rowGroupRows == 0) rowGroupRows = DEFAULT_ROW_GROUP_ROWS;
+    SampleStoreReader reader;
+    if (!reader.Open(storePath, error)) return false;
+
+    const std::string part = outPath + ".part";
+    FILE* f = OpenFile(part, "wb");
+    if (!f) return Fail(error, "cannot create " + outPath);
+    std::vector<char> buffer(1 << 16);
+    std::setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+    bool ok = std::fwrite(COLUMNAR_MAGIC, 1, 4, f) == 4 && std::fwrite(&COLUMNAR_VERSION, 4, 1, f) == 1;
+    uint64_t offset = 8;
+    std::vector<std::pair<uint64_t, uint32_t>> groups;
+    RowGroupWriter group;
+    SampleRecord r;
+    unsigned long long total = 0;
+    bool cancelled = false;
+    auto flush = [&] {
+        groups.emplace_back(offset, (uint32_t)group.Rows());
+        ok = ok && group.Flush(f);
+        offset = (uint64_t)FileTell(f);
+    };
+    while (ok && reader.Next(r)) {
+        if (cancel && cancel->load()) {
+            cancelled = true;
+            break;
+        }
+        group.Add(r);
+        total++;
+        if (group.Rows() == rowGroupRows) flush();
+    }
+    if (ok && !cancelled && group.Rows() > 0) flush();
+
+    // Footer and trailer
+    std::vector<uint8_t> footer;
+    PutRaw<uint32_t>(footer, (uint32_t)COLUMN_COUNT);
+    for (const auto& column : COLUMNS) {
+        footer.push_back(column.type);
+        footer.push_back(column.encoding);
+        footer.push_back((uint8_t)std::strlen(column.name));
+        footer.insert(footer.end(), column.name, column.name + std::strlen(column.name));
+    }
+    PutRaw<uint32_t>(footer, (uint32_t)groups.size());
+    for (const auto& g : groups) {
+        PutRaw<uint64_t>(footer, g.first);
+        PutRaw<uint32_t>(footer, g.second);
+    }
+    PutRaw<uint64_t>(footer, total);
+    PutRaw<uint32_t>(footer, (uint32_t)footer.size());
+    footer.insert(footer.end(), COLUMNAR_MAGIC, COLUMNAR_MAGIC + 4);
+    ok = ok && std::fwrite(footer.data(), 1, footer.size(), f) == footer.size();
+
+    ok = ok && !std::ferror(f);
+    long long bytes = ok ? FileTell(f) : 0;
+    ok = std::fclose(f) == 0 && ok;
+    if (cancelled || !ok) {
+        DiscardFile(part);
+        return Fail(error, cancelled ? "cancelled" : "write failed: " + outPath);
+    }
+    if (!CommitFile(part, outPath, error)) return false;
+    if (stats) {
+        stats->samples = total;
+        stats->bytes = bytes;
+        stats->rowGroups = (unsigned)groups.size();
+        stats->truncated = reader.Truncated();
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Columnar reader
+// ---------------------------------------------------------------------------
+namespace {
+
+struct ByteReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    uint64_t Varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) break;
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    template <typename T>
+    T Raw() {
+        T value = T();
+        if (end - p < (ptrdiff_t)sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+    std::string Bytes() {
+        uint64_t length = Varint();
+        if (!ok || (uint64_t)(end - p) < length) {
+            ok = false;
+            return std::string();
+        }
+        std::string text((const char*)p, (size_t)length);
+        p += length;
+        return text;
+    }
+};
+
+} // namespace
+
+bool ColumnarReader::Open(const std::string& filePath, std::string* errorOut) {
+    path = filePath;
+    groups.clear();
+    rows.clear();
+    nextGroup = row = 0;
+    FILE* f = OpenFile(path, "rb");
+    if (!f) return Fail(errorOut, "cannot open " + path);
+
+    // Trailer, then footer
+    char magic[4];
+    uint32_t footerBytes = 0;
+    std::vector<uint8_t> footer;
+    bool ok = FileSeek(f, -8, SEEK_END) == 0 && std::fread(&footerBytes, 4, 1, f) == 1 &&
+        std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, COLUMNAR_MAGIC, 4) == 0 && footerBytes < (64u << 20);
+    if (ok) {
+        footer.resize(footerBytes);
+        ok = FileSeek(f, -8 - (long long)footerBytes, SEEK_END) == 0 && std::fread(footer.data(), 1, footerBytes, f) == footerBytes;
+    }
+    std::fclose(f);
+    if (!ok) return Fail(errorOut, path + " is not a GrainEye columnar file");
+
+    ByteReader in = { footer.data(), footer.data() + footer.size() };
+    uint32_t columns = in.Raw<uint32_t>();
+    bool schemaOk = columns == COLUMN_COUNT;
+    for (uint32_t c = 0; c < columns && in.ok; c++) {
+        uint8_t type = in.Raw<uint8_t>(), encoding = in.Raw<uint8_t>(), nameLength = in.Raw<uint8_t>();
+        std::string name((const char*)in.p, std::min<size_t>(nameLength, (size_t)(in.end - in.p)));
+        in.p += name.size();
+        if (c < COLUMN_COUNT)
+            schemaOk = schemaOk && type == COLUMNS[c].type && encoding == COLUMNS[c].encoding && name == COLUMNS[c].name;
+    }
+    uint32_t groupCount = in.Raw<uint32_t>();
+    for (uint32_t g = 0; g < groupCount && in.ok; g++) {
+        uint64_t offset = in.Raw<uint64_t>();
+        uint32_t count = in.Raw<uint32_t>();
+        groups.emplace_back(offset, count);
+    }
+    totalRows = in.Raw<uint64_t>();
+    if (!in.ok || !schemaOk) return Fail(errorOut, path + ": unsupported columnar layout");
+    return true;
+}
+
+bool ColumnarReader::LoadGroup(size_t index) {
+    rows.clear();
+    row = 0;
+    FILE* f = OpenFile(path, "rb");
+    if (!f) return Fail(&error, "cannot open " + path);
+    uint32_t count = 0;
+    bool ok = FileSeek(f, (long long)groups[index].first, SEEK_SET) == 0 && std::fread(&count, 4, 1, f) == 1 &&
+        count == groups[index].second;
+    rows.resize(ok ? count : 0);
+
+    std::vector<uint8_t> data;
+    for (size_t c = 0; c < COLUMN_COUNT && ok; c++) {
+        uint8_t encoding = 0;
+        uint32_t bytes = 0;
+        ok = std::fread(&encoding, 1, 1, f) == 1 && std::fread(&bytes, 4, 1, f) == 1 && encoding == COLUMNS[c].encoding &&
+            bytes < (256u << 20);
+        if (!ok) break;
+        data.resize(bytes);
+        ok = bytes == 0 || std::fread(data.data(), 1, bytes, f) == bytes;
+        if (!ok) break;
+
+        ByteReader in = { data.data(), data.data() + data.size() };
+        int64_t previous = 0;
+        std::vector<std::string> dictionary;
+        if (encoding == DICT) {
+            uint64_t entries = in.Varint();
+            for (uint64_t i = 0; i < entries && in.ok; i++) dictionary.push_back(in.Bytes());
+        }
+        for (uint32_t i = 0; i < count && in.ok; i++) {
+            SampleRecord& r = rows[i];
+            switch (c) {
+            case 0: r.time = previous += UnZigZag(in.Varint()); break;
+            case 1: r.hasLocation = i / 8 < data.size() && (data[i / 8] >> (i % 8)) & 1; break;
+            case 2: r.latitude = (double)(previous += UnZigZag(in.Varint())) / 1e7; break;
+            case 3: r.longitude = (double)(previous += UnZigZag(in.Varint())) / 1e7; break;
+            case 4: r.d10Mm = in.Raw<float>(); break;
+            case 5: r.d50Mm = in.Raw<float>(); break;
+            case 6: r.d90Mm = in.Raw<float>(); break;
+            case 7: r.meanMm = in.Raw<float>(); break;
+            case 8: r.grainCount = (int32_t)UnZigZag(in.Varint()); break;
+            case 9: r.hasShape = i / 8 < data.size() && (data[i / 8] >> (i % 8)) & 1; break;
+            case 10: r.roundness = in.Raw<float>(); break;
+            case 11: r.sphericity = in.Raw<float>(); break;
+            case 12: case 13: case 14: {
+                uint64_t k = in.Varint();
+                if (k >= dictionary.size()) { in.ok = false; break; }
+                (c == 12 ? r.zone : c == 13 ? r.category : r.beachType) = dictionary[(size_t)k];
+                break;
+            }
+            case 15: r.imagePath = in.Bytes(); break;
+            }
+        }
+        ok = in.ok;
+    }
+    std::fclose(f);
+    if (!ok) {
+        rows.clear();
+        return Fail(&error, path + ": damaged row group " + std::to_string(index));
+    }
+    return true;
+}
+
+bool ColumnarReader::Next(SampleRecord& record) {
+    while (row >= rows.size()) {
+        if (nextGroup >= groups.size() || !LoadGroup(nextGroup++)) return false;
+    }
+    record = rows[row++];
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Background job
+// ---------------------------------------------------------------------------
+ExportJob::~ExportJob() {
+    Cancel();
+    Wait();
+}
+
+void ExportJob::Wait() {
+    if (thread.joinable()) thread.join();
+}
+
+bool ExportJob::Start(const ExportRequest& request, std::function<void(bool, const std::string&)> onDone) {
+    if (running.load()) return false;
+    Wait();
+    cancel = false;
+    truncated = false;
+    running = true;
+    thread = std::thread([this, request, onDone] {
+#ifdef _WIN32
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+        std::string message, error;
+        bool ok = true;
+        char line[128];
+        ExportStats stats;
+        if (!request.geoJsonPath.empty()) {
+            if (ExportGeoJson(request.storePath, request.geoJsonPath, &stats, &error, &cancel)) {
+                std::snprintf(line, sizeof(line), "%llu samples, %.1f MB", stats.samples, stats.bytes / 1e6);
+                message += request.geoJsonPath + " (" + line + ")\n";
+                if (stats.truncated) truncated = true;
+            }
+            else {
+                ok = false;
+                message += error + "\n";
+            }
+        }
+        if (ok && !request.columnarPath.empty()) {
+            if (ExportColumnar(request.storePath, request.columnarPath, &stats, &error, &cancel)) {
+                std::snprintf(line, sizeof(line), "%llu samples, %u row groups, %.1f MB", stats.samples, stats.rowGroups, stats.bytes / 1e6);
+                message += request.columnarPath + " (" + line + ")\n";
+                if (stats.truncated) truncated = true;
+            }
+            else {
+                ok = false;
+                message += error + "\n";
+            }
+        }
+        if (ok && truncated) {
+            message += "warning: " + request.storePath + " ends in a damaged record; only the " +
+                std::to_string(stats.samples) + " samples before it were exported\n";
+        }
+        running = false;
+        if (onDone) onDone(ok, message);
+    });
+    return true;
+}
+
+std::string DefaultSurveyExportName() {
+    std::time_t now = std::time(nullptr);
+    std::tm local = {};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char buf[64];
+    std::strftime(buf, sizeof(buf), "GrainEye_Survey_%Y-%m-%d_%H%M", &local);
+    return buf;
+}
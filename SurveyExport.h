@@ -0,0 +1,112 @@
+/*
+*****************************************************************************
+*   GrainEye - Survey export (GeoJSON, columnar)                              *
+*   ------------------------------------------------------------------------- *
+*   Both exporters stream from the sample store (SampleStore.h) to disk in  *
+*   constant memory: GeoJSON one feature at a time, the columnar file one   *
+*   row group at a time. Output goes to "<path>.part" and is renamed over  *
+*   the target when complete, so a cancelled or failed export leaves no    *
+*   half-written file behind.                                                 *
+*                                                                             *
+*   GeoJSON: a FeatureCollection of Points (null geometry for samples       *
+*   without a location), one feature per line, properties in snake_case.   *
+*                                                                             *
+*   Columnar file "GECF" (little-endian; varints are LEB128, signed ones   *
+*   zigzag-encoded):                                                          *
+*     "GECF" u32 version (1)                                                 *
+*     row groups: u32 rows, then per column u8 encoding, u32 bytes, data    *
+*     footer:     u32 columns, per column u8 type, u8 encoding, u8 name     *
+*                 length, name; u32 row groups, per group u64 offset,      *
+*                 u32 rows; u64 total rows                                   *
+*     trailer:    u32 footer bytes, "GECF"                                   *
+*   Encodings: PLAIN_F32 (4 bytes per row), DELTA_VARINT (differences from *
+*   the previous row, the first from 0), VARINT, BITMAP (LSB first),        *
+*   DICT (varint entry count, entries as varint length + bytes, then one   *
+*   varint index per row; one dictionary per row group), STRING (varint    *
+*   length + bytes per row).                                                 *
+*   Timestamps are delta-encoded; latitude / longitude are delta-encoded   *
+*   integers in 1e-7 degrees; zone, category and beach type are            *
+*   dictionary-encoded.                                                      *
+*****************************************************************************
+*/
+#pragma once
+
+#include "SampleStore.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ExportStats {
+    unsigned long long samples = 0;
+    long long bytes = 0;            // size of the written file
+    unsigned rowGroups = 0;         // columnar only
+    double ms = 0.0;
+    bool truncated = false;         // the store ends in a damaged record; samples after it are missing
+};
+
+const size_t DEFAULT_ROW_GROUP_ROWS = 65536;
+
+// cancel: checked between records; a cancelled export fails with "cancelled".
+bool ExportGeoJson(const std::string& storePath, const std::string& outPath, ExportStats* stats = nullptr,
+    std::string* error = nullptr, const std::atomic<bool>* cancel = nullptr);
+bool ExportColumnar(const std::string& storePath, const std::string& outPath, ExportStats* stats = nullptr,
+    std::string* error = nullptr, const std::atomic<bool>* cancel = nullptr, size_t rowGroupRows = DEFAULT_ROW_GROUP_ROWS);
+
+// Reads a columnar file back one row group at a time.
+class ColumnarReader {
+public:
+    bool Open(const std::string& path, std::string* error = nullptr);
+    bool Next(SampleRecord& record);        // false at the end or on a damaged row group
+    unsigned long long TotalRows() const { return totalRows; }
+    size_t RowGroupCount() const { return groups.size(); }
+    const std::string& Error() const { return error; }
+
+private:
+    bool LoadGroup(size_t index);
+
+    std::string path;
+    std::string error;
+    std::vector<std::pair<uint64_t, uint32_t>> groups;     // offset, rows
+    unsigned long long totalRows = 0;
+    size_t nextGroup = 0;
+    size_t row = 0;
+    std::vector<SampleRecord> rows;         // decoded current row group
+};
+
+// Runs the exports of one Save on a background thread (below normal
+// priority on Windows) so the UI keeps handling messages. onDone is called
+// on that thread; a truncated store still exports, with a warning line in
+// the message.
+struct ExportRequest {
+    std::string storePath;
+    std::string geoJsonPath;        // skipped when empty
+    std::string columnarPath;       // skipped when empty
+};
+
+class ExportJob {
+public:
+    ExportJob() = default;
+    ~ExportJob();                   // cancels a running export and waits for it
+    ExportJob(const ExportJob&) = delete;
+    ExportJob& operator=(const ExportJob&) = delete;
+
+    // False (and onDone is not called) while a previous export is running.
+    bool Start(const ExportRequest& request, std::function<void(bool ok, const std::string& message)> onDone);
+    bool Running() const { return running.load(); }
+    bool Truncated() const { return truncated.load(); }    // of the last export, valid in onDone
+    void Cancel() { cancel = true; }
+    void Wait();
+
+private:
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    std::atomic<bool> cancel{ false };
+    std::atomic<bool> truncated{ false };
+};
+
+// "GrainEye_Survey_YYYY-MM-DD_HHMM" for the current local time.
+std::string DefaultSurveyExportName();
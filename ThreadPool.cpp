@@ -0,0 +1,331 @@
+/*
+*****************************************************************************
+*   GrainEye - Worker thread pool                                             *
+*****************************************************************************
+*/
+#include "ThreadPool.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+
+// Controller tuning
+const unsigned long long WINDOW_MIN_LOOPS = 8;
+const double WINDOW_MIN_MS = 100.0;
+const double WINDOW_MAX_MS = 1000.0;
+const double CONTENDED_CPU_SHARE = 0.80;    // participants got the CPU less than this
+const double SLOW_LATENCY_RATIO = 0.75;     // ranges 1.33x slower than usual
+const double GROW_CPU_SHARE = 0.90;
+const double GROW_LATENCY_RATIO = 0.90;
+const double GROW_WIDTH = 1.5;              // ranges per participant that another thread could take
+const int GROW_COOLDOWN_WINDOWS = 3;
+const double USUAL_FASTER_ALPHA = 0.20;     // the usual latency follows speed-ups quickly ...
+const double USUAL_SLOWER_ALPHA = 0.02;     // ... and slow-downs slowly, so throttling stays visible
+const size_t MAX_SHAPES = 64;
+
+double ThreadCpuNs() {
+#ifdef _WIN32
+    // 100 ns units, but only updated at the scheduler tick; fine summed over a window
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0.0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (double)(k.QuadPart + u.QuadPart) * 100.0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+}
+
+int LatencyBucket(double ns) {
+    unsigned long long v = ns > 0 ? (unsigned long long)ns : 0;
+    int octave = 0;
+    while (v >= 8) {
+        v >>= 1;
+        octave++;
+    }
+    return std::min(v < 4 ? 0 : octave * 4 + (int)(v - 4), 159);
+}
+
+double BucketNs(int bucket) {
+    return (4 + bucket % 4 + 0.5) * (double)(1ull << (bucket / 4));
+}
+
+double Percentile(const unsigned* histogram, int buckets, double p) {
+    unsigned long long total = 0;
+    for (int i = 0; i < buckets; i++) total += histogram[i];
+    if (total == 0) return 0.0;
+    unsigned long long rank = (unsigned long long)(p * (total - 1)), seen = 0;
+    for (int i = 0; i < buckets; i++) {
+        seen += histogram[i];
+        if (seen > rank) return BucketNs(i);
+    }
+    return BucketNs(buckets - 1);
+}
+
+// Default band: the caller plus maxWorkers leave one core for the UI and
+// GNSS threads
+void DefaultBand(int& minWorkers, int& maxWorkers) {
+    maxWorkers = std::max(GetCpuFeatures().logicalCores - 2, 0);
+    minWorkers = std::min(1, maxWorkers);
+    const char* band = std::getenv("GRAINEYE_POOL");
+    int lo = 0, hi = 0;
+    if (band && std::sscanf(band, "%d:%d", &lo, &hi) == 2 && lo >= 0 && hi >= lo) {
+        minWorkers = lo;
+        maxWorkers = hi;
+    }
+}
+
+} // namespace
+
+void ThreadPool::Participant::Add(const Participant& other) {
+    ranges += other.ranges;
+    rangeNs += other.rangeNs;
+    wallNs += other.wallNs;
+    cpuNs += other.cpuNs;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) latency[i] += other.latency[i];
+}
+
+ThreadPool::ThreadPool(int workerCount) {
+    int lo = workerCount, hi = workerCount;
+    if (workerCount < 0) DefaultBand(lo, hi);
+    Start(lo, hi);
+}
+
+ThreadPool::ThreadPool(int minCount, int maxCount) {
+    Start(std::max(minCount, 0), std::max(maxCount, std::max(minCount, 0)));
+}
+
+void ThreadPool::Start(int minCount, int maxCount) {
+    minWorkers = minCount;
+    maxWorkers = maxCount;
+    activeWorkers = maxCount;
+    metrics.minWorkers = minCount;
+    metrics.maxWorkers = maxCount;
+    for (int i = 0; i < maxCount; i++) workers.emplace_back([this, i] { WorkerMain(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::RunRanges(Participant& stats) {
+    auto first = std::chrono::steady_clock::now(), last = first;
+    double cpuStart = 0.0;
+    for (;;) {
+        size_t begin = next.fetch_add(grain);
+        if (begin >= count) break;
+        size_t end = begin + grain < count ? begin + grain : count;
+        if (stats.ranges == 0) {
+            cpuStart = ThreadCpuNs();
+            first = std::chrono::steady_clock::now();
+            last = first;
+        }
+        (*body)(begin, end);
+        auto now = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(now - last).count();
+        last = now;
+        stats.ranges++;
+        stats.rangeNs += ns;
+        stats.latency[LatencyBucket(ns)]++;
+    }
+    if (stats.ranges > 0) {
+        stats.wallNs += std::chrono::duration<double, std::nano>(last - first).count();
+        stats.cpuNs += ThreadCpuNs() - cpuStart;
+    }
+}
+
+void ThreadPool::WorkerMain(int index) {
+    unsigned long long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            if (index >= loopWorkers) continue;     // parked by the controller
+        }
+        Participant stats;
+        RunRanges(stats);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            loopStats.Add(stats);
+            if (--pending == 0) done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::ParallelFor(size_t total, size_t rangeSize, const std::function<void(size_t, size_t)>& fn) {
+    if (total == 0) return;
+    if (rangeSize == 0) rangeSize = 1;
+    if (workers.empty() || total <= rangeSize) {
+        fn(0, total);
+        return;
+    }
+
+    waitingLoops++;
+    std::lock_guard<std::mutex> loop(loopLock);
+    waitingLoops--;
+    int participants;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        window.peakQueue = std::max(window.peakQueue, waitingLoops.load());
+        participants = activeWorkers.load();
+        body = &fn;
+        count = total;
+        grain = rangeSize;
+        next.store(0);
+        loopStats = Participant();
+        loopWorkers = participants;
+        pending = participants;
+        generation++;
+    }
+    if (participants > 0) wake.notify_all();
+    Participant mine;
+    RunRanges(mine);
+
+    // Every participating worker checks in once per loop (late ones find no
+    // ranges left), so none can still be reading this loop's state when the
+    // next one starts
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&] { return pending == 0; });
+    body = nullptr;
+    loopStats.Add(mine);
+    EndLoop(total, participants + 1);
+}
+
+void ThreadPool::EndLoop(size_t items, int participants) {
+    const Participant& loop = loopStats;
+    metrics.loops++;
+    metrics.ranges += loop.ranges;
+    metrics.items += items;
+
+    window.Add(loop);
+    window.loops++;
+    window.items += items;
+    window.widthSum += (double)loop.ranges / participants;
+
+    // Compare the per-item latency with what this loop shape usually takes
+    if (loop.rangeNs > 0) {
+        double itemNs = loop.rangeNs / (double)items;
+        unsigned long long key = (unsigned long long)count * 1000003ull ^ grain;
+        size_t slot = std::find(shapeKeys.begin(), shapeKeys.end(), key) - shapeKeys.begin();
+        if (slot == shapeKeys.size()) {
+            if (shapeKeys.size() < MAX_SHAPES) {
+                shapeKeys.push_back(key);
+                usualItemNs.push_back(itemNs);
+            }
+            else {
+                slot = nextShape++ % MAX_SHAPES;
+                shapeKeys[slot] = key;
+                usualItemNs[slot] = itemNs;
+            }
+        }
+        else {
+            double& usual = usualItemNs[slot];
+            window.ratioSum += usual / itemNs * loop.rangeNs;
+            window.ratioWeight += loop.rangeNs;
+            usual += (itemNs < usual ? USUAL_FASTER_ALPHA : USUAL_SLOWER_ALPHA) * (itemNs - usual);
+        }
+    }
+
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - window.start).count();
+    if ((window.loops >= WINDOW_MIN_LOOPS && elapsedMs >= WINDOW_MIN_MS) || elapsedMs >= WINDOW_MAX_MS) Decide();
+}
+
+void ThreadPool::Decide() {
+    const Window& w = window;
+    metrics.windows++;
+    metrics.rangeP50Us = Percentile(w.latency, LATENCY_BUCKETS, 0.5) / 1e3;
+    metrics.rangeP90Us = Percentile(w.latency, LATENCY_BUCKETS, 0.9) / 1e3;
+    metrics.cpuShare = w.wallNs > 0 ? std::min(w.cpuNs / w.wallNs, 1.0) : 1.0;
+    metrics.latencyRatio = w.ratioWeight > 0 ? w.ratioSum / w.ratioWeight : 1.0;
+    metrics.widthPerThread = w.loops ? w.widthSum / w.loops : 0.0;
+    metrics.peakQueueDepth = w.peakQueue;
+
+    const int active = activeWorkers.load();
+    const int participants = active + 1;
+    int target = active;
+    char reason[96] = "";
+    if (growCooldown > 0) growCooldown--;
+
+    if (metrics.cpuShare < CONTENDED_CPU_SHARE && active > minWorkers) {
+        // Keep about as many threads as actually got a core
+        int cores = (int)(participants * metrics.cpuShare + 0.5);
+        target = std::min(std::max(cores - 1, minWorkers), active - 1);
+        std::snprintf(reason, sizeof(reason), "cpu share %.2f", metrics.cpuShare);
+    }
+    else if (metrics.latencyRatio < SLOW_LATENCY_RATIO && active > minWorkers) {
+        int scaled = (int)(active * std::max(metrics.latencyRatio, 0.5));
+        target = std::min(std::max(scaled, minWorkers), active - 1);
+        std::snprintf(reason, sizeof(reason), "ranges %.1fx slower than usual", 1.0 / metrics.latencyRatio);
+    }
+    else if (active < maxWorkers && growCooldown == 0 && metrics.cpuShare >= GROW_CPU_SHARE &&
+        metrics.latencyRatio >= GROW_LATENCY_RATIO && (metrics.widthPerThread >= GROW_WIDTH || w.peakQueue > 0)) {
+        target = active + 1;
+        if (w.peakQueue > 0) std::snprintf(reason, sizeof(reason), "%d loop(s) queued", w.peakQueue);
+        else std::snprintf(reason, sizeof(reason), "%.1f ranges per thread", metrics.widthPerThread);
+    }
+
+    if (target != active) {
+        activeWorkers = target;
+        if (target < active) {
+            metrics.shrinks++;
+            growCooldown = GROW_COOLDOWN_WINDOWS;
+        }
+        else {
+            metrics.grows++;
+        }
+        char decision[160];
+        std::snprintf(decision, sizeof(decision), "%s %d->%d: %s", target < active ? "shrink" : "grow", active, target, reason);
+        metrics.lastDecision = decision;
+    }
+    window = Window();
+}
+
+PoolMetrics ThreadPool::Metrics() const {
+    std::lock_guard<std::mutex> guard(lock);
+    PoolMetrics snapshot = metrics;
+    snapshot.activeWorkers = activeWorkers.load();
+    snapshot.queueDepth = waitingLoops.load();
+    return snapshot;
+}
+
+ThreadPool& AnalysisPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+std::string FormatPoolMetrics(const PoolMetrics& m) {
+    char line[512];
+    if (m.windows == 0) {
+        std::snprintf(line, sizeof(line), "workers %d [%d..%d], %llu loops, first window still open",
+            m.activeWorkers, m.minWorkers, m.maxWorkers, m.loops);
+        return line;
+    }
+    std::snprintf(line, sizeof(line),
+        "workers %d [%d..%d], %llu loops, range p50 %.0f us p90 %.0f us, cpu share %.2f, latency x%.2f, "
+        "%.1f ranges/thread, queue %d (peak %d), grew %llu shrank %llu%s%s",
+        m.activeWorkers, m.minWorkers, m.maxWorkers, m.loops, m.rangeP50Us, m.rangeP90Us, m.cpuShare,
+        m.latencyRatio > 0 ? 1.0 / m.latencyRatio : 0.0, m.widthPerThread, m.queueDepth, m.peakQueueDepth,
+        m.grows, m.shrinks, m.lastDecision.empty() ? "" : ", last: ", m.lastDecision.c_str());
+    return line;
+}
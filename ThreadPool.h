@@ -0,0 +1,137 @@
+/*
+*****************************************************************************
+*   GrainEye - Worker thread pool                                             *
+*   ------------------------------------------------------------------------- *
+*   Set of workers for data-parallel loops (convolution rows, image tiles).  *
+*   The calling thread works too, so N active workers use N+1 cores while a  *
+*   loop runs and none while idle.                                           *
+*                                                                             *
+*   The number of active workers adapts within a [min, max] band. Each loop *
+*   records its range latencies, how much of the time the participants      *
+*   actually got the CPU, and how many loops were queued behind it; every    *
+*   window of loops the pool                                                  *
+*     - shrinks when the cores are contended (other processes, the UI) or    *
+*       ranges got slower than usual (thermal throttling),                   *
+*     - grows back one worker at a time while there is more work than        *
+*       threads and latency is back to normal.                               *
+*   The default band keeps one core free for the UI and GNSS threads; set    *
+*   GRAINEYE_POOL=min:max to override it (for testing).                      *
+*****************************************************************************
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PoolMetrics {
+    int minWorkers = 0;
+    int maxWorkers = 0;
+    int activeWorkers = 0;
+
+    unsigned long long loops = 0;
+    unsigned long long ranges = 0;
+    unsigned long long items = 0;
+
+    // Last completed window
+    double rangeP50Us = 0.0;        // range latency
+    double rangeP90Us = 0.0;
+    double latencyRatio = 1.0;      // usual per-item latency / current (< 1: slower than usual)
+    double cpuShare = 1.0;          // CPU time / wall time of the participants inside ranges
+    double widthPerThread = 0.0;    // ranges per participant, averaged over loops
+    int queueDepth = 0;             // loops waiting for the pool right now
+    int peakQueueDepth = 0;         // most loops waiting in the last window
+
+    // Decisions
+    unsigned long long windows = 0;
+    unsigned long long grows = 0;
+    unsigned long long shrinks = 0;
+    std::string lastDecision;       // e.g. "shrink 3->2: cpu share 0.61"
+};
+
+class ThreadPool {
+public:
+    // workers < 0: adaptive, default band (see above)
+    // workers >= 0: fixed at that many workers
+    explicit ThreadPool(int workers = -1);
+    // Adaptive within [minWorkers, maxWorkers]; starts at maxWorkers
+    ThreadPool(int minWorkers, int maxWorkers);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Calls body(begin, end) over [0, count) in ranges of at most `grain`
+    // items and returns when all of them are done. Loops from different
+    // threads are run one after the other.
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body);
+
+    int WorkerCount() const { return activeWorkers.load(); }
+    PoolMetrics Metrics() const;
+
+private:
+    static const int LATENCY_BUCKETS = 160;    // 4 per octave of nanoseconds
+
+    struct Participant {
+        unsigned long long ranges = 0;
+        double rangeNs = 0.0;       // sum of range latencies
+        double wallNs = 0.0;        // first range start to last range end
+        double cpuNs = 0.0;         // thread CPU time over the same span
+        unsigned latency[LATENCY_BUCKETS] = {};
+        void Add(const Participant& other);
+    };
+    struct Window : Participant {
+        unsigned long long loops = 0;
+        unsigned long long items = 0;
+        double ratioSum = 0.0;      // latency ratios weighted by range time
+        double ratioWeight = 0.0;
+        double widthSum = 0.0;
+        int peakQueue = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    };
+
+    void Start(int minWorkers, int maxWorkers);
+    void WorkerMain(int index);
+    void RunRanges(Participant& stats);
+    void EndLoop(size_t items, int participants);
+    void Decide();
+
+    std::vector<std::thread> workers;   // maxWorkers threads; only the first activeWorkers join a loop
+    int minWorkers = 0;
+    int maxWorkers = 0;
+    std::atomic<int> activeWorkers{ 0 };
+    std::atomic<int> waitingLoops{ 0 };
+    std::mutex loopLock;            // one loop at a time
+
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned long long generation = 0;
+    bool stopping = false;
+    int loopWorkers = 0;            // workers taking part in the current loop
+    int pending = 0;                // of those, the ones that have not finished it
+
+    const std::function<void(size_t, size_t)>* body = nullptr;
+    size_t count = 0;
+    size_t grain = 1;
+    std::atomic<size_t> next{ 0 };
+
+    // Statistics and controller state, guarded by `lock`
+    Participant loopStats;
+    Window window;
+    std::vector<unsigned long long> shapeKeys;  // loop shape (count, grain) ...
+    std::vector<double> usualItemNs;            // ... and its usual per-item range latency
+    size_t nextShape = 0;
+    int growCooldown = 0;           // windows to wait after a shrink before growing again
+    PoolMetrics metrics;
+};
+
+// Shared pool used by the analysis pipeline.
+ThreadPool& AnalysisPool();
+
+// One line for logs: "workers 2 [1..3], p50 120 us, ...".
+std::string FormatPoolMetrics(const PoolMetrics& metrics);
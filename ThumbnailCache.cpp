@@ -0,0 +1,444 @@
+/*
+*****************************************************************************
+*   GrainEye - Thumbnail cache                                                *
+*****************************************************************************
+*/
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "ThumbnailCache.h"
+#include "CpuFeatures.h"
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static const char PACK_MAGIC[4] = { 'G', 'E', 'T', 'P' };
+static const uint32_t PACK_VERSION = 1;
+static const size_t PACK_HEADER_BYTES = 8;
+static const long long PACK_MIN_COMPACT_BYTES = 1LL << 20;     // small packs are never rewritten
+
+static void PutLE(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static uint64_t GetLE(const uint8_t* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static bool WriteHeader(FILE* f) {
+    uint8_t header[PACK_HEADER_BYTES];
+    std::memcpy(header, PACK_MAGIC, 4);
+    for (int i = 0; i < 4; i++) header[4 + i] = (uint8_t)(PACK_VERSION >> (8 * i));
+    return std::fwrite(header, 1, sizeof(header), f) == sizeof(header);
+}
+
+void MakeThumbnail(const PixelImage& source, int maxWidth, int maxHeight, PixelImage& out) {
+    double scale = (std::min)({ (double)maxWidth / source.width, (double)maxHeight / source.height, 1.0 });
+    out.width = (std::max)(1, (int)(source.width * scale + 0.5));
+    out.height = (std::max)(1, (int)(source.height * scale + 0.5));
+    out.rgb.assign((size_t)out.width * out.height * 3, 0);
+    if (source.Empty()) return;
+
+    // Source pixels under each thumbnail column / row, weighted by how much
+    // of them the thumbnail pixel covers
+    struct Tap {
+        int index;
+        float weight;
+    };
+    auto taps = [](int sourceSize, int size) {
+        std::vector<std::vector<Tap>> result(size);
+        double ratio = (double)sourceSize / size;
+        for (int i = 0; i < size; i++) {
+            double begin = i * ratio, end = (i + 1) * ratio;
+            for (int s = (int)begin; s < sourceSize && s < end; s++) {
+                double weight = (std::min)(end, s + 1.0) - (std::max)(begin, (double)s);
+                if (weight > 1e-9) result[i].push_back({ s, (float)(weight / ratio) });
+            }
+        }
+        return result;
+    };
+    std::vector<std::vector<Tap>> columns = taps(source.width, out.width);
+    std::vector<std::vector<Tap>> rows = taps(source.height, out.height);
+
+    for (int y = 0; y < out.height; y++) {
+        uint8_t* dst = out.rgb.data() + (size_t)y * out.width * 3;
+        for (int x = 0; x < out.width; x++) {
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+            for (const Tap& row : rows[y]) {
+                const uint8_t* src = source.Row(row.index);
+                for (const Tap& column : columns[x]) {
+                    float weight = row.weight * column.weight;
+                    const uint8_t* pixel = src + column.index * 3;
+                    sum[0] += weight * pixel[0];
+                    sum[1] += weight * pixel[1];
+                    sum[2] += weight * pixel[2];
+                }
+            }
+            for (int c = 0; c < 3; c++) dst[3 * x + c] = (uint8_t)(std::min)(255.0f, sum[c] + 0.5f);
+        }
+    }
+}
+
+ThumbnailCache::ThumbnailCache(const ThumbnailOptions& options, std::function<void()> onReady)
+    : options(options), onReady(std::move(onReady)) {
+    if (!this->options.packPath.empty() && !OpenPack()) {
+        // Works without a pack, only slower the next session
+        packIndex.clear();
+        packBytes = 0;
+    }
+    int count = this->options.decodeThreads;
+    if (count <= 0) count = (std::min)(2, GetCpuFeatures().logicalCores - 1);
+    count = (std::max)(1, count);
+    for (int i = 0; i < count; i++) threads.emplace_back([this] { Worker(); });
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear();
+        queued.clear();
+    }
+    wake.notify_all();
+    for (auto& thread : threads) thread.join();
+    if (pack) std::fclose(pack);
+}
+
+std::shared_ptr<const PixelImage> ThumbnailCache::Get(const std::string& path, bool* failed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (failed) *failed = false;
+    auto found = lookup.find(path);
+    if (found != lookup.end()) {
+        lru.splice(lru.begin(), lru, found->second);
+        stats.memoryHits++;
+        return found->second->image;
+    }
+    if (failedPaths.count(path)) {
+        if (failed) *failed = true;
+        return nullptr;
+    }
+    if (decoding.count(path)) return nullptr;
+
+    if (queued.count(path)) {
+        queue.erase(std::find(queue.begin(), queue.end(), path));
+    }
+    else {
+        queued.insert(path);
+        if (queue.size() >= options.queueLimit && !queue.empty()) {
+            queued.erase(queue.back());
+            queue.pop_back();
+            stats.dropped++;
+        }
+    }
+    queue.push_front(path);
+    wake.notify_one();
+    return nullptr;
+}
+
+void ThumbnailCache::ClearQueue() {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.clear();
+    queued.clear();
+    if (decoding.empty()) idle.notify_all();
+}
+
+void ThumbnailCache::WaitIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return queue.empty() && decoding.empty(); });
+}
+
+ThumbnailStats ThumbnailCache::Stats() const {
+    ThumbnailStats result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result = stats;
+        result.entries = lru.size();
+        result.memoryBytes = memoryBytes;
+    }
+    std::lock_guard<std::mutex> lock(packMutex);
+    result.packEntries = packIndex.size();
+    result.packBytes = packBytes;
+    return result;
+}
+
+void ThumbnailCache::Worker() {
+    // Scrolling and the analysis come first
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#else
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);     // per thread on Linux
+#endif
+    for (;;) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+            path = queue.front();
+            queue.pop_front();
+            queued.erase(path);
+            decoding.insert(path);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool fromPack = false;
+        std::shared_ptr<const PixelImage> image = Produce(path, fromPack);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decoding.erase(path);
+            if (image) {
+                Remember(path, image);
+                if (fromPack) {
+                    stats.packHits++;
+                    stats.packReadMs += ms;
+                }
+                else {
+                    stats.decodes++;
+                    stats.decodeMs += ms;
+                }
+            }
+            else {
+                failedPaths.insert(path);
+                stats.failures++;
+            }
+            if (queue.empty() && decoding.empty()) idle.notify_all();
+        }
+        if (onReady) onReady();
+    }
+}
+
+std::shared_ptr<const PixelImage> ThumbnailCache::Produce(const std::string& path, bool& fromPack) {
+    long long modified = 0, size = 0;
+    if (!FileStamp(path, modified, size)) return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(packMutex);       // AppendPacked may drop the pack
+        auto found = pack ? packIndex.find(path) : packIndex.end();
+        if (found != packIndex.end() && found->second.modified == modified && found->second.size == size) {
+            auto image = std::make_shared<PixelImage>();
+            if (ReadPacked(found->second, *image)) {
+                fromPack = true;
+                return image;
+            }
+        }
+    }
+
+    PixelImage reduced;
+    if (!LoadPixelImageReduced(path, (std::max)(options.maxWidth, options.maxHeight), reduced)) return nullptr;
+    auto image = std::make_shared<PixelImage>();
+    MakeThumbnail(reduced, options.maxWidth, options.maxHeight, *image);
+
+    {
+        std::lock_guard<std::mutex> lock(packMutex);
+        if (pack) AppendPacked(path, modified, size, *image);
+    }
+    return image;
+}
+
+// Called with mutex held
+void ThumbnailCache::Remember(const std::string& path, std::shared_ptr<const PixelImage> image) {
+    memoryBytes += image->rgb.size();
+    lru.push_front({ path, std::move(image) });
+    lookup[path] = lru.begin();
+    while (memoryBytes > options.memoryBytes && lru.size() > 1) {
+        memoryBytes -= lru.back().image->rgb.size();
+        lookup.erase(lru.back().path);
+        lru.pop_back();
+        stats.evictions++;
+    }
+}
+
+// Reads the index, rewrites the pack if needed and keeps it open for
+// reading and appending. Called from the constructor, before the threads.
+bool ThumbnailCache::OpenPack() {
+    const std::string& path = options.packPath;
+    std::vector<std::pair<std::string, PackEntry>> entries;     // file order
+    long long fileSize = 0;
+    bool damaged = false;
+
+    FILE* f = OpenFile(path, "rb");
+    bool exists = f != nullptr;
+    if (f) {
+        FileSeek(f, 0, SEEK_END);
+        fileSize = FileTell(f);
+        FileSeek(f, 0, SEEK_SET);
+        uint8_t header[PACK_HEADER_BYTES];
+        if (fileSize == 0) {
+            damaged = true;         // created, header never written
+        }
+        else if (std::fread(header, 1, sizeof(header), f) != sizeof(header) || std::memcmp(header, PACK_MAGIC, 4) != 0 ||
+            GetLE(header + 4, 4) != PACK_VERSION) {
+            // Not a pack of this version (or not a pack at all): leave it alone
+            std::fclose(f);
+            return false;
+        }
+        long long position = PACK_HEADER_BYTES;
+        std::vector<uint8_t> fields;
+        while (!damaged && position < fileSize) {
+            uint8_t head[6];
+            if (std::fread(head, 1, sizeof(head), f) != sizeof(head)) { damaged = true; break; }
+            uint32_t payload = (uint32_t)GetLE(head, 4);
+            size_t pathLength = (size_t)GetLE(head + 4, 2);
+            fields.resize(pathLength + 20);
+            if (std::fread(fields.data(), 1, fields.size(), f) != fields.size()) { damaged = true; break; }
+            PackEntry entry;
+            entry.modified = (long long)GetLE(fields.data() + pathLength, 8);
+            entry.size = (long long)GetLE(fields.data() + pathLength + 8, 8);
+            entry.width = (int)GetLE(fields.data() + pathLength + 16, 2);
+            entry.height = (int)GetLE(fields.data() + pathLength + 18, 2);
+            long long pixels = (long long)entry.width * entry.height * 3;
+            entry.offset = position + 4 + 2 + (long long)fields.size();
+            if (entry.width <= 0 || entry.height <= 0 || (long long)payload != 2 + (long long)fields.size() + pixels ||
+                entry.offset + pixels > fileSize) {
+                damaged = true;
+                break;
+            }
+            entries.push_back({ std::string((const char*)fields.data(), pathLength), entry });
+            position = entry.offset + pixels;
+            FileSeek(f, position, SEEK_SET);
+        }
+        std::fclose(f);
+    }
+
+    // Later entries replace earlier ones for the same image
+    std::unordered_map<std::string, size_t> latest;
+    for (size_t i = 0; i < entries.size(); i++) latest[entries[i].first] = i;
+    long long liveBytes = PACK_HEADER_BYTES;
+    for (const auto& item : latest) {
+        const PackEntry& entry = entries[item.second].second;
+        liveBytes += 4 + 2 + (long long)item.first.size() + 20 + (long long)entry.width * entry.height * 3;
+    }
+
+    bool overLimit = fileSize > options.packLimitBytes;
+    bool mostlyStale = fileSize > PACK_MIN_COMPACT_BYTES && liveBytes * 2 < fileSize;
+    if (exists && (damaged || overLimit || mostlyStale)) {
+        std::vector<size_t> order;
+        for (const auto& item : latest) order.push_back(item.second);
+        std::sort(order.begin(), order.end());
+        if (overLimit) {
+            // Keep the newest thumbnails up to half the limit
+            long long budget = options.packLimitBytes / 2, kept = PACK_HEADER_BYTES;
+            size_t first = order.size();
+            while (first > 0) {
+                const auto& item = entries[order[first - 1]];
+                long long bytes = 4 + 2 + (long long)item.first.size() + 20 + (long long)item.second.width * item.second.height * 3;
+                if (kept + bytes > budget) break;
+                kept += bytes;
+                first--;
+            }
+            order.erase(order.begin(), order.begin() + first);
+        }
+        std::vector<std::pair<std::string, PackEntry>> keep;
+        for (size_t index : order) keep.push_back(entries[index]);
+        if (!CompactPack(keep)) return false;
+    }
+    else {
+        for (const auto& item : latest) packIndex[item.first] = entries[item.second].second;
+        packBytes = fileSize;
+    }
+
+    pack = OpenFile(path, "r+b");
+    if (!pack) {
+        pack = OpenFile(path, "w+b");
+        if (!pack || !WriteHeader(pack)) return false;
+        std::fflush(pack);
+        packBytes = PACK_HEADER_BYTES;
+    }
+    return true;
+}
+
+// Called with packMutex held
+bool ThumbnailCache::ReadPacked(const PackEntry& entry, PixelImage& image) {
+    image.width = entry.width;
+    image.height = entry.height;
+    image.rgb.resize((size_t)entry.width * entry.height * 3);
+    return FileSeek(pack, entry.offset, SEEK_SET) == 0 &&
+        std::fread(image.rgb.data(), 1, image.rgb.size(), pack) == image.rgb.size();
+}
+
+// Called with packMutex held. A failed write drops the pack for the rest
+// of the session; a partial record is rewritten away at the next open.
+void ThumbnailCache::AppendPacked(const std::string& path, long long modified, long long size, const PixelImage& image) {
+    if (path.size() > 0xFFFF || image.width > 0xFFFF || image.height > 0xFFFF) return;
+    std::vector<uint8_t> record;
+    record.reserve(4 + 2 + path.size() + 20 + image.rgb.size());
+    PutLE(record, 2 + path.size() + 20 + image.rgb.size(), 4);
+    PutLE(record, path.size(), 2);
+    record.insert(record.end(), path.begin(), path.end());
+    PutLE(record, (uint64_t)modified, 8);
+    PutLE(record, (uint64_t)size, 8);
+    PutLE(record, (uint64_t)image.width, 2);
+    PutLE(record, (uint64_t)image.height, 2);
+    size_t pixelsAt = record.size();
+    record.insert(record.end(), image.rgb.begin(), image.rgb.end());
+
+    long long offset = FileSeek(pack, 0, SEEK_END) == 0 ? FileTell(pack) : -1;
+    if (offset < 0 || std::fwrite(record.data(), 1, record.size(), pack) != record.size() || std::fflush(pack) != 0) {
+        std::fclose(pack);
+        pack = nullptr;
+        return;
+    }
+    PackEntry entry;
+    entry.offset = offset + (long long)pixelsAt;
+    entry.modified = modified;
+    entry.size = size;
+    entry.width = image.width;
+    entry.height = image.height;
+    packIndex[path] = entry;
+    packBytes = offset + (long long)record.size();
+}
+
+// Writes the kept entries (oldest first) to a new pack and replaces the old one.
+bool ThumbnailCache::CompactPack(const std::vector<std::pair<std::string, PackEntry>>& keep) {
+    const std::string& path = options.packPath;
+    std::string part = path + ".part";
+    FILE* out = OpenFile(part, "wb");
+    if (!out) return false;
+    FILE* in = OpenFile(path, "rb");
+    bool ok = WriteHeader(out);
+    long long position = PACK_HEADER_BYTES;
+    std::unordered_map<std::string, PackEntry> index;
+    PixelImage image;
+    std::vector<uint8_t> record;
+    for (const auto& item : keep) {
+        if (!ok || !in) break;
+        image.rgb.resize((size_t)item.second.width * item.second.height * 3);
+        if (FileSeek(in, item.second.offset, SEEK_SET) != 0 ||
+            std::fread(image.rgb.data(), 1, image.rgb.size(), in) != image.rgb.size()) continue;
+        record.clear();
+        PutLE(record, 2 + item.first.size() + 20 + image.rgb.size(), 4);
+        PutLE(record, item.first.size(), 2);
+        record.insert(record.end(), item.first.begin(), item.first.end());
+        PutLE(record, (uint64_t)item.second.modified, 8);
+        PutLE(record, (uint64_t)item.second.size, 8);
+        PutLE(record, (uint64_t)item.second.width, 2);
+        PutLE(record, (uint64_t)item.second.height, 2);
+        PackEntry entry = item.second;
+        entry.offset = position + (long long)record.size();
+        record.insert(record.end(), image.rgb.begin(), image.rgb.end());
+        ok = std::fwrite(record.data(), 1, record.size(), out) == record.size();
+        position += (long long)record.size();
+        index[item.first] = entry;
+    }
+    if (in) std::fclose(in);
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok) {
+        DiscardFile(part);
+        return false;
+    }
+    if (!CommitFile(part, path)) return false;
+    packIndex.swap(index);
+    packBytes = position;
+    return true;
+}
@@ -0,0 +1,135 @@
+/*
+*****************************************************************************
+*   GrainEye - Thumbnail cache                                                *
+*   ------------------------------------------------------------------------- *
+*   Thumbnails for the sample gallery. Get() never touches the disk: it      *
+*   returns a thumbnail from memory or queues the image for the decode      *
+*   threads, most recent request first, so whatever is on screen now is     *
+*   served before rows the user has already scrolled past. The queue is     *
+*   bounded; requests that fall off the end are simply asked for again if   *
+*   they come back into view.                                                *
+*                                                                             *
+*   Decoded thumbnails stay in a least-recently-used list within a byte     *
+*   budget and are appended to a pack file, so each image is decoded once  *
+*   (LoadPixelImageReduced) and later sessions read it back from the pack. *
+*   An entry is reused while the image keeps its size and write time.       *
+*                                                                             *
+*   Pack file (little-endian, append-only):                                  *
+*     "GETP" u32 version (1)                                                 *
+*     per thumbnail: u32 payload bytes, then                                  *
+*       u16 path length, path (UTF-8), i64 write time, i64 file size,       *
+*       u16 width, u16 height, width * height RGB                           *
+*   Only the index is read at open. A pack with a damaged tail, mostly     *
+*   superseded entries or above its size limit is rewritten then, keeping  *
+*   the newest thumbnails. A file without the "GETP" version 1 header is   *
+*   never touched; the cache then runs without a pack.                     *
+*****************************************************************************
+*/
+#pragma once
+
+#include "ImageIO.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct ThumbnailOptions {
+    int maxWidth = 160;                     // thumbnails fit this box, aspect kept
+    int maxHeight = 120;
+    size_t memoryBytes = 32u << 20;         // LRU budget for decoded thumbnails
+    int decodeThreads = 0;                  // 0: one per spare core, at most 2
+    size_t queueLimit = 128;                // oldest requests are dropped beyond this
+    std::string packPath;                   // empty: memory only
+    long long packLimitBytes = 256LL << 20; // rewritten at open above this
+};
+
+struct ThumbnailStats {
+    long long memoryHits = 0;
+    long long packHits = 0;
+    long long decodes = 0;
+    long long failures = 0;
+    long long evictions = 0;
+    long long dropped = 0;                  // queued requests pushed out by newer ones
+    size_t entries = 0;
+    size_t memoryBytes = 0;
+    size_t packEntries = 0;
+    long long packBytes = 0;
+    double decodeMs = 0.0;                  // total, decodes only
+    double packReadMs = 0.0;                // total, pack hits only
+};
+
+// Fits source into maxWidth x maxHeight (aspect kept, never enlarged) by
+// averaging the source pixels each thumbnail pixel covers.
+void MakeThumbnail(const PixelImage& source, int maxWidth, int maxHeight, PixelImage& out);
+
+class ThumbnailCache {
+public:
+    // onReady runs on a decode thread each time a request has finished
+    // (thumbnail ready or image unreadable); the gallery repaints then.
+    explicit ThumbnailCache(const ThumbnailOptions& options, std::function<void()> onReady = nullptr);
+    ~ThumbnailCache();                      // drops the queue and joins the decode threads
+    ThumbnailCache(const ThumbnailCache&) = delete;
+    ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+    // The thumbnail if it is in memory, otherwise null and the image is
+    // queued. failed is set for images that could not be read.
+    std::shared_ptr<const PixelImage> Get(const std::string& path, bool* failed = nullptr);
+
+    void ClearQueue();
+    void WaitIdle();                        // until nothing is queued or decoding
+    ThumbnailStats Stats() const;
+
+private:
+    struct MemoryEntry {
+        std::string path;
+        std::shared_ptr<const PixelImage> image;
+    };
+    struct PackEntry {
+        long long offset = 0;               // of the pixels
+        long long modified = 0;
+        long long size = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    void Worker();
+    std::shared_ptr<const PixelImage> Produce(const std::string& path, bool& fromPack);
+    void Remember(const std::string& path, std::shared_ptr<const PixelImage> image);
+
+    bool OpenPack();
+    bool ReadPacked(const PackEntry& entry, PixelImage& image);
+    void AppendPacked(const std::string& path, long long modified, long long size, const PixelImage& image);
+    bool CompactPack(const std::vector<std::pair<std::string, PackEntry>>& keep);
+
+    ThumbnailOptions options;
+    std::function<void()> onReady;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::list<MemoryEntry> lru;             // most recently used first
+    std::unordered_map<std::string, std::list<MemoryEntry>::iterator> lookup;
+    std::deque<std::string> queue;          // most recent request first
+    std::unordered_set<std::string> queued;
+    std::unordered_set<std::string> decoding;
+    std::unordered_set<std::string> failedPaths;
+    size_t memoryBytes = 0;
+    ThumbnailStats stats;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    mutable std::mutex packMutex;
+    FILE* pack = nullptr;
+    std::unordered_map<std::string, PackEntry> packIndex;
+    long long packBytes = 0;
+};
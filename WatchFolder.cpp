@@ -0,0 +1,375 @@
+/*
+*****************************************************************************
+*   GrainEye - Watch-folder ingestion                                         *
+*****************************************************************************
+*/
+#include "WatchFolder.h"
+#include "Analysis.h"
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// ---------- SampleQueue ----------
+
+SampleQueue::SampleQueue(size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+bool SampleQueue::Push(const std::string& path) {
+    std::unique_lock<std::mutex> guard(lock);
+    notFull.wait(guard, [this] { return closed || items.size() < capacity; });
+    if (closed) return false;
+    items.push_back(path);
+    notEmpty.notify_one();
+    return true;
+}
+
+bool SampleQueue::Pop(std::string& path) {
+    std::unique_lock<std::mutex> guard(lock);
+    notEmpty.wait(guard, [this] { return closed || !items.empty(); });
+    if (items.empty()) return false;
+    path = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+}
+
+void SampleQueue::Close() {
+    std::lock_guard<std::mutex> guard(lock);
+    closed = true;
+    notFull.notify_all();
+    notEmpty.notify_all();
+}
+
+size_t SampleQueue::Size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return items.size();
+}
+
+// ---------- Debouncing ----------
+
+// A file is only handed on once the writer is done with it: on Linux that is
+// IN_CLOSE_WRITE / IN_MOVED_TO, on Windows an exclusive open succeeding. In
+// both cases we additionally wait settleMs without further writes, because
+// phones over MTP/SMB often close and reopen a file while copying it.
+struct PendingFile {
+    Clock::time_point lastActivity;
+    bool writerDone = false;
+};
+
+using PendingMap = std::unordered_map<std::string, PendingFile>;
+
+static bool IsCandidateName(const std::string& name) {
+    // Hidden/temporary names (".IMG_001.jpg.part", "~tmp") are renamed into
+    // place when complete, which arrives as a separate event.
+    if (name.empty() || name[0] == '.' || name[0] == '~') return false;
+    return IsSupportedImageFile(name);
+}
+
+static void TouchPending(PendingMap& pending, const std::string& name, bool writerDone) {
+    PendingFile& file = pending[name];
+    file.lastActivity = Clock::now();
+    file.writerDone = writerDone;
+}
+
+// Milliseconds until the earliest pending file may become ready, -1 if none.
+static int NextDeadlineMs(const PendingMap& pending, int settleMs, bool requireWriterDone) {
+    if (pending.empty()) return -1;
+    Clock::time_point now = Clock::now();
+    long long best = -1;
+    for (const auto& entry : pending) {
+        if (requireWriterDone && !entry.second.writerDone) continue;
+        auto ready = entry.second.lastActivity + std::chrono::milliseconds(settleMs);
+        long long ms = ready <= now ? 0 :
+            std::chrono::duration_cast<std::chrono::milliseconds>(ready - now).count() + 1;
+        if (best < 0 || ms < best) best = ms;
+    }
+    return (int)best;
+}
+
+// Names already in the folder at start or handed on since. After the kernel
+// dropped events the folder is listed again, and every other candidate is
+// touched, pending ones included since their close may have been dropped.
+using KnownSet = std::unordered_set<std::string>;
+
+static void ListCandidates(const std::string& directory, std::vector<std::string>& names);
+
+static void Rescan(const std::string& directory, const KnownSet& known, PendingMap& pending, bool writerDone) {
+    std::vector<std::string> names;
+    ListCandidates(directory, names);
+    for (const std::string& name : names)
+        if (!known.count(name)) TouchPending(pending, name, writerDone);
+}
+
+using ReadyList = std::vector<std::pair<Clock::time_point, std::string>>;
+
+// Blocks while the queue is full. Returns false once the queue was closed.
+static bool PushInArrivalOrder(ReadyList& ready, SampleQueue* queue) {
+    std::sort(ready.begin(), ready.end());
+    for (const auto& entry : ready) {
+        if (!queue->Push(entry.second)) return false;
+    }
+    return true;
+}
+
+// ---------- WatchFolder ----------
+
+WatchFolder::~WatchFolder() {
+    Stop();
+}
+
+#ifdef _WIN32
+
+static void ListCandidates(const std::string& directory, std::vector<std::string>& names) {
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileW(Widen(directory + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        std::string name = Narrow(data.cFileName);
+        if (IsCandidateName(name)) names.push_back(name);
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+}
+
+bool WatchFolder::Start(const WatchOptions& opts, SampleQueue* q, std::string* error) {
+    if (IsRunning()) Stop();
+    options = opts;
+    queue = q;
+
+    HANDLE dir = CreateFileW(Widen(options.directory).c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (dir == INVALID_HANDLE_VALUE) {
+        if (error) *error = "cannot open watch folder: " + options.directory;
+        return false;
+    }
+    dirHandle = dir;
+    stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    worker = std::thread(&WatchFolder::Run, this);
+    return true;
+}
+
+void WatchFolder::Stop() {
+    if (queue) queue->Close();
+    if (stopEvent) SetEvent((HANDLE)stopEvent);
+    if (worker.joinable()) worker.join();
+    if (dirHandle) { CloseHandle((HANDLE)dirHandle); dirHandle = nullptr; }
+    if (stopEvent) { CloseHandle((HANDLE)stopEvent); stopEvent = nullptr; }
+}
+
+// True if nobody else has the file open for writing any more.
+static bool WriterFinished(const std::string& path) {
+    HANDLE h = CreateFileW(Widen(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    CloseHandle(h);
+    return true;
+}
+
+void WatchFolder::Run() {
+    HANDLE dir = (HANDLE)dirHandle;
+    OVERLAPPED ov = {};
+    ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    std::vector<DWORD> storage(16 * 1024);     // DWORD aligned, 64 KB
+    BYTE* buffer = (BYTE*)storage.data();
+    const DWORD bufferSize = (DWORD)(storage.size() * sizeof(DWORD));
+    const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+    PendingMap pending;
+    KnownSet known;
+    std::vector<std::string> existing;
+    ListCandidates(options.directory, existing);
+    known.insert(existing.begin(), existing.end());
+    std::string prefix = options.directory;
+    if (!prefix.empty() && prefix.back() != '\\' && prefix.back() != '/') prefix += '\\';
+
+    bool armed = ReadDirectoryChangesW(dir, buffer, bufferSize, FALSE, filter, NULL, &ov, NULL) != FALSE;
+    while (armed) {
+        HANDLE handles[2] = { ov.hEvent, (HANDLE)stopEvent };
+        int timeout = NextDeadlineMs(pending, options.settleMs, false);
+        DWORD wait = WaitForMultipleObjects(2, handles, FALSE, timeout < 0 ? INFINITE : (DWORD)timeout);
+        if (wait == WAIT_OBJECT_0 + 1 || wait == WAIT_FAILED) break;
+
+        if (wait == WAIT_OBJECT_0) {
+            DWORD bytes = 0;
+            if (!GetOverlappedResult(dir, &ov, &bytes, FALSE)) break;
+            if (bytes == 0) {
+                overflows++;    // buffer overflow, events were dropped
+                Rescan(options.directory, known, pending, false);
+            }
+            else {
+                BYTE* p = buffer;
+                for (;;) {
+                    FILE_NOTIFY_INFORMATION* info = (FILE_NOTIFY_INFORMATION*)p;
+                    std::string name = Narrow(std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+                    if (IsCandidateName(name)) {
+                        switch (info->Action) {
+                        case FILE_ACTION_ADDED:
+                        case FILE_ACTION_MODIFIED:
+                        case FILE_ACTION_RENAMED_NEW_NAME:
+                            TouchPending(pending, name, false);
+                            break;
+                        case FILE_ACTION_REMOVED:
+                        case FILE_ACTION_RENAMED_OLD_NAME:
+                            pending.erase(name);
+                            known.erase(name);
+                            break;
+                        }
+                    }
+                    if (!info->NextEntryOffset) break;
+                    p += info->NextEntryOffset;
+                }
+            }
+            ResetEvent(ov.hEvent);
+            armed = ReadDirectoryChangesW(dir, buffer, bufferSize, FALSE, filter, NULL, &ov, NULL) != FALSE;
+        }
+
+        // Hand on every file that has been quiet for settleMs
+        Clock::time_point now = Clock::now();
+        ReadyList ready;
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (now - it->second.lastActivity < std::chrono::milliseconds(options.settleMs)) { ++it; continue; }
+            if (!WriterFinished(prefix + it->first)) {
+                it->second.lastActivity = now;  // still being written, check again later
+                ++it;
+                continue;
+            }
+            ready.emplace_back(it->second.lastActivity, prefix + it->first);
+            known.insert(it->first);
+            it = pending.erase(it);
+        }
+        if (!PushInArrivalOrder(ready, queue)) armed = false;
+    }
+
+    CancelIo(dir);
+    CloseHandle(ov.hEvent);
+}
+
+#else
+
+static void ListCandidates(const std::string& directory, std::vector<std::string>& names) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_type == DT_DIR) continue;
+        std::string name = entry->d_name;
+        if (IsCandidateName(name)) names.push_back(name);
+    }
+    closedir(dir);
+}
+
+bool WatchFolder::Start(const WatchOptions& opts, SampleQueue* q, std::string* error) {
+    if (IsRunning()) Stop();
+    options = opts;
+    queue = q;
+
+    notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd < 0) {
+        if (error) *error = std::string("inotify_init1: ") + strerror(errno);
+        return false;
+    }
+    const uint32_t mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+        IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    if (inotify_add_watch(notifyFd, options.directory.c_str(), mask) < 0) {
+        if (error) *error = "cannot watch " + options.directory + ": " + strerror(errno);
+        close(notifyFd);
+        notifyFd = -1;
+        return false;
+    }
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    worker = std::thread(&WatchFolder::Run, this);
+    return true;
+}
+
+void WatchFolder::Stop() {
+    if (queue) queue->Close();
+    if (stopFd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(stopFd, &one, sizeof(one));
+        (void)ignored;
+    }
+    if (worker.joinable()) worker.join();
+    if (notifyFd >= 0) { close(notifyFd); notifyFd = -1; }
+    if (stopFd >= 0) { close(stopFd); stopFd = -1; }
+}
+
+void WatchFolder::Run() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    PendingMap pending;
+    KnownSet known;
+    std::vector<std::string> existing;
+    ListCandidates(options.directory, existing);
+    known.insert(existing.begin(), existing.end());
+    std::string prefix = options.directory;
+    if (!prefix.empty() && prefix.back() != '/') prefix += '/';
+
+    for (;;) {
+        struct pollfd fds[2] = { { notifyFd, POLLIN, 0 }, { stopFd, POLLIN, 0 } };
+        int timeout = NextDeadlineMs(pending, options.settleMs, true);
+        int rc = poll(fds, 2, timeout);
+        if (rc < 0 && errno != EINTR) break;
+        if (fds[1].revents) break;
+
+        bool watchGone = false;
+        bool overflowed = false;
+        if (rc > 0 && (fds[0].revents & POLLIN)) {
+            for (;;) {
+                ssize_t len = read(notifyFd, buffer, sizeof(buffer));
+                if (len <= 0) break;    // EAGAIN: drained
+                for (char* p = buffer; p < buffer + len;) {
+                    const struct inotify_event* ev = (const struct inotify_event*)p;
+                    p += sizeof(struct inotify_event) + ev->len;
+
+                    if (ev->mask & IN_Q_OVERFLOW) { overflows++; overflowed = true; continue; }
+                    if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) { watchGone = true; continue; }
+                    if (!ev->len || (ev->mask & IN_ISDIR)) continue;
+
+                    std::string name = ev->name;
+                    if (!IsCandidateName(name)) continue;
+                    if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        pending.erase(name);
+                        known.erase(name);
+                    }
+                    else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) TouchPending(pending, name, true);
+                    else if (ev->mask & (IN_CREATE | IN_MODIFY)) TouchPending(pending, name, false);
+                }
+            }
+        }
+        // Close events may be among the dropped ones: a file still being
+        // written sends IN_MODIFY again and waits for its close after all
+        if (overflowed) Rescan(options.directory, known, pending, true);
+
+        // Hand on every closed file that has been quiet for settleMs
+        Clock::time_point now = Clock::now();
+        ReadyList ready;
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (it->second.writerDone && now - it->second.lastActivity >= std::chrono::milliseconds(options.settleMs)) {
+                ready.emplace_back(it->second.lastActivity, prefix + it->first);
+                known.insert(it->first);
+                it = pending.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        if (!PushInArrivalOrder(ready, queue) || watchGone) break;
+    }
+}
+
+#endif
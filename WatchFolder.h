@@ -0,0 +1,81 @@
+/*
+*****************************************************************************
+*   GrainEye - Watch-folder ingestion                                         *
+*   ------------------------------------------------------------------------- *
+*   Picks up images dropped into a folder by the Pi camera or a tethered     *
+*   phone and hands them to the analysis pipeline through a bounded queue.   *
+*   Linux uses inotify, Windows uses ReadDirectoryChangesW; neither polls.   *
+*   The directory is listed once at start and again only when the kernel     *
+*   dropped events (a burst while the queue was full), so no image is lost.  *
+*****************************************************************************
+*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Bounded FIFO of image paths. Push blocks while the queue is full, which
+// throttles the watcher to the speed of the analysis stage (backpressure).
+class SampleQueue {
+public:
+    explicit SampleQueue(size_t capacity);
+
+    bool Push(const std::string& path);   // false once the queue is closed
+    bool Pop(std::string& path);          // false once closed and drained
+    void Close();
+    size_t Size() const;
+    size_t Capacity() const { return capacity; }
+
+private:
+    mutable std::mutex lock;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<std::string> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+struct WatchOptions {
+    std::string directory;
+    int settleMs = 750;     // quiet time after the last write before a file is taken
+};
+
+class WatchFolder {
+public:
+    WatchFolder() = default;
+    ~WatchFolder();
+    WatchFolder(const WatchFolder&) = delete;
+    WatchFolder& operator=(const WatchFolder&) = delete;
+
+    // Starts the watcher thread. New, fully written images are pushed to queue.
+    bool Start(const WatchOptions& options, SampleQueue* queue, std::string* error = nullptr);
+
+    // Stops the watcher and closes the queue so blocked producers/consumers wake up.
+    void Stop();
+
+    bool IsRunning() const { return worker.joinable(); }
+
+    // Number of times the kernel dropped events because we fell behind; each
+    // one lists the directory again for the images whose events were lost.
+    unsigned long long OverflowCount() const { return overflows.load(); }
+
+private:
+    void Run();
+
+    WatchOptions options;
+    SampleQueue* queue = nullptr;
+    std::thread worker;
+    std::atomic<unsigned long long> overflows{ 0 };
+
+#ifdef _WIN32
+    void* dirHandle = nullptr;      // HANDLE
+    void* stopEvent = nullptr;      // HANDLE
+#else
+    int notifyFd = -1;
+    int stopFd = -1;
+#endif
+};